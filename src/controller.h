@@ -84,6 +84,23 @@
  */
 #define NETCONF_EDIT_CONFIG_ADD_DEFAULT_OPERATION "merge"
 
+/*! SSH transport of devices, see ssh-transport config
+ *
+ * The libssh transport requires build with --with-libssh, otherwise the sub-process is used
+ */
+#define SSH_TRANSPORT_SUBPROCESS 0 /* ssh sub-process per device */
+#define SSH_TRANSPORT_LIBSSH     1 /* In-process ssh in backend event loop */
+
+/*! RFC 6470 NETCONF base notifications, see drift-tracking config
+ */
+#define NETCONF_NOTIFICATIONS_NAMESPACE "urn:ietf:params:xml:ns:yang:ietf-netconf-notifications"
+
+/*! RFC 5277 interleave capability, required to send RPCs on a subscribed session
+ */
+#ifndef NETCONF_INTERLEAVE_CAPABILITY
+#define NETCONF_INTERLEAVE_CAPABILITY "urn:ietf:params:netconf:capability:interleave:1.0"
+#endif
+
 /*! Controller debug levels
  */
 #define CLIXON_DBG_CTRL CLIXON_DBG_APP
@@ -95,6 +112,53 @@
 /*! Device state timeout if device-timeout config is invalid in s*/
 #define CONTROLLER_DEVICE_TIMEOUT_DEFAULT 60
 
+/*! Max outstanding get-schema requests per device if schema-window config is invalid */
+#define CONTROLLER_SCHEMA_WINDOW_DEFAULT 16
+
+/*! Max devices connecting at the same time if connect-window config is invalid */
+#define CONTROLLER_CONNECT_WINDOW_DEFAULT 64
+
+/*! Max allocated size of per-device input frame buffer kept between messages, larger are freed */
+#define CONTROLLER_FRAME_BUF_KEEP (1024*1024)
+
+/*! Min and max length of per-device socket read buffer */
+#define CONTROLLER_READ_BUF_MIN BUFSIZ
+#define CONTROLLER_READ_BUF_MAX (1024*1024)
+
+/*! Max bytes read from one device per event loop wakeup if read-budget config is invalid */
+#define CONTROLLER_READ_BUDGET_DEFAULT (4*1024*1024)
+
+/*! Max time in ms spent reading from one device per event loop wakeup if read-time-budget config is invalid */
+#define CONTROLLER_READ_TIME_BUDGET_DEFAULT 50
+
+/*! Consecutive drained wakeups without a full read before a grown read buffer is released */
+#define CONTROLLER_READ_BUF_IDLE 16
+
+/*! Max bytes of device input queued by an io worker thread before it stops reading devices
+ * with input already queued */
+#define CONTROLLER_IO_QUEUE_MAX (16*1024*1024)
+
+/*! Max devices in background sync-check at the same time if sync-check-window config is invalid */
+#define CONTROLLER_SYNC_CHECK_WINDOW_DEFAULT 8
+
+/*! Adaptive device state timeout: min samples of a state before its latency is used */
+#define CONTROLLER_ADAPTIVE_TIMEOUT_SAMPLES 8
+
+/*! Adaptive device state timeout: factor of state latency */
+#define CONTROLLER_ADAPTIVE_TIMEOUT_FACTOR 4
+
+/*! Min adaptive device state timeout if timeout-floor config is invalid in s */
+#define CONTROLLER_TIMEOUT_FLOOR_DEFAULT 5
+
+/*! Quarantine time of a device if quarantine-time config is invalid in s */
+#define CONTROLLER_QUARANTINE_TIME_DEFAULT 600
+
+/*! Max bytes queued to all devices before new work is held back if output-queue-limit config is invalid */
+#define CONTROLLER_OUTPUT_QUEUE_LIMIT_DEFAULT (64*1024*1024)
+
+/*! Poll interval in ms of device sockets with pending output */
+#define CONTROLLER_OUTPUT_TICK 10
+
 /*! Controller periodic timer for resoure handling in s */
 #define CONTROLLER_PERIODIC_TIMER 60
 
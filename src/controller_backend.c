@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <string.h>
 #include <errno.h>
 #include <signal.h>
@@ -55,6 +56,10 @@
 #include "controller_transaction.h"
 #include "controller_rpc_std.h"
 #include "controller_rpc.h"
+#include "controller_ssh.h"
+#include "controller_timer.h"
+#include "controller_io.h"
+#include "controller_work.h"
 
 /*! Called to get state data from plugin by programmatically adding state
  *
@@ -211,11 +216,53 @@ controller_commit_devices(clixon_handle h,
     cxobj   **vec2 = NULL;
     cxobj   **vec3 = NULL;
     cxobj   **vec4 = NULL;
+    cxobj   **vec5 = NULL;
+    cxobj   **vec6 = NULL;
+    cxobj   **vec7 = NULL;
+    cxobj   **vec8 = NULL;
+    cxobj   **vec9 = NULL;
+    cxobj   **vec10 = NULL;
+    cxobj   **vec11 = NULL;
+    cxobj   **vec12 = NULL;
+    cxobj   **vec13 = NULL;
+    cxobj   **vec14 = NULL;
+    cxobj   **vec15 = NULL;
+    cxobj   **vec16 = NULL;
+    cxobj   **vec17 = NULL;
+    cxobj   **vec18 = NULL;
+    cxobj   **vec19 = NULL;
+    cxobj   **vec20 = NULL;
+    cxobj   **vec21 = NULL;
+    cxobj   **vec22 = NULL;
+    cxobj   **vec23 = NULL;
+    cxobj   **vec24 = NULL;
+    cxobj   **vec25 = NULL;
     size_t    veclen0;
     size_t    veclen1;
     size_t    veclen2;
     size_t    veclen3;
     size_t    veclen4;
+    size_t    veclen5;
+    size_t    veclen6;
+    size_t    veclen7;
+    size_t    veclen8;
+    size_t    veclen9;
+    size_t    veclen10;
+    size_t    veclen11;
+    size_t    veclen12;
+    size_t    veclen13;
+    size_t    veclen14;
+    size_t    veclen15;
+    size_t    veclen16;
+    size_t    veclen17;
+    size_t    veclen18;
+    size_t    veclen19;
+    size_t    veclen20;
+    size_t    veclen21;
+    size_t    veclen22;
+    size_t    veclen23;
+    size_t    veclen24;
+    size_t    veclen25;
     int       i;
     cxobj    *x;
     char     *body;
@@ -236,6 +283,302 @@ controller_commit_devices(clixon_handle h,
         clixon_debug(CLIXON_DBG_CTRL, "controller-device-timeout: %u", dt);
         clicon_data_int_set(h, "controller-device-timeout", dt);
     }
+    if (xpath_vec_flag(target, nsc, "devices/schema-window",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec5, &veclen5) < 0)
+        goto done;
+    for (i=0; i<veclen5; i++){
+        x = vec5[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        if (parse_uint32(body, &dt, NULL) < 1){
+            clixon_err(OE_UNIX, errno, "error parsing limit:%s", body);
+            goto done;
+        }
+        clixon_debug(CLIXON_DBG_CTRL, "controller-schema-window: %u", dt);
+        clicon_data_int_set(h, "controller-schema-window", dt);
+    }
+    if (xpath_vec_flag(target, nsc, "devices/connect-window",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec6, &veclen6) < 0)
+        goto done;
+    for (i=0; i<veclen6; i++){
+        x = vec6[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        if (parse_uint32(body, &dt, NULL) < 1){
+            clixon_err(OE_UNIX, errno, "error parsing limit:%s", body);
+            goto done;
+        }
+        clixon_debug(CLIXON_DBG_CTRL, "controller-connect-window: %u", dt);
+        clicon_data_int_set(h, "controller-connect-window", dt);
+    }
+    if (xpath_vec_flag(target, nsc, "devices/pull-commit",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec7, &veclen7) < 0)
+        goto done;
+    for (i=0; i<veclen7; i++){
+        x = vec7[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        clixon_debug(CLIXON_DBG_CTRL, "controller-pull-commit: %s", body);
+        clicon_data_int_set(h, "controller-pull-commit", pull_commit_type_str2int(body));
+    }
+    if (xpath_vec_flag(target, nsc, "devices/push-pipeline",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec8, &veclen8) < 0)
+        goto done;
+    for (i=0; i<veclen8; i++){
+        x = vec8[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        clixon_debug(CLIXON_DBG_CTRL, "controller-push-pipeline: %s", body);
+        clicon_data_int_set(h, "controller-push-pipeline", strcmp(body, "true") == 0);
+    }
+    if (xpath_vec_flag(target, nsc, "devices/read-budget",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec9, &veclen9) < 0)
+        goto done;
+    for (i=0; i<veclen9; i++){
+        x = vec9[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        if (parse_uint32(body, &dt, NULL) < 1){
+            clixon_err(OE_UNIX, errno, "error parsing limit:%s", body);
+            goto done;
+        }
+        if (dt > INT_MAX) /* Stored as int */
+            dt = INT_MAX;
+        clixon_debug(CLIXON_DBG_CTRL, "controller-read-budget: %u", dt);
+        clicon_data_int_set(h, "controller-read-budget", dt);
+    }
+    if (xpath_vec_flag(target, nsc, "devices/read-time-budget",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec25, &veclen25) < 0)
+        goto done;
+    for (i=0; i<veclen25; i++){
+        x = vec25[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        if (parse_uint32(body, &dt, NULL) < 1){
+            clixon_err(OE_UNIX, errno, "error parsing limit:%s", body);
+            goto done;
+        }
+        clixon_debug(CLIXON_DBG_CTRL, "controller-read-time-budget: %u", dt);
+        clicon_data_int_set(h, "controller-read-time-budget", dt);
+    }
+    if (xpath_vec_flag(target, nsc, "devices/ssh-transport",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec10, &veclen10) < 0)
+        goto done;
+    for (i=0; i<veclen10; i++){
+        x = vec10[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        clixon_debug(CLIXON_DBG_CTRL, "controller-ssh-transport: %s", body);
+        clicon_data_int_set(h, "controller-ssh-transport",
+                            strcmp(body, "LIBSSH") == 0 ? SSH_TRANSPORT_LIBSSH : SSH_TRANSPORT_SUBPROCESS);
+    }
+    if (xpath_vec_flag(target, nsc, "devices/ssh-persist",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec11, &veclen11) < 0)
+        goto done;
+    for (i=0; i<veclen11; i++){
+        x = vec11[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        if (parse_uint32(body, &dt, NULL) < 1){
+            clixon_err(OE_UNIX, errno, "error parsing limit:%s", body);
+            goto done;
+        }
+        clixon_debug(CLIXON_DBG_CTRL, "controller-ssh-persist: %u", dt);
+        clicon_data_int_set(h, "controller-ssh-persist", dt);
+    }
+    if (xpath_vec_flag(target, nsc, "devices/drift-tracking",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec12, &veclen12) < 0)
+        goto done;
+    for (i=0; i<veclen12; i++){
+        x = vec12[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        clixon_debug(CLIXON_DBG_CTRL, "controller-drift-tracking: %s", body);
+        clicon_data_int_set(h, "controller-drift-tracking", strcmp(body, "true") == 0);
+    }
+    if (xpath_vec_flag(target, nsc, "devices/drift-trust",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec24, &veclen24) < 0)
+        goto done;
+    for (i=0; i<veclen24; i++){
+        x = vec24[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        clixon_debug(CLIXON_DBG_CTRL, "controller-drift-trust: %s", body);
+        clicon_data_int_set(h, "controller-drift-trust", strcmp(body, "true") == 0);
+    }
+    if (xpath_vec_flag(target, nsc, "devices/sync-check-interval",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec13, &veclen13) < 0)
+        goto done;
+    for (i=0; i<veclen13; i++){
+        x = vec13[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        if (parse_uint32(body, &dt, NULL) < 1){
+            clixon_err(OE_UNIX, errno, "error parsing limit:%s", body);
+            goto done;
+        }
+        clixon_debug(CLIXON_DBG_CTRL, "controller-sync-check-interval: %u", dt);
+        clicon_data_int_set(h, "controller-sync-check-interval", dt);
+    }
+    if (xpath_vec_flag(target, nsc, "devices/sync-check-jitter",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec14, &veclen14) < 0)
+        goto done;
+    for (i=0; i<veclen14; i++){
+        x = vec14[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        if (parse_uint32(body, &dt, NULL) < 1){
+            clixon_err(OE_UNIX, errno, "error parsing limit:%s", body);
+            goto done;
+        }
+        clixon_debug(CLIXON_DBG_CTRL, "controller-sync-check-jitter: %u", dt);
+        clicon_data_int_set(h, "controller-sync-check-jitter", dt);
+    }
+    if (xpath_vec_flag(target, nsc, "devices/sync-check-window",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec15, &veclen15) < 0)
+        goto done;
+    for (i=0; i<veclen15; i++){
+        x = vec15[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        if (parse_uint32(body, &dt, NULL) < 1){
+            clixon_err(OE_UNIX, errno, "error parsing limit:%s", body);
+            goto done;
+        }
+        clixon_debug(CLIXON_DBG_CTRL, "controller-sync-check-window: %u", dt);
+        clicon_data_int_set(h, "controller-sync-check-window", dt);
+    }
+    if (xpath_vec_flag(target, nsc, "devices/adaptive-timeout",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec16, &veclen16) < 0)
+        goto done;
+    for (i=0; i<veclen16; i++){
+        x = vec16[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        clixon_debug(CLIXON_DBG_CTRL, "controller-adaptive-timeout: %s", body);
+        clicon_data_int_set(h, "controller-adaptive-timeout", strcmp(body, "true") == 0);
+    }
+    if (xpath_vec_flag(target, nsc, "devices/timeout-floor",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec17, &veclen17) < 0)
+        goto done;
+    for (i=0; i<veclen17; i++){
+        x = vec17[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        if (parse_uint32(body, &dt, NULL) < 1){
+            clixon_err(OE_UNIX, errno, "error parsing limit:%s", body);
+            goto done;
+        }
+        clixon_debug(CLIXON_DBG_CTRL, "controller-timeout-floor: %u", dt);
+        clicon_data_int_set(h, "controller-timeout-floor", dt);
+    }
+    if (xpath_vec_flag(target, nsc, "devices/timeout-ceiling",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec18, &veclen18) < 0)
+        goto done;
+    for (i=0; i<veclen18; i++){
+        x = vec18[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        if (parse_uint32(body, &dt, NULL) < 1){
+            clixon_err(OE_UNIX, errno, "error parsing limit:%s", body);
+            goto done;
+        }
+        clixon_debug(CLIXON_DBG_CTRL, "controller-timeout-ceiling: %u", dt);
+        clicon_data_int_set(h, "controller-timeout-ceiling", dt);
+    }
+    if (xpath_vec_flag(target, nsc, "devices/quarantine-threshold",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec19, &veclen19) < 0)
+        goto done;
+    for (i=0; i<veclen19; i++){
+        x = vec19[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        if (parse_uint32(body, &dt, NULL) < 1){
+            clixon_err(OE_UNIX, errno, "error parsing limit:%s", body);
+            goto done;
+        }
+        clixon_debug(CLIXON_DBG_CTRL, "controller-quarantine-threshold: %u", dt);
+        clicon_data_int_set(h, "controller-quarantine-threshold", dt);
+    }
+    if (xpath_vec_flag(target, nsc, "devices/quarantine-time",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec20, &veclen20) < 0)
+        goto done;
+    for (i=0; i<veclen20; i++){
+        x = vec20[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        if (parse_uint32(body, &dt, NULL) < 1){
+            clixon_err(OE_UNIX, errno, "error parsing limit:%s", body);
+            goto done;
+        }
+        clixon_debug(CLIXON_DBG_CTRL, "controller-quarantine-time: %u", dt);
+        clicon_data_int_set(h, "controller-quarantine-time", dt);
+    }
+    if (xpath_vec_flag(target, nsc, "devices/output-queue-limit",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec21, &veclen21) < 0)
+        goto done;
+    for (i=0; i<veclen21; i++){
+        x = vec21[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        if (parse_uint32(body, &dt, NULL) < 1){
+            clixon_err(OE_UNIX, errno, "error parsing limit:%s", body);
+            goto done;
+        }
+        if (dt > INT_MAX) /* Stored as int */
+            dt = INT_MAX;
+        clixon_debug(CLIXON_DBG_CTRL, "controller-output-queue-limit: %u", dt);
+        clicon_data_int_set(h, "controller-output-queue-limit", dt);
+    }
+    if (xpath_vec_flag(target, nsc, "devices/io-threads",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec22, &veclen22) < 0)
+        goto done;
+    for (i=0; i<veclen22; i++){
+        x = vec22[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        if (parse_uint32(body, &dt, NULL) < 1){
+            clixon_err(OE_UNIX, errno, "error parsing limit:%s", body);
+            goto done;
+        }
+        clixon_debug(CLIXON_DBG_CTRL, "controller-io-threads: %u", dt);
+        clicon_data_int_set(h, "controller-io-threads", dt);
+    }
+    if (xpath_vec_flag(target, nsc, "devices/push-threads",
+                       XML_FLAG_ADD | XML_FLAG_CHANGE,
+                       &vec23, &veclen23) < 0)
+        goto done;
+    for (i=0; i<veclen23; i++){
+        x = vec23[i];
+        if ((body = xml_body(x)) == NULL)
+            continue;
+        if (parse_uint32(body, &dt, NULL) < 1){
+            clixon_err(OE_UNIX, errno, "error parsing limit:%s", body);
+            goto done;
+        }
+        clixon_debug(CLIXON_DBG_CTRL, "controller-push-threads: %u", dt);
+        clicon_data_int_set(h, "controller-push-threads", dt);
+    }
 
     /* 1) if device removed, disconnect */
     if (xpath_vec_flag(src, nsc, "devices/device",
@@ -298,6 +641,48 @@ controller_commit_devices(clixon_handle h,
         free(vec3);
     if (vec4)
         free(vec4);
+    if (vec5)
+        free(vec5);
+    if (vec6)
+        free(vec6);
+    if (vec7)
+        free(vec7);
+    if (vec8)
+        free(vec8);
+    if (vec9)
+        free(vec9);
+    if (vec10)
+        free(vec10);
+    if (vec11)
+        free(vec11);
+    if (vec12)
+        free(vec12);
+    if (vec13)
+        free(vec13);
+    if (vec14)
+        free(vec14);
+    if (vec15)
+        free(vec15);
+    if (vec16)
+        free(vec16);
+    if (vec17)
+        free(vec17);
+    if (vec18)
+        free(vec18);
+    if (vec19)
+        free(vec19);
+    if (vec20)
+        free(vec20);
+    if (vec21)
+        free(vec21);
+    if (vec22)
+        free(vec22);
+    if (vec23)
+        free(vec23);
+    if (vec24)
+        free(vec24);
+    if (vec25)
+        free(vec25);
     return retval;
 }
 
@@ -596,6 +981,8 @@ periodic_timer(int   s,
 
     if (controller_transaction_periodic(h) < 0)
         goto done;
+    if (device_sync_check_sweep(h) < 0)
+        goto done;
     if (periodic_timer_setup(h) < 0)
         goto done;
     retval = 0;
@@ -664,6 +1051,12 @@ controller_start(clixon_handle h)
             goto done;
     if (xmldb_drop_priv(h, "tmpdev", uid, gid) < 0)
         goto done;
+    /* Used by per-device commit of pulled config */
+    if (xmldb_exists(h, "tmpdevcommit") != 1)
+        if (xmldb_create(h, "tmpdevcommit") < 0)
+            goto done;
+    if (xmldb_drop_priv(h, "tmpdevcommit", uid, gid) < 0)
+        goto done;
     if (periodic_timer_setup(h) < 0)
         goto done;
     retval = 0;
@@ -681,9 +1074,21 @@ controller_exit(clixon_handle h)
     device_handle dh = NULL;
 
     controller_transaction_free_all(h);
+    /* Cancelled push jobs set their devices to OPEN before close */
+    controller_work_free_all(h);
+    device_schema_fetch_free_all(h);
+    device_shared_yspec_free_all(h);
     while ((dh = device_handle_each(h, dh)) != NULL)
         device_close_connection(dh, "controller exit");
     device_handle_free_all(h);
+    /* Continuations of dispatched requests of closed devices */
+    device_handle_dispatch_flush(h);
+    device_sync_check_free(h);
+    controller_io_free_all(h);
+    controller_timer_free_all(h);
+#ifdef HAVE_LIBSSH
+    clixon_client_libssh_pool_free(h);
+#endif
     return 0;
 }
 
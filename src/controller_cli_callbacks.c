@@ -1047,7 +1047,7 @@ cli_rpc_controller_commit(clixon_handle h,
     }
     push_type = cv_string_get(cv);
     if (push_type_str2int(push_type) == -1){
-        clixon_err(OE_PLUGIN, EINVAL, "<push-type> argument is %s, expected NONE/VALIDATE/COMMIT", push_type);
+        clixon_err(OE_PLUGIN, EINVAL, "<push-type> argument is %s, expected NONE/VALIDATE/COMMIT/COMMIT-NONATOMIC", push_type);
         goto done;
     }
     if ((cv = cvec_find(cvv, "name")) != NULL)
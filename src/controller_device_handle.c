@@ -38,12 +38,16 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <unistd.h>
 #include <syslog.h>
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
 #include <netinet/in.h>
 #include <signal.h>
 
@@ -60,9 +64,11 @@
 #include "controller.h"
 #include "controller_lib.h"
 #include "controller_netconf.h"
+#include "controller_ssh.h"
 #include "controller_device_state.h"
 #include "controller_device_handle.h"
 #include "controller_transaction.h"
+#include "controller_timer.h"
 
 /*
  * Constants
@@ -71,6 +77,60 @@
 
 #define devhandle(dh) (assert(device_handle_check(dh)==0),(struct controller_device_handle *)(dh))
 
+/*! Outstanding get-schema request, matched with reply by message-id
+ *
+ * Or, if sp_wait is set, waiting for another device fetching same schema
+ */
+struct schema_pending {
+    qelem_t            sp_qelem;       /* List header */
+    int                sp_wait;        /* Not sent, waiting for other device */
+    uint64_t           sp_msg_id;      /* Message-id of get-schema request (if not wait) */
+    char              *sp_name;        /* Schema name */
+    char              *sp_rev;         /* Schema revision, or NULL */
+};
+
+/*! Outstanding pipelined push request, replies are received in the order requests are sent
+ *
+ * @see devices/push-pipeline
+ */
+struct pipeline_request {
+    qelem_t            pr_qelem;       /* List header */
+    uint64_t           pr_msg_id;      /* Message-id of request */
+    conn_state         pr_state;       /* Connection state handling the reply */
+    int                pr_skip;        /* Drop reply, an earlier request failed */
+};
+
+/*! Outstanding request dispatched by message-id, outside of the device state machine
+ *
+ * When the device is closed, the request is moved to a deferred list and its continuation
+ * is called from the event loop, see dispatch_defer
+ */
+struct dispatch_request {
+    qelem_t            dr_qelem;       /* List header */
+    uint64_t           dr_msg_id;      /* Message-id of request */
+    device_reply_cb   *dr_fn;          /* Continuation called with reply */
+    void              *dr_arg;         /* Argument to continuation */
+    device_handle      dr_dh;          /* Back-pointer to device handle, NULL if deferred */
+    char              *dr_name;        /* Device name if deferred */
+    struct controller_timer dr_timer;  /* Timeout, or call of continuation if deferred */
+};
+
+/*! Max expired dispatched requests remembered per device, so that their late replies are dropped */
+#define DISPATCH_EXPIRED_MAX 16
+
+/*! Number of recent samples per state kept for latency percentiles */
+#define DEVICE_LATENCY_RING 16
+
+/*! Latency of one transient connection state of a device
+ *
+ * @see devices/adaptive-timeout
+ */
+struct device_latency {
+    uint32_t           dl_ewma;        /* Moving average in ms, new sample weighs 1/8 */
+    uint32_t           dl_nr;          /* Number of samples */
+    uint32_t           dl_ring[DEVICE_LATENCY_RING]; /* Last samples in ms */
+};
+
 /*! Internal structure of clixon controller device handle.
  */
 struct controller_device_handle{
@@ -84,28 +144,84 @@ struct controller_device_handle{
     struct timeval     cdh_sync_time;  /* Time when last sync (0 if unsynched) */
     struct timeval     cdh_stable_time; /* Time when last time entered stable state: open or close - after connect/close,
                                            skip push/rpc states */
+    struct timeval     cdh_check_time; /* Time of last sync-check (0 if never) */
+    struct timeval     cdh_check_due;  /* Time when next sync-check is due */
+    int                cdh_check_result; /* Last sync-check: 1: in sync, 0: out of sync, 2: unknown */
     clixon_handle      cdh_h;          /* Clixon handle */
     clixon_client_type cdh_type;       /* Clixon socket type */
     int                cdh_socket;     /* Input/output socket, -1 is closed */
     int                cdh_sockerr;    /* Stderr socket, -1 is closed */
     uint64_t           cdh_msg_id;     /* Client message-id to device */
     int                cdh_pid;        /* Sub-process-id Only applies for NETCONF/SSH */
+    void              *cdh_transport;  /* In-process SSH transport, or NULL if sub-process */
+    uint32_t           cdh_handshakes; /* Number of SSH connects with full handshake */
+    uint32_t           cdh_reuses;     /* Number of SSH connects reusing a kept connection */
+    uint32_t           cdh_handshake_time; /* Time in ms from last connect until hello */
+    uint32_t           cdh_session_id; /* NETCONF session-id of device from hello, 0 if unknown */
+    int                cdh_drift_subscribed; /* Subscribed to config change notifications */
+    int                cdh_drift;      /* Device config changed by others since last sync */
+    uint32_t           cdh_config_changes; /* Number of config changes by others notified */
+    struct device_latency *cdh_latency; /* Per-state latency, CS_NR entries, or NULL if no samples */
+    uint32_t           cdh_timeouts;   /* Consecutive state timeouts */
+    uint32_t           cdh_timeouts_total; /* Total state timeouts */
+    struct timeval     cdh_quarantine; /* Quarantined until this time, 0 if not quarantined */
+    struct controller_timer cdh_state_timer; /* Timeout of transient connection state */
     uint64_t           cdh_tid;        /* if >0, dev is part of transaction, 0 means unassigned */
     cbuf              *cdh_frame_buf;  /* Remaining expecting chunk bytes */
+    unsigned char     *cdh_read_buf;   /* Socket read buffer, grows and shrinks with input rate */
+    size_t             cdh_read_buflen; /* Allocated length of cdh_read_buf */
+    int                cdh_read_idle;  /* Consecutive drained wakeups without a full read */
     int                cdh_frame_state;/* Framing state for detecting EOM */
     size_t             cdh_frame_size; /* Remaining expecting chunk bytes */
     netconf_framing_type cdh_framing_type; /* Netconf framing type of device */
     cxobj             *cdh_xcaps;      /* Capabilities as XML tree */
     cxobj             *cdh_yang_lib;   /* RFC 8525 yang-library module list */
+    char              *cdh_yang_lib_digest; /* Cached digest of cdh_yang_lib, or NULL */
+    cxobj             *cdh_yang_lib_last; /* Last good yang-lib kept over reconnect, or NULL */
+    yang_stmt         *cdh_yspec_last; /* Mount YANG spec of cdh_yang_lib_last, still mounted, or NULL */
+    config_digest      cdh_caps_digest; /* Digest of capabilities when yang-lib was last good */
+    int                cdh_caps_digest_valid; /* cdh_caps_digest is set */
+    cxobj             *cdh_xcaps_good; /* Copy of capabilities of cdh_caps_digest, or NULL */
     int                cdh_nr_schemas; /* How many schemas from this device */
-    char              *cdh_schema_name; /* Pending schema name */
-    char              *cdh_schema_rev;  /* Pending schema revision */
+    struct schema_pending *cdh_schema_pending; /* Outstanding get-schema requests */
+    int                cdh_schema_pending_nr; /* Length of cdh_schema_pending */
+    int                cdh_schema_wait_nr; /* Entries in cdh_schema_pending waiting for other device */
     char              *cdh_logmsg;      /* Error log message / reason of failed open */
     char              *cdh_domain;      /* YANG domain (for isolation) */
     cbuf              *cdh_outmsg1;     /* Pending outgoing netconf message #1 for delayed output */
     cbuf              *cdh_outmsg2;     /* Pending outgoing netconf message #2 for delayed output */
+    controller_transaction *cdh_ct;     /* Transaction device is member of (shadow of cdh_tid) */
+    struct controller_device_handle *cdh_tnext; /* Next member of same transaction */
+    struct controller_device_handle *cdh_tprev; /* Previous member of same transaction */
+    char              *cdh_conn_dest;   /* Connect destination: [<user>@]<addr> */
+    char              *cdh_conn_port;   /* Connect port */
+    int                cdh_conn_stricthostkey; /* Connect with strict hostkey checking */
+    int                cdh_connecting;  /* Counted as connecting, from CONNECTING until OPEN/CLOSED */
+    struct controller_device_handle *cdh_cqnext; /* Next device in connect queue (if QUEUED) */
+    struct controller_device_handle *cdh_cqprev; /* Previous device in connect queue (if QUEUED) */
+    cbuf              *cdh_outq;        /* Framed output to device not yet written, or NULL */
+    size_t             cdh_outq_off;    /* Written offset of cdh_outq */
+    struct controller_device_handle *cdh_oqnext; /* Next device with pending output */
+    struct controller_device_handle *cdh_oqprev; /* Previous device with pending output */
+    config_digest      cdh_synced_digest;    /* Content digest of SYNCED device config */
+    config_digest      cdh_transient_digest; /* Content digest of TRANSIENT device config */
+    int                cdh_digest_valid;     /* Bitmask of valid digests: 1<<DT_SYNCED, 1<<DT_TRANSIENT */
+    config_digests    *cdh_synced_digests;   /* Subtree digests of SYNCED device config, or NULL */
+    char              *cdh_change_token_xpath; /* XPath of change indicator in device state, or NULL */
+    char              *cdh_synced_token;    /* Change token fetched with SYNCED device config, or NULL */
+    char              *cdh_transient_token; /* Change token fetched with last device config pull, or NULL */
+    struct pipeline_request *cdh_pipeline; /* Outstanding pipelined push requests, oldest first */
+    int                cdh_pipeline_nr; /* Length of cdh_pipeline */
+    struct dispatch_request *cdh_dispatch; /* Outstanding requests dispatched by message-id */
+    int                cdh_dispatch_nr; /* Length of cdh_dispatch */
+    uint64_t           cdh_dispatch_expired[DISPATCH_EXPIRED_MAX]; /* Message-ids of expired requests */
+    int                cdh_dispatch_expired_nr; /* Entries in cdh_dispatch_expired */
 };
 
+/* Forward declarations */
+static int device_handle_connq_rm(clixon_handle h, struct controller_device_handle *cdh);
+static int device_handle_connecting_update(struct controller_device_handle *cdh, conn_state state);
+
 /*! Check struct magic number for sanity checks
  *
  * @param[in]  dh  Device handle
@@ -129,26 +245,51 @@ device_handle_check(device_handle dh)
 static int
 device_handle_free1(struct controller_device_handle *cdh)
 {
+    (void)controller_timer_cancel(cdh->cdh_h, &cdh->cdh_state_timer);
+    device_handle_dispatch_clear(cdh);
+    device_handle_outq_clear(cdh);
+    if (cdh->cdh_outq)
+        cbuf_free(cdh->cdh_outq);
     if (cdh->cdh_name)
         free(cdh->cdh_name);
     if (cdh->cdh_frame_buf)
         cbuf_free(cdh->cdh_frame_buf);
+    if (cdh->cdh_read_buf)
+        free(cdh->cdh_read_buf);
     if (cdh->cdh_xcaps)
         xml_free(cdh->cdh_xcaps);
     if (cdh->cdh_yang_lib)
         xml_free(cdh->cdh_yang_lib);
+    if (cdh->cdh_yang_lib_digest)
+        free(cdh->cdh_yang_lib_digest);
+    if (cdh->cdh_yang_lib_last)
+        xml_free(cdh->cdh_yang_lib_last);
+    if (cdh->cdh_xcaps_good)
+        xml_free(cdh->cdh_xcaps_good);
+    if (cdh->cdh_change_token_xpath)
+        free(cdh->cdh_change_token_xpath);
+    if (cdh->cdh_synced_token)
+        free(cdh->cdh_synced_token);
+    if (cdh->cdh_transient_token)
+        free(cdh->cdh_transient_token);
+    if (cdh->cdh_synced_digests)
+        config_digests_free(cdh->cdh_synced_digests);
     if (cdh->cdh_logmsg)
         free(cdh->cdh_logmsg);
-    if (cdh->cdh_schema_name)
-        free(cdh->cdh_schema_name);
-    if (cdh->cdh_schema_rev)
-        free(cdh->cdh_schema_rev);
+    if (cdh->cdh_latency)
+        free(cdh->cdh_latency);
+    device_handle_schema_pending_clear(cdh);
+    device_handle_pipeline_clear(cdh);
     if (cdh->cdh_domain)
         free(cdh->cdh_domain);
     if (cdh->cdh_outmsg1)
         cbuf_free(cdh->cdh_outmsg1);
     if (cdh->cdh_outmsg2)
         cbuf_free(cdh->cdh_outmsg2);
+    if (cdh->cdh_conn_dest)
+        free(cdh->cdh_conn_dest);
+    if (cdh->cdh_conn_port)
+        free(cdh->cdh_conn_port);
     free(cdh);
     return 0;
 }
@@ -166,9 +307,15 @@ device_handle_new(clixon_handle h,
 {
     struct controller_device_handle *cdh = NULL;
     struct controller_device_handle *cdh_list = NULL;
+    clicon_hash_t                   *hash = NULL;
     size_t                           sz;
 
     clixon_debug(CLIXON_DBG_CTRL, "%s", name);
+    if (clicon_ptr_get(h, "client-hash", (void**)&hash) < 0 || hash == NULL){
+        if ((hash = clicon_hash_init()) == NULL)
+            return NULL;
+        clicon_ptr_set(h, "client-hash", (void*)hash);
+    }
     sz = sizeof(struct controller_device_handle);
     if ((cdh = malloc(sz)) == NULL){
         clixon_err(OE_NETCONF, errno, "malloc");
@@ -191,6 +338,10 @@ device_handle_new(clixon_handle h,
         device_handle_free1(cdh);
         return NULL;
     }
+    if (clicon_hash_add(hash, name, &cdh, sizeof(cdh)) == NULL){
+        device_handle_free1(cdh);
+        return NULL;
+    }
     (void)clicon_ptr_get(h, "client-list", (void**)&cdh_list);
     ADDQ(cdh, cdh_list);
     clicon_ptr_set(h, "client-list", (void*)cdh_list);
@@ -208,9 +359,20 @@ device_handle_free(device_handle dh)
     struct controller_device_handle *cdh = devhandle(dh);
     struct controller_device_handle *cdh_list = NULL;
     struct controller_device_handle *c;
+    clicon_hash_t                   *hash = NULL;
     clixon_handle                    h;
 
     h = (clixon_handle)cdh->cdh_h;
+    if (cdh->cdh_ct)
+        device_handle_tid_set(dh, 0);
+    if (cdh->cdh_conn_state == CS_QUEUED)
+        device_handle_connq_rm(h, cdh);
+    device_handle_connecting_update(cdh, CS_CLOSED);
+    if (cdh->cdh_yang_lib_digest)
+        (void)device_shared_yspec_rm(h, dh);
+    if (clicon_ptr_get(h, "client-hash", (void**)&hash) == 0 && hash != NULL &&
+        device_handle_find(h, cdh->cdh_name) == cdh)
+        clicon_hash_del(hash, cdh->cdh_name);
     clicon_ptr_get(h, "client-list", (void**)&cdh_list);
     if ((c = cdh_list) != NULL) {
         do {
@@ -235,6 +397,7 @@ device_handle_free_all(clixon_handle h)
 {
     struct controller_device_handle *cdh_list = NULL;
     struct controller_device_handle *c;
+    clicon_hash_t                   *hash = NULL;
 
     clicon_ptr_get(h, "client-list", (void**)&cdh_list);
     while ((c = cdh_list) != NULL) {
@@ -242,31 +405,38 @@ device_handle_free_all(clixon_handle h)
         device_handle_free1(c);
     }
     clicon_ptr_set(h, "client-list", (void*)cdh_list);
+    clicon_ptr_set(h, "client-connect-queue", NULL);
+    clicon_data_int_set(h, "controller-connecting-nr", 0);
+    if (clicon_ptr_get(h, "client-hash", (void**)&hash) == 0 && hash != NULL){
+        clicon_hash_free(hash);
+        clicon_ptr_set(h, "client-hash", NULL);
+    }
     return 0;
 }
 
 /*! Find clixon-client given name
  *
+ * Lookup in name->handle hash index, maintained by device_handle_new/free
  * @param[in]  h     Clixon  handle
  * @param[in]  name  Client name
  * @retval     dh    Device handle
+ * @retval     NULL  Not found
  */
 device_handle
 device_handle_find(clixon_handle h,
                    const char   *name)
 {
-    struct controller_device_handle *cdh_list = NULL;
-    struct controller_device_handle *c = NULL;
+    clicon_hash_t *hash = NULL;
+    void          *p;
+    size_t         vlen = 0;
 
-    if (clicon_ptr_get(h, "client-list", (void**)&cdh_list) == 0 &&
-        (c = cdh_list) != NULL) {
-        do {
-            if (strcmp(c->cdh_name, name) == 0)
-                return c;
-            c = NEXTQ(struct controller_device_handle *, c);
-        } while (c && c != cdh_list);
-    }
-    return NULL;
+    if (name == NULL)
+        return NULL;
+    if (clicon_ptr_get(h, "client-hash", (void**)&hash) < 0 || hash == NULL)
+        return NULL;
+    if ((p = clicon_hash_value(hash, name, &vlen)) == NULL)
+        return NULL;
+    return *(struct controller_device_handle **)p;
 }
 
 /*! Iterator over device-handles
@@ -296,6 +466,308 @@ device_handle_each(clixon_handle h,
         return cdh;
 }
 
+/*! Iterator over device-handles that are members of a transaction
+ *
+ * Unlike device_handle_each, only visits devices in the transaction.
+ * It is safe to leave the transaction (device_handle_tid_set) in the loop body, provided
+ * the next handle is fetched before.
+ * @param[in]  ct     Controller transaction
+ * @param[in]  dhprev iteration handle, init with NULL
+ * @code
+ *    device_handle dh = NULL;
+ *    while ((dh = device_handle_each_tid(ct, dh)) != NULL){
+ *       dh...
+ * @endcode
+ */
+device_handle
+device_handle_each_tid(controller_transaction *ct,
+                       device_handle           dhprev)
+{
+    struct controller_device_handle *cdh = (struct controller_device_handle *)dhprev;
+    struct controller_device_handle *cdh0;
+
+    cdh0 = (struct controller_device_handle *)ct->ct_members;
+    if (cdh == NULL)
+        return cdh0;
+    cdh = cdh->cdh_tnext;
+    if (cdh == NULL || cdh == cdh0)
+        return NULL;
+    else
+        return cdh;
+}
+
+/*! Add device to transaction member list and per-state counters
+ *
+ * @param[in]  ct   Controller transaction
+ * @param[in]  cdh  Controller device handle, not member of any transaction
+ */
+static int
+device_handle_member_add(controller_transaction          *ct,
+                         struct controller_device_handle *cdh)
+{
+    struct controller_device_handle *cdh0;
+
+    if ((cdh0 = (struct controller_device_handle *)ct->ct_members) == NULL){
+        cdh->cdh_tnext = cdh;
+        cdh->cdh_tprev = cdh;
+        ct->ct_members = cdh;
+    }
+    else { /* Append last */
+        cdh->cdh_tnext = cdh0;
+        cdh->cdh_tprev = cdh0->cdh_tprev;
+        cdh0->cdh_tprev->cdh_tnext = cdh;
+        cdh0->cdh_tprev = cdh;
+    }
+    cdh->cdh_ct = ct;
+    ct->ct_nr_members++;
+    ct->ct_nr_state[cdh->cdh_conn_state]++;
+    return 0;
+}
+
+/*! Remove device from transaction member list and per-state counters
+ *
+ * @param[in]  ct   Controller transaction
+ * @param[in]  cdh  Controller device handle, member of ct
+ */
+static int
+device_handle_member_rm(controller_transaction          *ct,
+                        struct controller_device_handle *cdh)
+{
+    if (cdh->cdh_tnext == cdh)
+        ct->ct_members = NULL;
+    else {
+        cdh->cdh_tprev->cdh_tnext = cdh->cdh_tnext;
+        cdh->cdh_tnext->cdh_tprev = cdh->cdh_tprev;
+        if (ct->ct_members == cdh)
+            ct->ct_members = cdh->cdh_tnext;
+    }
+    cdh->cdh_tnext = NULL;
+    cdh->cdh_tprev = NULL;
+    cdh->cdh_ct = NULL;
+    ct->ct_nr_members--;
+    ct->ct_nr_state[cdh->cdh_conn_state]--;
+    return 0;
+}
+
+/*! Add device last in connect queue
+ *
+ * The queue is a circular list with head in "client-connect-queue"
+ * @param[in]  h    Clixon handle
+ * @param[in]  cdh  Controller device handle, entering QUEUED state
+ */
+static int
+device_handle_connq_add(clixon_handle                    h,
+                        struct controller_device_handle *cdh)
+{
+    struct controller_device_handle *cdh0 = NULL;
+
+    (void)clicon_ptr_get(h, "client-connect-queue", (void**)&cdh0);
+    if (cdh0 == NULL){
+        cdh->cdh_cqnext = cdh;
+        cdh->cdh_cqprev = cdh;
+        clicon_ptr_set(h, "client-connect-queue", (void*)cdh);
+    }
+    else { /* Append last */
+        cdh->cdh_cqnext = cdh0;
+        cdh->cdh_cqprev = cdh0->cdh_cqprev;
+        cdh0->cdh_cqprev->cdh_cqnext = cdh;
+        cdh0->cdh_cqprev = cdh;
+    }
+    return 0;
+}
+
+/*! Remove device from connect queue
+ *
+ * @param[in]  h    Clixon handle
+ * @param[in]  cdh  Controller device handle, leaving QUEUED state
+ */
+static int
+device_handle_connq_rm(clixon_handle                    h,
+                       struct controller_device_handle *cdh)
+{
+    struct controller_device_handle *cdh0 = NULL;
+
+    (void)clicon_ptr_get(h, "client-connect-queue", (void**)&cdh0);
+    if (cdh->cdh_cqnext == cdh)
+        clicon_ptr_set(h, "client-connect-queue", NULL);
+    else if (cdh->cdh_cqnext != NULL) {
+        cdh->cdh_cqprev->cdh_cqnext = cdh->cdh_cqnext;
+        cdh->cdh_cqnext->cdh_cqprev = cdh->cdh_cqprev;
+        if (cdh0 == cdh)
+            clicon_ptr_set(h, "client-connect-queue", (void*)cdh->cdh_cqnext);
+    }
+    cdh->cdh_cqnext = NULL;
+    cdh->cdh_cqprev = NULL;
+    return 0;
+}
+
+/*! Add device last in list of devices with pending output
+ *
+ * The list is a circular list with head in "client-output-queue"
+ * @param[in]  h    Clixon handle
+ * @param[in]  cdh  Controller device handle
+ */
+static int
+device_handle_outq_link(clixon_handle                    h,
+                        struct controller_device_handle *cdh)
+{
+    struct controller_device_handle *cdh0 = NULL;
+
+    if (cdh->cdh_oqnext != NULL)
+        return 0;
+    (void)clicon_ptr_get(h, "client-output-queue", (void**)&cdh0);
+    if (cdh0 == NULL){
+        cdh->cdh_oqnext = cdh;
+        cdh->cdh_oqprev = cdh;
+        clicon_ptr_set(h, "client-output-queue", (void*)cdh);
+    }
+    else { /* Append last */
+        cdh->cdh_oqnext = cdh0;
+        cdh->cdh_oqprev = cdh0->cdh_oqprev;
+        cdh0->cdh_oqprev->cdh_oqnext = cdh;
+        cdh0->cdh_oqprev = cdh;
+    }
+    return 0;
+}
+
+/*! Remove device from list of devices with pending output
+ *
+ * @param[in]  h    Clixon handle
+ * @param[in]  cdh  Controller device handle
+ */
+static int
+device_handle_outq_unlink(clixon_handle                    h,
+                          struct controller_device_handle *cdh)
+{
+    struct controller_device_handle *cdh0 = NULL;
+
+    (void)clicon_ptr_get(h, "client-output-queue", (void**)&cdh0);
+    if (cdh->cdh_oqnext == cdh)
+        clicon_ptr_set(h, "client-output-queue", NULL);
+    else if (cdh->cdh_oqnext != NULL) {
+        cdh->cdh_oqprev->cdh_oqnext = cdh->cdh_oqnext;
+        cdh->cdh_oqnext->cdh_oqprev = cdh->cdh_oqprev;
+        if (cdh0 == cdh)
+            clicon_ptr_set(h, "client-output-queue", (void*)cdh->cdh_oqnext);
+    }
+    cdh->cdh_oqnext = NULL;
+    cdh->cdh_oqprev = NULL;
+    return 0;
+}
+
+/*! Get first device in connect queue
+ *
+ * @param[in]  h     Clixon handle
+ * @retval     dh    First device in QUEUED state
+ * @retval     NULL  Queue is empty
+ * @see device_connect_schedule
+ */
+device_handle
+device_handle_connq_first(clixon_handle h)
+{
+    struct controller_device_handle *cdh0 = NULL;
+
+    (void)clicon_ptr_get(h, "client-connect-queue", (void**)&cdh0);
+    return cdh0;
+}
+
+/*! Iterate devices with pending output
+ *
+ * @param[in]  h       Clixon handle
+ * @param[in]  dhprev  Previous device, or NULL to get first
+ * @retval     dh      Next device with pending output
+ * @retval     NULL    No more devices
+ * @note The list may not be changed while iterating, eg by device_handle_outq_flush
+ */
+device_handle
+device_handle_outq_each(clixon_handle h,
+                        device_handle dhprev)
+{
+    struct controller_device_handle *cdh0 = NULL;
+    struct controller_device_handle *cdh;
+
+    (void)clicon_ptr_get(h, "client-output-queue", (void**)&cdh0);
+    if (cdh0 == NULL)
+        return NULL;
+    if (dhprev == NULL)
+        return cdh0;
+    cdh = devhandle(dhprev);
+    if (cdh->cdh_oqnext == NULL || cdh->cdh_oqnext == cdh0)
+        return NULL;
+    return cdh->cdh_oqnext;
+}
+
+/*! Add to total number of bytes of pending output of all devices
+ *
+ * The total is kept in clicon data "controller-output-queued", updated when output is
+ * appended, written or dropped
+ * @param[in]  h      Clixon handle
+ * @param[in]  delta  Bytes appended (positive) or written or dropped (negative)
+ */
+static void
+device_handle_outq_count(clixon_handle h,
+                         ssize_t       delta)
+{
+    int total;
+
+    if ((total = clicon_data_int_get(h, "controller-output-queued")) < 0)
+        total = 0;
+    total += delta;
+    clicon_data_int_set(h, "controller-output-queued", total < 0 ? 0 : total);
+}
+
+/*! Get total number of bytes of pending output of all devices
+ *
+ * @param[in]  h     Clixon handle
+ * @retval     len   Bytes not yet written
+ */
+size_t
+device_handle_outq_total(clixon_handle h)
+{
+    int total;
+
+    if ((total = clicon_data_int_get(h, "controller-output-queued")) < 0)
+        return 0;
+    return total;
+}
+
+/*! Get number of devices connecting, ie from CONNECTING until OPEN or CLOSED
+ *
+ * @param[in]  h     Clixon handle
+ * @retval     nr    Number of connecting devices
+ */
+int
+device_handle_connecting_nr(clixon_handle h)
+{
+    int nr;
+
+    if ((nr = clicon_data_int_get(h, "controller-connecting-nr")) < 0)
+        nr = 0;
+    return nr;
+}
+
+/*! Update number of connecting devices
+ *
+ * @param[in]  cdh   Controller device handle
+ * @param[in]  state New connection state
+ */
+static int
+device_handle_connecting_update(struct controller_device_handle *cdh,
+                                conn_state                       state)
+{
+    clixon_handle h = cdh->cdh_h;
+
+    if (state == CS_CONNECTING && !cdh->cdh_connecting){
+        cdh->cdh_connecting = 1;
+        clicon_data_int_set(h, "controller-connecting-nr", device_handle_connecting_nr(h) + 1);
+    }
+    else if ((state == CS_OPEN || state == CS_CLOSED) && cdh->cdh_connecting){
+        cdh->cdh_connecting = 0;
+        clicon_data_int_set(h, "controller-connecting-nr", device_handle_connecting_nr(h) - 1);
+    }
+    return 0;
+}
+
 /*! Connect client to clixon backend according to config and return a socket
  *
  * @param[in]  h        Clixon handle
@@ -316,6 +788,8 @@ device_handle_connect(device_handle      dh,
     int                              retval = -1;
     struct controller_device_handle *cdh = (struct controller_device_handle *)dh;
     clixon_handle                    h;
+    int                              persist;
+    int                              reused = 0;
 
     clixon_debug(CLIXON_DBG_CTRL, "");
     if (cdh == NULL){
@@ -333,14 +807,29 @@ device_handle_connect(device_handle      dh,
         if (clixon_client_connect_netconf(h, &cdh->cdh_pid, &cdh->cdh_socket) < 0)
             goto err;
         break;
-#ifdef SSH_BIN
     case CLIXON_CLIENT_SSH:
-        if (clixon_client_connect_ssh(h, dest, port, stricthostkey, &cdh->cdh_pid, &cdh->cdh_socket, &cdh->cdh_sockerr) < 0)
+        if ((persist = clicon_data_int_get(h, "controller-ssh-persist")) < 0)
+            persist = 0;
+#ifdef HAVE_LIBSSH
+        if (clicon_data_int_get(h, "controller-ssh-transport") == SSH_TRANSPORT_LIBSSH){
+            if (clixon_client_connect_libssh(h, dest, port, stricthostkey, &cdh->cdh_transport, &cdh->cdh_socket, &cdh->cdh_sockerr, &reused) < 0)
+                goto err;
+        }
+        else
+#endif
+#ifdef SSH_BIN
+        if (clixon_client_connect_ssh(h, dest, port, stricthostkey, persist, &cdh->cdh_pid, &cdh->cdh_socket, &cdh->cdh_sockerr, &reused) < 0)
             goto err;
 #else
-        clixon_err(OE_UNIX, 0, "No ssh bin");
-        goto done;
+        {
+            clixon_err(OE_UNIX, 0, "No ssh bin");
+            goto done;
+        }
 #endif
+        if (reused)
+            cdh->cdh_reuses++;
+        else
+            cdh->cdh_handshakes++;
         break;
     } /* switch */
     retval = 0;
@@ -366,12 +855,16 @@ device_handle_disconnect(device_handle dh)
 {
     int                              retval = -1;
     struct controller_device_handle *cdh = devhandle(dh);
+#ifdef HAVE_LIBSSH
+    int                              persist;
+#endif
 
     if (cdh == NULL){
         clixon_err(OE_XML, EINVAL, "Expected cdh handle");
         goto done;
     }
     clixon_debug(CLIXON_DBG_CTRL, "%s", cdh->cdh_name);
+    device_handle_outq_clear(dh);
     switch(cdh->cdh_type){
     case CLIXON_CLIENT_IPC:
         close(cdh->cdh_socket);
@@ -379,6 +872,22 @@ device_handle_disconnect(device_handle dh)
         break;
     case CLIXON_CLIENT_SSH:
     case CLIXON_CLIENT_NETCONF:
+#ifdef HAVE_LIBSSH
+        if (cdh->cdh_transport != NULL){
+            if ((persist = clicon_data_int_get(cdh->cdh_h, "controller-ssh-persist")) < 0)
+                persist = 0;
+            if (clixon_client_disconnect_libssh(cdh->cdh_transport, persist) < 0)
+                goto done;
+            cdh->cdh_transport = NULL;
+            if (cdh->cdh_sockerr != -1){
+                close(cdh->cdh_sockerr);
+                cdh->cdh_sockerr = -1;
+            }
+            close(cdh->cdh_socket);
+            cdh->cdh_socket = -1;
+            break;
+        }
+#endif
         assert(cdh->cdh_pid && cdh->cdh_socket != -1);
         if (cdh->cdh_sockerr != -1){
             close(cdh->cdh_sockerr);
@@ -558,8 +1067,10 @@ device_handle_tid_get(device_handle dh)
     return cdh->cdh_tid;
 }
 
-/*! Get transaction id
+/*! Set transaction id
  *
+ * Also maintain transaction member list: leave previous transaction (if any) and join new.
+ * When leaving a transaction, pending outgoing messages are freed.
  * @param[in]  dh     Device handle
  * @param[in]  tid    Transaction-id (0 means unassigned)
  */
@@ -568,10 +1079,20 @@ device_handle_tid_set(device_handle dh,
                       uint64_t      tid)
 {
     struct controller_device_handle *cdh = devhandle(dh);
-    controller_transaction *ct;
+    controller_transaction          *ct = NULL;
 
-    if ((ct = controller_transaction_find(cdh->cdh_h, tid)) != NULL)
+    if (tid != 0 &&
+        (ct = controller_transaction_find(cdh->cdh_h, tid)) != NULL)
         controller_transaction_device_add(ct, cdh->cdh_name);
+    if (cdh->cdh_ct != ct){
+        if (cdh->cdh_ct != NULL){
+            device_handle_member_rm(cdh->cdh_ct, cdh);
+            device_handle_outmsg_set(dh, 1, NULL);
+            device_handle_outmsg_set(dh, 2, NULL);
+        }
+        if (ct != NULL)
+            device_handle_member_add(ct, cdh);
+    }
     cdh->cdh_tid = tid;
     return 0;
 }
@@ -654,6 +1175,15 @@ device_handle_conn_state_set(device_handle dh,
         free(cdh->cdh_logmsg);
         cdh->cdh_logmsg = NULL;
     }
+    if (cdh->cdh_ct != NULL){
+        cdh->cdh_ct->ct_nr_state[cdh->cdh_conn_state]--;
+        cdh->cdh_ct->ct_nr_state[state]++;
+    }
+    if (cdh->cdh_conn_state == CS_QUEUED && state != CS_QUEUED)
+        device_handle_connq_rm(cdh->cdh_h, cdh);
+    else if (cdh->cdh_conn_state != CS_QUEUED && state == CS_QUEUED)
+        device_handle_connq_add(cdh->cdh_h, cdh);
+    device_handle_connecting_update(cdh, state);
     cdh->cdh_conn_state = state;
     gettimeofday(&t, NULL);
     device_handle_conn_time_set(dh, &t);
@@ -662,6 +1192,63 @@ device_handle_conn_state_set(device_handle dh,
     return 0;
 }
 
+/*! Set connect parameters, used when device is dequeued from connect queue
+ *
+ * @param[in]  dh            Device handle
+ * @param[in]  dest          Destination: [<user>@]<addr>, is copied
+ * @param[in]  port          Port, is copied
+ * @param[in]  stricthostkey If set ensure strict hostkey checking
+ * @retval     0             OK
+ * @retval    -1             Error
+ * @see device_connect_schedule
+ */
+int
+device_handle_conn_params_set(device_handle dh,
+                              const char   *dest,
+                              const char   *port,
+                              int           stricthostkey)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    if (cdh->cdh_conn_dest)
+        free(cdh->cdh_conn_dest);
+    if (cdh->cdh_conn_port)
+        free(cdh->cdh_conn_port);
+    cdh->cdh_conn_port = NULL;
+    if ((cdh->cdh_conn_dest = strdup(dest)) == NULL ||
+        (port && (cdh->cdh_conn_port = strdup(port)) == NULL)){
+        clixon_err(OE_UNIX, errno, "strdup");
+        return -1;
+    }
+    cdh->cdh_conn_stricthostkey = stricthostkey;
+    return 0;
+}
+
+/*! Get connect parameters
+ *
+ * @param[in]  dh            Device handle
+ * @param[out] dest          Destination: [<user>@]<addr>
+ * @param[out] port          Port
+ * @param[out] stricthostkey If set ensure strict hostkey checking
+ * @retval     0             OK
+ */
+int
+device_handle_conn_params_get(device_handle dh,
+                              char        **dest,
+                              char        **port,
+                              int          *stricthostkey)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    if (dest)
+        *dest = cdh->cdh_conn_dest;
+    if (port)
+        *port = cdh->cdh_conn_port;
+    if (stricthostkey)
+        *stricthostkey = cdh->cdh_conn_stricthostkey;
+    return 0;
+}
+
 /*! Get connection timestamp
  *
  * @param[in]  dh     Device handle
@@ -761,75 +1348,563 @@ device_handle_stable_time_set(device_handle   dh,
     return 0;
 }
 
-/*! Access frame state get
+/*! Get result of last background sync-check
  *
  * @param[in]  dh     Device handle
- * @retval     state
+ * @param[out] t      Time of last check (=0 if never) (if not NULL)
+ * @param[out] due    Time when next check is due (if not NULL)
+ * @param[out] result 1: in sync, 0: out of sync, 2: unknown (if not NULL)
+ * @retval     0      OK
+ * @see sync-check-interval in clixon-controller.yang
  */
 int
-device_handle_frame_state_get(device_handle dh)
+device_handle_sync_check_get(device_handle   dh,
+                             struct timeval *t,
+                             struct timeval *due,
+                             int            *result)
 {
     struct controller_device_handle *cdh = devhandle(dh);
 
-    return cdh->cdh_frame_state;
+    if (t)
+        *t = cdh->cdh_check_time;
+    if (due)
+        *due = cdh->cdh_check_due;
+    if (result)
+        *result = cdh->cdh_check_time.tv_sec ? cdh->cdh_check_result : 2;
+    return 0;
 }
 
-/*! Access state get
+/*! Set result of background sync-check
  *
  * @param[in]  dh     Device handle
- * @retval     state  State
+ * @param[in]  t      Time of check, if NULL set w gettimeofday
+ * @param[in]  due    Time when next check is due
+ * @param[in]  result 1: in sync, 0: out of sync, 2: unknown
  * @retval     0      OK
  */
 int
-device_handle_frame_state_set(device_handle dh,
-                              int           state)
+device_handle_sync_check_set(device_handle   dh,
+                             struct timeval *t,
+                             struct timeval *due,
+                             int             result)
 {
     struct controller_device_handle *cdh = devhandle(dh);
 
-    cdh->cdh_frame_state = state;
+    if (t == NULL)
+        gettimeofday(&cdh->cdh_check_time, NULL);
+    else
+        cdh->cdh_check_time = *t;
+    cdh->cdh_check_due = *due;
+    cdh->cdh_check_result = result;
     return 0;
 }
 
-/*! Get Netconf frame size, part of dynamic framing detection
+/*! Add latency sample of a transient connection state
  *
- * @param[in]  dh    Device handle
- * @retval     fs    Frame size
+ * A reply in time also resets the number of consecutive timeouts
+ * @param[in]  dh     Device handle
+ * @param[in]  state  Connection state left
+ * @param[in]  ms     Time in ms spent in state
+ * @retval     0      OK
+ * @retval    -1      Error
  */
-size_t
-device_handle_frame_size_get(device_handle dh)
+int
+device_handle_latency_add(device_handle dh,
+                          conn_state    state,
+                          uint32_t      ms)
 {
+    int                              retval = -1;
     struct controller_device_handle *cdh = devhandle(dh);
+    struct device_latency           *dl;
 
-    return cdh->cdh_frame_size;
+    if (cdh->cdh_latency == NULL){
+        if ((cdh->cdh_latency = calloc(CS_NR, sizeof(struct device_latency))) == NULL){
+            clixon_err(OE_UNIX, errno, "calloc");
+            goto done;
+        }
+    }
+    dl = &cdh->cdh_latency[state];
+    if (dl->dl_nr == 0)
+        dl->dl_ewma = ms;
+    else
+        dl->dl_ewma = (uint32_t)((int64_t)dl->dl_ewma + ((int64_t)ms - (int64_t)dl->dl_ewma)/8);
+    dl->dl_ring[dl->dl_nr % DEVICE_LATENCY_RING] = ms;
+    dl->dl_nr++;
+    cdh->cdh_timeouts = 0;
+    retval = 0;
+ done:
+    return retval;
 }
 
-/*! Set Netconf frame size, part of dynamic framing detection
+static int
+latency_cmp(const void *a,
+            const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/*! Get latency of a transient connection state
  *
+ * The percentile is of the last samples only, see DEVICE_LATENCY_RING
  * @param[in]  dh     Device handle
- * @param[in]  size   Frame size
+ * @param[in]  state  Connection state
+ * @param[out] ewma   Moving average in ms (if not NULL)
+ * @param[out] p95    95th percentile in ms (if not NULL)
+ * @param[out] nr     Number of samples, 0 if none (if not NULL)
+ * @retval     0      OK
  */
 int
-device_handle_frame_size_set(device_handle dh,
-                             size_t        size)
+device_handle_latency_get(device_handle dh,
+                          conn_state    state,
+                          uint32_t     *ewma,
+                          uint32_t     *p95,
+                          uint32_t     *nr)
 {
     struct controller_device_handle *cdh = devhandle(dh);
-
-    cdh->cdh_frame_size = size;
+    struct device_latency           *dl = NULL;
+    uint32_t                         vec[DEVICE_LATENCY_RING];
+    uint32_t                         n;
+
+    if (cdh->cdh_latency)
+        dl = &cdh->cdh_latency[state];
+    if (ewma)
+        *ewma = dl ? dl->dl_ewma : 0;
+    if (nr)
+        *nr = dl ? dl->dl_nr : 0;
+    if (p95){
+        *p95 = 0;
+        if (dl && dl->dl_nr > 0){
+            n = dl->dl_nr < DEVICE_LATENCY_RING ? dl->dl_nr : DEVICE_LATENCY_RING;
+            memcpy(vec, dl->dl_ring, n*sizeof(uint32_t));
+            qsort(vec, n, sizeof(uint32_t), latency_cmp);
+            /* Nearest rank */
+            *p95 = vec[(n*95 + 99)/100 - 1];
+        }
+    }
     return 0;
 }
 
-/*! Get Netconf framing type of device
+/*! Count a state timeout of device
  *
- * @param[in]  dh     Device handle
+ * @param[in]  dh          Device handle
+ * @param[out] consecutive Number of consecutive timeouts including this (if not NULL)
+ * @retval     0           OK
  */
-cbuf *
-device_handle_frame_buf_get(device_handle dh)
+int
+device_handle_timeout_add(device_handle dh,
+                          uint32_t     *consecutive)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    cdh->cdh_timeouts++;
+    cdh->cdh_timeouts_total++;
+    if (consecutive)
+        *consecutive = cdh->cdh_timeouts;
+    return 0;
+}
+
+/*! Get number of state timeouts of device
+ *
+ * @param[in]  dh          Device handle
+ * @param[out] consecutive Number of consecutive timeouts (if not NULL)
+ * @param[out] total       Number of timeouts since controller start (if not NULL)
+ * @retval     0           OK
+ */
+int
+device_handle_timeout_get(device_handle dh,
+                          uint32_t     *consecutive,
+                          uint32_t     *total)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    if (consecutive)
+        *consecutive = cdh->cdh_timeouts;
+    if (total)
+        *total = cdh->cdh_timeouts_total;
+    return 0;
+}
+
+/*! Check if device is quarantined, ie left out of transactions on multiple devices
+ *
+ * @param[in]  dh     Device handle
+ * @retval     1      Quarantined
+ * @retval     0      Not quarantined, or quarantine has expired
+ * @see devices/quarantine-threshold
+ */
+int
+device_handle_quarantined(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+    struct timeval                   now;
+
+    if (cdh->cdh_quarantine.tv_sec == 0)
+        return 0;
+    gettimeofday(&now, NULL);
+    return timercmp(&now, &cdh->cdh_quarantine, <) ? 1 : 0;
+}
+
+/*! Check if quarantine of device has expired but is not released
+ *
+ * @param[in]  dh     Device handle
+ * @retval     1      Expired
+ * @retval     0      Quarantined, or not quarantined
+ */
+int
+device_handle_quarantine_expired(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    return cdh->cdh_quarantine.tv_sec != 0 && !device_handle_quarantined(dh);
+}
+
+/*! Set or release quarantine of device
+ *
+ * Also resets the consecutive timeouts, so that a device is quarantined again only after
+ * quarantine-threshold new timeouts
+ * @param[in]  dh     Device handle
+ * @param[in]  until  Quarantined until this time, or NULL to release
+ * @retval     0      OK
+ */
+int
+device_handle_quarantine_set(device_handle   dh,
+                             struct timeval *until)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    if (until)
+        cdh->cdh_quarantine = *until;
+    else
+        timerclear(&cdh->cdh_quarantine);
+    cdh->cdh_timeouts = 0;
+    return 0;
+}
+
+/*! Get timer of transient connection state
+ *
+ * @param[in]  dh     Device handle
+ * @retval     tm     Timer, owned by device handle
+ * @see device_state_timeout_register
+ */
+struct controller_timer *
+device_handle_state_timer_get(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    return &cdh->cdh_state_timer;
+}
+
+/*! Get SSH connect statistics
+ *
+ * @param[in]  dh         Device handle
+ * @param[out] handshakes Number of connects with full SSH handshake
+ * @param[out] reuses     Number of connects reusing a kept SSH connection
+ * @param[out] ms         Time in ms from last connect until hello received
+ */
+int
+device_handle_handshake_get(device_handle dh,
+                            uint32_t     *handshakes,
+                            uint32_t     *reuses,
+                            uint32_t     *ms)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    if (handshakes)
+        *handshakes = cdh->cdh_handshakes;
+    if (reuses)
+        *reuses = cdh->cdh_reuses;
+    if (ms)
+        *ms = cdh->cdh_handshake_time;
+    return 0;
+}
+
+/*! Set time from last connect until hello received
+ *
+ * @param[in]  dh     Device handle
+ * @param[in]  ms     Time in ms
+ */
+int
+device_handle_handshake_time_set(device_handle dh,
+                                 uint32_t      ms)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    cdh->cdh_handshake_time = ms;
+    return 0;
+}
+
+/*! Get NETCONF session-id of device
+ *
+ * @param[in]  dh     Device handle
+ * @retval     id     Session-id from hello, 0 if unknown
+ */
+uint32_t
+device_handle_session_id_get(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    return cdh->cdh_session_id;
+}
+
+/*! Set NETCONF session-id of device
+ *
+ * @param[in]  dh     Device handle
+ * @param[in]  id     Session-id from hello, 0 if unknown
+ * @retval     0      OK
+ */
+int
+device_handle_session_id_set(device_handle dh,
+                             uint32_t      id)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    cdh->cdh_session_id = id;
+    return 0;
+}
+
+/*! Get config drift of device, ie config changes made by others than the controller
+ *
+ * @param[in]  dh         Device handle
+ * @param[out] subscribed Subscribed to config change notifications (if not NULL)
+ * @param[out] drift      Device config changed since last sync (if not NULL)
+ * @param[out] changes    Number of config changes notified (if not NULL)
+ * @retval     0          OK
+ * @see drift-tracking in clixon-controller.yang
+ */
+int
+device_handle_drift_get(device_handle dh,
+                        int          *subscribed,
+                        int          *drift,
+                        uint32_t     *changes)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    if (subscribed)
+        *subscribed = cdh->cdh_drift_subscribed;
+    if (drift)
+        *drift = cdh->cdh_drift;
+    if (changes)
+        *changes = cdh->cdh_config_changes;
+    return 0;
+}
+
+/*! Set if device is subscribed to config change notifications
+ *
+ * @param[in]  dh         Device handle
+ * @param[in]  subscribed 0: not subscribed, 1: subscribed
+ * @retval     0          OK
+ */
+int
+device_handle_drift_subscribed_set(device_handle dh,
+                                   int           subscribed)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    cdh->cdh_drift_subscribed = subscribed;
+    return 0;
+}
+
+/*! Mark device config as changed by others, or as in sync
+ *
+ * @param[in]  dh     Device handle
+ * @param[in]  drift  1: config change notified, count it, 0: device config is synced
+ * @retval     0      OK
+ */
+int
+device_handle_drift_set(device_handle dh,
+                        int           drift)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    cdh->cdh_drift = drift;
+    if (drift)
+        cdh->cdh_config_changes++;
+    return 0;
+}
+
+/*! Access frame state get
+ *
+ * @param[in]  dh     Device handle
+ * @retval     state
+ */
+int
+device_handle_frame_state_get(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    return cdh->cdh_frame_state;
+}
+
+/*! Access state get
+ *
+ * @param[in]  dh     Device handle
+ * @retval     state  State
+ * @retval     0      OK
+ */
+int
+device_handle_frame_state_set(device_handle dh,
+                              int           state)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    cdh->cdh_frame_state = state;
+    return 0;
+}
+
+/*! Get Netconf frame size, part of dynamic framing detection
+ *
+ * @param[in]  dh    Device handle
+ * @retval     fs    Frame size
+ */
+size_t
+device_handle_frame_size_get(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    return cdh->cdh_frame_size;
+}
+
+/*! Set Netconf frame size, part of dynamic framing detection
+ *
+ * @param[in]  dh     Device handle
+ * @param[in]  size   Frame size
+ */
+int
+device_handle_frame_size_set(device_handle dh,
+                             size_t        size)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    cdh->cdh_frame_size = size;
+    return 0;
+}
+
+/*! Get Netconf framing type of device
+ *
+ * @param[in]  dh     Device handle
+ */
+cbuf *
+device_handle_frame_buf_get(device_handle dh)
 {
     struct controller_device_handle *cdh = devhandle(dh);
 
     return cdh->cdh_frame_buf;
 }
 
+/*! Reset frame buffer after a complete message has been parsed
+ *
+ * A large message, such as a full get-config reply, grows the buffer to the size of the
+ * message. Release such a buffer instead of keeping it for the lifetime of the device
+ * @param[in]  dh     Device handle
+ * @retval     0      OK
+ * @retval    -1      Error
+ * @see CONTROLLER_FRAME_BUF_KEEP
+ */
+int
+device_handle_frame_buf_reset(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+    cbuf                            *cb;
+
+    if (cbuf_buflen(cdh->cdh_frame_buf) > CONTROLLER_FRAME_BUF_KEEP){
+        if ((cb = cbuf_new()) == NULL){
+            clixon_err(OE_UNIX, errno, "cbuf_new");
+            return -1;
+        }
+        cbuf_free(cdh->cdh_frame_buf);
+        cdh->cdh_frame_buf = cb;
+    }
+    else
+        cbuf_reset(cdh->cdh_frame_buf);
+    return 0;
+}
+
+/*! Get socket read buffer of device, allocate with minimum size if not allocated
+ *
+ * @param[in]  dh     Device handle
+ * @param[out] len    Allocated length of buffer
+ * @retval     buf    Read buffer
+ * @retval     NULL   Error
+ * @see device_handle_read_buf_resize
+ */
+unsigned char *
+device_handle_read_buf_get(device_handle dh,
+                           size_t       *len)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    if (cdh->cdh_read_buf == NULL &&
+        device_handle_read_buf_resize(dh, CONTROLLER_READ_BUF_MIN) < 0)
+        return NULL;
+    *len = cdh->cdh_read_buflen;
+    return cdh->cdh_read_buf;
+}
+
+/*! Resize socket read buffer of device
+ *
+ * @param[in]  dh     Device handle
+ * @param[in]  len    New length, 0 frees buffer
+ * @retval     0      OK
+ * @retval    -1      Error
+ */
+int
+device_handle_read_buf_resize(device_handle dh,
+                              size_t        len)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+    unsigned char                   *buf;
+
+    if (len == 0){
+        if (cdh->cdh_read_buf)
+            free(cdh->cdh_read_buf);
+        cdh->cdh_read_buf = NULL;
+        cdh->cdh_read_buflen = 0;
+        cdh->cdh_read_idle = 0;
+        return 0;
+    }
+    if (len == cdh->cdh_read_buflen)
+        return 0;
+    if ((buf = realloc(cdh->cdh_read_buf, len)) == NULL){
+        clixon_err(OE_UNIX, errno, "realloc");
+        return -1;
+    }
+    cdh->cdh_read_buf = buf;
+    cdh->cdh_read_buflen = len;
+    return 0;
+}
+
+/*! Get number of consecutive drained input wakeups without a full read
+ *
+ * @param[in]  dh     Device handle
+ * @retval     idle   Number of wakeups
+ * @see device_input_cb
+ */
+int
+device_handle_read_idle_get(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    return cdh->cdh_read_idle;
+}
+
+/*! Set number of consecutive drained input wakeups without a full read
+ *
+ * @param[in]  dh     Device handle
+ * @param[in]  idle   Number of wakeups
+ * @retval     0      OK
+ */
+int
+device_handle_read_idle_set(device_handle dh,
+                            int           idle)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    cdh->cdh_read_idle = idle;
+    return 0;
+}
+
 /*! Set Netconf framing type of device
  *
  * @param[in]  dh   Device handle
@@ -953,9 +2028,18 @@ device_handle_yang_lib_set(device_handle dh,
     /* Sanity check */
     if (xylib)
         assert(xml_find_type(xylib, NULL, "module-set", CX_ELMNT));
+    /* Digest changes, remove from shared yspec index */
+    if (cdh->cdh_yang_lib_digest)
+        (void)device_shared_yspec_rm(cdh->cdh_h, dh);
     if (cdh->cdh_yang_lib != NULL)
         xml_free(cdh->cdh_yang_lib);
     cdh->cdh_yang_lib = xylib;
+    if (xylib)
+        cdh->cdh_caps_digest_valid = 0; /* Until marked good */
+    if (cdh->cdh_yang_lib_digest){
+        free(cdh->cdh_yang_lib_digest);
+        cdh->cdh_yang_lib_digest = NULL;
+    }
     return 0;
 }
 
@@ -987,6 +2071,12 @@ device_handle_yang_lib_append(device_handle dh,
             goto done;
         }
     }
+    cdh->cdh_caps_digest_valid = 0; /* Until marked good */
+    if (cdh->cdh_yang_lib_digest){
+        (void)device_shared_yspec_rm(cdh->cdh_h, dh);
+        free(cdh->cdh_yang_lib_digest);
+        cdh->cdh_yang_lib_digest = NULL;
+    }
     if (cdh->cdh_yang_lib) {
         if (xylib){
             if ((xms0 = xml_find_type(cdh->cdh_yang_lib, NULL, "module-set", CX_ELMNT)) == NULL){
@@ -1029,18 +2119,417 @@ device_handle_yang_lib_append(device_handle dh,
     return retval;
 }
 
-/*! Get nr of schemas
+/*! Get digest of RFC 8525 yang library, computed on first access
  *
+ * The digest is cached in the handle until the yang library is changed
  * @param[in]  dh     Device handle
- * @retval     nr
+ * @param[out] digest Digest string, or NULL if no yang library. Do not free
+ * @retval     0      OK
+ * @retval    -1      Error
+ * @see xyanglib_digest
  */
 int
-device_handle_nr_schemas_get(device_handle dh)
+device_handle_yang_lib_digest_get(device_handle dh,
+                                  char        **digest)
 {
+    int                              retval = -1;
     struct controller_device_handle *cdh = devhandle(dh);
 
-    return cdh->cdh_nr_schemas;
-}
+    if (cdh->cdh_yang_lib_digest == NULL && cdh->cdh_yang_lib != NULL){
+        if (xyanglib_digest(cdh->cdh_yang_lib, &cdh->cdh_yang_lib_digest) < 0)
+            goto done;
+    }
+    *digest = cdh->cdh_yang_lib_digest;
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Mark yang-lib as good for the current device capabilities
+ *
+ * Called when the device is open after schema discovery, the capabilities digest is compared
+ * on next connect, see device_handle_yang_lib_restore
+ * @param[in]  dh     Device handle
+ * @retval     0      OK
+ * @retval    -1      Error
+ */
+int
+device_handle_yang_lib_mark(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    cdh->cdh_caps_digest_valid = 0;
+    if (cdh->cdh_xcaps_good){
+        xml_free(cdh->cdh_xcaps_good);
+        cdh->cdh_xcaps_good = NULL;
+    }
+    if (cdh->cdh_xcaps == NULL || cdh->cdh_yang_lib == NULL)
+        return 0;
+    if (xml_config_digest(cdh->cdh_xcaps, &cdh->cdh_caps_digest) < 0)
+        return -1;
+    /* Digest match is confirmed on restore, see xml_config_digest */
+    if ((cdh->cdh_xcaps_good = xml_dup(cdh->cdh_xcaps)) == NULL)
+        return -1;
+    cdh->cdh_caps_digest_valid = 1;
+    return 0;
+}
+
+/*! Keep yang-lib and mount YANG spec over reconnect, or clear it if not marked good
+ *
+ * Call on connect instead of removing the device mount. If kept, the device mount is left in
+ * place, which keeps the mount YANG spec, until it is reused or the kept yang-lib is not
+ * restored. The device has no yang-lib after this call
+ * @param[in]  dh     Device handle
+ * @retval     1      Kept, leave the device mount
+ * @retval     0      Not kept, remove the device mount
+ * @retval    -1      Error
+ * @see device_handle_yang_lib_restore
+ */
+int
+device_handle_yang_lib_keep(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    /* Kept on a previous connect that did not reach hello */
+    if (cdh->cdh_yang_lib == NULL && cdh->cdh_yang_lib_last != NULL &&
+        cdh->cdh_yspec_last != NULL)
+        return 1;
+    if (cdh->cdh_yang_lib_last){
+        xml_free(cdh->cdh_yang_lib_last);
+        cdh->cdh_yang_lib_last = NULL;
+    }
+    cdh->cdh_yspec_last = NULL;
+    if (cdh->cdh_caps_digest_valid){
+        if (controller_mount_yspec_get(cdh->cdh_h, cdh->cdh_name, &cdh->cdh_yspec_last) < 0)
+            return -1;
+        if (cdh->cdh_yspec_last != NULL){
+            cdh->cdh_yang_lib_last = cdh->cdh_yang_lib;
+            cdh->cdh_yang_lib = NULL;
+        }
+    }
+    if (device_handle_yang_lib_set(dh, NULL) < 0)
+        return -1;
+    return cdh->cdh_yspec_last != NULL;
+}
+
+/*! Get mount YANG spec kept over reconnect
+ *
+ * @param[in]  dh     Device handle
+ * @retval     yspec  Kept mount YANG spec, still mounted on the device
+ * @retval     NULL   No kept mount YANG spec
+ * @see device_handle_yang_lib_keep
+ */
+yang_stmt *
+device_handle_yspec_last_get(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    return cdh->cdh_yspec_last;
+}
+
+/*! Release mount YANG spec kept over reconnect
+ *
+ * Called when the kept spec is reused by the device, or not restored. In the latter case the
+ * device mount left in place on connect is removed.
+ * @param[in]  dh      Device handle
+ * @param[in]  unmount If set, remove device mount from the kept spec
+ * @retval     0       OK
+ * @retval    -1       Error
+ * @see device_handle_yang_lib_keep
+ */
+int
+device_handle_yspec_last_release(device_handle dh,
+                                 int           unmount)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    if (cdh->cdh_yspec_last == NULL)
+        return 0;
+    cdh->cdh_yspec_last = NULL;
+    if (unmount)
+        return controller_mount_yspec_rm(cdh->cdh_h, cdh->cdh_name);
+    return 0;
+}
+
+/*! Restore kept yang-lib if device capabilities are unchanged since it was marked good
+ *
+ * The kept yang-lib is consumed in both cases. If not restored, the kept mount YANG spec is
+ * also released and unmounted, otherwise it is released by the caller when reused.
+ * @param[in]  dh     Device handle
+ * @retval     1      Restored, device yang-lib is set
+ * @retval     0      Not restored, no kept yang-lib or capabilities have changed
+ * @retval    -1      Error
+ * @see device_handle_yang_lib_keep
+ */
+int
+device_handle_yang_lib_restore(device_handle dh)
+{
+    int                              retval = -1;
+    struct controller_device_handle *cdh = devhandle(dh);
+    cxobj                           *xylib;
+    config_digest                    digest;
+
+    if ((xylib = cdh->cdh_yang_lib_last) == NULL)
+        goto fail;
+    cdh->cdh_yang_lib_last = NULL;
+    if (!cdh->cdh_caps_digest_valid || cdh->cdh_xcaps == NULL ||
+        cdh->cdh_yang_lib != NULL)
+        goto fail;
+    if (xml_config_digest(cdh->cdh_xcaps, &digest) < 0)
+        goto done;
+    if (!CONFIG_DIGEST_EQ(digest, cdh->cdh_caps_digest))
+        goto fail;
+    /* xml_tree_equal 0: Equal, 1: not equal */
+    if (cdh->cdh_xcaps_good == NULL || xml_tree_equal(cdh->cdh_xcaps, cdh->cdh_xcaps_good) != 0)
+        goto fail;
+    if (device_handle_yang_lib_set(dh, xylib) < 0)
+        goto done;
+    xylib = NULL;
+    cdh->cdh_caps_digest_valid = 1;
+    retval = 1;
+ done:
+    if (xylib)
+        xml_free(xylib);
+    return retval;
+ fail:
+    if (device_handle_yspec_last_release(dh, 1) < 0)
+        goto done;
+    retval = 0;
+    goto done;
+}
+
+/*! Get content digest of a device config datastore
+ *
+ * @param[in]  dh     Device handle
+ * @param[in]  dt     Device config type, DT_SYNCED or DT_TRANSIENT
+ * @param[out] digest Content digest (if retval = 1)
+ * @retval     1      OK, digest is set
+ * @retval     0      Digest not known, eg datastore not written since start
+ * @retval    -1      Error
+ * @see xml_config_digest
+ */
+int
+device_handle_config_digest_get(device_handle      dh,
+                                device_config_type dt,
+                                config_digest     *digest)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    switch (dt){
+    case DT_SYNCED:
+        *digest = cdh->cdh_synced_digest;
+        break;
+    case DT_TRANSIENT:
+        *digest = cdh->cdh_transient_digest;
+        break;
+    default:
+        clixon_err(OE_UNIX, EINVAL, "No digest for config type %s", device_config_type_int2str(dt));
+        return -1;
+    }
+    return (cdh->cdh_digest_valid & (1<<dt)) != 0;
+}
+
+/*! Set content digest of a device config datastore
+ *
+ * @param[in]  dh     Device handle
+ * @param[in]  dt     Device config type, DT_SYNCED or DT_TRANSIENT
+ * @param[in]  digest Content digest, or NULL to invalidate
+ * @retval     0      OK
+ * @retval    -1      Error
+ */
+int
+device_handle_config_digest_set(device_handle      dh,
+                                device_config_type dt,
+                                config_digest     *digest)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+    config_digest                   *dp;
+
+    switch (dt){
+    case DT_SYNCED:
+        dp = &cdh->cdh_synced_digest;
+        break;
+    case DT_TRANSIENT:
+        dp = &cdh->cdh_transient_digest;
+        break;
+    default:
+        clixon_err(OE_UNIX, EINVAL, "No digest for config type %s", device_config_type_int2str(dt));
+        return -1;
+    }
+    if (digest){
+        *dp = *digest;
+        cdh->cdh_digest_valid |= (1<<dt);
+    }
+    else{
+        memset(dp, 0, sizeof(*dp));
+        cdh->cdh_digest_valid &= ~(1<<dt);
+        if (dt == DT_SYNCED)
+            device_handle_synced_digests_set(dh, NULL);
+    }
+    return 0;
+}
+
+/*! Get subtree digests of SYNCED device config
+ *
+ * @param[in]  dh     Device handle
+ * @retval     cd     Config digests, take a reference with config_digests_ref to keep it
+ * @retval     NULL   Not known
+ */
+config_digests *
+device_handle_synced_digests_get(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    return cdh->cdh_synced_digests;
+}
+
+/*! Set subtree digests of SYNCED device config
+ *
+ * @param[in]  dh     Device handle
+ * @param[in]  cd     Computed config digests, consumed, or NULL to invalidate
+ * @retval     0      OK
+ */
+int
+device_handle_synced_digests_set(device_handle   dh,
+                                 config_digests *cd)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    if (cdh->cdh_synced_digests)
+        config_digests_free(cdh->cdh_synced_digests);
+    cdh->cdh_synced_digests = cd;
+    return 0;
+}
+
+/*! Get XPath of change indicator in device state
+ *
+ * @param[in]  dh     Device handle
+ * @retval     xpath  XPath, or NULL if not configured
+ * @see change-token in clixon-controller.yang
+ */
+char *
+device_handle_change_token_xpath_get(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    return cdh->cdh_change_token_xpath;
+}
+
+/*! Set XPath of change indicator in device state
+ *
+ * Clears change tokens of previous xpath
+ * @param[in]  dh     Device handle
+ * @param[in]  xpath  XPath, or NULL, is copied
+ * @retval     0      OK
+ * @retval    -1      Error
+ */
+int
+device_handle_change_token_xpath_set(device_handle dh,
+                                     const char   *xpath)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    if (cdh->cdh_change_token_xpath){
+        if (xpath && strcmp(cdh->cdh_change_token_xpath, xpath) == 0)
+            return 0;
+        free(cdh->cdh_change_token_xpath);
+        cdh->cdh_change_token_xpath = NULL;
+    }
+    if (xpath && (cdh->cdh_change_token_xpath = strdup(xpath)) == NULL){
+        clixon_err(OE_UNIX, errno, "strdup");
+        return -1;
+    }
+    device_handle_change_token_set(dh, DT_SYNCED, NULL);
+    device_handle_change_token_set(dh, DT_TRANSIENT, NULL);
+    return 0;
+}
+
+/*! Get change token of device config
+ *
+ * @param[in]  dh     Device handle
+ * @param[in]  dt     Device config type, DT_SYNCED or DT_TRANSIENT
+ * @retval     token  Change token, or NULL if not known
+ */
+char *
+device_handle_change_token_get(device_handle      dh,
+                               device_config_type dt)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    switch (dt){
+    case DT_SYNCED:
+        return cdh->cdh_synced_token;
+    case DT_TRANSIENT:
+        return cdh->cdh_transient_token;
+    default:
+        return NULL;
+    }
+}
+
+/*! Set change token of device config
+ *
+ * @param[in]  dh     Device handle
+ * @param[in]  dt     Device config type, DT_SYNCED or DT_TRANSIENT
+ * @param[in]  token  Change token, or NULL, is consumed
+ * @retval     0      OK
+ * @retval    -1      Error
+ */
+int
+device_handle_change_token_set(device_handle      dh,
+                               device_config_type dt,
+                               char              *token)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+    char                           **tp;
+
+    switch (dt){
+    case DT_SYNCED:
+        tp = &cdh->cdh_synced_token;
+        break;
+    case DT_TRANSIENT:
+        tp = &cdh->cdh_transient_token;
+        break;
+    default:
+        clixon_err(OE_UNIX, EINVAL, "No change token for config type %s", device_config_type_int2str(dt));
+        if (token)
+            free(token);
+        return -1;
+    }
+    if (*tp)
+        free(*tp);
+    *tp = token;
+    return 0;
+}
+
+/*! Change token of last pull becomes token of SYNCED, when SYNCED is written from device config
+ *
+ * @param[in]  dh     Device handle
+ * @retval     0      OK
+ */
+int
+device_handle_change_token_sync(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    if (cdh->cdh_synced_token)
+        free(cdh->cdh_synced_token);
+    cdh->cdh_synced_token = cdh->cdh_transient_token;
+    cdh->cdh_transient_token = NULL;
+    return 0;
+}
+
+/*! Get nr of schemas
+ *
+ * @param[in]  dh     Device handle
+ * @retval     nr
+ */
+int
+device_handle_nr_schemas_get(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    return cdh->cdh_nr_schemas;
+}
 
 /*! Set nr of schemas
  *
@@ -1057,68 +2546,817 @@ device_handle_nr_schemas_set(device_handle dh,
     return 0;
 }
 
-/*! Get pending schema name, strdup
+/*! Add outstanding get-schema request
  *
- * @param[in]  dh     Device handle
- * @retval     schema-name
- * @retval     NULL
+ * @param[in]  dh      Device handle
+ * @param[in]  wait    If set, request not sent, wait for other device fetching same schema
+ * @param[in]  msg_id  Message-id of get-schema request (if not wait)
+ * @param[in]  name    Schema name, is copied
+ * @param[in]  rev     Schema revision, is copied, may be NULL
+ * @retval     0       OK
+ * @retval    -1       Error
+ * @see device_handle_schema_pending_find
  */
-char*
-device_handle_schema_name_get(device_handle dh)
+int
+device_handle_schema_pending_add(device_handle dh,
+                                 int           wait,
+                                 uint64_t      msg_id,
+                                 char         *name,
+                                 char         *rev)
 {
+    int                              retval = -1;
     struct controller_device_handle *cdh = devhandle(dh);
+    struct schema_pending           *sp = NULL;
 
-    return cdh->cdh_schema_name;
+    if ((sp = malloc(sizeof(*sp))) == NULL){
+        clixon_err(OE_UNIX, errno, "malloc");
+        goto done;
+    }
+    memset(sp, 0, sizeof(*sp));
+    sp->sp_wait = wait;
+    sp->sp_msg_id = msg_id;
+    if ((sp->sp_name = strdup(name)) == NULL){
+        clixon_err(OE_UNIX, errno, "strdup");
+        goto done;
+    }
+    if (rev && (sp->sp_rev = strdup(rev)) == NULL){
+        clixon_err(OE_UNIX, errno, "strdup");
+        goto done;
+    }
+    ADDQ(sp, cdh->cdh_schema_pending);
+    cdh->cdh_schema_pending_nr++;
+    if (wait)
+        cdh->cdh_schema_wait_nr++;
+    sp = NULL;
+    retval = 0;
+ done:
+    if (sp){
+        if (sp->sp_name)
+            free(sp->sp_name);
+        free(sp);
+    }
+    return retval;
 }
 
-/*! Set pending schema name, strdup
+/*! Find outstanding get-schema request given message-id
  *
- * @param[in]  dh     Device handle
- * @param[in]  schema-name Is copied
+ * @param[in]  dh      Device handle
+ * @param[in]  msg_id  Message-id of get-schema reply
+ * @param[out] name    Schema name, direct pointer into struct
+ * @param[out] rev     Schema revision, direct pointer into struct (may be NULL)
+ * @retval     1       Found
+ * @retval     0       Not found
+ */
+int
+device_handle_schema_pending_find(device_handle dh,
+                                  uint64_t      msg_id,
+                                  char        **name,
+                                  char        **rev)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+    struct schema_pending           *sp;
+
+    if ((sp = cdh->cdh_schema_pending) != NULL) {
+        do {
+            if (!sp->sp_wait && sp->sp_msg_id == msg_id){
+                if (name)
+                    *name = sp->sp_name;
+                if (rev)
+                    *rev = sp->sp_rev;
+                return 1;
+            }
+            sp = NEXTQ(struct schema_pending *, sp);
+        } while (sp && sp != cdh->cdh_schema_pending);
+    }
+    return 0;
+}
+
+/*! Get message-id of oldest outstanding get-schema request
+ *
+ * @param[in]  dh      Device handle
+ * @param[out] msg_id  Message-id of request
+ * @retval     1       Found
+ * @retval     0       No outstanding requests
  */
 int
-device_handle_schema_name_set(device_handle dh,
-                              char        *schema_name)
+device_handle_schema_pending_first(device_handle dh,
+                                   uint64_t     *msg_id)
 {
     struct controller_device_handle *cdh = devhandle(dh);
+    struct schema_pending           *sp;
 
-    if (cdh->cdh_schema_name)
-        free(cdh->cdh_schema_name);
-    cdh->cdh_schema_name = strdup(schema_name);
+    if ((sp = cdh->cdh_schema_pending) != NULL) {
+        do {
+            if (!sp->sp_wait){
+                *msg_id = sp->sp_msg_id;
+                return 1;
+            }
+            sp = NEXTQ(struct schema_pending *, sp);
+        } while (sp && sp != cdh->cdh_schema_pending);
+    }
     return 0;
 }
 
-/*! Get pending schema rev, strdup
+/*! Remove outstanding get-schema request given message-id
  *
- * @param[in]  dh     Device handle
- * @retval     schema-rev
- * @retval     NULL
+ * @param[in]  dh      Device handle
+ * @param[in]  msg_id  Message-id of get-schema request
+ * @retval     0       OK
  */
-char*
-device_handle_schema_rev_get(device_handle dh)
+int
+device_handle_schema_pending_rm(device_handle dh,
+                                uint64_t      msg_id)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+    struct schema_pending           *sp;
+
+    if ((sp = cdh->cdh_schema_pending) != NULL) {
+        do {
+            if (!sp->sp_wait && sp->sp_msg_id == msg_id){
+                DELQ(sp, cdh->cdh_schema_pending, struct schema_pending *);
+                cdh->cdh_schema_pending_nr--;
+                free(sp->sp_name);
+                if (sp->sp_rev)
+                    free(sp->sp_rev);
+                free(sp);
+                break;
+            }
+            sp = NEXTQ(struct schema_pending *, sp);
+        } while (sp && sp != cdh->cdh_schema_pending);
+    }
+    return 0;
+}
+
+/*! Find get-schema entry waiting for other device given schema name and revision
+ *
+ * @param[in]  cdh     Controller device handle
+ * @param[in]  name    Schema name
+ * @param[in]  rev     Schema revision, or NULL
+ * @retval     sp      Waiting entry
+ * @retval     NULL    Not found
+ */
+static struct schema_pending *
+device_handle_schema_wait_find(struct controller_device_handle *cdh,
+                               char                            *name,
+                               char                            *rev)
+{
+    struct schema_pending *sp;
+
+    if ((sp = cdh->cdh_schema_pending) != NULL) {
+        do {
+            if (sp->sp_wait &&
+                strcmp(sp->sp_name, name) == 0 &&
+                clicon_strcmp(sp->sp_rev, rev) == 0)
+                return sp;
+            sp = NEXTQ(struct schema_pending *, sp);
+        } while (sp && sp != cdh->cdh_schema_pending);
+    }
+    return NULL;
+}
+
+/*! Remove get-schema entry waiting for other device given schema name and revision
+ *
+ * @param[in]  dh      Device handle
+ * @param[in]  name    Schema name
+ * @param[in]  rev     Schema revision, or NULL
+ * @retval     1       Found and removed
+ * @retval     0       No such waiting entry
+ */
+int
+device_handle_schema_wait_rm(device_handle dh,
+                             char         *name,
+                             char         *rev)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+    struct schema_pending           *sp;
+
+    if ((sp = device_handle_schema_wait_find(cdh, name, rev)) == NULL)
+        return 0;
+    DELQ(sp, cdh->cdh_schema_pending, struct schema_pending *);
+    cdh->cdh_schema_pending_nr--;
+    cdh->cdh_schema_wait_nr--;
+    free(sp->sp_name);
+    if (sp->sp_rev)
+        free(sp->sp_rev);
+    free(sp);
+    return 1;
+}
+
+/*! Remove all outstanding get-schema requests
+ *
+ * @param[in]  dh      Device handle
+ * @retval     0       OK
+ */
+int
+device_handle_schema_pending_clear(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+    struct schema_pending           *sp;
+
+    while ((sp = cdh->cdh_schema_pending) != NULL) {
+        DELQ(sp, cdh->cdh_schema_pending, struct schema_pending *);
+        free(sp->sp_name);
+        if (sp->sp_rev)
+            free(sp->sp_rev);
+        free(sp);
+    }
+    cdh->cdh_schema_pending_nr = 0;
+    cdh->cdh_schema_wait_nr = 0;
+    return 0;
+}
+
+/*! Add outstanding pipelined request last
+ *
+ * @param[in]  dh      Device handle
+ * @param[in]  msg_id  Message-id of sent request
+ * @param[in]  state   Connection state handling the reply
+ * @retval     0       OK
+ * @retval    -1       Error
+ */
+int
+device_handle_pipeline_add(device_handle dh,
+                           uint64_t      msg_id,
+                           conn_state    state)
+{
+    int                              retval = -1;
+    struct controller_device_handle *cdh = devhandle(dh);
+    struct pipeline_request         *pr;
+
+    if ((pr = malloc(sizeof(*pr))) == NULL){
+        clixon_err(OE_UNIX, errno, "malloc");
+        goto done;
+    }
+    memset(pr, 0, sizeof(*pr));
+    pr->pr_msg_id = msg_id;
+    pr->pr_state = state;
+    ADDQ(pr, cdh->cdh_pipeline);
+    cdh->cdh_pipeline_nr++;
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Get oldest outstanding pipelined request
+ *
+ * @param[in]  dh      Device handle
+ * @param[out] msg_id  Message-id of request
+ * @param[out] state   Connection state handling the reply
+ * @param[out] skip    If set, drop the reply
+ * @retval     1       Found
+ * @retval     0       No outstanding request
+ */
+int
+device_handle_pipeline_first(device_handle dh,
+                             uint64_t     *msg_id,
+                             conn_state   *state,
+                             int          *skip)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+    struct pipeline_request         *pr;
+
+    if ((pr = cdh->cdh_pipeline) == NULL)
+        return 0;
+    if (msg_id)
+        *msg_id = pr->pr_msg_id;
+    if (state)
+        *state = pr->pr_state;
+    if (skip)
+        *skip = pr->pr_skip;
+    return 1;
+}
+
+/*! Remove oldest outstanding pipelined request
+ *
+ * @param[in]  dh      Device handle
+ * @retval     0       OK
+ */
+int
+device_handle_pipeline_rm(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+    struct pipeline_request         *pr;
+
+    if ((pr = cdh->cdh_pipeline) != NULL){
+        DELQ(pr, cdh->cdh_pipeline, struct pipeline_request *);
+        free(pr);
+        cdh->cdh_pipeline_nr--;
+    }
+    return 0;
+}
+
+/*! Mark all outstanding pipelined requests so that their replies are dropped
+ *
+ * Used when a request fails and later requests are already sent
+ * @param[in]  dh      Device handle
+ * @retval     0       OK
+ */
+int
+device_handle_pipeline_skip(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+    struct pipeline_request         *pr;
+
+    if ((pr = cdh->cdh_pipeline) != NULL){
+        do {
+            pr->pr_skip = 1;
+            pr = NEXTQ(struct pipeline_request *, pr);
+        } while (pr && pr != cdh->cdh_pipeline);
+    }
+    return 0;
+}
+
+/*! Remove all outstanding pipelined requests
+ *
+ * @param[in]  dh      Device handle
+ * @retval     0       OK
+ */
+int
+device_handle_pipeline_clear(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    while (cdh->cdh_pipeline != NULL)
+        device_handle_pipeline_rm(dh);
+    return 0;
+}
+
+/*! Get number of outstanding pipelined requests
+ *
+ * @param[in]  dh      Device handle
+ * @retval     nr      Number of outstanding pipelined requests
+ */
+int
+device_handle_pipeline_nr(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    return cdh->cdh_pipeline_nr;
+}
+
+/*! Find dispatched request given message-id
+ */
+static struct dispatch_request *
+dispatch_find(struct controller_device_handle *cdh,
+              uint64_t                         msg_id)
+{
+    struct dispatch_request *dr;
+
+    if ((dr = cdh->cdh_dispatch) != NULL){
+        do {
+            if (dr->dr_msg_id == msg_id)
+                return dr;
+            dr = NEXTQ(struct dispatch_request *, dr);
+        } while (dr && dr != cdh->cdh_dispatch);
+    }
+    return NULL;
+}
+
+/*! Remember message-id of expired request, so that a late reply is dropped
+ *
+ * The oldest is forgotten if DISPATCH_EXPIRED_MAX are remembered
+ */
+static void
+dispatch_expired_add(struct controller_device_handle *cdh,
+                     uint64_t                         msg_id)
+{
+    if (cdh->cdh_dispatch_expired_nr == DISPATCH_EXPIRED_MAX){
+        memmove(&cdh->cdh_dispatch_expired[0], &cdh->cdh_dispatch_expired[1],
+                (DISPATCH_EXPIRED_MAX-1)*sizeof(uint64_t));
+        cdh->cdh_dispatch_expired_nr--;
+    }
+    cdh->cdh_dispatch_expired[cdh->cdh_dispatch_expired_nr++] = msg_id;
+}
+
+/*! Forget message-id of expired request
+ *
+ * @retval     1      Found and forgotten
+ * @retval     0      Not found
+ */
+static int
+dispatch_expired_rm(struct controller_device_handle *cdh,
+                    uint64_t                         msg_id)
+{
+    int i;
+
+    for (i=0; i<cdh->cdh_dispatch_expired_nr; i++)
+        if (cdh->cdh_dispatch_expired[i] == msg_id){
+            memmove(&cdh->cdh_dispatch_expired[i], &cdh->cdh_dispatch_expired[i+1],
+                    (cdh->cdh_dispatch_expired_nr-i-1)*sizeof(uint64_t));
+            cdh->cdh_dispatch_expired_nr--;
+            return 1;
+        }
+    return 0;
+}
+
+/*! Remove and free dispatched request, cancel its timeout
+ */
+static int
+dispatch_rm(struct controller_device_handle *cdh,
+            struct dispatch_request         *dr)
+{
+    (void)controller_timer_cancel(cdh->cdh_h, &dr->dr_timer);
+    DELQ(dr, cdh->cdh_dispatch, struct dispatch_request *);
+    free(dr);
+    cdh->cdh_dispatch_nr--;
+    return 0;
+}
+
+/*! Timeout of dispatched request, remove it and call continuation without reply
+ *
+ * Its message-id is remembered so that a late reply is dropped
+ * @param[in]  h      Clixon handle
+ * @param[in]  arg    Dispatched request
+ * @retval     0      OK
+ * @retval    -1      Error
+ */
+static int
+device_handle_dispatch_timeout(clixon_handle h,
+                               void         *arg)
+{
+    struct dispatch_request         *dr = (struct dispatch_request *)arg;
+    device_handle                    dh = dr->dr_dh;
+    struct controller_device_handle *cdh = devhandle(dh);
+    device_reply_cb                 *fn;
+    void                            *fnarg;
+
+    clixon_debug(CLIXON_DBG_CTRL, "%s: timeout of message-id %" PRIu64,
+                 cdh->cdh_name, dr->dr_msg_id);
+    fn = dr->dr_fn;
+    fnarg = dr->dr_arg;
+    dispatch_expired_add(cdh, dr->dr_msg_id);
+    dispatch_rm(cdh, dr);
+    return fn(h, dh, NULL, fnarg);
+}
+
+/*! Call continuation of deferred request without reply, called from the event loop
+ *
+ * The device handle is found again by name, and is NULL if the device has been removed
+ * @param[in]  h      Clixon handle
+ * @param[in]  arg    Deferred request
+ * @retval     0      OK
+ * @retval    -1      Error
+ * @see dispatch_defer
+ */
+static int
+dispatch_deferred_call(clixon_handle h,
+                       void         *arg)
+{
+    struct dispatch_request *dr = (struct dispatch_request *)arg;
+    struct dispatch_request *deferred = NULL;
+    device_reply_cb         *fn;
+    void                    *fnarg;
+    device_handle            dh;
+
+    (void)controller_timer_cancel(h, &dr->dr_timer);
+    clicon_ptr_get(h, "controller-dispatch-deferred", (void**)&deferred);
+    DELQ(dr, deferred, struct dispatch_request *);
+    clicon_ptr_set(h, "controller-dispatch-deferred", (void*)deferred);
+    fn = dr->dr_fn;
+    fnarg = dr->dr_arg;
+    dh = device_handle_find(h, dr->dr_name);
+    free(dr->dr_name);
+    free(dr);
+    return fn(h, dh, NULL, fnarg);
+}
+
+/*! Move dispatched request of a closed device to the deferred list
+ *
+ * Its continuation is called from the event loop and not from within the close, since
+ * the caller of the close may still use the device and its transaction
+ * @param[in]  cdh    Device handle
+ * @param[in]  dr     Dispatched request
+ * @retval     0      OK
+ * @retval    -1      Error
+ */
+static int
+dispatch_defer(struct controller_device_handle *cdh,
+               struct dispatch_request         *dr)
+{
+    clixon_handle            h = cdh->cdh_h;
+    struct dispatch_request *deferred = NULL;
+    struct timeval           t;
+
+    (void)controller_timer_cancel(h, &dr->dr_timer);
+    DELQ(dr, cdh->cdh_dispatch, struct dispatch_request *);
+    cdh->cdh_dispatch_nr--;
+    if ((dr->dr_name = strdup(cdh->cdh_name)) == NULL){
+        clixon_err(OE_UNIX, errno, "strdup");
+        free(dr);
+        return -1;
+    }
+    dr->dr_dh = NULL;
+    clicon_ptr_get(h, "controller-dispatch-deferred", (void**)&deferred);
+    ADDQ(dr, deferred);
+    clicon_ptr_set(h, "controller-dispatch-deferred", (void*)deferred);
+    gettimeofday(&t, NULL);
+    return controller_timer_set(h, &dr->dr_timer, &t, dispatch_deferred_call, dr);
+}
+
+/*! Add request dispatched by message-id, its reply bypasses the device state machine
+ *
+ * Several such requests can be outstanding on the same session, also while the device is
+ * in a push or other transaction.
+ * The continuation is called exactly once: with the reply, or with NULL on timeout or close.
+ * On close it is called from the event loop, with a NULL device handle if the device has
+ * been removed.
+ * @param[in]  dh      Device handle
+ * @param[in]  msg_id  Message-id of sent request
+ * @param[in]  fn      Continuation
+ * @param[in]  arg     Argument to continuation, owned by the continuation
+ * @param[in]  timeout Timeout in seconds
+ * @retval     0       OK
+ * @retval    -1       Error
+ * @see device_handle_dispatch
+ */
+int
+device_handle_dispatch_add(device_handle    dh,
+                           uint64_t         msg_id,
+                           device_reply_cb *fn,
+                           void            *arg,
+                           int              timeout)
+{
+    int                              retval = -1;
+    struct controller_device_handle *cdh = devhandle(dh);
+    struct dispatch_request         *dr;
+    struct timeval                   t;
+    struct timeval                   t1;
+
+    if ((dr = malloc(sizeof(*dr))) == NULL){
+        clixon_err(OE_UNIX, errno, "malloc");
+        goto done;
+    }
+    memset(dr, 0, sizeof(*dr));
+    dr->dr_msg_id = msg_id;
+    dr->dr_fn = fn;
+    dr->dr_arg = arg;
+    dr->dr_dh = dh;
+    ADDQ(dr, cdh->cdh_dispatch);
+    cdh->cdh_dispatch_nr++;
+    gettimeofday(&t, NULL);
+    t1.tv_sec = timeout;
+    t1.tv_usec = 0;
+    timeradd(&t, &t1, &t);
+    if (controller_timer_set(cdh->cdh_h, &dr->dr_timer, &t, device_handle_dispatch_timeout, dr) < 0)
+        goto done;
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Dispatch reply to continuation of outstanding request with same message-id
+ *
+ * @param[in]  dh      Device handle
+ * @param[in]  xmsg    Reply message
+ * @retval     1       Reply dispatched, or dropped if request expired
+ * @retval     0       No such request, handle reply by state machine
+ * @retval    -1       Error
+ */
+int
+device_handle_dispatch(device_handle dh,
+                       cxobj        *xmsg)
+{
+    int                              retval = -1;
+    struct controller_device_handle *cdh = devhandle(dh);
+    struct dispatch_request         *dr;
+    device_reply_cb                 *fn;
+    void                            *arg;
+    char                            *msgidstr;
+    uint64_t                         msgid;
+    int                              ret;
+
+    if ((cdh->cdh_dispatch == NULL && cdh->cdh_dispatch_expired_nr == 0) ||
+        (msgidstr = xml_find_value(xmsg, "message-id")) == NULL)
+        goto notfound;
+    if ((ret = parse_uint64(msgidstr, &msgid, NULL)) < 0)
+        goto done;
+    if (ret == 0)
+        goto notfound;
+    if ((dr = dispatch_find(cdh, msgid)) == NULL){
+        if (dispatch_expired_rm(cdh, msgid) == 0)
+            goto notfound;
+        clixon_debug(CLIXON_DBG_CTRL, "%s: late reply of message-id %" PRIu64 " dropped",
+                     cdh->cdh_name, msgid);
+        goto ok;
+    }
+    fn = dr->dr_fn;
+    arg = dr->dr_arg;
+    dispatch_rm(cdh, dr);
+    if (fn(cdh->cdh_h, dh, xmsg, arg) < 0)
+        goto done;
+ ok:
+    retval = 1;
+ done:
+    return retval;
+ notfound:
+    retval = 0;
+    goto done;
+}
+
+/*! Remove all dispatched requests of device, their continuations are deferred
+ *
+ * Called when the device is closed or freed. The continuations are called without reply
+ * from the event loop
+ * @param[in]  dh      Device handle
+ * @retval     0       OK
+ * @retval    -1       Error
+ * @see dispatch_defer
+ */
+int
+device_handle_dispatch_clear(device_handle dh)
+{
+    int                              retval = 0;
+    struct controller_device_handle *cdh = devhandle(dh);
+    struct dispatch_request         *dr;
+
+    while ((dr = cdh->cdh_dispatch) != NULL)
+        if (dispatch_defer(cdh, dr) < 0)
+            retval = -1;
+    cdh->cdh_dispatch_expired_nr = 0;
+    return retval;
+}
+
+/*! Call deferred continuations of dispatched requests now, eg on exit
+ *
+ * @param[in]  h       Clixon handle
+ * @retval     0       OK
+ * @retval    -1       Error
+ */
+int
+device_handle_dispatch_flush(clixon_handle h)
+{
+    int                      retval = 0;
+    struct dispatch_request *deferred = NULL;
+
+    while (clicon_ptr_get(h, "controller-dispatch-deferred", (void**)&deferred) == 0 &&
+           deferred != NULL)
+        if (dispatch_deferred_call(h, deferred) < 0)
+            retval = -1;
+    return retval;
+}
+
+/*! Get number of outstanding dispatched requests
+ *
+ * @param[in]  dh      Device handle
+ * @retval     nr      Number of outstanding dispatched requests, including expired
+ */
+int
+device_handle_dispatch_nr(device_handle dh)
 {
     struct controller_device_handle *cdh = devhandle(dh);
 
-    return cdh->cdh_schema_rev;
+    return cdh->cdh_dispatch_nr + cdh->cdh_dispatch_expired_nr;
 }
 
-/*! Set pending schema rev, strdup
+/*! Get number of outstanding get-schema requests
  *
  * @param[in]  dh     Device handle
- * @param[in]  schema-rev Is copied
+ * @param[in]  sent   0: All, 1: Only sent requests, ie excluding entries waiting for other devices
+ * @retval     nr     Number of outstanding get-schema requests
+ */
+int
+device_handle_schema_pending_nr(device_handle dh,
+                                int           sent)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    if (sent)
+        return cdh->cdh_schema_pending_nr - cdh->cdh_schema_wait_nr;
+    return cdh->cdh_schema_pending_nr;
+}
+
+/*! Append framed message to output queue of device
+ *
+ * @param[in]  dh    Device handle
+ * @param[in]  buf   Data
+ * @param[in]  len   Length of data
+ * @retval     0     OK
+ * @retval    -1     Error
+ * @see device_handle_outq_flush to write the queue
+ */
+int
+device_handle_outq_append(device_handle dh,
+                          const char   *buf,
+                          size_t        len)
+{
+    int                              retval = -1;
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    if (cdh->cdh_outq == NULL &&
+        (cdh->cdh_outq = cbuf_new()) == NULL){
+        clixon_err(OE_UNIX, errno, "cbuf_new");
+        goto done;
+    }
+    if (cbuf_append_buf(cdh->cdh_outq, (void*)buf, len) < 0){
+        clixon_err(OE_UNIX, errno, "cbuf_append_buf");
+        goto done;
+    }
+    device_handle_outq_count(cdh->cdh_h, len);
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Write output queue of device to its socket without blocking
+ *
+ * A device with remaining output is linked in the list of devices with pending output.
+ * If the device has closed its end, the output is dropped and the close is detected as
+ * EOF on input. On other write errors the output is dropped and the socket is shut down,
+ * so that the device is closed on EOF on input, not the caller.
+ * @param[in]  dh    Device handle
+ * @retval     1     All output written
+ * @retval     0     Output remains, socket is full
+ * @retval    -1     Error
  */
 int
-device_handle_schema_rev_set(device_handle dh,
-                             char        *schema_rev)
+device_handle_outq_flush(device_handle dh)
 {
+    int                              retval = -1;
     struct controller_device_handle *cdh = devhandle(dh);
+    char                            *buf;
+    size_t                           len;
+    ssize_t                          n;
+    int                              dontwait = 1;
+
+    if (cdh->cdh_outq == NULL)
+        goto drained;
+    buf = cbuf_get(cdh->cdh_outq);
+    len = cbuf_len(cdh->cdh_outq);
+    while (cdh->cdh_outq_off < len && cdh->cdh_socket != -1){
+        if (dontwait)
+            n = send(cdh->cdh_socket, buf + cdh->cdh_outq_off, len - cdh->cdh_outq_off,
+                     MSG_DONTWAIT | MSG_NOSIGNAL);
+        else
+            n = write(cdh->cdh_socket, buf + cdh->cdh_outq_off, len - cdh->cdh_outq_off);
+        if (n < 0){
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK){
+                if (device_handle_outq_link(cdh->cdh_h, cdh) < 0)
+                    goto done;
+                retval = 0;
+                goto done;
+            }
+            if (errno == ENOTSOCK && dontwait){ /* Not a socket, fall back to blocking write */
+                dontwait = 0;
+                continue;
+            }
+            if (errno == EPIPE || errno == ECONNRESET){
+                clixon_debug(CLIXON_DBG_MSG, "%s: closed by device, output dropped", cdh->cdh_name);
+                break;
+            }
+            clixon_log(cdh->cdh_h, LOG_WARNING, "%s: write to device failed: %s, output dropped",
+                       cdh->cdh_name, strerror(errno));
+            (void)shutdown(cdh->cdh_socket, SHUT_RDWR);
+            break;
+        }
+        cdh->cdh_outq_off += n;
+        device_handle_outq_count(cdh->cdh_h, -n);
+    }
+    device_handle_outq_clear(dh);
+ drained:
+    retval = 1;
+ done:
+    return retval;
+}
 
-    if (cdh->cdh_schema_rev){
-        free(cdh->cdh_schema_rev);
-        cdh->cdh_schema_rev = NULL;
+/*! Get number of bytes in output queue of device not yet written
+ *
+ * @param[in]  dh    Device handle
+ * @retval     len   Bytes not yet written
+ */
+size_t
+device_handle_outq_len(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    if (cdh->cdh_outq == NULL)
+        return 0;
+    return cbuf_len(cdh->cdh_outq) - cdh->cdh_outq_off;
+}
+
+/*! Drop output queue of device, eg on close
+ *
+ * A large buffer is freed, otherwise it is kept for the next message
+ * @param[in]  dh    Device handle
+ * @retval     0     OK
+ * @see CONTROLLER_FRAME_BUF_KEEP
+ */
+int
+device_handle_outq_clear(device_handle dh)
+{
+    struct controller_device_handle *cdh = devhandle(dh);
+
+    device_handle_outq_unlink(cdh->cdh_h, cdh);
+    if (cdh->cdh_outq){
+        device_handle_outq_count(cdh->cdh_h, -(ssize_t)(cbuf_len(cdh->cdh_outq) - cdh->cdh_outq_off));
+        if (cbuf_buflen(cdh->cdh_outq) > CONTROLLER_FRAME_BUF_KEEP){
+            cbuf_free(cdh->cdh_outq);
+            cdh->cdh_outq = NULL;
+        }
+        else
+            cbuf_reset(cdh->cdh_outq);
     }
-    if (schema_rev)
-        cdh->cdh_schema_rev = strdup(schema_rev);
+    cdh->cdh_outq_off = 0;
     return 0;
 }
 
@@ -1270,14 +3508,20 @@ device_handle_stats(clixon_handle  h,
                 sz += strlen(cdh->cdh_name)+1;
             if (cdh->cdh_frame_buf)
                 sz += cbuf_buflen(cdh->cdh_frame_buf);
+            if (cdh->cdh_outq)
+                sz += cbuf_buflen(cdh->cdh_outq);
+            sz += cdh->cdh_read_buflen;
             if (cdh->cdh_xcaps)
                 xml_stats(cdh->cdh_xcaps, XML_STATS_ALL, NULL, &sz);
             if (cdh->cdh_yang_lib)
                 xml_stats(cdh->cdh_yang_lib, XML_STATS_ALL, NULL, &sz);
-            if (cdh->cdh_schema_name)
-                sz += strlen(cdh->cdh_schema_name)+1;
-            if (cdh->cdh_schema_rev)
-                sz += strlen(cdh->cdh_schema_rev)+1;
+            if (cdh->cdh_yang_lib_digest)
+                sz += strlen(cdh->cdh_yang_lib_digest)+1;
+            if (cdh->cdh_yang_lib_last)
+                xml_stats(cdh->cdh_yang_lib_last, XML_STATS_ALL, NULL, &sz);
+            sz += cdh->cdh_schema_pending_nr*sizeof(struct schema_pending);
+            if (cdh->cdh_latency)
+                sz += CS_NR*sizeof(struct device_latency);
             if (cdh->cdh_logmsg)
                 sz += strlen(cdh->cdh_logmsg)+1;
             if (cdh->cdh_domain)
@@ -1286,6 +3530,10 @@ device_handle_stats(clixon_handle  h,
                 sz += cbuf_buflen(cdh->cdh_outmsg1);
             if (cdh->cdh_outmsg2)
                 sz += cbuf_buflen(cdh->cdh_outmsg2);
+            if (cdh->cdh_conn_dest)
+                sz += strlen(cdh->cdh_conn_dest)+1;
+            if (cdh->cdh_conn_port)
+                sz += strlen(cdh->cdh_conn_port)+1;
             cdh = NEXTQ(struct controller_device_handle *, cdh);
         } while (cdh && cdh != cdh_list);
     if (nrp)
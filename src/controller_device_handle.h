@@ -45,6 +45,9 @@
 #define DH_FLAG_NETCONF_BASE10    0x02 /* Configured NETCONF base10 (eom) announcement */
 #define DH_FLAG_NETCONF_BASE11    0x04 /* Configured NETCONF base11 (chunked) announcement */
 #define DH_FLAG_YANG_ANNOUNCE_LATEST 0x08 /* If device announces multiple YANGs, 0: use earliest revision, 1: use latest */
+#define DH_FLAG_SYNC_CHECK        0x10 /* Background sync-check get-config outstanding */
+#define DH_FLAG_IO_WORKER         0x20 /* Device input is read by an io worker thread */
+#define DH_FLAG_PUSH_HELD         0x40 /* Push edit-config held back by output-queue-limit */
 
 /*
  * Types
@@ -52,6 +55,20 @@
 /* Abstract device handle, see struct controller_device_handle for concrete struct */
 typedef void *device_handle;
 
+struct controller_transaction_t; /* Forward declaration, see controller_transaction.h */
+struct controller_timer;         /* Forward declaration, see controller_timer.h */
+
+/*! Continuation of a request dispatched by message-id
+ *
+ * @param[in]  h     Clixon handle
+ * @param[in]  dh    Device handle, or NULL if the device has been removed after close
+ * @param[in]  xmsg  Reply message, or NULL on timeout or close
+ * @param[in]  arg   Argument given to device_handle_dispatch_add
+ * @retval     0     OK
+ * @retval    -1     Error
+ */
+typedef int (device_reply_cb)(clixon_handle h, device_handle dh, cxobj *xmsg, void *arg);
+
 /*
  * Prototypes
  */
@@ -65,10 +82,15 @@ int    device_handle_free(device_handle dh);
 int    device_handle_free_all(clixon_handle h);
 device_handle device_handle_find(clixon_handle h, const char *name);
 device_handle device_handle_each(clixon_handle h, device_handle dhprev);
+device_handle device_handle_each_tid(struct controller_transaction_t *ct, device_handle dhprev);
 int    device_handle_connect(device_handle dh, clixon_client_type socktype,
                              const char *dest, const char *port, int stricthostkey);
 int    device_handle_disconnect(device_handle dh);
 int    device_handle_allocate_flag(clixon_handle h, uint32_t *flag);
+device_handle device_handle_connq_first(clixon_handle h);
+int    device_handle_connecting_nr(clixon_handle h);
+device_handle device_handle_outq_each(clixon_handle h, device_handle dhprev);
+size_t device_handle_outq_total(clixon_handle h);
 
 /* Accessor functions */
 char  *device_handle_name_get(device_handle dh);
@@ -86,17 +108,41 @@ conn_state    device_handle_conn_state_get(device_handle dh);
 yang_config_t device_handle_yang_config_get(device_handle dh);
 int    device_handle_yang_config_set(device_handle dh, char *yfstr);
 int    device_handle_conn_state_set(device_handle dh, conn_state  state);
+int    device_handle_conn_params_set(device_handle dh, const char *dest, const char *port, int stricthostkey);
+int    device_handle_conn_params_get(device_handle dh, char **dest, char **port, int *stricthostkey);
 int    device_handle_conn_time_get(device_handle dh, struct timeval *t);
 int    device_handle_conn_time_set(device_handle dh, struct timeval *t);
 int    device_handle_sync_time_get(device_handle dh, struct timeval *t);
 int    device_handle_sync_time_set(device_handle dh, struct timeval *t);
 int    device_handle_stable_time_get(device_handle dh, struct timeval *t);
 int    device_handle_stable_time_set(device_handle dh, struct timeval *t);
+int    device_handle_sync_check_get(device_handle dh, struct timeval *t, struct timeval *due, int *result);
+int    device_handle_sync_check_set(device_handle dh, struct timeval *t, struct timeval *due, int result);
+int    device_handle_latency_add(device_handle dh, conn_state state, uint32_t ms);
+int    device_handle_latency_get(device_handle dh, conn_state state, uint32_t *ewma, uint32_t *p95, uint32_t *nr);
+int    device_handle_timeout_add(device_handle dh, uint32_t *consecutive);
+int    device_handle_timeout_get(device_handle dh, uint32_t *consecutive, uint32_t *total);
+int    device_handle_quarantined(device_handle dh);
+int    device_handle_quarantine_expired(device_handle dh);
+int    device_handle_quarantine_set(device_handle dh, struct timeval *until);
+struct controller_timer *device_handle_state_timer_get(device_handle dh);
+int    device_handle_handshake_get(device_handle dh, uint32_t *handshakes, uint32_t *reuses, uint32_t *ms);
+int    device_handle_handshake_time_set(device_handle dh, uint32_t ms);
+uint32_t device_handle_session_id_get(device_handle dh);
+int    device_handle_session_id_set(device_handle dh, uint32_t id);
+int    device_handle_drift_get(device_handle dh, int *subscribed, int *drift, uint32_t *changes);
+int    device_handle_drift_subscribed_set(device_handle dh, int subscribed);
+int    device_handle_drift_set(device_handle dh, int drift);
 int    device_handle_frame_state_get(device_handle dh);
 int    device_handle_frame_state_set(device_handle dh, int state);
 size_t device_handle_frame_size_get(device_handle dh);
 int    device_handle_frame_size_set(device_handle dh, size_t size);
 cbuf  *device_handle_frame_buf_get(device_handle dh);
+int    device_handle_frame_buf_reset(device_handle dh);
+unsigned char *device_handle_read_buf_get(device_handle dh, size_t *len);
+int    device_handle_read_buf_resize(device_handle dh, size_t len);
+int    device_handle_read_idle_get(device_handle dh);
+int    device_handle_read_idle_set(device_handle dh, int idle);
 netconf_framing_type device_handle_framing_type_get(device_handle dh);
 int    device_handle_framing_type_set(device_handle dh, netconf_framing_type ft);
 cxobj *device_handle_capabilities_get(device_handle dh);
@@ -105,12 +151,45 @@ int    device_handle_capabilities_find(clixon_handle ch, const char *name);
 cxobj *device_handle_yang_lib_get(device_handle dh);
 int    device_handle_yang_lib_set(device_handle dh, cxobj *xylib);
 int    device_handle_yang_lib_append(device_handle dh, cxobj *xylib);
+int    device_handle_yang_lib_digest_get(device_handle dh, char **digest);
+int    device_handle_yang_lib_mark(device_handle dh);
+int    device_handle_yang_lib_keep(device_handle dh);
+int    device_handle_yang_lib_restore(device_handle dh);
+yang_stmt *device_handle_yspec_last_get(device_handle dh);
+int    device_handle_yspec_last_release(device_handle dh, int unmount);
+int    device_handle_config_digest_get(device_handle dh, device_config_type dt, config_digest *digest);
+int    device_handle_config_digest_set(device_handle dh, device_config_type dt, config_digest *digest);
+config_digests *device_handle_synced_digests_get(device_handle dh);
+int    device_handle_synced_digests_set(device_handle dh, config_digests *cd);
+char  *device_handle_change_token_xpath_get(device_handle dh);
+int    device_handle_change_token_xpath_set(device_handle dh, const char *xpath);
+char  *device_handle_change_token_get(device_handle dh, device_config_type dt);
+int    device_handle_change_token_set(device_handle dh, device_config_type dt, char *token);
+int    device_handle_change_token_sync(device_handle dh);
 int    device_handle_nr_schemas_get(device_handle dh);
 int    device_handle_nr_schemas_set(device_handle dh, int nr);
-char  *device_handle_schema_name_get(device_handle dh);
-int    device_handle_schema_name_set(device_handle dh, char *schema_name);
-char  *device_handle_schema_rev_get(device_handle dh);
-int    device_handle_schema_rev_set(device_handle dh, char  *schema_rev);
+int    device_handle_schema_pending_add(device_handle dh, int wait, uint64_t msg_id, char *name, char *rev);
+int    device_handle_schema_pending_find(device_handle dh, uint64_t msg_id, char **name, char **rev);
+int    device_handle_schema_pending_first(device_handle dh, uint64_t *msg_id);
+int    device_handle_schema_pending_rm(device_handle dh, uint64_t msg_id);
+int    device_handle_schema_wait_rm(device_handle dh, char *name, char *rev);
+int    device_handle_schema_pending_clear(device_handle dh);
+int    device_handle_schema_pending_nr(device_handle dh, int sent);
+int    device_handle_pipeline_add(device_handle dh, uint64_t msg_id, conn_state state);
+int    device_handle_pipeline_first(device_handle dh, uint64_t *msg_id, conn_state *state, int *skip);
+int    device_handle_pipeline_rm(device_handle dh);
+int    device_handle_pipeline_skip(device_handle dh);
+int    device_handle_pipeline_clear(device_handle dh);
+int    device_handle_pipeline_nr(device_handle dh);
+int    device_handle_dispatch_add(device_handle dh, uint64_t msg_id, device_reply_cb *fn, void *arg, int timeout);
+int    device_handle_dispatch(device_handle dh, cxobj *xmsg);
+int    device_handle_dispatch_clear(device_handle dh);
+int    device_handle_dispatch_flush(clixon_handle h);
+int    device_handle_dispatch_nr(device_handle dh);
+int    device_handle_outq_append(device_handle dh, const char *buf, size_t len);
+int    device_handle_outq_flush(device_handle dh);
+size_t device_handle_outq_len(device_handle dh);
+int    device_handle_outq_clear(device_handle dh);
 char  *device_handle_logmsg_get(device_handle dh);
 int    device_handle_logmsg_set(device_handle dh, char *logmsg);
 char  *device_handle_domain_get(device_handle dh);
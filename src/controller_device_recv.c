@@ -128,11 +128,14 @@ device_recv_hello(clixon_handle h,
                   char         *rpcname,
                   conn_state    conn_state)
 {
-    int    retval = -1;
-    char  *rpcprefix;
-    char  *namespace = NULL;
-    cvec  *nsc = NULL;
-    cxobj *xcapabilities;
+    int      retval = -1;
+    char    *rpcprefix;
+    char    *namespace = NULL;
+    cvec    *nsc = NULL;
+    cxobj   *xcapabilities;
+    char    *str;
+    uint32_t sid = 0;
+    int      ret;
 
     clixon_debug(CLIXON_DBG_CTRL|CLIXON_DBG_DETAIL, "");
     rpcprefix = xml_prefix(xmsg);
@@ -160,6 +163,14 @@ device_recv_hello(clixon_handle h,
         goto done;
     if (device_handle_capabilities_set(dh, xcapabilities) < 0)
         goto done;
+    /* Session-id of device, see device_recv_notification */
+    if ((str = xml_find_body(xmsg, "session-id")) != NULL){
+        if ((ret = parse_uint32(str, &sid, NULL)) < 0)
+            goto done;
+        if (ret == 0)
+            sid = 0;
+    }
+    device_handle_session_id_set(dh, sid);
     retval = 1;
  done:
    if (nsc)
@@ -170,6 +181,56 @@ device_recv_hello(clixon_handle h,
     goto done;
 }
 
+/*! Receive notification from device, outside of state machine
+ *
+ * A RFC 6470 netconf-config-change of running, not made by the controller session, marks
+ * the device config as drifted. Other notifications are ignored.
+ * @param[in] h          Clixon handle.
+ * @param[in] dh         Clixon client handle.
+ * @param[in] xmsg       XML tree of incoming notification
+ * @retval    0          OK
+ * @retval   -1          Error
+ * @see drift-tracking in clixon-controller.yang
+ */
+int
+device_recv_notification(clixon_handle h,
+                         device_handle dh,
+                         cxobj        *xmsg)
+{
+    int      retval = -1;
+    cxobj   *xc;
+    cxobj   *xb;
+    char    *namespace = NULL;
+    char    *str;
+    uint32_t sid;
+    int      ret;
+
+    if ((xc = xml_find_type(xmsg, NULL, "netconf-config-change", CX_ELMNT)) == NULL)
+        goto ok;
+    if (xml2ns(xc, xml_prefix(xc), &namespace) < 0)
+        goto done;
+    if (namespace == NULL || strcmp(namespace, NETCONF_NOTIFICATIONS_NAMESPACE) != 0)
+        goto ok;
+    /* Datastore defaults to running */
+    if ((str = xml_find_body(xc, "datastore")) != NULL && strcmp(str, "running") != 0)
+        goto ok;
+    /* Skip changes made by the controller session */
+    if ((xb = xml_find_type(xc, NULL, "changed-by", CX_ELMNT)) != NULL &&
+        (str = xml_find_body(xb, "session-id")) != NULL &&
+        device_handle_session_id_get(dh) != 0){
+        if ((ret = parse_uint32(str, &sid, NULL)) < 0)
+            goto done;
+        if (ret == 1 && sid == device_handle_session_id_get(dh))
+            goto ok;
+    }
+    clixon_debug(CLIXON_DBG_CTRL, "%s: config changed on device", device_handle_name_get(dh));
+    device_handle_drift_set(dh, 1);
+ ok:
+    retval = 0;
+ done:
+    return retval;
+}
+
 /*! Receive config data from device and add config to mount-point
  *
  * @param[in] h          Clixon handle.
@@ -179,6 +240,7 @@ device_recv_hello(clixon_handle h,
  * @param[in] rpcname    Name of RPC, only "rpc-reply" expected here
  * @param[in] conn_state Device connection state
  * @param[in] force_transient If set, always save config in TRANSIENT db, regardless of dh setting
+ *                           Device may then be outside of a transaction
  * @param[in] force_merge If set, always merge db
  * @retval    1          OK
  * @retval    0          Closed
@@ -208,10 +270,9 @@ device_recv_config(clixon_handle h,
     yang_stmt              *yroot;
     cxobj                  *xerr = NULL;
     uint64_t                tid;
-    controller_transaction *ct;
+    controller_transaction *ct = NULL;
     int                     merge = 0;
     int                     transient = 0;
-    cxobj                  *xt1 = NULL;
     char                   *db = NULL;
     int                     ret;
 
@@ -295,21 +356,23 @@ device_recv_config(clixon_handle h,
         goto done;
     if (xml_sort(xroot) < 0)
         goto done;
-    /* Special handling if part of transaction. XXX: currently not activated */
-    if ((tid = device_handle_tid_get(dh)) == 0) {
+    /* Only transient config outside of transaction, see device_sync_check_cb */
+    if ((tid = device_handle_tid_get(dh)) == 0 && !force_transient) {
         clixon_debug(CLIXON_DBG_CTRL, "tid is 0, shouldnt happen");
         if (device_close_connection(dh, "Tid is zero") < 0)
             goto done;
         goto closed;
     }
-    if ((ct = controller_transaction_find(h, tid)) == NULL){
+    if (tid != 0 && (ct = controller_transaction_find(h, tid)) == NULL){
         clixon_debug(CLIXON_DBG_CTRL, "ct is NULL, shouldnt happen");
         if (device_close_connection(dh, "ct is NULL") < 0)
             goto done;
         goto closed;
     }
-    merge = ct->ct_pull_merge;
-    transient = ct->ct_pull_transient;
+    if (tid != 0){
+        merge = ct->ct_pull_merge;
+        transient = ct->ct_pull_transient;
+    }
     if (force_transient)
         transient = 1;
     if (force_merge)
@@ -332,11 +395,30 @@ device_recv_config(clixon_handle h,
         }
         goto ok;
     }
-    /* Must make a copy: xmldb_put strips attributes */
-    if ((xt1 = xml_dup(xt)) == NULL)
-        goto done;
-    /* 1. Put device config change to tmp */
-    if ((ret = xmldb_put(h, "tmpdev", OP_NONE, xt, NULL, cbret)) < 0)
+    if (ct->ct_pull_commit == PC_DEVICE){
+        /* 1. Commit device config change to running via a copy of running, as
+         * commit_after_pull does for all devices of the transaction with tmpdev
+         */
+        if (xmldb_db_reset(h, "tmpdevcommit") < 0)
+            goto done;
+        if (xmldb_copy(h, "running", "tmpdevcommit") < 0)
+            goto done;
+        if ((ret = xmldb_put(h, "tmpdevcommit", OP_NONE, xt, NULL, cbret)) < 0)
+            goto done;
+        if (ret == 1){
+            if ((ret = candidate_commit(h, NULL, "tmpdevcommit", 0, 0, cbret)) < 0){
+                /* Handle that candidate_commit can return < 0 if transaction ongoing */
+                cprintf(cbret, "%s", clixon_err_reason());
+                ret = 0;
+            }
+            if (clicon_option_bool(h, "CLICON_AUTOLOCK"))
+                xmldb_unlock(h, "tmpdevcommit");
+        }
+        xmldb_delete(h, "tmpdevcommit");
+    }
+    else /* 1. Put device config change to tmp */
+        ret = xmldb_put(h, "tmpdev", OP_NONE, xt, NULL, cbret);
+    if (ret < 0)
         goto done;
     if (ret == 0){ /* discard */
         clixon_debug(CLIXON_DBG_CTRL, "%s", cbuf_get(cbret));
@@ -357,7 +439,18 @@ device_recv_config(clixon_handle h,
     /* This is where existing config is overwritten
      * One could have a warning here, but that would require a diff
      */
-    if ((ret = xmldb_put(h, db, OP_NONE, xt1, NULL, cbret)) < 0)
+    /* xmldb_put strips attributes, add operation again instead of putting a copy of the tree */
+    if ((xa = xml_find_type(xroot, NETCONF_BASE_PREFIX, "operation", CX_ATTR)) == NULL){
+        if ((xa = xml_new("operation", xroot, CX_ATTR)) == NULL)
+            goto done;
+        if (xml_prefix_set(xa, NETCONF_BASE_PREFIX) < 0)
+            goto done;
+        if (xml_sort(xroot) < 0)
+            goto done;
+    }
+    if (xml_value_set(xa, xml_operation2str(merge ? OP_MERGE : OP_REPLACE)) < 0)
+        goto done;
+    if ((ret = xmldb_put(h, db, OP_NONE, xt, NULL, cbret)) < 0)
         goto done;
     if (ret && (ret = device_config_write(h, name, "SYNCED", xt, cbret)) < 0)
         goto done;
@@ -367,11 +460,12 @@ device_recv_config(clixon_handle h,
         goto closed;
     }
     device_handle_sync_time_set(dh, NULL);
+    /* Change token fetched before this config, see device_state_sync_send */
+    device_handle_change_token_sync(dh);
+    device_handle_drift_set(dh, 0);
  ok:
     retval = 1;
  done:
-    if (xt1)
-        xml_free(xt1);
     if (xt)
         xml_free(xt);
     if (xerr)
@@ -539,12 +633,14 @@ device_recv_schema_list(device_handle dh,
  * Local dir is CLICON_YANG_DOMAIN_DIR/domain and is created if it does not exist.
  * Get data payload as YANG and write to file.
  * Decode yang using CDATA or regular XML character decoding
+ * Module name and revision are given by the outstanding request with same message-id
  * @param[in] h          Clixon handle.
  * @param[in] dh         Clixon client handle.
  * @param[in] s          Socket where input arrives. Read from this.
  * @param[in] xmsg       XML tree of incoming message
  * @param[in] rpcname    Name of RPC, only "hello" is expected here
  * @param[in] conn_state Device connection state, should be CONNECTING
+ * @param[out] resume    Devices waiting for this schema that may resume, free with cvec_free
  * @retval    1          OK
  * @retval    0          Closed
  * @retval   -1          Error
@@ -555,7 +651,8 @@ int
 device_recv_get_schema(device_handle dh,
                        cxobj        *xmsg,
                        char         *rpcname,
-                       conn_state    conn_state)
+                       conn_state    conn_state,
+                       cvec        **resume)
 {
     int           retval = -1;
     clixon_handle h;
@@ -571,6 +668,8 @@ device_recv_get_schema(device_handle dh,
     char         *domain;
     struct stat   st0;
     struct stat   st1;
+    char         *msgidstr;
+    uint64_t      msgid = 0;
     int           ret;
 
     clixon_debug(CLIXON_DBG_CTRL, "");
@@ -579,6 +678,23 @@ device_recv_get_schema(device_handle dh,
         goto done;
     if (ret == 0)
         goto closed;
+    /* Match reply with outstanding request, if no message-id assume oldest */
+    if ((msgidstr = xml_find_value(xmsg, "message-id")) != NULL){
+        if ((ret = parse_uint64(msgidstr, &msgid, NULL)) < 0)
+            goto done;
+        if (ret == 0){
+            device_close_connection(dh, "Invalid message-id in get-schema reply: %s", msgidstr);
+            goto closed;
+        }
+    }
+    else if (device_handle_schema_pending_first(dh, &msgid) == 0){
+        device_close_connection(dh, "Unexpected get-schema reply, no request outstanding");
+        goto closed;
+    }
+    if (device_handle_schema_pending_find(dh, msgid, &modname, &revision) == 0){
+        device_close_connection(dh, "Unexpected get-schema reply, message-id %" PRIu64 " not outstanding", msgid);
+        goto closed;
+    }
     if ((ret = device_recv_check_errors(h, dh, xmsg, conn_state, &cb)) < 0)
         goto done;
     if (ret == 0){
@@ -604,8 +720,6 @@ device_recv_get_schema(device_handle dh,
     else if (xml_chardata_decode(&ydec, "%s", ystr) < 0)
         goto done;
     sz = strlen(ydec);
-    revision = device_handle_schema_rev_get(dh);
-    modname = device_handle_schema_name_get(dh);
     /* Write to file */
     if ((domain = device_handle_domain_get(dh)) == NULL){
         clixon_err(OE_YANG, 0, "No YANG domain");
@@ -656,6 +770,10 @@ device_recv_get_schema(device_handle dh,
         goto done;
     }
     fflush(f);
+    /* Before rm since modname and revision belong to the pending request */
+    if (device_schema_fetch_done(h, dh, domain, modname, revision, resume) < 0)
+        goto done;
+    device_handle_schema_pending_rm(dh, msgid);
     retval = 1;
  done:
     if (f)
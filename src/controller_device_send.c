@@ -34,6 +34,7 @@
 #include <syslog.h>
 #include <fcntl.h>
 #include <fnmatch.h>
+#include <poll.h>
 #include <sys/time.h>
 
 /* clicon */
@@ -53,6 +54,171 @@
 #include "controller_device_handle.h"
 #include "controller_device_send.h"
 
+/*! Poll device sockets with pending output and write to those that are writable
+ *
+ * Timeout callback registered by device_send_output_register while any device has
+ * pending output. When total pending output is below output-queue-limit, work held
+ * back is resumed: push edit-configs, queued connects and background sync-checks.
+ * @param[in]  s     Not used
+ * @param[in]  arg   Clixon handle
+ * @retval     0     OK
+ * @retval    -1     Error
+ */
+static int
+device_send_output_drain(int   s,
+                         void *arg)
+{
+    int            retval = -1;
+    clixon_handle  h = (clixon_handle)arg;
+    device_handle  dh;
+    device_handle *dvec = NULL;
+    struct pollfd *fds = NULL;
+    int            n;
+    int            i;
+
+    clicon_data_int_set(h, "controller-output-drain", 0);
+    n = 0;
+    dh = NULL;
+    while ((dh = device_handle_outq_each(h, dh)) != NULL)
+        n++;
+    if (n == 0)
+        goto resume;
+    if ((dvec = calloc(n, sizeof(*dvec))) == NULL ||
+        (fds = calloc(n, sizeof(*fds))) == NULL){
+        clixon_err(OE_UNIX, errno, "calloc");
+        goto done;
+    }
+    i = 0;
+    dh = NULL;
+    while ((dh = device_handle_outq_each(h, dh)) != NULL && i < n){
+        dvec[i] = dh;
+        fds[i].fd = device_handle_socket_get(dh);
+        fds[i].events = POLLOUT;
+        i++;
+    }
+    if (poll(fds, n, 0) < 0 && errno != EINTR){
+        clixon_err(OE_UNIX, errno, "poll");
+        goto done;
+    }
+    /* The list is changed by flush, use the copy */
+    for (i=0; i<n; i++){
+        if (fds[i].revents == 0)
+            continue;
+        if (device_handle_outq_flush(dvec[i]) < 0)
+            goto done;
+    }
+    if (device_send_output_register(h) < 0)
+        goto done;
+ resume:
+    /* Pushes first, held back connects and sync-checks get the rest */
+    if (device_push_edit_next(h) < 0)
+        goto done;
+    if (!device_send_backpressure(h)){
+        if (device_handle_connq_first(h) != NULL &&
+            device_connect_dispatch_register(h) < 0)
+            goto done;
+        if (device_sync_check_next(h) < 0)
+            goto done;
+    }
+    retval = 0;
+ done:
+    if (dvec)
+        free(dvec);
+    if (fds)
+        free(fds);
+    return retval;
+}
+
+/*! Register poll of device sockets with pending output, unless already registered
+ *
+ * The event loop has no write events, pending output is polled every CONTROLLER_OUTPUT_TICK ms
+ * @param[in]  h     Clixon handle
+ * @retval     0     OK
+ * @retval    -1     Error
+ */
+int
+device_send_output_register(clixon_handle h)
+{
+    int            retval = -1;
+    struct timeval t;
+    struct timeval t1;
+
+    if (clicon_data_int_get(h, "controller-output-drain") == 1 ||
+        device_handle_outq_each(h, NULL) == NULL)
+        goto ok;
+    gettimeofday(&t, NULL);
+    t1.tv_sec = 0;
+    t1.tv_usec = CONTROLLER_OUTPUT_TICK*1000;
+    timeradd(&t, &t1, &t);
+    if (clixon_event_reg_timeout(t, device_send_output_drain, h, "controller output drain") < 0)
+        goto done;
+    clicon_data_int_set(h, "controller-output-drain", 1);
+ ok:
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Check if pending output to devices exceeds output-queue-limit
+ *
+ * If so, new work such as push edit-configs, connects and sync-checks is held back until the
+ * output is drained
+ * @param[in]  h     Clixon handle
+ * @retval     1     Pending output exceeds limit
+ * @retval     0     Below limit
+ * @see output-queue-limit in clixon-controller.yang
+ */
+int
+device_send_backpressure(clixon_handle h)
+{
+    int limit;
+
+    if ((limit = clicon_data_int_get(h, "controller-output-queue-limit")) <= 0)
+        limit = CONTROLLER_OUTPUT_QUEUE_LIMIT_DEFAULT;
+    return device_handle_outq_total(h) > (size_t)limit;
+}
+
+/*! Frame and send a NETCONF message to a device without blocking
+ *
+ * The message is framed according to the device framing type and appended to the device
+ * output queue. What cannot be written now is written when the socket is writable.
+ * Messages are written in order.
+ * @param[in]  h     Clixon handle
+ * @param[in]  dh    Device handle
+ * @param[in]  cb    NETCONF message without framing
+ * @retval     0     OK
+ * @retval    -1     Error
+ * @see device_send_output_drain
+ */
+int
+device_send_msg(clixon_handle h,
+                device_handle dh,
+                cbuf         *cb)
+{
+    int   retval = -1;
+    char  hdr[32];
+    int   ret;
+
+    clixon_debug(CLIXON_DBG_MSG, "Send [%s]: %s", device_handle_name_get(dh), cbuf_get(cb));
+    if (device_handle_framing_type_get(dh) == NETCONF_SSH_CHUNKED){
+        snprintf(hdr, sizeof(hdr), "\n#%zu\n", cbuf_len(cb));
+        if (device_handle_outq_append(dh, hdr, strlen(hdr)) < 0 ||
+            device_handle_outq_append(dh, cbuf_get(cb), cbuf_len(cb)) < 0 ||
+            device_handle_outq_append(dh, "\n##\n", strlen("\n##\n")) < 0)
+            goto done;
+    }
+    else if (device_handle_outq_append(dh, cbuf_get(cb), cbuf_len(cb)) < 0 ||
+             device_handle_outq_append(dh, "]]>]]>", strlen("]]>]]>")) < 0)
+        goto done;
+    if ((ret = device_handle_outq_flush(dh)) < 0)
+        goto done;
+    if (ret == 0 && device_send_output_register(h) < 0)
+        goto done;
+    retval = 0;
+ done:
+    return retval;
+}
+
 /*! Send a <lock>/<unlock> target candidate
  *
  * @param[in]  h    Clixon handle
@@ -68,13 +234,11 @@ device_send_lock(clixon_handle h,
 {
     int   retval = -1;
     cbuf *cb = NULL;
-    int   s;
 
     if (lock != 0 && lock != 1){
         clixon_err(OE_UNIX, EINVAL, "lock is not 0 or 1");
         goto done;
     }
-    s = device_handle_socket_get(dh);
     if ((cb = cbuf_new()) == NULL){
         clixon_err(OE_PLUGIN, errno, "cbuf_new");
         goto done;
@@ -90,11 +254,7 @@ device_send_lock(clixon_handle h,
     cprintf(cb, "<target><candidate/></target>");
     cprintf(cb, "</%slock>", lock==0?"un":"");
     cprintf(cb, "</rpc>");
-    if (device_handle_framing_type_get(dh) == NETCONF_SSH_CHUNKED){
-        if (clixon_msg_send11(s, device_handle_name_get(dh), cb) < 0)
-            goto done;
-    }
-    else if (clixon_msg_send10(s, device_handle_name_get(dh), cb) < 0)
+    if (device_send_msg(h, dh, cb) < 0)
         goto done;
     retval = 0;
  done:
@@ -142,12 +302,7 @@ device_send_get(clixon_handle h,
         cprintf(cb, "</get-config>");
     }
     cprintf(cb, "</rpc>");
-    s = device_handle_socket_get(dh);
-    if (device_handle_framing_type_get(dh) == NETCONF_SSH_CHUNKED){
-        if (clixon_msg_send11(s, device_handle_name_get(dh), cb) < 0)
-            goto done;
-    }
-    else if (clixon_msg_send10(s, device_handle_name_get(dh), cb) < 0)
+    if (device_send_msg(h, dh, cb) < 0)
         goto done;
     retval = 0;
  done:
@@ -158,12 +313,14 @@ device_send_get(clixon_handle h,
 
 /*! Send s single get-schema requests to a device
  *
- * @param[in]  h   Clixon handle
- * @param[in]  dh  Clixon client handle
- * @param[in]  s   Socket
- * @param[in]  xd  XML tree of netconf monitor schema entry
- * @retval     0   OK, sent a get-schema request
- * @retval    -1   Error
+ * @param[in]  h          Clixon handle
+ * @param[in]  dh         Clixon client handle
+ * @param[in]  s          Socket
+ * @param[in]  identifier Schema name
+ * @param[in]  version    Schema revision
+ * @param[out] seqp       Message-id of request
+ * @retval     0          OK, sent a get-schema request
+ * @retval    -1          Error
  * @see ietf-netconf-monitoring@2010-10-04.yang
  */
 static int
@@ -171,7 +328,8 @@ device_get_schema_sendit(clixon_handle h,
                          device_handle dh,
                          int           s,
                          char         *identifier,
-                         char         *version)
+                         char         *version,
+                         uint64_t     *seqp)
 {
     int      retval = -1;
     cbuf    *cb = NULL;
@@ -192,13 +350,10 @@ device_get_schema_sendit(clixon_handle h,
     cprintf(cb, "<format>yang</format>");
     cprintf(cb, "</get-schema>");
     cprintf(cb, "</rpc>");
-    if (device_handle_framing_type_get(dh) == NETCONF_SSH_CHUNKED){
-        if (clixon_msg_send11(s, device_handle_name_get(dh), cb) < 0)
-            goto done;
-    }
-    else if (clixon_msg_send10(s, device_handle_name_get(dh), cb) < 0)
+    if (device_send_msg(h, dh, cb) < 0)
         goto done;
     clixon_debug(CLIXON_DBG_CTRL, "%s: sent get-schema(%s@%s) seq:%" PRIu64, name, identifier, version, seq);
+    *seqp = seq;
     retval = 0;
  done:
     if (cb)
@@ -206,16 +361,18 @@ device_get_schema_sendit(clixon_handle h,
     return retval;
 }
 
-/*! Find next schema in list, check if already loaded, or exists locally,
+/*! Find next schemas in list, check if already loaded, or exists locally,
  *
- * If not send request to device
+ * If not send request to device.
+ * Several get-schema requests may be outstanding, up to a window given by
+ * devices/schema-window. Replies are matched with requests by message-id.
  * @param[in]     h   Clixon handle
  * @param[in]     dh  Clixon client handle
  * @param[in]     s   Socket
  * @param[in,out] nr  Last schema index sent
- * @retval        2   Sent a get-schema, nr updated
+ * @retval        2   Outstanding get-schema requests exist, nr updated
  * @retval        1   Error, device closed
- * @retval        0   No schema sent, either because all are sent or they are none, or cberr set
+ * @retval        0   No schema outstanding, either because all are received or they are none, or cberr set
  * @retval       -1   Error
  * @see device_recv_get_schema  Receive a schema request
  * @see device_schemas_mount_parse   Parse the module after if already found or received
@@ -239,6 +396,8 @@ device_send_get_schema_next(clixon_handle h,
     int        i;
     char      *domain;
     char      *location;
+    int        window;
+    uint64_t   seq;
 
     clixon_debug(CLIXON_DBG_CTRL|CLIXON_DBG_DETAIL, "%d", *nr);
     if (controller_mount_yspec_get(h, device_handle_name_get(dh), &yspec) < 0)
@@ -251,14 +410,16 @@ device_send_get_schema_next(clixon_handle h,
         clixon_err(OE_YANG, 0, "No YANG domain");
         goto done;
     }
+    if ((window = clicon_data_int_get(h, "controller-schema-window")) <= 0)
+        window = CONTROLLER_SCHEMA_WINDOW_DEFAULT;
     xylib = device_handle_yang_lib_get(dh);
     x = NULL;
     if (xpath_vec(xylib, nsc, "module-set/module", &vec, &veclen) < 0)
         goto done;
-    for (i=0; i<veclen; i++){
+    for (i=*nr; i<veclen; i++){
+        if (device_handle_schema_pending_nr(dh, 1) >= window)
+            break;
         x = vec[i];
-        if (i != *nr)
-            continue;
         name = xml_find_body(x, "name");
         revision = xml_find_body(x, "revision");
         (*nr)++;
@@ -276,16 +437,19 @@ device_send_get_schema_next(clixon_handle h,
             retval = 1;
             goto done;
         }
-        /* May be some concurrency here if several devices requests same yang simultaneously
-         * To avoid that one needs to keep track if another request has been sent.
-         */
-        if ((ret = device_get_schema_sendit(h, dh, s, name, revision)) < 0)
+        /* If another device already requested the same yang, wait for that reply */
+        if ((ret = device_schema_fetch_wait(h, dh, domain, name, revision)) < 0)
+            goto done;
+        if (ret == 1)
+            continue;
+        if ((ret = device_get_schema_sendit(h, dh, s, name, revision, &seq)) < 0)
+            goto done;
+        if (device_handle_schema_pending_add(dh, 0, seq, name, revision) < 0)
+            goto done;
+        if (device_schema_fetch_add(h, dh, domain, name, revision) < 0)
             goto done;
-        device_handle_schema_name_set(dh, name);
-        device_handle_schema_rev_set(dh, revision);
-        break;
     }
-    if (i < veclen)
+    if (device_handle_schema_pending_nr(dh, 0) > 0)
         retval = 2;
     else
         retval = 0;
@@ -295,6 +459,36 @@ device_send_get_schema_next(clixon_handle h,
     return retval;
 }
 
+/*! Send get-schema for a schema this device was waiting for from another device
+ *
+ * Used when the device originally fetching the schema is closed, and this device takes over.
+ * The waiting entry is assumed to be removed by the caller.
+ * @param[in]  h      Clixon handle
+ * @param[in]  dh     Clixon client handle
+ * @param[in]  name   Schema name
+ * @param[in]  rev    Schema revision, or NULL
+ * @retval     0      OK
+ * @retval    -1      Error
+ * @see device_schema_fetch_release
+ */
+int
+device_send_get_schema(clixon_handle h,
+                       device_handle dh,
+                       char         *name,
+                       char         *rev)
+{
+    int      retval = -1;
+    uint64_t seq;
+
+    if (device_get_schema_sendit(h, dh, device_handle_socket_get(dh), name, rev, &seq) < 0)
+        goto done;
+    if (device_handle_schema_pending_add(dh, 0, seq, name, rev) < 0)
+        goto done;
+    retval = 0;
+ done:
+    return retval;
+}
+
 /*! Send ietf-netconf-monitoring schema get request to get list of schemas
  *
  * @param[in]  h      Clixon handle.
@@ -329,11 +523,7 @@ device_send_get_schema_list(clixon_handle h,
     cprintf(cb, "</filter>");
     cprintf(cb, "</get>");
     cprintf(cb, "</rpc>");
-    if (device_handle_framing_type_get(dh) == NETCONF_SSH_CHUNKED){
-        if (clixon_msg_send11(s, device_handle_name_get(dh), cb) < 0)
-            goto done;
-    }
-    else if (clixon_msg_send10(s, device_handle_name_get(dh), cb) < 0)
+    if (device_send_msg(h, dh, cb) < 0)
         goto done;
     retval = 0;
  done:
@@ -554,10 +744,8 @@ device_send_rpc(clixon_handle h,
 {
     int   retval = -1;
     cbuf *cb = NULL;
-    int   s;
 
     clixon_debug(CLIXON_DBG_CTRL, "%s", msgbody);
-    s = device_handle_socket_get(dh);
     if ((cb = cbuf_new()) == NULL){
         clixon_err(OE_PLUGIN, errno, "cbuf_new");
         goto done;
@@ -568,11 +756,7 @@ device_send_rpc(clixon_handle h,
     if (msgbody)
         cprintf(cb, "%s", msgbody);
     cprintf(cb, "</rpc>");
-    if (device_handle_framing_type_get(dh) == NETCONF_SSH_CHUNKED){
-        if (clixon_msg_send11(s, device_handle_name_get(dh), cb) < 0)
-            goto done;
-    }
-    else if (clixon_msg_send10(s, device_handle_name_get(dh), cb) < 0)
+    if (device_send_msg(h, dh, cb) < 0)
         goto done;
     retval = 0;
  done:
@@ -608,6 +792,54 @@ device_send_discard_changes(clixon_handle h,
     return device_send_rpc(h, dh, "<discard-changes/>");
 }
 
+/*! Send RFC 5277 create-subscription of default NETCONF event stream to device
+ */
+int
+device_send_create_subscription(clixon_handle h,
+                                device_handle dh)
+{
+    return device_send_rpc(h, dh, "<create-subscription xmlns=\"" EVENT_RFC5277_NAMESPACE "\"/>");
+}
+
+/*! Send saved edit-config message to device
+ *
+ * @param[in]  h       Clixon handle
+ * @param[in]  dh      Device handle
+ * @param[in]  nr      Saved message #1 or #2, see device_handle_outmsg_set
+ * @param[out] msgidp  Message-id of sent message, or NULL
+ * @retval     1       OK, sent
+ * @retval     0       No saved message
+ * @retval    -1       Error
+ * @see device_create_edit_config_diff  where message is created
+ */
+int
+device_send_outmsg(clixon_handle h,
+                   device_handle dh,
+                   int           nr,
+                   uint64_t     *msgidp)
+{
+    int   retval = -1;
+    cbuf *cbmsg;
+    char *str;
+
+    if ((cbmsg = device_handle_outmsg_get(dh, nr)) == NULL){
+        retval = 0;
+        goto done;
+    }
+    if (msgidp){
+        if ((str = strstr(cbuf_get(cbmsg), "message-id=\"")) == NULL ||
+            sscanf(str + strlen("message-id=\""), "%" SCNu64, msgidp) != 1){
+            clixon_err(OE_XML, EINVAL, "No message-id in saved message #%d", nr);
+            goto done;
+        }
+    }
+    if (device_send_msg(h, dh, cbmsg) < 0)
+        goto done;
+    retval = 1;
+ done:
+    return retval;
+}
+
 /*! Send generic RPC to device
  *
  * @param[in]  h       Clixon handle
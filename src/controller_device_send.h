@@ -44,9 +44,13 @@
 extern "C" {
 #endif
 
+int device_send_output_register(clixon_handle h);
+int device_send_backpressure(clixon_handle h);
+int device_send_msg(clixon_handle h, device_handle dh, cbuf *cb);
 int device_send_lock(clixon_handle h, device_handle dh, int lock);
 int device_send_get(clixon_handle h, device_handle ch, int s, int state, const char *xpath);
 int device_send_get_schema_next(clixon_handle h, device_handle dh, int s, int *nr);
+int device_send_get_schema(clixon_handle h, device_handle dh, char *name, char *rev);
 int device_send_get_schema_list(clixon_handle h, device_handle dh, int s);
 int device_create_edit_config_diff(clixon_handle h, device_handle dh,
                                    cxobj *x0, cxobj *x1, yang_stmt *yspec,
@@ -57,6 +61,8 @@ int device_create_edit_config_diff(clixon_handle h, device_handle dh,
 int device_send_validate(clixon_handle h, device_handle dh);
 int device_send_commit(clixon_handle h, device_handle dh);
 int device_send_discard_changes(clixon_handle h, device_handle dh);
+int device_send_create_subscription(clixon_handle h, device_handle dh);
+int device_send_outmsg(clixon_handle h, device_handle dh, int nr, uint64_t *msgidp);
 int device_send_generic_rpc(clixon_handle h, device_handle dh, cxobj *rpc_data);
 
 #ifdef __cplusplus
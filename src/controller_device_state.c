@@ -24,6 +24,8 @@
 
  CS_CLOSED \
      ^      \ connect
+     |<-- CS_QUEUED (if connect-window full)
+     |       |
      |       v        send get
      |<-- CS_CONNECTING
      |       |
@@ -54,10 +56,14 @@ Push state-machine:
      ^            |
      |            |
  PUSH-LOCK        |
+     ^            |
+     |            |
+ PUSH-DIFF**      |
      ^           /
      |          /
  CS_OPEN <------
 
+ ** Only if push-threads > 0
  */
 
 #include <stdio.h>
@@ -91,6 +97,16 @@ Push state-machine:
 #include "controller_device_send.h"
 #include "controller_transaction.h"
 #include "controller_device_recv.h"
+#include "controller_timer.h"
+#include "controller_io.h"
+
+/*! What to do with a change token fetched from device, see device_change_token_cb
+ */
+enum change_token_mode {
+    CT_FETCH,  /* Keep as token of device config pulled next */
+    CT_STORE,  /* Keep as token of SYNCED, after push commit */
+    CT_CHECK,  /* Compare with token of SYNCED, pull full config only if changed */
+};
 
 /*! Mapping between enum conn_state and yang connection-state
  *
@@ -100,11 +116,13 @@ static const map_str2int csmap[] = {
     {"CLOSED",           CS_CLOSED},
     {"OPEN",             CS_OPEN},
     /* Connect state machine */
+    {"QUEUED",           CS_QUEUED},
     {"CONNECTING",       CS_CONNECTING},
     {"SCHEMA-LIST",      CS_SCHEMA_LIST},
     {"SCHEMA-ONE",       CS_SCHEMA_ONE}, /* substate is schema-nr */
     {"DEVICE-SYNC",      CS_DEVICE_SYNC},
     /* Push state machine */
+    {"PUSH-DIFF",        CS_PUSH_DIFF},
     {"PUSH-LOCK",        CS_PUSH_LOCK},
     {"PUSH-CHECK",       CS_PUSH_CHECK},
     {"PUSH-EDIT",        CS_PUSH_EDIT},
@@ -166,6 +184,392 @@ yang_config_str2int(char *str)
     return clicon_str2int(yfmap, str);
 }
 
+/*! Schema fetch shared by all devices requesting the same schema in the same domain
+ *
+ * Indexed by "<domain>/<module>@<revision>" in the hash "controller-schema-fetch"
+ * Only the owner sends get-schema, other devices wait for it to be written to file.
+ */
+struct schema_fetch {
+    clixon_handle sf_h;      /* Clixon handle */
+    char         *sf_key;    /* Key in "controller-schema-fetch" */
+    char         *sf_owner;  /* Name of device that sent the get-schema request */
+    char         *sf_name;   /* Schema name */
+    char         *sf_rev;    /* Schema revision, or NULL */
+    cvec         *sf_waiters; /* Names of devices waiting for the schema */
+    struct controller_timer sf_timer; /* Handover to a waiting device if owner is closed */
+};
+
+/*! Free a schema fetch entry
+ */
+static int
+schema_fetch_free(struct schema_fetch *sf)
+{
+    (void)controller_timer_cancel(sf->sf_h, &sf->sf_timer);
+    if (sf->sf_key)
+        free(sf->sf_key);
+    if (sf->sf_owner)
+        free(sf->sf_owner);
+    if (sf->sf_name)
+        free(sf->sf_name);
+    if (sf->sf_rev)
+        free(sf->sf_rev);
+    if (sf->sf_waiters)
+        cvec_free(sf->sf_waiters);
+    free(sf);
+    return 0;
+}
+
+/*! Find schema fetch entry
+ *
+ * @param[in]  h       Clixon handle
+ * @param[in]  key     Key as created by schema_fetch_key
+ * @retval     sf      Schema fetch entry
+ * @retval     NULL    Not found
+ */
+static struct schema_fetch *
+schema_fetch_find(clixon_handle h,
+                  char         *key)
+{
+    clicon_hash_t *hash = NULL;
+    void          *p;
+    size_t         vlen;
+
+    if (clicon_ptr_get(h, "controller-schema-fetch", (void**)&hash) < 0 || hash == NULL)
+        return NULL;
+    if ((p = clicon_hash_value(hash, key, &vlen)) == NULL)
+        return NULL;
+    return *(struct schema_fetch **)p;
+}
+
+/*! Create schema fetch key
+ *
+ * @param[in]  domain  YANG domain
+ * @param[in]  name    Schema name
+ * @param[in]  rev     Schema revision, or NULL
+ * @retval     cb      Key buffer, free with cbuf_free
+ * @retval     NULL    Error
+ */
+static cbuf *
+schema_fetch_key(char *domain,
+                 char *name,
+                 char *rev)
+{
+    cbuf *cb;
+
+    if ((cb = cbuf_new()) == NULL){
+        clixon_err(OE_UNIX, errno, "cbuf_new");
+        return NULL;
+    }
+    cprintf(cb, "%s/%s", domain, name);
+    if (rev)
+        cprintf(cb, "@%s", rev);
+    return cb;
+}
+
+/*! Register that device sent get-schema for a schema
+ *
+ * @param[in]  h       Clixon handle
+ * @param[in]  dh      Device handle of owner
+ * @param[in]  domain  YANG domain
+ * @param[in]  name    Schema name
+ * @param[in]  rev     Schema revision, or NULL
+ * @retval     0       OK
+ * @retval    -1       Error
+ * @see device_schema_fetch_done
+ */
+int
+device_schema_fetch_add(clixon_handle h,
+                        device_handle dh,
+                        char         *domain,
+                        char         *name,
+                        char         *rev)
+{
+    int                  retval = -1;
+    clicon_hash_t       *hash = NULL;
+    struct schema_fetch *sf = NULL;
+    struct schema_fetch *sf0;
+    cbuf                *cb = NULL;
+
+    if (clicon_ptr_get(h, "controller-schema-fetch", (void**)&hash) < 0 || hash == NULL){
+        if ((hash = clicon_hash_init()) == NULL)
+            goto done;
+        clicon_ptr_set(h, "controller-schema-fetch", (void*)hash);
+    }
+    if ((cb = schema_fetch_key(domain, name, rev)) == NULL)
+        goto done;
+    if ((sf = malloc(sizeof(*sf))) == NULL){
+        clixon_err(OE_UNIX, errno, "malloc");
+        goto done;
+    }
+    memset(sf, 0, sizeof(*sf));
+    sf->sf_h = h;
+    if ((sf->sf_key = strdup(cbuf_get(cb))) == NULL ||
+        (sf->sf_owner = strdup(device_handle_name_get(dh))) == NULL ||
+        (sf->sf_name = strdup(name)) == NULL ||
+        (rev && (sf->sf_rev = strdup(rev)) == NULL)){
+        clixon_err(OE_UNIX, errno, "strdup");
+        goto done;
+    }
+    if ((sf->sf_waiters = cvec_new(0)) == NULL){
+        clixon_err(OE_UNIX, errno, "cvec_new");
+        goto done;
+    }
+    if ((sf0 = schema_fetch_find(h, cbuf_get(cb))) != NULL){ /* Replace, keep waiters */
+        cvec_free(sf->sf_waiters);
+        sf->sf_waiters = sf0->sf_waiters;
+        sf0->sf_waiters = NULL;
+        schema_fetch_free(sf0);
+    }
+    if (clicon_hash_add(hash, cbuf_get(cb), &sf, sizeof(sf)) == NULL)
+        goto done;
+    sf = NULL;
+    retval = 0;
+ done:
+    if (sf)
+        schema_fetch_free(sf);
+    if (cb)
+        cbuf_free(cb);
+    return retval;
+}
+
+/*! Check if another device already requested a schema, if so wait for it
+ *
+ * If so, the device is added as waiter and a waiting entry is added to the device
+ * @param[in]  h       Clixon handle
+ * @param[in]  dh      Device handle
+ * @param[in]  domain  YANG domain
+ * @param[in]  name    Schema name
+ * @param[in]  rev     Schema revision, or NULL
+ * @retval     1       Another device fetches the schema, wait for it
+ * @retval     0       No other device fetches the schema
+ * @retval    -1       Error
+ */
+int
+device_schema_fetch_wait(clixon_handle h,
+                         device_handle dh,
+                         char         *domain,
+                         char         *name,
+                         char         *rev)
+{
+    int                  retval = -1;
+    struct schema_fetch *sf;
+    cbuf                *cb = NULL;
+    char                *devname;
+
+    devname = device_handle_name_get(dh);
+    if ((cb = schema_fetch_key(domain, name, rev)) == NULL)
+        goto done;
+    if ((sf = schema_fetch_find(h, cbuf_get(cb))) == NULL ||
+        strcmp(sf->sf_owner, devname) == 0){
+        retval = 0;
+        goto done;
+    }
+    if (cvec_find(sf->sf_waiters, devname) == NULL &&
+        cvec_add_string(sf->sf_waiters, devname, NULL) < 0){
+        clixon_err(OE_UNIX, errno, "cvec_add_string");
+        goto done;
+    }
+    if (device_handle_schema_pending_add(dh, 1, 0, name, rev) < 0)
+        goto done;
+    clixon_debug(CLIXON_DBG_CTRL, "%s: wait for get-schema(%s@%s) from %s",
+                 devname, name, rev?rev:"", sf->sf_owner);
+    retval = 1;
+ done:
+    if (cb)
+        cbuf_free(cb);
+    return retval;
+}
+
+/*! Schema has been received by owner, remove fetch and resolve waiting devices
+ *
+ * Waiting devices with no more outstanding schemas are returned and can resume
+ * @param[in]  h       Clixon handle
+ * @param[in]  dh      Device handle that received the schema
+ * @param[in]  domain  YANG domain
+ * @param[in]  name    Schema name
+ * @param[in]  rev     Schema revision, or NULL
+ * @param[out] resume  Names of devices that can resume, free with cvec_free (if set)
+ * @retval     0       OK
+ * @retval    -1       Error
+ */
+int
+device_schema_fetch_done(clixon_handle h,
+                         device_handle dh,
+                         char         *domain,
+                         char         *name,
+                         char         *rev,
+                         cvec        **resume)
+{
+    int                  retval = -1;
+    clicon_hash_t       *hash = NULL;
+    struct schema_fetch *sf;
+    cbuf                *cb = NULL;
+    cg_var              *cv = NULL;
+    device_handle        dh1;
+
+    if ((cb = schema_fetch_key(domain, name, rev)) == NULL)
+        goto done;
+    if ((sf = schema_fetch_find(h, cbuf_get(cb))) == NULL ||
+        strcmp(sf->sf_owner, device_handle_name_get(dh)) != 0)
+        goto ok;
+    while ((cv = cvec_each(sf->sf_waiters, cv)) != NULL){
+        if ((dh1 = device_handle_find(h, cv_name_get(cv))) == NULL)
+            continue;
+        if (device_handle_conn_state_get(dh1) != CS_SCHEMA_ONE)
+            continue;
+        if (device_handle_schema_wait_rm(dh1, name, rev) == 0)
+            continue;
+        if (device_handle_schema_pending_nr(dh1, 0) > 0)
+            continue;
+        if (*resume == NULL && (*resume = cvec_new(0)) == NULL){
+            clixon_err(OE_UNIX, errno, "cvec_new");
+            goto done;
+        }
+        if (cvec_add_string(*resume, cv_name_get(cv), NULL) < 0){
+            clixon_err(OE_UNIX, errno, "cvec_add_string");
+            goto done;
+        }
+    }
+    if (clicon_ptr_get(h, "controller-schema-fetch", (void**)&hash) == 0 && hash != NULL)
+        clicon_hash_del(hash, cbuf_get(cb));
+    schema_fetch_free(sf);
+ ok:
+    retval = 0;
+ done:
+    if (cb)
+        cbuf_free(cb);
+    return retval;
+}
+
+/*! Hand over a schema fetch of a closed device to a waiting device
+ *
+ * Called from the event loop, not when the owner is closed, since the new owner may be in
+ * the middle of handling its own input.
+ * The first waiting device still requesting the schema sends a new get-schema and becomes
+ * owner, its state timeout is restarted. If there is none, the fetch is removed.
+ * @param[in]  h       Clixon handle
+ * @param[in]  arg     Schema fetch entry
+ * @retval     0       OK
+ * @retval    -1       Error
+ * @see device_schema_fetch_release
+ */
+static int
+schema_fetch_handover(clixon_handle h,
+                      void         *arg)
+{
+    int                  retval = -1;
+    struct schema_fetch *sf = (struct schema_fetch *)arg;
+    clicon_hash_t       *hash = NULL;
+    cg_var              *cv;
+    device_handle        dh1 = NULL;
+
+    while ((cv = cvec_i(sf->sf_waiters, 0)) != NULL){
+        dh1 = device_handle_find(h, cv_name_get(cv));
+        cvec_del(sf->sf_waiters, cv);
+        if (dh1 != NULL &&
+            device_handle_conn_state_get(dh1) == CS_SCHEMA_ONE &&
+            device_handle_schema_wait_rm(dh1, sf->sf_name, sf->sf_rev) == 1)
+            break;
+        dh1 = NULL;
+    }
+    if (dh1 == NULL){
+        if (clicon_ptr_get(h, "controller-schema-fetch", (void**)&hash) == 0 && hash != NULL)
+            clicon_hash_del(hash, sf->sf_key);
+        schema_fetch_free(sf);
+        goto ok;
+    }
+    free(sf->sf_owner);
+    if ((sf->sf_owner = strdup(device_handle_name_get(dh1))) == NULL){
+        clixon_err(OE_UNIX, errno, "strdup");
+        goto done;
+    }
+    if (device_send_get_schema(h, dh1, sf->sf_name, sf->sf_rev) < 0)
+        goto done;
+    if (device_state_timeout_register(dh1) < 0)
+        goto done;
+ ok:
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Device is closed, hand over its outstanding schema fetches to a waiting device
+ *
+ * The handover is deferred to the event loop
+ * @param[in]  h       Clixon handle
+ * @param[in]  dh      Device handle being closed
+ * @retval     0       OK
+ * @retval    -1       Error
+ * @see schema_fetch_handover
+ */
+static int
+device_schema_fetch_release(clixon_handle h,
+                            device_handle dh)
+{
+    int                  retval = -1;
+    clicon_hash_t       *hash = NULL;
+    struct schema_fetch *sf;
+    char               **keys = NULL;
+    size_t               klen = 0;
+    int                  i;
+    char                *devname;
+    struct timeval       t;
+
+    devname = device_handle_name_get(dh);
+    if (clicon_ptr_get(h, "controller-schema-fetch", (void**)&hash) < 0 || hash == NULL)
+        goto ok;
+    if ((keys = clicon_hash_keys(hash, &klen)) == NULL)
+        goto ok;
+    gettimeofday(&t, NULL);
+    for (i=0; i<klen; i++){
+        if ((sf = schema_fetch_find(h, keys[i])) == NULL ||
+            strcmp(sf->sf_owner, devname) != 0 ||
+            controller_timer_pending(&sf->sf_timer))
+            continue;
+        if (controller_timer_set(h, &sf->sf_timer, &t, schema_fetch_handover, sf) < 0)
+            goto done;
+    }
+ ok:
+    retval = 0;
+ done:
+    if (keys)
+        free(keys);
+    return retval;
+}
+
+/*! Free all schema fetch entries
+ *
+ * @param[in]  h       Clixon handle
+ * @retval     0       OK
+ * @retval    -1       Error
+ */
+int
+device_schema_fetch_free_all(clixon_handle h)
+{
+    int                  retval = -1;
+    clicon_hash_t       *hash = NULL;
+    struct schema_fetch *sf;
+    char               **keys = NULL;
+    size_t               klen = 0;
+    int                  i;
+
+    if (clicon_ptr_get(h, "controller-schema-fetch", (void**)&hash) < 0 || hash == NULL)
+        goto ok;
+    /* NULL keys and klen 0 if hash is empty, the hash is still freed */
+    keys = clicon_hash_keys(hash, &klen);
+    for (i=0; i<klen; i++){
+        if ((sf = schema_fetch_find(h, keys[i])) != NULL)
+            schema_fetch_free(sf);
+    }
+    clicon_hash_free(hash);
+    clicon_ptr_set(h, "controller-schema-fetch", NULL);
+ ok:
+    retval = 0;
+    if (keys)
+        free(keys);
+    return retval;
+}
+
 /*! Close connection, unregister events and timers
  *
  * @param[in]  dh      Clixon device handle.
@@ -190,6 +594,13 @@ device_close_connection(device_handle dh,
     name = device_handle_name_get(dh);
     device_handle_outmsg_set(dh, 1, NULL);
     device_handle_outmsg_set(dh, 2, NULL);
+    if (device_schema_fetch_release(device_handle_handle_get(dh), dh) < 0)
+        goto done;
+    device_handle_schema_pending_clear(dh);
+    device_handle_pipeline_clear(dh);
+    device_handle_drift_subscribed_set(dh, 0);
+    if (device_handle_dispatch_clear(dh) < 0)
+        goto done;
     if (format == NULL){
         clixon_debug(CLIXON_DBG_CTRL, "%s", name);
         device_handle_logmsg_set(dh, NULL);
@@ -213,10 +624,15 @@ device_close_connection(device_handle dh,
     }
     /* Handle case already closed */
     if ((s = device_handle_socket_get(dh)) != -1){
-        clixon_event_unreg_fd(s, device_input_cb); /* deregister events */
+        /* deregister events */
+        if (controller_io_unregister(device_handle_handle_get(dh), dh) == 0)
+            clixon_event_unreg_fd(s, device_input_cb);
         if (device_handle_disconnect(dh) < 0) /* close socket, reap sub-processes */
             goto done;
     }
+    /* Release read buffer, allocated again on next connect */
+    if (device_handle_read_buf_resize(dh, 0) < 0)
+        goto done;
 #if 0
     /* Clear yangs for domain changes, upgrade etc on close,
      * The drawback is you cannot run the CLI on disconnected devices
@@ -238,161 +654,364 @@ device_close_connection(device_handle dh,
     return retval;
 }
 
-/*! Handle input data from device, whole or part of a frame, called by event loop
+/*! Device input is closed, close device and fail its transaction, if any
  *
- * @param[in] s    Socket
- * @param[in] arg  Device handle
+ * If the device is an ssh sub-process, the reason is read from its stderr
+ * @param[in] h    Clixon handle
+ * @param[in] dh   Device handle
  * @retval    0    OK
  * @retval   -1    Error
  */
-int
-device_input_cb(int   s,
-                void *arg)
+static int
+device_input_eof(clixon_handle h,
+                 device_handle dh)
 {
     int                     retval = -1;
-    device_handle           dh = (device_handle)arg;
-    clixon_handle           h;
-    unsigned char           buf[BUFSIZ]; /* from stdio.h, typically 8K */
-    ssize_t                 buflen = sizeof(buf);
-    char                   *buferr=NULL; /* from stderr.h, typically 8K */
+    char                   *buferr = NULL; /* from stderr.h, typically 8K */
     ssize_t                 buferrlen = 1024;
-    int                     eom = 0;
-    int                     eof = 0;
-    int                     frame_state; /* only used for chunked framing not eom */
-    size_t                  frame_size;
-    netconf_framing_type    framing_type;
-    cbuf                   *cbmsg;
-    cbuf                   *cberr = NULL;
-    cxobj                  *xtop = NULL;
-    cxobj                  *xmsg;
-    cxobj                  *xerr = NULL;
-    unsigned char          *p = buf;
     ssize_t                 len;
-    size_t                  plen;
-    char                   *name;
+    int                     sockerr;
     uint64_t                tid;
     controller_transaction *ct = NULL;
-    int                     sockerr;
-    int                     ret;
 
-    h = device_handle_handle_get(dh);
-    frame_state = device_handle_frame_state_get(dh);
-    frame_size = device_handle_frame_size_get(dh);
-    cbmsg = device_handle_frame_buf_get(dh);
-    name = device_handle_name_get(dh);
     if ((tid = device_handle_tid_get(dh)) != 0)
         ct = controller_transaction_find(h, tid);
-    /* Read input data from socket and append to cbbuf */
-    if ((len = netconf_input_read2(s, buf, buflen, &eof)) < 0)
-        goto done;
-    if (eof){
-        if ((sockerr = device_handle_sockerr_get(dh)) != -1){
-            if ((buferr = malloc(buferrlen)) == NULL){
-                clixon_err(OE_UNIX, errno, "malloc");
-                goto done;
-            }
-            memset(buferr, 0, buferrlen);
-            if (clixon_event_poll(sockerr) == 0){
-                strncpy(buferr, "ssh sub-process killed", buferrlen);
-            }
-            else {
-                if ((len = read(sockerr, buferr, buferrlen-1)) < 0){ // XXX hangs on SIGCHLD?
-                    free(buferr);
-                    buferr = NULL;
-                }
-                /* Special case for removing CR at end of stderr string */
-                while (len>0 && (buferr[len-1] == '\r' || buferr[len-1] == '\n')) {
-                    buferr[len - 1] = '\0';
-                    len--;
-                }
-            }
-        }
-        if (ct){
-            if (controller_transaction_failed(h, tid, ct, dh, TR_FAILED_DEV_CLOSE, name,
-                                              buferr?buferr:"Closed by device"
-                                              ) < 0)
-                goto done;
-        }
-        else{
-            if (buferr)
-                device_close_connection(dh, "%s", buferr);
-            else
-                device_close_connection(dh, "Closed by device");
+    if ((sockerr = device_handle_sockerr_get(dh)) != -1){
+        if ((buferr = malloc(buferrlen)) == NULL){
+            clixon_err(OE_UNIX, errno, "malloc");
+            goto done;
         }
-        goto ok;
-    }
-    p = buf;
-    plen = len;
-    while (!eof && plen > 0){
-        framing_type = device_handle_framing_type_get(dh);
-        if (netconf_input_msg2(&p, &plen,
-                               cbmsg,
-                               framing_type,
-                               &frame_state,
-                               &frame_size,
-                               &eom) < 0)
-            goto done;
-        if (eom == 0){ /* frame not complete */
-            clixon_debug(CLIXON_DBG_MSG | CLIXON_DBG_DETAIL2, "frame: %lu", cbuf_len(cbmsg));
-            /* Extra data to read, save data and continue on next round */
-            break;
+        memset(buferr, 0, buferrlen);
+        if (clixon_event_poll(sockerr) == 0){
+            strncpy(buferr, "ssh sub-process killed", buferrlen);
         }
-        if (clixon_debug_detail())
-            clixon_debug(CLIXON_DBG_MSG | CLIXON_DBG_DETAIL, "Recv [%s]: %s", name, cbuf_get(cbmsg));
-        else
-            clixon_debug(CLIXON_DBG_MSG, "Recv [%s] len: %lu", name, cbuf_len(cbmsg));
-        if ((ret = netconf_input_frame2(cbmsg, YB_NONE, NULL, &xtop, &xerr)) < 0)
-            goto done;
-        cbuf_reset(cbmsg);
-        if (ret == 0){
-            if ((cberr = cbuf_new()) == NULL){
-                clixon_err(OE_UNIX, errno, "cbuf_new");
-                goto done;
+        else {
+            if ((len = read(sockerr, buferr, buferrlen-1)) < 0){ // XXX hangs on SIGCHLD?
+                free(buferr);
+                buferr = NULL;
             }
-            if (netconf_err2cb(h, xerr, cberr) < 0)
-                goto done;
-            if (ct){
-                // use XXX cberr but its XML
-                if (controller_transaction_failed(h, tid, ct, dh, TR_FAILED_DEV_CLOSE, name, "Invalid frame") < 0)
-                    goto done;
+            /* Special case for removing CR at end of stderr string */
+            while (len>0 && (buferr[len-1] == '\r' || buferr[len-1] == '\n')) {
+                buferr[len - 1] = '\0';
+                len--;
             }
-            else
-                device_close_connection(dh, "Invalid frame");
-            goto ok;
         }
-        xmsg = xml_child_i_type(xtop, 0, CX_ELMNT);
-        if ((xmsg = xml_child_i_type(xtop, 0, CX_ELMNT)) != NULL) {
-            /* Main state machine for controller transactions+devices */
-            if (device_state_handler(h, dh, s, xmsg) < 0)
-                goto done;
-        }
-    } /* while */
-    device_handle_frame_state_set(dh, frame_state);
-    device_handle_frame_size_set(dh, frame_size);
- ok:
+    }
+    if (ct){
+        if (controller_transaction_failed(h, tid, ct, dh, TR_FAILED_DEV_CLOSE,
+                                          device_handle_name_get(dh),
+                                          buferr?buferr:"Closed by device"
+                                          ) < 0)
+            goto done;
+    }
+    else{
+        if (buferr)
+            device_close_connection(dh, "%s", buferr);
+        else
+            device_close_connection(dh, "Closed by device");
+    }
     retval = 0;
  done:
     if (buferr)
         free(buferr);
-    if (cberr)
-        cbuf_free(cberr);
-    if (xerr)
-        xml_free(xerr);
-    if (xtop)
-        xml_free(xtop);
     return retval;
 }
 
-/*! Given devicename and XML tree, create XML tree and device mount-point
+/*! Invalid input from device, close device and fail its transaction, if any
  *
- * @param[in]  devicename Name of device
- * @param[in]  yspec      Top level Yang spec
- * @param[out] xt         Top of created tree (Deallocate with xml_free)
- * @param[out] xroot      XML mount-point in created tree
- * @retval     0          OK
- * @retval    -1          Error
+ * @param[in] h      Clixon handle
+ * @param[in] dh     Device handle
+ * @param[in] xerr   Parse error, or NULL
+ * @param[in] reason Reason
+ * @retval    0      OK
+ * @retval   -1      Error
  */
-int
+static int
+device_input_invalid(clixon_handle h,
+                     device_handle dh,
+                     cxobj        *xerr,
+                     const char   *reason)
+{
+    int                     retval = -1;
+    cbuf                   *cberr = NULL;
+    uint64_t                tid;
+    controller_transaction *ct = NULL;
+
+    if ((tid = device_handle_tid_get(dh)) != 0)
+        ct = controller_transaction_find(h, tid);
+    if (xerr){
+        if ((cberr = cbuf_new()) == NULL){
+            clixon_err(OE_UNIX, errno, "cbuf_new");
+            goto done;
+        }
+        if (netconf_err2cb(h, xerr, cberr) < 0)
+            goto done;
+    }
+    if (ct){
+        // use XXX cberr but its XML
+        if (controller_transaction_failed(h, tid, ct, dh, TR_FAILED_DEV_CLOSE,
+                                          device_handle_name_get(dh), reason) < 0)
+            goto done;
+    }
+    else
+        device_close_connection(dh, "%s", reason);
+    retval = 0;
+ done:
+    if (cberr)
+        cbuf_free(cberr);
+    return retval;
+}
+
+/*! Dispatch a received and parsed message from device
+ *
+ * @param[in] h    Clixon handle
+ * @param[in] dh   Device handle
+ * @param[in] s    Socket
+ * @param[in] xtop Parsed message
+ * @retval    0    OK
+ * @retval   -1    Error
+ */
+static int
+device_input_xml(clixon_handle h,
+                 device_handle dh,
+                 int           s,
+                 cxobj        *xtop)
+{
+    cxobj *xmsg;
+
+    if ((xmsg = xml_child_i_type(xtop, 0, CX_ELMNT)) != NULL) {
+        /* Unsolicited notifications are not part of the state machine */
+        if (strcmp(xml_name(xmsg), "notification") == 0){
+            if (device_recv_notification(h, dh, xmsg) < 0)
+                return -1;
+        }
+        /* Main state machine for controller transactions+devices */
+        else if (device_state_handler(h, dh, s, xmsg) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/*! Handle message, or end of input, from device read by an io worker thread
+ *
+ * @param[in] h      Clixon handle
+ * @param[in] dh     Device handle
+ * @param[in] s      Socket
+ * @param[in] cbmsg  Message without framing, freed here, or NULL on end of input
+ * @param[in] reason If cbmsg is NULL: "" if closed by device, otherwise error reason
+ * @retval    0      OK
+ * @retval   -1      Error
+ * @see controller_io_register
+ */
+static int
+device_input_worker_cb(clixon_handle h,
+                       device_handle dh,
+                       int           s,
+                       cbuf         *cbmsg,
+                       const char   *reason)
+{
+    int    retval = -1;
+    cxobj *xtop = NULL;
+    cxobj *xerr = NULL;
+    char  *name;
+    int    ret;
+
+    if (device_handle_socket_get(dh) != s)
+        goto ok;
+    name = device_handle_name_get(dh);
+    if (cbmsg == NULL){
+        if (*reason == '\0'){
+            if (device_input_eof(h, dh) < 0)
+                goto done;
+        }
+        else if (device_input_invalid(h, dh, NULL, reason) < 0)
+            goto done;
+        goto ok;
+    }
+    if (clixon_debug_detail())
+        clixon_debug(CLIXON_DBG_MSG | CLIXON_DBG_DETAIL, "Recv [%s]: %s", name, cbuf_get(cbmsg));
+    else
+        clixon_debug(CLIXON_DBG_MSG, "Recv [%s] len: %lu", name, cbuf_len(cbmsg));
+    ret = netconf_input_frame2(cbmsg, YB_NONE, NULL, &xtop, &xerr);
+    /* Release message text before the parsed tree is processed */
+    cbuf_free(cbmsg);
+    cbmsg = NULL;
+    if (ret < 0)
+        goto done;
+    if (ret == 0){
+        if (device_input_invalid(h, dh, xerr, "Invalid frame") < 0)
+            goto done;
+        goto ok;
+    }
+    if (device_input_xml(h, dh, s, xtop) < 0)
+        goto done;
+ ok:
+    retval = 0;
+ done:
+    if (cbmsg)
+        cbuf_free(cbmsg);
+    if (xerr)
+        xml_free(xerr);
+    if (xtop)
+        xml_free(xtop);
+    return retval;
+}
+
+/*! Handle input data from device, whole or part of a frame, called by event loop
+ *
+ * Drain the socket with reads into a per-device buffer until no more input is available or
+ * the read budget of this wakeup is used, so that a large reply is received in few wakeups
+ * while other devices and clients are still served.
+ * The buffer doubles when a read fills it. A grown buffer is released when the socket is
+ * drained without a full read in CONTROLLER_READ_BUF_IDLE consecutive wakeups, so that it is
+ * kept between the messages of a burst.
+ * @param[in] s    Socket
+ * @param[in] arg  Device handle
+ * @retval    0    OK
+ * @retval   -1    Error
+ * @see read-budget in clixon-controller.yang
+ */
+int
+device_input_cb(int   s,
+                void *arg)
+{
+    int                     retval = -1;
+    device_handle           dh = (device_handle)arg;
+    clixon_handle           h;
+    unsigned char          *buf;
+    size_t                  buflen;
+    int                     eom = 0;
+    int                     eof = 0;
+    int                     frame_state; /* only used for chunked framing not eom */
+    size_t                  frame_size;
+    netconf_framing_type    framing_type;
+    cbuf                   *cbmsg;
+    cxobj                  *xtop = NULL;
+    cxobj                  *xerr = NULL;
+    unsigned char          *p;
+    ssize_t                 len;
+    size_t                  plen;
+    char                   *name;
+    int                     budget;
+    int                     tbudget;
+    size_t                  total = 0;
+    int                     idle = 0;
+    int                     full = 0;
+    int                     nidle;
+    struct timeval          t0;
+    struct timeval          t;
+    int                     ret;
+
+    h = device_handle_handle_get(dh);
+    frame_state = device_handle_frame_state_get(dh);
+    frame_size = device_handle_frame_size_get(dh);
+    cbmsg = device_handle_frame_buf_get(dh);
+    name = device_handle_name_get(dh);
+    if ((budget = clicon_data_int_get(h, "controller-read-budget")) <= 0)
+        budget = CONTROLLER_READ_BUDGET_DEFAULT;
+    if ((tbudget = clicon_data_int_get(h, "controller-read-time-budget")) <= 0)
+        tbudget = CONTROLLER_READ_TIME_BUDGET_DEFAULT;
+    gettimeofday(&t0, NULL);
+    do {
+        if ((buf = device_handle_read_buf_get(dh, &buflen)) == NULL)
+            goto done;
+        /* Read input data from socket and append to cbbuf */
+        if ((len = netconf_input_read2(s, buf, buflen, &eof)) < 0)
+            goto done;
+        if (eof){
+            if (device_input_eof(h, dh) < 0)
+                goto done;
+            goto ok;
+        }
+        total += len;
+        p = buf;
+        plen = len;
+        while (!eof && plen > 0){
+            framing_type = device_handle_framing_type_get(dh);
+            if (netconf_input_msg_scan(&p, &plen,
+                                       cbmsg,
+                                       framing_type,
+                                       &frame_state,
+                                       &frame_size,
+                                       &eom) < 0)
+                goto done;
+            if (eom == 0){ /* frame not complete */
+                clixon_debug(CLIXON_DBG_MSG | CLIXON_DBG_DETAIL2, "frame: %lu", cbuf_len(cbmsg));
+                /* Extra data to read, save data and continue on next round */
+                break;
+            }
+            if (clixon_debug_detail())
+                clixon_debug(CLIXON_DBG_MSG | CLIXON_DBG_DETAIL, "Recv [%s]: %s", name, cbuf_get(cbmsg));
+            else
+                clixon_debug(CLIXON_DBG_MSG, "Recv [%s] len: %lu", name, cbuf_len(cbmsg));
+            if ((ret = netconf_input_frame2(cbmsg, YB_NONE, NULL, &xtop, &xerr)) < 0)
+                goto done;
+            /* Release message text before the parsed tree is processed */
+            if (device_handle_frame_buf_reset(dh) < 0)
+                goto done;
+            cbmsg = device_handle_frame_buf_get(dh);
+            if (ret == 0){
+                if (device_input_invalid(h, dh, xerr, "Invalid frame") < 0)
+                    goto done;
+                goto ok;
+            }
+            if (device_input_xml(h, dh, s, xtop) < 0)
+                goto done;
+            /* Free message before next is parsed */
+            xml_free(xtop);
+            xtop = NULL;
+        } /* while */
+        /* Adapt read buffer to input rate */
+        if ((size_t)len == buflen){
+            full++;
+            if (buflen < CONTROLLER_READ_BUF_MAX &&
+                device_handle_read_buf_resize(dh, buflen*2) < 0)
+                goto done;
+        }
+        /* Device may have been closed by state machine */
+        if (device_handle_socket_get(dh) != s)
+            break;
+        if (total >= (size_t)budget)
+            break;
+        gettimeofday(&t, NULL);
+        timersub(&t, &t0, &t);
+        if (t.tv_sec*1000 + t.tv_usec/1000 >= tbudget)
+            break;
+    } while ((idle = (clixon_event_poll(s) == 0)) == 0);
+    /* Socket drained: release a grown read buffer after some wakeups without a burst */
+    if (device_handle_socket_get(dh) == s){
+        nidle = device_handle_read_idle_get(dh);
+        if (full || !idle)
+            nidle = 0;
+        else if (++nidle >= CONTROLLER_READ_BUF_IDLE){
+            if (device_handle_read_buf_resize(dh, CONTROLLER_READ_BUF_MIN) < 0)
+                goto done;
+            nidle = 0;
+        }
+        device_handle_read_idle_set(dh, nidle);
+    }
+    device_handle_frame_state_set(dh, frame_state);
+    device_handle_frame_size_set(dh, frame_size);
+ ok:
+    retval = 0;
+ done:
+    if (xerr)
+        xml_free(xerr);
+    if (xtop)
+        xml_free(xtop);
+    return retval;
+}
+
+/*! Given devicename and XML tree, create XML tree and device mount-point
+ *
+ * @param[in]  devicename Name of device
+ * @param[in]  yspec      Top level Yang spec
+ * @param[out] xt         Top of created tree (Deallocate with xml_free)
+ * @param[out] xroot      XML mount-point in created tree
+ * @retval     0          OK
+ * @retval    -1          Error
+ */
+int
 device_state_mount_point_get(char      *devicename,
                              yang_stmt *yspec,
                              cxobj    **xtp,
@@ -547,31 +1166,49 @@ device_schemas_local_check(clixon_handle h,
 
 /*! Timeout callback of transient states, close connection
  *
+ * @param[in] h      Clixon handle
  * @param[in] arg    In effect client handle
  * @retval    0      OK
  * @retval   -1      Error
  */
 static int
-device_state_timeout(int   s,
-                     void *arg)
+device_state_timeout(clixon_handle h,
+                     void         *arg)
 {
     int                     retval = -1;
     device_handle           dh = (device_handle)arg;
     uint64_t                tid;
     controller_transaction *ct = NULL;
-    clixon_handle           h;
     char                   *name;
+    uint32_t                consecutive;
+    int                     threshold;
+    int                     qtime;
+    struct timeval          t;
 
     name = device_handle_name_get(dh);
     clixon_debug(CLIXON_DBG_CTRL, "%s", name);
-    h = device_handle_handle_get(dh);
     clixon_log(h, LOG_NOTICE, "%s Device state timeout. Waiting for device %s to change state from %s",
                __func__, name, device_state_int2str(device_handle_conn_state_get(dh)));
+    /* Release expired quarantine, count consecutive timeouts from start */
+    if (device_handle_quarantine_expired(dh))
+        device_handle_quarantine_set(dh, NULL);
+    device_handle_timeout_add(dh, &consecutive);
+    if ((threshold = clicon_data_int_get(h, "controller-quarantine-threshold")) > 0 &&
+        consecutive >= threshold &&
+        !device_handle_quarantined(dh)){
+        if ((qtime = clicon_data_int_get(h, "controller-quarantine-time")) < 0)
+            qtime = CONTROLLER_QUARANTINE_TIME_DEFAULT;
+        gettimeofday(&t, NULL);
+        t.tv_sec += qtime;
+        device_handle_quarantine_set(dh, &t);
+        clixon_log(h, LOG_NOTICE, "%s Device %s quarantined for %d s after %u consecutive timeouts",
+                   __func__, name, qtime, consecutive);
+    }
     if ((tid = device_handle_tid_get(dh)) != 0){
         ct = controller_transaction_find(h, tid);
     }
     if (ct){
-        if (controller_transaction_failed(device_handle_handle_get(dh), tid, ct, dh, TR_FAILED_DEV_CLOSE, name, "Timeout waiting for remote peer") < 0)
+        if (controller_transaction_failed(h, tid, ct, dh, TR_FAILED_DEV_CLOSE, name, "Timeout waiting for remote peer") < 0)
             goto done;
     }
     else if (device_close_connection(dh, "Timeout waiting for remote peer") < 0)
@@ -581,8 +1218,57 @@ device_state_timeout(int   s,
     return retval;
 }
 
-/*! Set timeout of transient device state
+/*! Get timeout of a transient state of a device
+ *
+ * The timeout is device-timeout, or if adaptive-timeout is set and the device has
+ * enough samples of the state, a factor of its latency between timeout-floor and
+ * timeout-ceiling
+ * @param[in]  h      Clixon handle
+ * @param[in]  dh     Device handle
+ * @param[in]  state  Transient connection state
+ * @param[out] tv     Timeout
+ * @retval     0      OK
+ */
+static int
+device_state_timeout_get(clixon_handle   h,
+                         device_handle   dh,
+                         conn_state      state,
+                         struct timeval *tv)
+{
+    int      d;
+    int      tfloor;
+    int      tceiling;
+    uint32_t ewma;
+    uint32_t p95;
+    uint32_t nr;
+    uint64_t ms;
+
+    if ((d = clicon_data_int_get(h, "controller-device-timeout")) < 0)
+        d = CONTROLLER_DEVICE_TIMEOUT_DEFAULT;
+    ms = (uint64_t)d*1000;
+    /* Waiting for other devices is not a latency of the device */
+    if (clicon_data_int_get(h, "controller-adaptive-timeout") == 1 && state != CS_PUSH_WAIT){
+        device_handle_latency_get(dh, state, &ewma, &p95, &nr);
+        if (nr >= CONTROLLER_ADAPTIVE_TIMEOUT_SAMPLES){
+            if ((tfloor = clicon_data_int_get(h, "controller-timeout-floor")) < 0)
+                tfloor = CONTROLLER_TIMEOUT_FLOOR_DEFAULT;
+            if ((tceiling = clicon_data_int_get(h, "controller-timeout-ceiling")) <= 0)
+                tceiling = d;
+            ms = (uint64_t)(p95 > ewma ? p95 : ewma) * CONTROLLER_ADAPTIVE_TIMEOUT_FACTOR;
+            if (ms < (uint64_t)tfloor*1000)
+                ms = (uint64_t)tfloor*1000;
+            if (ms > (uint64_t)tceiling*1000)
+                ms = (uint64_t)tceiling*1000;
+        }
+    }
+    tv->tv_sec = ms/1000;
+    tv->tv_usec = (ms%1000)*1000;
+    return 0;
+}
+
+/*! Set timeout of transient device state, or restart it if already set
  *
+ * The timer of the device is rescheduled in the controller timer wheel
  * @param[in] dh  Device handle
  * @retval    0      OK
  * @retval   -1      Error
@@ -593,33 +1279,18 @@ device_state_timeout_register(device_handle dh)
     int            retval = -1;
     struct timeval t;
     struct timeval t1;
-    int            d;
     clixon_handle  h;
-    cbuf          *cb = NULL;
-    char          *name;
 
-    name = device_handle_name_get(dh);
     gettimeofday(&t, NULL);
     h = device_handle_handle_get(dh);
-    if ((d = clicon_data_int_get(h, "controller-device-timeout")) < 0)
-        t1.tv_sec = CONTROLLER_DEVICE_TIMEOUT_DEFAULT;
-    else
-        t1.tv_sec = d;
-    t1.tv_usec = 0;
-    clixon_debug(CLIXON_DBG_CTRL | CLIXON_DBG_DETAIL, "timeout:%ld s", t1.tv_sec);
+    device_state_timeout_get(h, dh, device_handle_conn_state_get(dh), &t1);
+    clixon_debug(CLIXON_DBG_CTRL | CLIXON_DBG_DETAIL, "%s timeout:%ld.%03ld s",
+                 device_handle_name_get(dh), t1.tv_sec, (long)t1.tv_usec/1000);
     timeradd(&t, &t1, &t);
-    if ((cb = cbuf_new()) == NULL){
-        clixon_err(OE_UNIX, errno, "cbuf_new");
-        goto done;
-    }
-    cprintf(cb, "Device %s in state %s",
-            name, device_state_int2str(device_handle_conn_state_get(dh)));
-    if (clixon_event_reg_timeout(t, device_state_timeout, dh, cbuf_get(cb)) < 0)
+    if (controller_timer_set(h, device_handle_state_timer_get(dh), &t, device_state_timeout, dh) < 0)
         goto done;
     retval = 0;
  done:
-    if (cb)
-        cbuf_free(cb);
     return retval;
 }
 
@@ -630,15 +1301,11 @@ device_state_timeout_register(device_handle dh)
 int
 device_state_timeout_unregister(device_handle dh)
 {
-    char *name;
-
-    name = device_handle_name_get(dh);
-    clixon_debug(CLIXON_DBG_CTRL | CLIXON_DBG_DETAIL, "%s", name);
-    (void)clixon_event_unreg_timeout(device_state_timeout, dh);
-    return 0;
+    clixon_debug(CLIXON_DBG_CTRL | CLIXON_DBG_DETAIL, "%s", device_handle_name_get(dh));
+    return controller_timer_cancel(device_handle_handle_get(dh), device_handle_state_timer_get(dh));
 }
 
-/*! Restart timer (stop; start)
+/*! Restart timer
  *
  * @param[in] dh  Device handle
  * @retval    0   OK
@@ -647,15 +1314,27 @@ device_state_timeout_unregister(device_handle dh)
 static int
 device_state_timeout_restart(device_handle dh)
 {
-    int retval = -1;
+    return device_state_timeout_register(dh);
+}
 
-    if (device_state_timeout_unregister(dh) < 0)
-        goto done;
-    if (device_state_timeout_register(dh) < 0)
-        goto done;
-    retval = 0;
- done:
-    return retval;
+/*! Add latency sample of current state, the time since the state was entered
+ *
+ * @param[in] dh  Device handle
+ * @retval    0   OK
+ * @retval   -1   Error
+ * @see devices/device/state-latency
+ */
+static int
+device_state_latency_sample(device_handle dh)
+{
+    struct timeval t0;
+    struct timeval t;
+
+    device_handle_conn_time_get(dh, &t0);
+    gettimeofday(&t, NULL);
+    timersub(&t, &t0, &t);
+    return device_handle_latency_add(dh, device_handle_conn_state_get(dh),
+                                     t.tv_sec*1000 + t.tv_usec/1000);
 }
 
 /*! Combined function to both change device state and set/reset/unregister timeout
@@ -670,82 +1349,308 @@ int
 device_state_set(device_handle dh,
                  conn_state    state)
 {
-    int        retval = -1;
-    conn_state state0;
+    int            retval = -1;
+    conn_state     state0;
 
     /* From state handling */
     state0 = device_handle_conn_state_get(dh);
-    if (state0 != CS_CLOSED && state0 != CS_OPEN){
-        if (device_state_timeout_unregister(dh) < 0)
+    if (state0 != CS_CLOSED && state0 != CS_OPEN && state0 != CS_QUEUED){
+        /* Timer is restarted in place if next state is also transient */
+        if ((state == CS_CLOSED || state == CS_OPEN || state == CS_QUEUED) &&
+            device_state_timeout_unregister(dh) < 0)
             goto done;
+        /* Latency of state, unless failed or waiting for other devices.
+         * A push held back by output-queue-limit was sampled when held */
+        if (state != CS_CLOSED && state0 != CS_PUSH_WAIT &&
+            !device_handle_flag_get(dh, DH_FLAG_PUSH_HELD)){
+            if (device_state_latency_sample(dh) < 0)
+                goto done;
+        }
     }
     /* To state handling */
     device_handle_conn_state_set(dh, state);
-    if (state != CS_CLOSED && state != CS_OPEN){
+    device_handle_flag_reset(dh, DH_FLAG_PUSH_HELD);
+    if (state != CS_CLOSED && state != CS_OPEN && state != CS_QUEUED){
         if (device_state_timeout_register(dh) < 0)
             goto done;
     }
+    /* A connect slot may have been freed */
+    if ((state == CS_CLOSED || state == CS_OPEN) &&
+        device_handle_connq_first(device_handle_handle_get(dh)) != NULL){
+        if (device_connect_dispatch_register(device_handle_handle_get(dh)) < 0)
+            goto done;
+    }
     retval = 0;
  done:
     return retval;
 }
 
-/*! Write device config to db file without sanity of yang checks
+/*! Get max number of devices connecting at the same time
  *
- * @param[in]  h           Clixon handle.
- * @param[in]  devname     Device name
- * @param[in]  config_type Device config tyoe
- * @param[in]  xdata       XML tree to write
- * @param[out] cbret       Initialized cligen buffer. On exit contains XML if retval == 0
- * @retval     1           OK
- * @retval     0           Fail (cbret set)
- * @retval    -1           Error
+ * @param[in]  h       Clixon handle
+ * @retval     window  Max number of connecting devices
  */
-int
-device_config_write(clixon_handle h,
-                    char         *devname,
-                    char         *config_type,
-                    cxobj        *xdata,
-                    cbuf         *cbret)
+static int
+device_connect_window(clixon_handle h)
 {
-    int    retval = -1;
-    cbuf  *cb = NULL;
-    char  *db;
+    int window;
 
-    if (devname == NULL || config_type == NULL){
-        clixon_err(OE_UNIX, EINVAL, "devname or config_type is NULL");
+    if ((window = clicon_data_int_get(h, "controller-connect-window")) <= 0)
+        window = CONTROLLER_CONNECT_WINDOW_DEFAULT;
+    return window;
+}
+
+/*! Start connecting a device using its connect parameters
+ *
+ * @param[in]  h       Clixon handle
+ * @param[in]  dh      Device handle, in CLOSED or QUEUED state
+ * @retval     0       OK
+ * @retval    -1       Error
+ * @see device_handle_conn_params_set
+ */
+static int
+device_connect_start(clixon_handle h,
+                     device_handle dh)
+{
+    int   retval = -1;
+    cbuf *cb = NULL;
+    char *dest = NULL;
+    char *port = NULL;
+    int   stricthostkey = 1;
+    int   s;
+    int   ret;
+
+    device_handle_conn_params_get(dh, &dest, &port, &stricthostkey);
+    if (dest == NULL){
+        clixon_err(OE_PLUGIN, EINVAL, "No connect destination");
         goto done;
     }
+    if (device_handle_connect(dh, CLIXON_CLIENT_SSH, dest, port, stricthostkey) < 0)
+        goto done;
+    if (device_state_set(dh, CS_CONNECTING) < 0)
+        goto done;
+    s = device_handle_socket_get(dh);
+    device_handle_framing_type_set(dh, NETCONF_SSH_EOM); // XXX
     if ((cb = cbuf_new()) == NULL){
         clixon_err(OE_UNIX, errno, "cbuf_new");
         goto done;
     }
-    cprintf(cb, "device-%s-%s", devname, config_type);
-    db = cbuf_get(cb);
-    if (xmldb_db_reset(h, db) < 0)
+    cprintf(cb, "Netconf ssh %s", dest);
+    /* Read by an io worker thread if io-threads is set, otherwise by the event loop */
+    if ((ret = controller_io_register(h, dh, s, device_input_worker_cb)) < 0)
+        goto done;
+    if (ret == 0 &&
+        clixon_event_reg_fd(s, device_input_cb, dh, cbuf_get(cb)) < 0)
         goto done;
-    retval = xmldb_put(h, db, OP_REPLACE, xdata, clicon_username_get(h), cbret);
+    retval = 0;
  done:
     if (cb)
         cbuf_free(cb);
     return retval;
 }
 
-/*! Get local copy device datastore
+/*! Connect queued devices while there are free connect slots
  *
- * @param[in]  h           Clixon handle
- * @param[in]  name        Device name
- * @param[in]  config_type Device config tyoe
- * @param[out] xdatap      Device config XML (if retval=1)
- * @param[out] cberr       Error message (if retval=0)
- * @retval     1           OK
- * @retval     0           Failed (No such device tree)
- * @retval    -1           Error
+ * Timeout callback registered by device_connect_dispatch_register
+ * If a device fails to start connecting, it is closed and leaves its transaction
+ * @param[in]  s     Not used
+ * @param[in]  arg   Clixon handle
+ * @retval     0     OK
+ * @retval    -1     Error
  */
-int
-device_config_read(clixon_handle h,
-                   char         *devname,
-                   char         *config_type,
+static int
+device_connect_dispatch(int   s,
+                        void *arg)
+{
+    int                     retval = -1;
+    clixon_handle           h = (clixon_handle)arg;
+    device_handle           dh;
+    controller_transaction *ct;
+    uint64_t                tid;
+    int                     window;
+
+    window = device_connect_window(h);
+    while (device_handle_connecting_nr(h) < window &&
+           !device_send_backpressure(h) &&
+           (dh = device_handle_connq_first(h)) != NULL){
+        if (device_connect_start(h, dh) == 0)
+            continue;
+        if (device_close_connection(dh, "Connect failed: %s", clixon_err_reason()) < 0)
+            goto done;
+        clixon_err_reset();
+        ct = NULL;
+        if ((tid = device_handle_tid_get(dh)) != 0 &&
+            (ct = controller_transaction_find(h, tid)) != NULL){
+            if (controller_transaction_failed(h, tid, ct, dh, TR_FAILED_DEV_LEAVE,
+                                              device_handle_name_get(dh),
+                                              device_handle_logmsg_get(dh)) < 0)
+                goto done;
+        }
+    }
+    retval = 0;
+ done:
+    clicon_data_int_set(h, "controller-connect-dispatch", 0);
+    return retval;
+}
+
+/*! Register connect dispatch to run immediately from the event loop, unless already registered
+ *
+ * Not run directly since slots are freed deep in the state machine, eg in device_close_connection
+ * @param[in]  h     Clixon handle
+ * @retval     0     OK
+ * @retval    -1     Error
+ */
+int
+device_connect_dispatch_register(clixon_handle h)
+{
+    int            retval = -1;
+    struct timeval t;
+
+    if (clicon_data_int_get(h, "controller-connect-dispatch") == 1)
+        goto ok;
+    gettimeofday(&t, NULL);
+    if (clixon_event_reg_timeout(t, device_connect_dispatch, h, "controller connect dispatch") < 0)
+        goto done;
+    clicon_data_int_set(h, "controller-connect-dispatch", 1);
+ ok:
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Connect device now, or queue it if max number of devices are connecting
+ *
+ * Connect parameters are set by device_handle_conn_params_set.
+ * Queued devices are in the QUEUED state, and are connected in order as
+ * other devices become OPEN or CLOSED, or as output to devices is drained below
+ * output-queue-limit.
+ * @param[in]  h     Clixon handle
+ * @param[in]  dh    Device handle in CLOSED state
+ * @retval     0     OK
+ * @retval    -1     Error
+ * @see clixon-controller@2026-06-01.yang connect-window
+ */
+int
+device_connect_schedule(clixon_handle h,
+                        device_handle dh)
+{
+    int retval = -1;
+
+    if (device_handle_connq_first(h) == NULL &&
+        device_handle_connecting_nr(h) < device_connect_window(h) &&
+        !device_send_backpressure(h)){
+        if (device_connect_start(h, dh) < 0)
+            goto done;
+    }
+    else if (device_state_set(dh, CS_QUEUED) < 0)
+        goto done;
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Write device config to db file without sanity of yang checks
+ *
+ * Also compute content digest of the device config and store it in the device handle.
+ * For SYNCED, also the digests of its subtrees, used to diff only changed subtrees on push
+ * @param[in]  h           Clixon handle.
+ * @param[in]  devname     Device name
+ * @param[in]  config_type Device config tyoe
+ * @param[in]  xdata       XML tree to write
+ * @param[out] cbret       Initialized cligen buffer. On exit contains XML if retval == 0
+ * @retval     1           OK
+ * @retval     0           Fail (cbret set)
+ * @retval    -1           Error
+ * @see device_config_digest_equal
+ */
+int
+device_config_write(clixon_handle h,
+                    char         *devname,
+                    char         *config_type,
+                    cxobj        *xdata,
+                    cbuf         *cbret)
+{
+    int                retval = -1;
+    cbuf              *cb = NULL;
+    char              *db;
+    device_handle      dh;
+    device_config_type dt;
+    cxobj             *xroot;
+    config_digest      digest;
+    config_digests    *cd = NULL;
+    int                ret;
+
+    if (devname == NULL || config_type == NULL){
+        clixon_err(OE_UNIX, EINVAL, "devname or config_type is NULL");
+        goto done;
+    }
+    if ((cb = cbuf_new()) == NULL){
+        clixon_err(OE_UNIX, errno, "cbuf_new");
+        goto done;
+    }
+    cprintf(cb, "device-%s-%s", devname, config_type);
+    db = cbuf_get(cb);
+    dt = device_config_type_str2int(config_type);
+    if ((dh = device_handle_find(h, devname)) != NULL &&
+        (dt == DT_SYNCED || dt == DT_TRANSIENT)){
+        /* Invalidate until written */
+        if (device_handle_config_digest_set(dh, dt, NULL) < 0)
+            goto done;
+    }
+    else
+        dh = NULL;
+    /* Content digest of device config mount-point, and of its subtrees if SYNCED */
+    if (dh && (xroot = xpath_first(xdata, NULL, "devices/device/config")) != NULL){
+        if (dt == DT_SYNCED){
+            if (config_digests_new(xroot, 0, &cd) < 0)
+                goto done;
+            if (config_digests_compute(cd) < 0){
+                clixon_err(OE_UNIX, errno, "config_digests_compute");
+                goto done;
+            }
+            digest = config_digests_root(cd);
+        }
+        else if (xml_config_digest(xroot, &digest) < 0)
+            goto done;
+    }
+    else
+        xroot = NULL;
+    if (xmldb_db_reset(h, db) < 0)
+        goto done;
+    if ((ret = xmldb_put(h, db, OP_REPLACE, xdata, clicon_username_get(h), cbret)) < 0)
+        goto done;
+    if (ret == 1 && xroot != NULL){
+        if (device_handle_config_digest_set(dh, dt, &digest) < 0)
+            goto done;
+        if (cd != NULL){
+            device_handle_synced_digests_set(dh, cd);
+            cd = NULL;
+        }
+    }
+    retval = ret;
+ done:
+    if (cd)
+        config_digests_free(cd);
+    if (cb)
+        cbuf_free(cb);
+    return retval;
+}
+
+/*! Get local copy device datastore
+ *
+ * @param[in]  h           Clixon handle
+ * @param[in]  name        Device name
+ * @param[in]  config_type Device config tyoe
+ * @param[out] xdatap      Device config XML (if retval=1)
+ * @param[out] cberr       Error message (if retval=0)
+ * @retval     1           OK
+ * @retval     0           Failed (No such device tree)
+ * @retval    -1           Error
+ */
+int
+device_config_read(clixon_handle h,
+                   char         *devname,
+                   char         *config_type,
                    cxobj       **xdatap,
                    cbuf        **cberr)
 {
@@ -906,6 +1811,62 @@ device_config_copy(clixon_handle h,
     return retval;
 }
 
+/*! Compare content digests of transient and last synced device config
+ *
+ * Different digests means different configs. Equal digests are confirmed by a full
+ * compare of the cached trees, since the digest is not collision-resistant and the
+ * configs are supplied by the device, see xml_config_digest.
+ * @param[in]  dh     Device handle.
+ * @retval     2      Unknown, one or both digests not computed, or configs not cached
+ * @retval     1      Equal
+ * @retval     0      Not equal
+ * @retval    -1      Error
+ * @see device_config_write  where digests are computed
+ */
+int
+device_config_digest_equal(device_handle dh)
+{
+    int           retval = -1;
+    clixon_handle h;
+    char         *name;
+    cxobj        *x0 = NULL;
+    cxobj        *x1 = NULL;
+    cbuf         *cberr = NULL;
+    config_digest d0;
+    config_digest d1;
+    int           ret;
+
+    if ((ret = device_handle_config_digest_get(dh, DT_SYNCED, &d0)) < 0)
+        goto done;
+    if (ret == 0)
+        goto unknown;
+    if ((ret = device_handle_config_digest_get(dh, DT_TRANSIENT, &d1)) < 0)
+        goto done;
+    if (ret == 0)
+        goto unknown;
+    if (!CONFIG_DIGEST_EQ(d0, d1)){
+        retval = 0;
+        goto done;
+    }
+    h = device_handle_handle_get(dh);
+    name = device_handle_name_get(dh);
+    if ((ret = device_config_read_cache(h, name, "SYNCED", &x0, &cberr)) < 0)
+        goto done;
+    if (ret && (ret = device_config_read_cache(h, name, "TRANSIENT", &x1, &cberr)) < 0)
+        goto done;
+    if (ret == 0)
+        goto unknown;
+    /* xml_tree_equal 0: Equal, 1: not equal */
+    retval = xml_tree_equal(x0, x1) == 0;
+ done:
+    if (cberr)
+        cbuf_free(cberr);
+    return retval;
+ unknown:
+    retval = 2;
+    goto done;
+}
+
 /*! Compare transient and last synced
  *
  * @param[in]  h      Clixon handle.
@@ -931,17 +1892,27 @@ device_config_compare(clixon_handle           h,
     int     eq;
     int     ret;
 
-    if ((ret = device_config_read_cache(h, name, "SYNCED", &x0, &cberr)) < 0)
-        goto done;
-    if (ret && (ret = device_config_read_cache(h, name, "TRANSIENT", &x1, &cberr)) < 0)
+    /* Fast path: compare content digests, fallback to tree compare if unknown */
+    if ((ret = device_config_digest_equal(dh)) < 0)
         goto done;
-    if (ret == 0){
-        if (device_close_connection(dh, "%s", cbuf_get(cberr)) < 0)
+    if (ret == 1)
+        eq = 0;
+    else if (ret == 0)
+        eq = 1;
+    else {
+        if ((ret = device_config_read_cache(h, name, "SYNCED", &x0, &cberr)) < 0)
+            goto done;
+        if (ret && (ret = device_config_read_cache(h, name, "TRANSIENT", &x1, &cberr)) < 0)
             goto done;
-        goto closed;
+        if (ret == 0){
+            if (device_close_connection(dh, "%s", cbuf_get(cberr)) < 0)
+                goto done;
+            goto closed;
+        }
+        /* 0: Equal, 1: not equal */
+        eq = xml_tree_equal(x0, x1);
     }
-    /* 0: Equal, 1: not equal */
-    if ((eq = xml_tree_equal(x0, x1)) != 0 && cberr0){
+    if (eq != 0 && cberr0){
         if ((*cberr0 = cbuf_new()) == NULL){
             clixon_err(OE_UNIX, errno, "cbuf_new");
             goto done;
@@ -961,64 +1932,225 @@ device_config_compare(clixon_handle           h,
     goto done;
 }
 
+/*! Create key of shared yspec index: <domain>/<digest>
+ *
+ * @param[in]  domain  YANG domain
+ * @param[in]  digest  Digest of yang-lib
+ * @retval     cb      Key buffer, free with cbuf_free
+ * @retval     NULL    Error
+ */
+static cbuf *
+device_shared_yspec_key(char *domain,
+                        char *digest)
+{
+    cbuf *cb;
+
+    if ((cb = cbuf_new()) == NULL){
+        clixon_err(OE_UNIX, errno, "cbuf_new");
+        return NULL;
+    }
+    cprintf(cb, "%s/%s", domain, digest);
+    return cb;
+}
+
+/*! Check if device has same domain and yang-lib digest
+ *
+ * @param[in]  dh      Device handle
+ * @param[in]  domain  YANG domain
+ * @param[in]  digest  Digest of yang-lib
+ * @retval     1       Match
+ * @retval     0       No match
+ * @retval    -1       Error
+ */
+static int
+device_shared_yspec_match(device_handle dh,
+                          char         *domain,
+                          const char   *digest)
+{
+    char *digest1 = NULL;
+
+    if (clicon_strcmp(domain, device_handle_domain_get(dh)) != 0)
+        return 0;
+    if (device_handle_yang_lib_digest_get(dh, &digest1) < 0)
+        return -1;
+    if (digest1 == NULL || strcmp(digest, digest1) != 0)
+        return 0;
+    return 1;
+}
+
+/*! Register device as holder of a mounted yspec given its domain and yang-lib digest
+ *
+ * The index maps <domain>/<digest> to a device name in hash "controller-yspec-index".
+ * Entries are removed when the yang-lib of the device is reset or the device is freed,
+ * and are also validated on lookup.
+ * @param[in]  h         Clixon handle
+ * @param[in]  dh        Clixon device handle.
+ * @retval     0         OK
+ * @retval    -1         Error
+ * @see device_shared_yspec
+ */
+static int
+device_shared_yspec_add(clixon_handle h,
+                        device_handle dh)
+{
+    int            retval = -1;
+    clicon_hash_t *hash = NULL;
+    char          *digest = NULL;
+    char          *name;
+    cbuf          *cb = NULL;
+
+    if (device_handle_yang_lib_digest_get(dh, &digest) < 0)
+        goto done;
+    if (digest == NULL)
+        goto ok;
+    if (clicon_ptr_get(h, "controller-yspec-index", (void**)&hash) < 0 || hash == NULL){
+        if ((hash = clicon_hash_init()) == NULL)
+            goto done;
+        clicon_ptr_set(h, "controller-yspec-index", (void*)hash);
+    }
+    if ((cb = device_shared_yspec_key(device_handle_domain_get(dh), digest)) == NULL)
+        goto done;
+    name = device_handle_name_get(dh);
+    if (clicon_hash_add(hash, cbuf_get(cb), name, strlen(name)+1) == NULL)
+        goto done;
+ ok:
+    retval = 0;
+ done:
+    if (cb)
+        cbuf_free(cb);
+    return retval;
+}
+
+/*! Remove device as holder of a mounted yspec from the shared yspec index
+ *
+ * Only removes the entry if it refers to this device
+ * @param[in]  h         Clixon handle
+ * @param[in]  dh        Clixon device handle.
+ * @retval     0         OK
+ * @retval    -1         Error
+ * @see device_shared_yspec_add
+ */
+int
+device_shared_yspec_rm(clixon_handle h,
+                       device_handle dh)
+{
+    int            retval = -1;
+    clicon_hash_t *hash = NULL;
+    char          *digest = NULL;
+    char          *devname;
+    size_t         vlen;
+    cbuf          *cb = NULL;
+
+    if (clicon_ptr_get(h, "controller-yspec-index", (void**)&hash) < 0 || hash == NULL)
+        goto ok;
+    if (device_handle_yang_lib_digest_get(dh, &digest) < 0)
+        goto done;
+    if (digest == NULL)
+        goto ok;
+    if ((cb = device_shared_yspec_key(device_handle_domain_get(dh), digest)) == NULL)
+        goto done;
+    if ((devname = clicon_hash_value(hash, cbuf_get(cb), &vlen)) != NULL &&
+        strcmp(devname, device_handle_name_get(dh)) == 0)
+        clicon_hash_del(hash, cbuf_get(cb));
+ ok:
+    retval = 0;
+ done:
+    if (cb)
+        cbuf_free(cb);
+    return retval;
+}
+
+/*! Free shared yspec index
+ *
+ * @param[in]  h         Clixon handle
+ * @retval     0         OK
+ */
+int
+device_shared_yspec_free_all(clixon_handle h)
+{
+    clicon_hash_t *hash = NULL;
+
+    if (clicon_ptr_get(h, "controller-yspec-index", (void**)&hash) == 0 && hash != NULL){
+        clicon_hash_free(hash);
+        clicon_ptr_set(h, "controller-yspec-index", NULL);
+    }
+    return 0;
+}
+
 /*! Check if there is another equivalent xyanglib and if so reuse that yspec
  *
  * Prereq: schema-list (xyanglib) is completely known.
- * Look for an existing equivalent schema-list among other devices.
+ * Look up an existing equivalent schema-list among other devices in the yspec index.
  * If found, re-use that YANG-SPEC.
+ * If the indexed device is gone or has changed, look for another equivalent device
+ * using the cached yang-lib digests and re-index.
  * @param[in]  h         Clixon handle
  * @param[in]  dh        Clixon device handle.
- * @param[in]  xylib1    Yang-lib in XML format
+ * @param[in]  digest1   Digest of yang-lib
  * @param[out] yspec1    New or shared yang-spec
  * @retval     0         OK
  * @retval    -1         Error
  * @see yang_schema_find_share  Similar
+ * @see device_shared_yspec_add
  */
 static int
 device_shared_yspec(clixon_handle h,
                     device_handle dh0,
-                    cxobj        *xylib1,
                     const char   *digest1,
                     yang_stmt   **yspec1)
 {
-    int           retval = -1;
-    yang_stmt    *yspec = NULL;
-    device_handle dh1;
-    cxobj        *xylib2;
-    char         *domain0;
-    char         *digest2 = NULL;
+    int            retval = -1;
+    yang_stmt     *yspec = NULL;
+    device_handle  dh1 = NULL;
+    char          *domain0;
+    clicon_hash_t *hash = NULL;
+    cbuf          *cb = NULL;
+    char          *devname1;
+    size_t         vlen;
+    int            ret;
 
-    if (clicon_option_bool(h, "CLICON_YANG_SCHEMA_MOUNT_SHARE")) {
+    if (clicon_option_bool(h, "CLICON_YANG_SCHEMA_MOUNT_SHARE") &&
+        clicon_ptr_get(h, "controller-yspec-index", (void**)&hash) == 0 && hash != NULL) {
         domain0 = device_handle_domain_get(dh0);
-        /* New yspec only on first connect */
-        dh1 = NULL;
-        while ((dh1 = device_handle_each(h, dh1)) != NULL){
-            if (dh1 == dh0)
-                continue;
-            if ((xylib2 = device_handle_yang_lib_get(dh1)) == NULL)
-                continue;
-            if (strcmp(domain0, device_handle_domain_get(dh1)) != 0)
-                continue;
-            if (digest2){
-                free(digest2);
-                digest2 = NULL;
-            }
-            if (xyanglib_digest(xylib2, &digest2) < 0)
+        if ((cb = device_shared_yspec_key(domain0, (char*)digest1)) == NULL)
+            goto done;
+        if ((devname1 = clicon_hash_value(hash, cbuf_get(cb), &vlen)) == NULL)
+            goto ok;
+        if ((dh1 = device_handle_find(h, devname1)) != NULL && dh1 != dh0){
+            if ((ret = device_shared_yspec_match(dh1, domain0, digest1)) < 0)
+                goto done;
+            if (ret == 1 &&
+                controller_mount_yspec_get(h, device_handle_name_get(dh1), &yspec) < 0)
                 goto done;
-            if (clicon_strcmp(digest1, digest2) == 0)
-                break;
         }
-        if (dh1 != NULL){
-            if (controller_mount_yspec_get(h, device_handle_name_get(dh1), &yspec) < 0)
+        if (yspec == NULL){
+            /* Stale entry, but keep an entry of this device itself */
+            if (dh1 != dh0)
+                clicon_hash_del(hash, cbuf_get(cb));
+            dh1 = NULL;
+            while ((dh1 = device_handle_each(h, dh1)) != NULL){
+                if (dh1 == dh0)
+                    continue;
+                if ((ret = device_shared_yspec_match(dh1, domain0, digest1)) < 0)
+                    goto done;
+                if (ret == 0)
+                    continue;
+                if (controller_mount_yspec_get(h, device_handle_name_get(dh1), &yspec) < 0)
+                    goto done;
+                if (yspec != NULL)
+                    break;
+            }
+            if (dh1 != NULL && device_shared_yspec_add(h, dh1) < 0)
                 goto done;
         }
     }
+ ok:
     if (yspec1)
         *yspec1 = yspec;
     retval = 0;
  done:
-    if (digest2)
-        free(digest2);
+    if (cb)
+        cbuf_free(cb);
     return retval;
 }
 
@@ -1045,13 +2177,22 @@ device_state_check_fail(clixon_handle           h,
             clixon_err(OE_XML, 0, "Transaction unexpected SUCCESS state");
             goto done;
         }
-        else if (discard){        /* Trigger DISCARD of the device */
+        if (device_handle_conn_state_get(dh) == CS_PUSH_COMMIT &&
+            device_handle_pipeline_nr(dh) > 0){
+            /* Pipelined: unlock already sent after commit, nothing to discard */
+            if (device_state_set(dh, CS_PUSH_UNLOCK) < 0)
+                goto done;
+        }
+        else if (discard){        /* Trigger DISCARD of the device */
+            /* Drop replies of already sent pipelined requests */
+            device_handle_pipeline_skip(dh);
             if (device_send_discard_changes(h, dh) < 0)
                 goto done;
             if (device_state_set(dh, CS_PUSH_DISCARD) < 0)
                 goto done;
         }
         else {                    /* Trigger UNLOCK of the device */
+            device_handle_pipeline_skip(dh);
             if (device_send_lock(h, dh, 0) < 0)
                 goto done;
             if (device_state_set(dh, CS_PUSH_UNLOCK) < 0)
@@ -1091,17 +2232,27 @@ device_state_check_ok(clixon_handle           h,
         clixon_err(OE_XML, 0, "Transaction unexpected SUCCESS state");
         goto done;
     }
+    if (ct->ct_push_type == PT_COMMIT_NONATOMIC){
+        /* Each device has its own result, a failed device has it set already */
+        if (controller_transaction_device_result(ct, device_handle_name_get(dh),
+                                                 ct->ct_state == TS_RESOLVED?TR_FAILED:TR_SUCCESS,
+                                                 NULL) < 0)
+            goto done;
+    }
     if (device_state_set(dh, CS_OPEN) < 0)
         goto done;
     /* See rpc_connection_change where the description is set */
     if (ct->ct_description && strcmp(ct->ct_description, "Controller connect OPEN") == 0)
         device_handle_stable_time_set(dh, NULL);
+    /* A device completing a transaction is no longer a straggler */
+    if (ct->ct_state != TS_RESOLVED)
+        device_handle_quarantine_set(dh, NULL);
     /* 2.2.2.1 Leave transaction */
     device_handle_tid_set(dh, 0);
     /* 2.2.2.2 If no devices in transaction, mark as OK and close it*/
     if (controller_transaction_nr_devices(h, tid) == 0){
         if (ct->ct_state != TS_RESOLVED){
-            controller_transaction_state_set(ct, TS_RESOLVED, TR_SUCCESS);
+            controller_transaction_state_set(ct, TS_RESOLVED, ct->ct_nr_failed?TR_FAILED:TR_SUCCESS);
         /* Garbage-collect yspecs with no mount-points */
             if (1) /* Causes SEGV when reconnect */
                 if (yang_mount_cleanup(h) < 0)
@@ -1115,6 +2266,145 @@ device_state_check_ok(clixon_handle           h,
     return retval;
 }
 
+/*! Helper device_state_handler: commit actions to the controller running datastore
+ *
+ * Made once in a push commit, before devices are committed.
+ * If the controller commit fails the transaction is failed and the devices in WAIT discarded
+ * @param[in]  h     Clixon handle
+ * @param[in]  dh    Device handle, last device validated
+ * @param[in]  ct    Controller transaction
+ * @retval     1     OK, or no actions to commit
+ * @retval     0     Failed
+ * @retval    -1     Error
+ */
+static int
+device_state_local_commit(clixon_handle           h,
+                          device_handle           dh,
+                          controller_transaction *ct)
+{
+    int       retval = -1;
+    cbuf     *cberr = NULL;
+    cbuf     *cberr2 = NULL;
+    char     *candidate = NULL;
+    db_elmnt *de = NULL;
+    char     *name;
+    int       ret;
+
+    /* Check if action, skip if dryrun */
+    if (ct->ct_actions_type == AT_NONE || strcmp(ct->ct_sourcedb, "candidate") != 0)
+        goto ok;
+    name = device_handle_name_get(dh);
+    if ((cberr = cbuf_new()) == NULL){
+        clixon_err(OE_UNIX, errno, "cbuf_new");
+        goto done;
+    }
+    /* What to copy to candidate and commit to running? */
+    if (xmldb_candidate_find(h, "candidate", ct->ct_client_id, &de, &candidate) < 0)
+        goto done;
+    if (candidate == NULL){
+        if (controller_transaction_failed(h, ct->ct_id, ct, dh, TR_FAILED_DEV_LEAVE, name, "Candidate does not exist (privcand exit?)") < 0)
+            goto done;
+        goto fail;
+    }
+    if (xmldb_copy(h, "actions", candidate) < 0)
+        goto done;
+    /* Third validate,
+     * first in rpc_controller_commit,
+     * second in rpc_transactions_actions_done
+     * candidate should NOT have changed here
+     */
+    if (clicon_option_bool(h, "CLICON_XMLDB_PRIVATE_CANDIDATE")){
+        /* Rebase private candidate with running */
+        if ((ret = backend_update(h, ct->ct_client_id, de, cberr)) < 0)
+            goto done;
+        if (ret == 0){
+            if (controller_transaction_failed(h, ct->ct_id, ct, dh, TR_FAILED_DEV_IGNORE, name, cbuf_get(cberr)) < 0)
+                goto done;
+            /* 1.1 The error is "recoverable" (eg validate fail) */
+            /* --> 1.1.1 Trigger DISCARD of the device */
+            if (device_state_set(dh, CS_PUSH_DISCARD) < 0)
+                goto done;
+            goto fail;
+        }
+    }
+    if ((ret = candidate_commit(h, NULL, candidate, 0, 0, cberr)) < 0){
+        /* Handle that candidate_commit can return < 0 if transaction ongoing */
+        cprintf(cberr, "Controller commit error");
+        if (strlen(clixon_err_reason()) > 0)
+            cprintf(cberr, " %s", clixon_err_reason());
+        if (controller_transaction_failed(h, ct->ct_id, ct, dh, TR_FAILED_DEV_LEAVE, name, cbuf_get(cberr)) < 0)
+            goto done;
+        goto fail;
+    }
+    if (ret == 1){
+        if (xmldb_post_commit(h, ct->ct_client_id) < 0)
+            goto done;
+    }
+    if (clicon_option_bool(h, "CLICON_AUTOLOCK")) // XXX maybe also when ret = 0
+        xmldb_unlock(h, candidate);
+    if (ret == 0){
+        if ((cberr2 = cbuf_new()) == NULL){
+            clixon_err(OE_UNIX, errno, "cbuf_new");
+            goto done;
+        }
+        cprintf(cberr2, "Validation: ");
+        if (netconf_cbuf_err2cb(h, cberr, cberr2) < 0)
+            goto done;
+        if (controller_transaction_failed(h, ct->ct_id, ct, dh, TR_FAILED_DEV_IGNORE, "controller", cbuf_get(cberr2)) < 0)
+            goto done;
+        if (controller_transaction_wait_trigger(h, ct->ct_id, 0) < 0)
+            goto done;
+        goto fail;
+    }
+ ok:
+    retval = 1;
+ done:
+    if (cberr)
+        cbuf_free(cberr);
+    if (cberr2)
+        cbuf_free(cberr2);
+    return retval;
+ fail:
+    retval = 0;
+    goto done;
+}
+
+/*! Commit controller and devices of a push if all devices of the transaction are in WAIT
+ *
+ * @param[in]  h     Clixon handle
+ * @param[in]  dh    Device handle in WAIT state, last device validated
+ * @retval     0     OK
+ * @retval    -1     Error
+ */
+int
+device_state_push_commit(clixon_handle h,
+                         device_handle dh)
+{
+    int                     retval = -1;
+    controller_transaction *ct;
+    uint64_t                tid;
+    int                     ret;
+
+    tid = device_handle_tid_get(dh);
+    if ((ct = controller_transaction_find(h, tid)) == NULL)
+        goto ok;
+    /* 2.2.1 Check if all devices are in WAIT (none are in EDIT/VALIDATE) */
+    if ((ret = controller_transaction_wait(h, tid)) < 0)
+        goto done;
+    if (ret == 1){ /* All devices are in WAIT state */
+        if ((ret = device_state_local_commit(h, dh, ct)) < 0)
+            goto done;
+        if (ret == 0)
+            goto ok;
+        if (controller_transaction_wait_trigger(h, tid, 1) < 0)
+            goto done;
+    }
+ ok:
+    retval = 0;
+ done:
+    return retval;
+}
+
 /*! Helper device_state_handler: check sanity of message and transaction parameters
  *
  * @param[in]  dh          Device handle.
@@ -1153,6 +2443,32 @@ device_state_check_sanity(device_handle           dh,
     return 1;
 }
 
+/*! Delete private candidate orig after pull since its content may have been overwritten
+ *
+ * @param[in] h     Clixon handle
+ * @param[in] ct    Transaction
+ * @retval    0     OK
+ * @retval   -1     Error
+ * @see device_recv_config  where candidate is overwritten
+ */
+static int
+commit_after_pull_privcand(clixon_handle           h,
+                           controller_transaction *ct)
+{
+    int   retval = -1;
+    char *db1 = NULL;
+
+    if (clicon_option_bool(h, "CLICON_XMLDB_PRIVATE_CANDIDATE")){
+        if (xmldb_candidate_find(h, "candidate-orig", ct->ct_client_id, NULL, &db1) < 0)
+            goto done;
+        if (db1)
+            xmldb_delete(h, db1);
+    }
+    retval = 0;
+ done:
+    return retval;
+}
+
 /*! Commit db to running after pull transaction done
  *
  * @param[in] h     Clixon handle
@@ -1176,21 +2492,14 @@ commit_after_pull(clixon_handle           h,
 {
     int       retval = -1;
     cbuf     *cbret = NULL;
-    char     *db1 = NULL;
-    uint32_t  ceid;
     int       ret;
 
-    ceid = ct->ct_client_id;
     if ((cbret = cbuf_new()) == NULL){
         clixon_err(OE_UNIX, errno, "cbuf_new");
         goto done;
     }
-    if (clicon_option_bool(h, "CLICON_XMLDB_PRIVATE_CANDIDATE")){
-        if (xmldb_candidate_find(h, "candidate-orig", ceid, NULL, &db1) < 0)
-            goto done;
-        if (db1)
-            xmldb_delete(h, db1); /* Delete orig since its content may have been overwritten in device_recv_config */
-    }
+    if (commit_after_pull_privcand(h, ct) < 0)
+        goto done;
     if ((ret = candidate_commit(h, NULL, db, 0, 0, cbret)) < 0){
         /* Handle that candidate_commit can return < 0 if transaction ongoing */
         cprintf(cbret, "Failed to commit: %s", clixon_err_reason());
@@ -1202,121 +2511,1181 @@ commit_after_pull(clixon_handle           h,
         clixon_debug(CLIXON_DBG_CTRL, "%s", cbuf_get(cbret));
         if (device_close_connection(dh, "%s", cbuf_get(cbret)) < 0)
             goto done;
-        if (controller_transaction_failed(h, ct->ct_id, ct, dh, TR_FAILED_DEV_LEAVE,
-                                          device_handle_name_get(dh),
-                                          device_handle_logmsg_get(dh)) < 0)
+        if (controller_transaction_failed(h, ct->ct_id, ct, dh, TR_FAILED_DEV_LEAVE,
+                                          device_handle_name_get(dh),
+                                          device_handle_logmsg_get(dh)) < 0)
+            goto done;
+        goto failed;
+    }
+    retval = 1;
+ done:
+    if (cbret)
+        cbuf_free(cbret);
+    return retval;
+ failed:
+    retval = 0;
+    goto done;
+}
+
+/*! Map device capabilities to local settings
+ *
+ * Based on dcapabilities announced by the device, and the local configuration,
+ * set local settings.
+ * From: RFC 6241:
+ * If more than one protocol version URI in common is present,
+ * then the highest numbered (most recent) protocol version MUST be used
+ * by both peers.
+ * From RFC 6242:
+ * If the :base:1.1 capability is advertised by both
+ * peers, the chunked framing mechanism (see Section 4.2) is used for
+ * the remainder of the NETCONF session.  Otherwise, the old end-of-
+ * message-based mechanism (see Section 4.3) is used.
+ * @param[in] h     Clixon handle
+ * @param[in] dh    Clixon device handle.
+ * @retval    1     OK
+ * @retval    0     Fail: close connection
+ * @retval   -1     Error
+ *
+ * Truth values:
+ client 10 | client 11 | config 10 | config 11 | Result
+-----------+-----------+-----------+-----------+-----------+
+ 0         | 0         | -         | -         | Error
+ 0         | 0         | -         | -         | Error
+ 0         | 0         | -         | -         | Error
+ 0         | 1         | 0         | 0         | 11
+ 0         | 1         | 0         | 1         | 11
+ 0         | 1         | 1         | 0         | Error
+ 1         | 0         | 0         | 0         | 10
+ 1         | 0         | 0         | 1         | Error
+ 1         | 0         | 1         | 0         | 10
+ 1         | 1         | 0         | 0         | 11
+ 1         | 1         | 0         | 1         | 11
+ 1         | 1         | 1         | 0         | 10
+
+ */
+static int
+device_capabilities2settings(clixon_handle h,
+                             device_handle dh)
+{
+    int                  retval = -1;
+    cxobj               *xcaps;
+    int                  client10;
+    int                  client11;
+    int                  config10;
+    int                  config11;
+    netconf_framing_type framing;
+
+    if ((xcaps = device_handle_capabilities_get(dh)) == NULL){
+        clixon_err(OE_XML, 0, "No capabilities");
+        goto done;
+    }
+    client10 = device_handle_capabilities_find(dh, NETCONF_BASE_CAPABILITY_1_0);
+    client11 = device_handle_capabilities_find(dh, NETCONF_BASE_CAPABILITY_1_1);
+    if (client10 == 0 && client11 == 0){
+        device_close_connection(dh, "Neither NETCONF base 10 or 11 capability found in hello protocol from device %s", device_handle_name_get(dh));
+        goto fail;
+    }
+    config10 = device_handle_flag_get(dh, DH_FLAG_NETCONF_BASE10);
+    config11 = device_handle_flag_get(dh, DH_FLAG_NETCONF_BASE11);
+    if (config10 == 1 && config11 == 1){
+        clixon_err(OE_XML, 0, "Invalid config: Both base10 and base11 are configured to 1");
+        goto done;
+    }
+    if (client10 == 0 && client11 == 1){
+        if (config10){
+            device_close_connection(dh, "NETCONF framing is configured to 10 but device announces only base 11");
+            goto fail;
+        }
+        framing = NETCONF_SSH_CHUNKED;
+    }
+    else if (client10 == 1 && client11 == 0){
+        if (config11){
+            device_close_connection(dh, "NETCONF framing is configured to 11 but device announces only base 10");
+            goto fail;
+        }
+        framing = NETCONF_SSH_EOM;
+    }
+    else{ /* both 1 */
+        if (config10)
+            framing = NETCONF_SSH_EOM;
+        else
+            framing = NETCONF_SSH_CHUNKED;
+    }
+    clixon_debug(CLIXON_DBG_CTRL, "netconf framing: %s", netconf_framing_int2str(framing));
+    //    framing = 0; //NETCONF_SSH_EOM; // XXX
+    device_handle_framing_type_set(dh, framing);
+    controller_io_framing_set(h, dh, framing);
+
+    /* Private candidate, only if both configured and from device is set */
+    if (device_handle_flag_get(dh, DH_FLAG_PRIVATE_CANDIDATE) &&
+        !device_handle_capabilities_find(dh, NETCONF_PRIVATE_CANDIDATE_CAPABILITY)){
+        device_handle_flag_reset(dh, DH_FLAG_PRIVATE_CANDIDATE);
+    }
+    retval = 1;
+ done:
+    return retval;
+ fail:
+    retval = 0;
+    goto done;
+}
+
+/*! Fast reconnect: reuse yang-lib and mounted YANGs of last open if capabilities are unchanged
+ *
+ * Skips schema list, get-schema and parsing of the mount YANG spec. The mount YANG spec is
+ * kept over reconnect by leaving the device mount, see device_handle_yang_lib_keep
+ * @param[in]  h     Clixon handle
+ * @param[in]  dh    Device handle, in state CONNECTING with hello received
+ * @retval     1     Yang-lib and mount restored, continue with sync
+ * @retval     0     Not restored, continue with schema discovery
+ * @retval    -1     Error
+ * @see device_handle_yang_lib_mark
+ */
+static int
+device_state_fast_reconnect(clixon_handle h,
+                            device_handle dh)
+{
+    int        retval = -1;
+    char      *name;
+    char      *digest = NULL; /* Cached in device handle, do not free */
+    yang_stmt *yspec1 = NULL;
+    cbuf      *cbxpath = NULL;
+    int        ret;
+
+    name = device_handle_name_get(dh);
+    if ((ret = device_handle_yang_lib_restore(dh)) < 0)
+        goto done;
+    if (ret == 0)
+        goto fail;
+    if (device_handle_yang_lib_digest_get(dh, &digest) < 0)
+        goto done;
+    if (yang_mount_get_xpath(h, device_handle_domain_get(dh), digest, &yspec1, NULL) < 0)
+        goto done;
+    if (yspec1 == NULL){ /* Other domain, rediscover */
+        device_handle_yang_lib_set(dh, NULL);
+        if (device_handle_yspec_last_release(dh, 1) < 0)
+            goto done;
+        goto fail;
+    }
+    if (yspec1 != device_handle_yspec_last_get(dh)){
+        /* Device mount was left on kept spec, move it */
+        if (device_handle_yspec_last_release(dh, 1) < 0)
+            goto done;
+        if (controller_mount_xpath_get(name, &cbxpath) < 0)
+            goto done;
+        if (yang_cvec_add(yspec1, CGV_STRING, cbuf_get(cbxpath)) == NULL)
+            goto done;
+    }
+    if (controller_mount_yspec_set(h, name, yspec1) < 0)
+        goto done;
+    /* Mounted, kept spec is not needed */
+    if (device_handle_yspec_last_release(dh, 0) < 0)
+        goto done;
+    if (device_shared_yspec_add(h, dh) < 0)
+        goto done;
+    clixon_debug(CLIXON_DBG_CTRL, "Device %s: capabilities unchanged, skip schema discovery", name);
+    retval = 1;
+ done:
+    if (cbxpath)
+        cbuf_free(cbxpath);
+    return retval;
+ fail:
+    retval = 0;
+    goto done;
+}
+
+/*! Request next schemas of device, or if all are received, parse them and sync
+ *
+ * @param[in]  h     Clixon handle
+ * @param[in]  dh    Device handle, in state SCHEMA_ONE
+ * @param[in]  ct    Controller transaction
+ * @retval     1     OK
+ * @retval     0     Failed, device left transaction
+ * @retval    -1     Error
+ * @see device_send_get_schema_next
+ */
+static int
+device_state_schema_next(clixon_handle           h,
+                         device_handle           dh,
+                         controller_transaction *ct)
+{
+    int      retval = -1;
+    char    *name;
+    uint64_t tid;
+    int      s;
+    int      nr;
+    cxobj   *xyanglib;
+    int      ret;
+
+    name = device_handle_name_get(dh);
+    tid = device_handle_tid_get(dh);
+    s = device_handle_socket_get(dh);
+    nr = device_handle_nr_schemas_get(dh);
+    if ((ret = device_send_get_schema_next(h, dh, s, &nr)) < 0)
+        goto done;
+    if (ret == 1){ /* Device closed */
+        if (controller_transaction_failed(h, tid, ct, dh, TR_FAILED_DEV_LEAVE, name, NULL) < 0)
+            goto done;
+        goto fail;
+    }
+    if (ret == 0){ /* None outstanding */
+        /* All schemas ready, parse them */
+        if ((xyanglib = device_handle_yang_lib_get(dh)) == NULL){
+            if (controller_transaction_failed(h, tid, ct, dh, TR_FAILED_DEV_CLOSE, name, "No YANG device lib 2") < 0)
+                goto done;
+            goto fail;
+        }
+        if ((ret = device_schemas_mount_parse(h, dh, xyanglib)) < 0)
+            goto done;
+        if (ret == 0){
+            if (controller_transaction_failed(h, tid, ct, dh, TR_FAILED_DEV_LEAVE, name, device_handle_logmsg_get(dh)) < 0)
+                goto done;
+            goto fail;
+        }
+        /* Unconditionally sync */
+        if (device_state_sync_send(h, dh, 0) < 0)
+            goto done;
+        if (device_state_set(dh, CS_DEVICE_SYNC) < 0)
+            goto done;
+        goto ok;
+    }
+    device_handle_nr_schemas_set(dh, nr);
+    device_state_timeout_restart(dh);
+    clixon_debug(CLIXON_DBG_CTRL, "%s: %s(%d) -> %s(%d)",
+                 name,
+                 device_state_int2str(CS_SCHEMA_ONE), nr-1,
+                 device_state_int2str(CS_SCHEMA_ONE), nr);
+ ok:
+    retval = 1;
+ done:
+    return retval;
+ fail:
+    retval = 0;
+    goto done;
+}
+
+/*! Resume devices that waited for schemas fetched by another device
+ *
+ * @param[in]  h       Clixon handle
+ * @param[in]  resume  Names of devices with no more outstanding schemas
+ * @retval     0       OK
+ * @retval    -1       Error
+ * @see device_schema_fetch_done
+ */
+static int
+device_state_schema_resume(clixon_handle h,
+                           cvec         *resume)
+{
+    int                     retval = -1;
+    cg_var                 *cv = NULL;
+    device_handle           dh;
+    controller_transaction *ct;
+    uint64_t                tid;
+
+    while ((cv = cvec_each(resume, cv)) != NULL){
+        if ((dh = device_handle_find(h, cv_name_get(cv))) == NULL)
+            continue;
+        if (device_handle_conn_state_get(dh) != CS_SCHEMA_ONE)
+            continue;
+        ct = NULL;
+        if ((tid = device_handle_tid_get(dh)) != 0)
+            ct = controller_transaction_find(h, tid);
+        if (device_state_schema_next(h, dh, ct) < 0)
+            goto done;
+    }
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Match reply with oldest outstanding pipelined push request
+ *
+ * Replies are received in the same order as the requests are sent. The device is set to
+ * the state of the request so that the reply is handled as in a non-pipelined push.
+ * @param[in]     h          Clixon handle
+ * @param[in]     dh         Device handle
+ * @param[in]     xmsg       Reply message
+ * @param[in,out] cstate     Connection state, set to state of request
+ * @retval        2          OK, handle reply in conn_state
+ * @retval        1          Drop reply, an earlier request failed
+ * @retval        0          Closed, unexpected message-id
+ * @retval       -1          Error
+ * @see devices/push-pipeline
+ */
+static int
+device_state_pipeline_recv(clixon_handle h,
+                           device_handle dh,
+                           cxobj        *xmsg,
+                           conn_state   *cstate)
+{
+    int        retval = -1;
+    uint64_t   msgid0;
+    uint64_t   msgid;
+    conn_state state;
+    int        skip;
+    char      *msgidstr;
+    int        ret;
+
+    if (device_handle_pipeline_first(dh, &msgid0, &state, &skip) == 0)
+        goto ok;
+    /* If no message-id assume oldest */
+    if ((msgidstr = xml_find_value(xmsg, "message-id")) != NULL){
+        if ((ret = parse_uint64(msgidstr, &msgid, NULL)) < 0)
+            goto done;
+        if (ret == 0 || msgid != msgid0){
+            device_close_connection(dh, "Unexpected message-id %s in reply, expected %" PRIu64, msgidstr, msgid0);
+            goto closed;
+        }
+    }
+    device_handle_pipeline_rm(dh);
+    if (skip){
+        retval = 1;
+        goto done;
+    }
+    if (state != *cstate){
+        if (device_state_set(dh, state) < 0)
+            goto done;
+        *cstate = state;
+    }
+ ok:
+    retval = 2;
+ done:
+    return retval;
+ closed:
+    retval = 0;
+    goto done;
+}
+
+/*! Send saved edit-config messages and validate to device back-to-back
+ *
+ * @param[in]  h     Clixon handle
+ * @param[in]  dh    Device handle
+ * @retval     1     OK, sent
+ * @retval     0     No saved edit-config message
+ * @retval    -1     Error
+ * @see devices/push-pipeline
+ */
+static int
+device_state_pipeline_edit(clixon_handle h,
+                           device_handle dh)
+{
+    int        retval = -1;
+    uint64_t   msgid;
+    conn_state state;
+    conn_state state0 = CS_PUSH_VALIDATE;
+    int        nr;
+    int        ret;
+
+    for (nr=1; nr<=2; nr++){
+        if ((ret = device_send_outmsg(h, dh, nr, &msgid)) < 0)
+            goto done;
+        if (ret == 0)
+            continue;
+        state = nr == 1 ? CS_PUSH_EDIT : CS_PUSH_EDIT2;
+        if (device_handle_pipeline_add(dh, msgid, state) < 0)
+            goto done;
+        if (state0 == CS_PUSH_VALIDATE)
+            state0 = state;
+    }
+    if (state0 == CS_PUSH_VALIDATE){
+        retval = 0;
+        goto done;
+    }
+    msgid = device_handle_msg_id_get(dh);
+    if (device_send_validate(h, dh) < 0)
+        goto done;
+    if (device_handle_pipeline_add(dh, msgid, CS_PUSH_VALIDATE) < 0)
+        goto done;
+    if (device_state_set(dh, state0) < 0)
+        goto done;
+    retval = 1;
+ done:
+    return retval;
+}
+
+/*! Device config is received in a pull or connect, commit if last device and leave transaction
+ *
+ * @param[in]  h     Clixon handle
+ * @param[in]  dh    Device handle, in state DEVICE_SYNC
+ * @param[in]  ct    Controller transaction
+ * @retval     0     OK
+ * @retval    -1     Error
+ */
+static int
+device_state_sync_done(clixon_handle           h,
+                       device_handle           dh,
+                       controller_transaction *ct)
+{
+    int retval = -1;
+    int ret;
+
+    if (controller_transaction_nr_devices(h, ct->ct_id) == 1 &&
+        !ct->ct_pull_transient) {
+        if (ct->ct_pull_commit == PC_DEVICE){
+            /* Each device already committed to running in device_recv_config() */
+            if (commit_after_pull_privcand(h, ct) < 0)
+                goto done;
+        }
+        else {
+            /* See puts from each device in device_recv_config() */
+            if ((ret = commit_after_pull(h, dh, ct, "tmpdev")) < 0)
+                goto done;
+            if (ret == 0)
+                goto ok;
+            xmldb_delete(h, "tmpdev");
+        }
+    }
+    /* The device is OK */
+    if (device_state_check_ok(h, dh, ct) < 0)
+        goto done;
+ ok:
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Device config is unchanged in a push, send saved edit-config messages
+ *
+ * Held back in state PUSH_CHECK while pending output to all devices exceeds
+ * output-queue-limit, or the device has pending output of its own
+ * @param[in]  h     Clixon handle
+ * @param[in]  dh    Device handle, in state PUSH_CHECK
+ * @param[in]  ct    Controller transaction
+ * @retval     0     OK
+ * @retval    -1     Error
+ * @see device_push_edit_next  where held back edit-configs are resumed
+ */
+static int
+device_state_push_edit(clixon_handle           h,
+                       device_handle           dh,
+                       controller_transaction *ct)
+{
+    int   retval = -1;
+    char *name;
+    cbuf *cbmsg;
+    int   ret;
+
+    name = device_handle_name_get(dh);
+    if ((ret = device_state_check_fail(h, dh, ct, 1)) < 0)
+        goto done;
+    if (ret == 0)
+        goto ok;
+    if (device_send_backpressure(h) || device_handle_outq_len(dh) > 0){
+        clixon_debug(CLIXON_DBG_CTRL, "%s: output queued, hold back edit-config", name);
+        if (!device_handle_flag_get(dh, DH_FLAG_PUSH_HELD)){
+            /* Latency of PUSH_CHECK is until the reply, not including time held back */
+            if (device_state_latency_sample(dh) < 0)
+                goto done;
+            device_handle_flag_set(dh, DH_FLAG_PUSH_HELD);
+        }
+        goto ok;
+    }
+    /* 2.2 The transaction is OK
+       Proceed to next step: get saved edit-msg and send it */
+    if (ct->ct_push_pipeline){
+        /* Send edit-msgs and validate without waiting for replies */
+        if ((ret = device_state_pipeline_edit(h, dh)) < 0)
+            goto done;
+        if (ret == 1)
+            goto ok;
+    }
+    if ((cbmsg = device_handle_outmsg_get(dh, 1)) == NULL){
+        if ((cbmsg = device_handle_outmsg_get(dh, 2)) == NULL){
+            device_close_connection(dh, "Device %s no edit-msg in state %s",
+                                    name, device_state_int2str(CS_PUSH_CHECK));
+            if (controller_transaction_failed(h, ct->ct_id, ct, dh, TR_FAILED_DEV_LEAVE, name, device_handle_logmsg_get(dh)) < 0)
+                goto done;
+            goto ok;
+        }
+        if (device_send_msg(h, dh, cbmsg) < 0)
+            goto done;
+        if (device_state_set(dh, CS_PUSH_EDIT2) < 0)
+            goto done;
+        goto ok;
+    }
+    if (device_send_msg(h, dh, cbmsg) < 0)
+        goto done;
+    if (device_state_set(dh, CS_PUSH_EDIT) < 0)
+        goto done;
+ ok:
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Send edit-configs of pushes held back by output-queue-limit
+ *
+ * Edit-configs are sent in device order until output exceeds output-queue-limit again.
+ * Devices still held back have their state timeout restarted, they are not waiting for
+ * the device.
+ * @param[in]  h     Clixon handle
+ * @retval     0     OK
+ * @retval    -1     Error
+ * @see device_send_output_drain
+ */
+int
+device_push_edit_next(clixon_handle h)
+{
+    int                     retval = -1;
+    device_handle           dh;
+    controller_transaction *ct;
+
+    dh = NULL;
+    while ((dh = device_handle_each(h, dh)) != NULL){
+        if (!device_handle_flag_get(dh, DH_FLAG_PUSH_HELD))
+            continue;
+        if (device_handle_conn_state_get(dh) != CS_PUSH_CHECK ||
+            (ct = controller_transaction_find(h, device_handle_tid_get(dh))) == NULL){
+            device_handle_flag_reset(dh, DH_FLAG_PUSH_HELD);
+            continue;
+        }
+        if (device_send_backpressure(h) || device_handle_outq_len(dh) > 0){
+            if (device_state_timeout_restart(dh) < 0)
+                goto done;
+            continue;
+        }
+        /* Flag is reset on next state, PUSH_CHECK latency is already sampled */
+        if (device_state_push_edit(h, dh, ct) < 0)
+            goto done;
+    }
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Get change token from reply of filtered get
+ *
+ * The token is the data of the reply as compact XML text
+ * @param[in]  xmsg   Reply, <rpc-reply><data>...</data></rpc-reply>
+ * @param[out] token  Change token, malloced, or NULL if error reply or no data
+ * @retval     0      OK
+ * @retval    -1      Error
+ */
+static int
+device_change_token_parse(cxobj *xmsg,
+                          char **token)
+{
+    int    retval = -1;
+    cxobj *xdata;
+    cxobj *x;
+    cbuf  *cb = NULL;
+
+    *token = NULL;
+    if (xml_find_type(xmsg, NULL, "rpc-error", CX_ELMNT) != NULL ||
+        (xdata = xml_find_type(xmsg, NULL, "data", CX_ELMNT)) == NULL)
+        goto ok;
+    if ((cb = cbuf_new()) == NULL){
+        clixon_err(OE_UNIX, errno, "cbuf_new");
+        goto done;
+    }
+    x = NULL;
+    while ((x = xml_child_each(xdata, x, CX_ELMNT)) != NULL)
+        if (clixon_xml2cbuf(cb, x, 0, 0, NULL, -1, 0) < 0)
+            goto done;
+    if (cbuf_len(cb) && (*token = strdup(cbuf_get(cb))) == NULL){
+        clixon_err(OE_UNIX, errno, "strdup");
+        goto done;
+    }
+ ok:
+    retval = 0;
+ done:
+    if (cb)
+        cbuf_free(cb);
+    return retval;
+}
+
+/*! Check if device config is unchanged since SYNCED: same change token and no local edits
+ *
+ * @param[in]  h      Clixon handle
+ * @param[in]  dh     Device handle
+ * @param[in]  token  Change token just fetched from device, or NULL
+ * @param[in]  local  Also check that device config in running is same as SYNCED
+ * @retval     1      Unchanged
+ * @retval     0      Changed or unknown
+ * @retval    -1      Error
+ */
+static int
+device_change_token_unchanged(clixon_handle h,
+                              device_handle dh,
+                              char         *token,
+                              int           local)
+{
+    int           retval = -1;
+    char         *token0;
+    cbuf         *cb = NULL;
+    cbuf         *cberr = NULL;
+    cxobj        *xt = NULL;
+    cxobj        *x;
+    cxobj        *xs = NULL;
+    config_digest d0;
+    config_digest d1;
+    int           ret;
+
+    if (token == NULL ||
+        (token0 = device_handle_change_token_get(dh, DT_SYNCED)) == NULL ||
+        strcmp(token, token0) != 0)
+        goto changed;
+    if (local){
+        if ((ret = device_handle_config_digest_get(dh, DT_SYNCED, &d0)) < 0)
+            goto done;
+        if (ret == 0)
+            goto changed;
+        if ((cb = cbuf_new()) == NULL){
+            clixon_err(OE_UNIX, errno, "cbuf_new");
+            goto done;
+        }
+        cprintf(cb, "devices/device[name='%s']/config", device_handle_name_get(dh));
+        if (xmldb_get0(h, "running", YB_MODULE, NULL, cbuf_get(cb), 1, WITHDEFAULTS_EXPLICIT, &xt, NULL, NULL) < 0)
+            goto done;
+        if ((x = xpath_first(xt, NULL, "%s", cbuf_get(cb))) == NULL)
+            goto changed;
+        if (xml_config_digest(x, &d1) < 0)
+            goto done;
+        if (!CONFIG_DIGEST_EQ(d0, d1))
+            goto changed;
+        /* Equal digests are confirmed, see xml_config_digest */
+        if ((ret = device_config_read_cache(h, device_handle_name_get(dh), "SYNCED", &xs, &cberr)) < 0)
+            goto done;
+        /* xml_tree_equal 0: Equal, 1: not equal */
+        if (ret == 0 || xml_tree_equal(xs, x) != 0)
+            goto changed;
+    }
+    retval = 1;
+ done:
+    if (cb)
+        cbuf_free(cb);
+    if (cberr)
+        cbuf_free(cberr);
+    if (xt)
+        xml_free(xt);
+    return retval;
+ changed:
+    retval = 0;
+    goto done;
+}
+
+/*! Continuation of change token request
+ *
+ * @param[in]  h     Clixon handle
+ * @param[in]  dh    Device handle
+ * @param[in]  xmsg  Reply, or NULL on timeout or close, then the device state timeout or
+ *                   close handles the transaction
+ * @param[in]  arg   enum change_token_mode
+ * @retval     0     OK
+ * @retval    -1     Error
+ * @see device_state_sync_send
+ */
+static int
+device_change_token_cb(clixon_handle h,
+                       device_handle dh,
+                       cxobj        *xmsg,
+                       void         *arg)
+{
+    int                     retval = -1;
+    enum change_token_mode  mode = (enum change_token_mode)(intptr_t)arg;
+    controller_transaction *ct;
+    conn_state              state;
+    char                   *token = NULL;
+    int                     ret;
+
+    if (xmsg == NULL)
+        goto ok;
+    if (device_change_token_parse(xmsg, &token) < 0)
+        goto done;
+    switch (mode){
+    case CT_FETCH:
+        device_handle_change_token_set(dh, DT_TRANSIENT, token);
+        token = NULL;
+        break;
+    case CT_STORE:
+        device_handle_change_token_set(dh, DT_SYNCED, token);
+        token = NULL;
+        break;
+    case CT_CHECK:
+        state = device_handle_conn_state_get(dh);
+        if ((state != CS_DEVICE_SYNC && state != CS_PUSH_CHECK) ||
+            (ct = controller_transaction_find(h, device_handle_tid_get(dh))) == NULL)
+            break;
+        if ((ret = device_change_token_unchanged(h, dh, token, state == CS_DEVICE_SYNC)) < 0)
+            goto done;
+        if (ret == 1){
+            clixon_debug(CLIXON_DBG_CTRL, "%s: change token unchanged, skip get-config",
+                         device_handle_name_get(dh));
+            if (state == CS_DEVICE_SYNC){
+                device_handle_sync_time_set(dh, NULL);
+                if (device_state_sync_done(h, dh, ct) < 0)
+                    goto done;
+            }
+            else if (device_state_push_edit(h, dh, ct) < 0)
+                goto done;
+            break;
+        }
+        /* Changed, get full config, handled by state machine */
+        device_handle_change_token_set(dh, DT_TRANSIENT, token);
+        token = NULL;
+        if (device_send_get(h, dh, device_handle_socket_get(dh), 0, NULL) < 0)
+            goto done;
+        break;
+    }
+ ok:
+    retval = 0;
+ done:
+    if (token)
+        free(token);
+    return retval;
+}
+
+/*! Send change token request, reply is dispatched by message-id
+ */
+static int
+device_change_token_send(clixon_handle          h,
+                         device_handle          dh,
+                         enum change_token_mode mode)
+{
+    int      retval = -1;
+    uint64_t msgid;
+    int      d;
+
+    msgid = device_handle_msg_id_get(dh);
+    if (device_send_get(h, dh, device_handle_socket_get(dh), 1,
+                        device_handle_change_token_xpath_get(dh)) < 0)
+        goto done;
+    if ((d = clicon_data_int_get(h, "controller-device-timeout")) < 0)
+        d = CONTROLLER_DEVICE_TIMEOUT_DEFAULT;
+    if (device_handle_dispatch_add(dh, msgid, device_change_token_cb, (void*)(intptr_t)mode, d) < 0)
+        goto done;
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Send request to get device config, first change token if configured
+ *
+ * If the device has a change-token xpath, the token is requested first.
+ * If conditional and the token of SYNCED is known, the full config is requested only if the
+ * token has changed, otherwise the sync or push check is done without it, see
+ * device_change_token_cb. The reply of the full config is handled by the state machine in
+ * state DEVICE_SYNC or PUSH_CHECK.
+ * @param[in]  h           Clixon handle
+ * @param[in]  dh          Device handle
+ * @param[in]  conditional Skip full config if change token is unchanged
+ * @retval     0           OK
+ * @retval    -1           Error
+ * @see change-token in clixon-controller.yang
+ */
+int
+device_state_sync_send(clixon_handle h,
+                       device_handle dh,
+                       int           conditional)
+{
+    int retval = -1;
+
+    if (device_handle_change_token_xpath_get(dh) != NULL){
+        if (conditional && device_handle_change_token_get(dh, DT_SYNCED) != NULL){
+            if (device_change_token_send(h, dh, CT_CHECK) < 0)
+                goto done;
+            goto ok;
+        }
+        if (device_change_token_send(h, dh, CT_FETCH) < 0)
+            goto done;
+    }
+    if (device_send_get(h, dh, device_handle_socket_get(dh), 0, NULL) < 0)
+        goto done;
+ ok:
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Device config is changed by push commit, refetch change token if configured
+ *
+ * The request is sent before unlock so that the token corresponds to the pushed config.
+ * If pipelined, unlock is already sent and the token is left unknown.
+ * @param[in]  h     Clixon handle
+ * @param[in]  dh    Device handle
+ * @param[in]  ct    Push transaction
+ * @retval     0     OK
+ * @retval    -1     Error
+ */
+static int
+device_change_token_push(clixon_handle           h,
+                         device_handle           dh,
+                         controller_transaction *ct)
+{
+    device_handle_change_token_set(dh, DT_SYNCED, NULL);
+    device_handle_change_token_set(dh, DT_TRANSIENT, NULL);
+    if (device_handle_change_token_xpath_get(dh) == NULL || ct->ct_push_pipeline)
+        return 0;
+    return device_change_token_send(h, dh, CT_STORE);
+}
+
+/*! Continuation of create-subscription request
+ *
+ * @param[in]  h     Clixon handle
+ * @param[in]  dh    Device handle
+ * @param[in]  xmsg  Reply, or NULL on timeout or close
+ * @param[in]  arg   Not used
+ * @retval     0     OK
+ * @retval    -1     Error
+ * @see device_drift_subscribe
+ */
+static int
+device_drift_subscribe_cb(clixon_handle h,
+                          device_handle dh,
+                          cxobj        *xmsg,
+                          void         *arg)
+{
+    if (xmsg == NULL)
+        return 0;
+    if (xml_find_type(xmsg, NULL, "ok", CX_ELMNT) == NULL){
+        clixon_log(h, LOG_WARNING, "%s: Device %s create-subscription failed, config drift not tracked",
+                   __func__, device_handle_name_get(dh));
+        return 0;
+    }
+    device_handle_drift_subscribed_set(dh, 1);
+    return 0;
+}
+
+/*! Subscribe to the NETCONF event stream of device to track config changes by others
+ *
+ * Only if drift-tracking is set and the device announces the notification and interleave
+ * capabilities. Without interleave, the device does not accept RPCs on a subscribed session.
+ * The subscription is sent before the initial sync so that no change is lost between them
+ * @param[in]  h     Clixon handle
+ * @param[in]  dh    Device handle
+ * @retval     0     OK
+ * @retval    -1     Error
+ * @see device_recv_notification
+ */
+static int
+device_drift_subscribe(clixon_handle h,
+                       device_handle dh)
+{
+    int      retval = -1;
+    uint64_t msgid;
+    int      d;
+
+    if (clicon_data_int_get(h, "controller-drift-tracking") <= 0 ||
+        !device_handle_capabilities_find(dh, NETCONF_NOTIFICATION_CAPABILITY))
+        goto ok;
+    if (!device_handle_capabilities_find(dh, NETCONF_INTERLEAVE_CAPABILITY)){
+        clixon_debug(CLIXON_DBG_CTRL, "%s: no interleave capability, config drift not tracked",
+                     device_handle_name_get(dh));
+        goto ok;
+    }
+    msgid = device_handle_msg_id_get(dh);
+    if (device_send_create_subscription(h, dh) < 0)
+        goto done;
+    if ((d = clicon_data_int_get(h, "controller-device-timeout")) < 0)
+        d = CONTROLLER_DEVICE_TIMEOUT_DEFAULT;
+    if (device_handle_dispatch_add(dh, msgid, device_drift_subscribe_cb, NULL, d) < 0)
+        goto done;
+ ok:
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Check if device config is known to be unchanged since last sync without getting it
+ *
+ * Only if drift-trust is set, otherwise the device config is always got and compared
+ * @param[in]  h     Clixon handle
+ * @param[in]  dh    Device handle
+ * @retval     1     Subscribed to config changes, none since last sync
+ * @retval     0     Unknown or changed, or notifications not trusted
+ */
+int
+device_drift_clean(clixon_handle h,
+                   device_handle dh)
+{
+    int           subscribed;
+    int           drift;
+    config_digest digest;
+
+    if (clicon_data_int_get(h, "controller-drift-trust") <= 0)
+        return 0;
+    device_handle_drift_get(dh, &subscribed, &drift, NULL);
+    if (!subscribed || drift)
+        return 0;
+    /* There must be a SYNCED device config to compare with */
+    if (device_handle_config_digest_get(dh, DT_SYNCED, &digest) != 1)
+        return 0;
+    return 1;
+}
+
+/*! Device due for background sync-check
+ */
+struct sync_check_entry {
+    struct timeval sce_time; /* Time of last check, 0 if never */
+    char          *sce_name; /* Device name */
+};
+
+/*! Background sync-check sweep, in clicon_ptr "controller-sync-check"
+ *
+ * Devices due for check, least recently checked first, are checked at most
+ * sync-check-window at a time
+ */
+struct sync_check_sweep {
+    struct sync_check_entry *scs_vec;    /* Devices due in this sweep */
+    int                      scs_len;    /* Length of scs_vec */
+    int                      scs_next;   /* Next device in scs_vec to check */
+    int                      scs_active; /* Number of outstanding checks */
+};
+
+/*! Free devices of a sync-check sweep
+ */
+static int
+sync_check_sweep_reset(struct sync_check_sweep *scs)
+{
+    int i;
+
+    for (i=0; i<scs->scs_len; i++)
+        if (scs->scs_vec[i].sce_name)
+            free(scs->scs_vec[i].sce_name);
+    if (scs->scs_vec)
+        free(scs->scs_vec);
+    scs->scs_vec = NULL;
+    scs->scs_len = 0;
+    scs->scs_next = 0;
+    return 0;
+}
+
+/*! Get sync-check sweep, create if not found
+ */
+static struct sync_check_sweep *
+sync_check_sweep_get(clixon_handle h)
+{
+    struct sync_check_sweep *scs = NULL;
+
+    if (clicon_ptr_get(h, "controller-sync-check", (void**)&scs) < 0 || scs == NULL){
+        if ((scs = calloc(1, sizeof(*scs))) == NULL){
+            clixon_err(OE_UNIX, errno, "calloc");
+            return NULL;
+        }
+        clicon_ptr_set(h, "controller-sync-check", (void*)scs);
+    }
+    return scs;
+}
+
+/*! Order sync-check entries least recently checked first
+ */
+static int
+sync_check_entry_cmp(const void *a,
+                     const void *b)
+{
+    const struct sync_check_entry *sa = a;
+    const struct sync_check_entry *sb = b;
+
+    if (timercmp(&sa->sce_time, &sb->sce_time, <))
+        return -1;
+    if (timercmp(&sa->sce_time, &sb->sce_time, >))
+        return 1;
+    return strcmp(sa->sce_name, sb->sce_name);
+}
+
+/*! Record result of sync-check and schedule next check of device after interval+jitter
+ *
+ * @param[in]  h       Clixon handle
+ * @param[in]  dh      Device handle
+ * @param[in]  result  1: in sync, 0: out of sync, 2: unknown
+ */
+static int
+sync_check_done(clixon_handle h,
+                device_handle dh,
+                int           result)
+{
+    struct timeval due;
+    int            interval;
+    int            jitter;
+
+    gettimeofday(&due, NULL);
+    if ((interval = clicon_data_int_get(h, "controller-sync-check-interval")) > 0)
+        due.tv_sec += interval;
+    if ((jitter = clicon_data_int_get(h, "controller-sync-check-jitter")) > 0)
+        due.tv_sec += random() % (jitter + 1);
+    return device_handle_sync_check_set(dh, NULL, &due, result);
+}
+
+/*! Continuation of sync-check get-config: write TRANSIENT and compare digest with SYNCED
+ *
+ * @param[in]  h     Clixon handle
+ * @param[in]  dh    Device handle, or NULL if removed
+ * @param[in]  xmsg  Reply, or NULL on timeout or close
+ * @param[in]  arg   Not used
+ * @retval     0     OK
+ * @retval    -1     Error
+ * @see device_sync_check_next
+ */
+static int
+device_sync_check_cb(clixon_handle h,
+                     device_handle dh,
+                     cxobj        *xmsg,
+                     void         *arg)
+{
+    int                      retval = -1;
+    struct sync_check_sweep *scs;
+    int                      result = 2;
+    int                      ret;
+
+    if ((scs = sync_check_sweep_get(h)) == NULL)
+        goto done;
+    if (scs->scs_active > 0)
+        scs->scs_active--;
+    if (dh == NULL) /* Removed */
+        goto next;
+    device_handle_flag_reset(dh, DH_FLAG_SYNC_CHECK);
+    /* Skip if device has entered a transaction meanwhile, it may use TRANSIENT */
+    if (xmsg != NULL &&
+        xml_find_type(xmsg, NULL, "data", CX_ELMNT) != NULL &&
+        device_handle_conn_state_get(dh) == CS_OPEN &&
+        device_handle_tid_get(dh) == 0){
+        if ((ret = device_recv_config(h, dh, xmsg, clicon_dbspec_yang(h), xml_name(xmsg), CS_OPEN, 1, 0)) < 0)
+            goto done;
+        if (ret == 1 && (result = device_config_digest_equal(dh)) < 0)
+            goto done;
+    }
+    if (sync_check_done(h, dh, result) < 0)
+        goto done;
+ next:
+    if (device_sync_check_next(h) < 0)
+        goto done;
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Start sync-checks of next devices in sweep until sync-check-window are outstanding
+ *
+ * Only devices that are open and not in a transaction are checked. With drift-trust, a device
+ * subscribed to config changes without drift is in sync without getting its config.
+ * Held back while pending output exceeds output-queue-limit, and resumed when it is drained.
+ * @param[in]  h     Clixon handle
+ * @retval     0     OK
+ * @retval    -1     Error
+ * @see device_send_output_drain
+ */
+int
+device_sync_check_next(clixon_handle h)
+{
+    int                      retval = -1;
+    struct sync_check_sweep *scs;
+    struct sync_check_entry *sce;
+    device_handle            dh;
+    uint64_t                 msgid;
+    int                      window;
+    int                      d;
+
+    if ((scs = sync_check_sweep_get(h)) == NULL)
+        goto done;
+    if ((window = clicon_data_int_get(h, "controller-sync-check-window")) <= 0)
+        window = CONTROLLER_SYNC_CHECK_WINDOW_DEFAULT;
+    if ((d = clicon_data_int_get(h, "controller-device-timeout")) < 0)
+        d = CONTROLLER_DEVICE_TIMEOUT_DEFAULT;
+    while (scs->scs_active < window && scs->scs_next < scs->scs_len &&
+           !device_send_backpressure(h)){
+        sce = &scs->scs_vec[scs->scs_next++];
+        if ((dh = device_handle_find(h, sce->sce_name)) == NULL)
+            continue;
+        if (device_handle_conn_state_get(dh) != CS_OPEN ||
+            device_handle_tid_get(dh) != 0 ||
+            device_handle_flag_get(dh, DH_FLAG_SYNC_CHECK))
+            continue;
+        if (device_drift_clean(h, dh)){
+            if (sync_check_done(h, dh, 1) < 0)
+                goto done;
+            continue;
+        }
+        clixon_debug(CLIXON_DBG_CTRL, "%s: sync-check", sce->sce_name);
+        msgid = device_handle_msg_id_get(dh);
+        if (device_send_get(h, dh, device_handle_socket_get(dh), 0, NULL) < 0)
+            goto done;
+        if (device_handle_dispatch_add(dh, msgid, device_sync_check_cb, NULL, d) < 0)
             goto done;
-        goto failed;
+        device_handle_flag_set(dh, DH_FLAG_SYNC_CHECK);
+        scs->scs_active++;
     }
-    retval = 1;
+    retval = 0;
  done:
-    if (cbret)
-        cbuf_free(cbret);
     return retval;
- failed:
-    retval = 0;
-    goto done;
 }
 
-/*! Map device capabilities to local settings
- *
- * Based on dcapabilities announced by the device, and the local configuration,
- * set local settings.
- * From: RFC 6241:
- * If more than one protocol version URI in common is present,
- * then the highest numbered (most recent) protocol version MUST be used
- * by both peers.
- * From RFC 6242:
- * If the :base:1.1 capability is advertised by both
- * peers, the chunked framing mechanism (see Section 4.2) is used for
- * the remainder of the NETCONF session.  Otherwise, the old end-of-
- * message-based mechanism (see Section 4.3) is used.
- * @param[in] h     Clixon handle
- * @param[in] dh    Clixon device handle.
- * @retval    1     OK
- * @retval    0     Fail: close connection
- * @retval   -1     Error
+/*! Background sync-check sweep, called from controller periodic timer
  *
- * Truth values:
- client 10 | client 11 | config 10 | config 11 | Result
------------+-----------+-----------+-----------+-----------+
- 0         | 0         | -         | -         | Error
- 0         | 0         | -         | -         | Error
- 0         | 0         | -         | -         | Error
- 0         | 1         | 0         | 0         | 11
- 0         | 1         | 0         | 1         | 11
- 0         | 1         | 1         | 0         | Error
- 1         | 0         | 0         | 0         | 10
- 1         | 0         | 0         | 1         | Error
- 1         | 0         | 1         | 0         | 10
- 1         | 1         | 0         | 0         | 11
- 1         | 1         | 0         | 1         | 11
- 1         | 1         | 1         | 0         | 10
-
+ * When the previous sweep is done, a new sweep is made of all open devices whose next check
+ * is due, least recently checked first. Each check gets the device config as TRANSIENT and
+ * compares its digest with SYNCED, see sync-check-state.
+ * @param[in]  h     Clixon handle
+ * @retval     0     OK
+ * @retval    -1     Error
+ * @see sync-check-interval in clixon-controller.yang
  */
-static int
-device_capabilities2settings(clixon_handle h,
-                             device_handle dh)
+int
+device_sync_check_sweep(clixon_handle h)
 {
-    int                  retval = -1;
-    cxobj               *xcaps;
-    int                  client10;
-    int                  client11;
-    int                  config10;
-    int                  config11;
-    netconf_framing_type framing;
+    int                      retval = -1;
+    struct sync_check_sweep *scs;
+    device_handle            dh;
+    struct timeval           now;
+    struct timeval           t;
+    struct timeval           due;
+    int                      n;
 
-    if ((xcaps = device_handle_capabilities_get(dh)) == NULL){
-        clixon_err(OE_XML, 0, "No capabilities");
-        goto done;
-    }
-    client10 = device_handle_capabilities_find(dh, NETCONF_BASE_CAPABILITY_1_0);
-    client11 = device_handle_capabilities_find(dh, NETCONF_BASE_CAPABILITY_1_1);
-    if (client10 == 0 && client11 == 0){
-        device_close_connection(dh, "Neither NETCONF base 10 or 11 capability found in hello protocol from device %s", device_handle_name_get(dh));
-        goto fail;
-    }
-    config10 = device_handle_flag_get(dh, DH_FLAG_NETCONF_BASE10);
-    config11 = device_handle_flag_get(dh, DH_FLAG_NETCONF_BASE11);
-    if (config10 == 1 && config11 == 1){
-        clixon_err(OE_XML, 0, "Invalid config: Both base10 and base11 are configured to 1");
+    if (clicon_data_int_get(h, "controller-sync-check-interval") <= 0)
+        goto ok;
+    if ((scs = sync_check_sweep_get(h)) == NULL)
         goto done;
-    }
-    if (client10 == 0 && client11 == 1){
-        if (config10){
-            device_close_connection(dh, "NETCONF framing is configured to 10 but device announces only base 11");
-            goto fail;
+    if (scs->scs_next >= scs->scs_len){
+        sync_check_sweep_reset(scs);
+        n = 0;
+        dh = NULL;
+        while ((dh = device_handle_each(h, dh)) != NULL)
+            n++;
+        if (n > 0 && (scs->scs_vec = calloc(n, sizeof(*scs->scs_vec))) == NULL){
+            clixon_err(OE_UNIX, errno, "calloc");
+            goto done;
         }
-        framing = NETCONF_SSH_CHUNKED;
-    }
-    else if (client10 == 1 && client11 == 0){
-        if (config11){
-            device_close_connection(dh, "NETCONF framing is configured to 11 but device announces only base 10");
-            goto fail;
+        gettimeofday(&now, NULL);
+        dh = NULL;
+        while ((dh = device_handle_each(h, dh)) != NULL && scs->scs_len < n){
+            if (device_handle_conn_state_get(dh) != CS_OPEN)
+                continue;
+            device_handle_sync_check_get(dh, &t, &due, NULL);
+            if (timercmp(&due, &now, >))
+                continue;
+            scs->scs_vec[scs->scs_len].sce_time = t;
+            if ((scs->scs_vec[scs->scs_len].sce_name = strdup(device_handle_name_get(dh))) == NULL){
+                clixon_err(OE_UNIX, errno, "strdup");
+                goto done;
+            }
+            scs->scs_len++;
         }
-        framing = NETCONF_SSH_EOM;
-    }
-    else{ /* both 1 */
-        if (config10)
-            framing = NETCONF_SSH_EOM;
-        else
-            framing = NETCONF_SSH_CHUNKED;
-    }
-    clixon_debug(CLIXON_DBG_CTRL, "netconf framing: %s", netconf_framing_int2str(framing));
-    //    framing = 0; //NETCONF_SSH_EOM; // XXX
-    device_handle_framing_type_set(dh, framing);
-
-    /* Private candidate, only if both configured and from device is set */
-    if (device_handle_flag_get(dh, DH_FLAG_PRIVATE_CANDIDATE) &&
-        !device_handle_capabilities_find(dh, NETCONF_PRIVATE_CANDIDATE_CAPABILITY)){
-        device_handle_flag_reset(dh, DH_FLAG_PRIVATE_CANDIDATE);
+        if (scs->scs_len > 1)
+            qsort(scs->scs_vec, scs->scs_len, sizeof(*scs->scs_vec), sync_check_entry_cmp);
+        clixon_debug(CLIXON_DBG_CTRL, "sync-check sweep: %d devices due", scs->scs_len);
     }
-    retval = 1;
+    if (device_sync_check_next(h) < 0)
+        goto done;
+ ok:
+    retval = 0;
  done:
     return retval;
- fail:
-    retval = 0;
-    goto done;
+}
+
+/*! Free background sync-check sweep
+ *
+ * @param[in]  h     Clixon handle
+ * @retval     0     OK
+ */
+int
+device_sync_check_free(clixon_handle h)
+{
+    struct sync_check_sweep *scs = NULL;
+
+    if (clicon_ptr_get(h, "controller-sync-check", (void**)&scs) == 0 && scs != NULL){
+        sync_check_sweep_reset(scs);
+        free(scs);
+        clicon_ptr_set(h, "controller-sync-check", NULL);
+    }
+    return 0;
 }
 
 /*! Main state machine for controller transactions+devices
@@ -1347,12 +3716,13 @@ device_state_handler(clixon_handle h,
     cbuf       *cberr = NULL;
     cbuf       *cbmsg;
     cxobj      *xyanglib;
-    char       *candidate = NULL;
-    db_elmnt   *de = NULL;
-    char       *digest = NULL;
+    char       *digest = NULL; /* Cached in device handle, do not free */
     char       *domain;
     cbuf       *cbxpath = NULL;
+    cvec       *resume = NULL;
     int         ret;
+    struct timeval t0;
+    struct timeval t;
 
     rpcname = xml_name(xmsg);
     conn_state = device_handle_conn_state_get(dh);
@@ -1361,6 +3731,31 @@ device_state_handler(clixon_handle h,
     yspec0 = clicon_dbspec_yang(h);
     if ((tid = device_handle_tid_get(dh)) != 0)
         ct = controller_transaction_find(h, tid);
+    /* Reply of request dispatched by message-id, outside of state machine */
+    if (device_handle_dispatch_nr(dh) > 0 && strcmp(rpcname, "rpc-reply") == 0){
+        if ((ret = device_handle_dispatch(dh, xmsg)) < 0)
+            goto done;
+        if (ret == 1){
+            /* Continuation may have closed device */
+            if (device_handle_conn_state_get(dh) == CS_CLOSED && ct != NULL &&
+                controller_transaction_failed(h, tid, ct, dh, TR_FAILED_DEV_LEAVE, name, device_handle_logmsg_get(dh)) < 0)
+                goto done;
+            goto ok;
+        }
+    }
+    /* Pipelined push: set state of request and check message-id */
+    if (device_handle_pipeline_nr(dh) > 0 && strcmp(rpcname, "rpc-reply") == 0){
+        if ((ret = device_state_pipeline_recv(h, dh, xmsg, &conn_state)) < 0)
+            goto done;
+        if (ret == 0){ /* closed */
+            if (ct != NULL &&
+                controller_transaction_failed(h, tid, ct, dh, TR_FAILED_DEV_LEAVE, name, device_handle_logmsg_get(dh)) < 0)
+                goto done;
+            goto ok;
+        }
+        if (ret == 1) /* dropped */
+            goto ok;
+    }
     switch (conn_state){
         /* Here starts states of OPEN transaction */
     case CS_CONNECTING:
@@ -1374,6 +3769,11 @@ device_state_handler(clixon_handle h,
                 goto done;
             break;
         }
+        /* Time from connect until hello, see handshake-time */
+        device_handle_conn_time_get(dh, &t0);
+        gettimeofday(&t, NULL);
+        timersub(&t, &t0, &t);
+        device_handle_handshake_time_set(dh, t.tv_sec*1000 + t.tv_usec/1000);
         /* Map device capabilities to local settings */
         if (device_capabilities2settings(h, dh) < 0)
             goto done;
@@ -1388,6 +3788,8 @@ device_state_handler(clixon_handle h,
             clixon_err(OE_XML, 0, "Transaction unexpected SUCCESS state");
             goto done;
         }
+        if (device_drift_subscribe(h, dh) < 0)
+            goto done;
         /* Reset YANGs */
         if ((xyanglib = device_handle_yang_lib_get(dh)) != NULL){
             /* If local schemas, check if they exist as local file */
@@ -1400,6 +3802,22 @@ device_state_handler(clixon_handle h,
                 break;
             }
         }
+        /* Capabilities unchanged since last open: skip schema discovery */
+        if (xyanglib == NULL &&
+            device_handle_capabilities_find(dh, NETCONF_MONITORING_NAMESPACE)){
+            if ((ret = device_state_fast_reconnect(h, dh)) < 0)
+                goto done;
+            if (ret == 1){
+                if (device_state_sync_send(h, dh, 0) < 0)
+                    goto done;
+                if (device_state_set(dh, CS_DEVICE_SYNC) < 0)
+                    goto done;
+                break;
+            }
+        }
+        /* Not restored: remove device mount left on kept spec before schema discovery */
+        if (device_handle_yspec_last_release(dh, 1) < 0)
+            goto done;
         if (!device_handle_capabilities_find(dh, NETCONF_MONITORING_NAMESPACE)){
             clixon_debug(CLIXON_DBG_CTRL, "Device %s: Netconf monitoring capability %s not announced in hello protocol",
                          name,
@@ -1420,7 +3838,7 @@ device_state_handler(clixon_handle h,
             new = 0;
             yspec1 = NULL;
             domain = device_handle_domain_get(dh);
-            if (xyanglib_digest(xyanglib, &digest) < 0)
+            if (device_handle_yang_lib_digest_get(dh, &digest) < 0)
                 goto done;
             if (yang_mount_get_xpath(h, domain, digest, &yspec1, NULL) < 0)
                 goto done;
@@ -1442,7 +3860,7 @@ device_state_handler(clixon_handle h,
                     if ((ydomain = ydomain_new(h, domain)) == NULL)
                         goto done;
                 }
-                if (device_shared_yspec(h, dh, xyanglib, digest, &yspec1) < 0)
+                if (device_shared_yspec(h, dh, digest, &yspec1) < 0)
                     goto done;
                 if (yspec1 == NULL){
                     if ((yspec1 = yspec_new1(h, domain, digest)) == NULL)
@@ -1454,6 +3872,8 @@ device_state_handler(clixon_handle h,
                     goto done;
                 if (controller_mount_yspec_set(h, name, yspec1) < 0)
                     goto done;
+                if (device_shared_yspec_add(h, dh) < 0)
+                    goto done;
             }
             /* All schemas ready, parse them (may do device_close) */
             if (new){
@@ -1466,7 +3886,7 @@ device_state_handler(clixon_handle h,
                 }
             }
             /* Send a <get-config> request to a device */
-            if (device_send_get(h, dh, s, 0, NULL) < 0)
+            if (device_state_sync_send(h, dh, 0) < 0)
                 goto done;
             if (device_state_set(dh, CS_DEVICE_SYNC) < 0)
                 goto done;
@@ -1505,7 +3925,7 @@ device_state_handler(clixon_handle h,
         new = 0;
         yspec1 = NULL;
         domain =  device_handle_domain_get(dh);
-        if (xyanglib_digest(xyanglib, &digest) < 0)
+        if (device_handle_yang_lib_digest_get(dh, &digest) < 0)
             goto done;
         if (yang_mount_get_xpath(h, domain, digest, &yspec1, NULL) < 0)
             goto done;
@@ -1527,7 +3947,7 @@ device_state_handler(clixon_handle h,
                 if ((ydomain = ydomain_new(h, domain)) == NULL)
                     goto done;
             }
-            if (device_shared_yspec(h, dh, xyanglib, digest, &yspec1) < 0)
+            if (device_shared_yspec(h, dh, digest, &yspec1) < 0)
                 goto done;
             if (yspec1 == NULL){
                 if ((yspec1 = yspec_new1(h, domain, digest)) == NULL)
@@ -1540,6 +3960,8 @@ device_state_handler(clixon_handle h,
             goto done;
         if (controller_mount_yspec_set(h, name, yspec1) < 0)
             goto done;
+        if (device_shared_yspec_add(h, dh) < 0)
+            goto done;
         nr = 0;
         if ((ret = device_send_get_schema_next(h, dh, s, &nr)) < 0)
             goto done;
@@ -1560,7 +3982,7 @@ device_state_handler(clixon_handle h,
                 }
             }
             /* Unconditionally sync */
-            if (device_send_get(h, dh, s, 0, NULL) < 0)
+            if (device_state_sync_send(h, dh, 0) < 0)
                 goto done;
             if (device_state_set(dh, CS_DEVICE_SYNC) < 0)
                 goto done;
@@ -1574,7 +3996,7 @@ device_state_handler(clixon_handle h,
         if (device_state_check_sanity(dh, tid, ct, name, conn_state, rpcname) == 0)
             break;
         /* Receive get-schema and write to local yang file */
-        if ((ret = device_recv_get_schema(dh, xmsg, rpcname, conn_state)) < 0)
+        if ((ret = device_recv_get_schema(dh, xmsg, rpcname, conn_state, &resume)) < 0)
             goto done;
         if (ret == 0){ /* closed */
             if (controller_transaction_failed(h, tid, ct, dh, TR_FAILED_DEV_LEAVE, name, device_handle_logmsg_get(dh)) < 0)
@@ -1586,42 +4008,12 @@ device_state_handler(clixon_handle h,
             clixon_err(OE_XML, 0, "Transaction unexpected SUCCESS state");
             goto done;
         }
+        /* Resume other devices that waited for this schema */
+        if (resume && device_state_schema_resume(h, resume) < 0)
+            goto done;
         /* Check if all schemas are received */
-        nr = device_handle_nr_schemas_get(dh);
-        if ((ret = device_send_get_schema_next(h, dh, s, &nr)) < 0)
+        if (device_state_schema_next(h, dh, ct) < 0)
             goto done;
-        if (ret == 1){ /* Device closed */
-            if (controller_transaction_failed(h, tid, ct, dh, TR_FAILED_DEV_LEAVE, name, NULL) < 0)
-                goto done;
-            break;
-        }
-        if (ret == 0){ /* None sent */
-            /* All schemas ready, parse them */
-            if ((xyanglib = device_handle_yang_lib_get(dh)) == NULL){
-                if (controller_transaction_failed(h, tid, ct, dh, TR_FAILED_DEV_CLOSE, name, "No YANG device lib 2") < 0)
-                    goto done;
-                break;
-            }
-            if ((ret = device_schemas_mount_parse(h, dh, xyanglib)) < 0)
-                goto done;
-            if (ret == 0){
-                if (controller_transaction_failed(h, tid, ct, dh, TR_FAILED_DEV_LEAVE, name, device_handle_logmsg_get(dh)) < 0)
-                    goto done;
-                break;
-            }
-            /* Unconditionally sync */
-            if (device_send_get(h, dh, s, 0, NULL) < 0)
-                goto done;
-            if (device_state_set(dh, CS_DEVICE_SYNC) < 0)
-                goto done;
-            break;
-        }
-        device_handle_nr_schemas_set(dh, nr);
-        device_state_timeout_restart(dh);
-        clixon_debug(CLIXON_DBG_CTRL, "%s: %s(%d) -> %s(%d)",
-                     name,
-                     device_state_int2str(conn_state), nr-1,
-                     device_state_int2str(conn_state), nr);
         break;
     case CS_DEVICE_SYNC:
         if (device_state_check_sanity(dh, tid, ct, name, conn_state, rpcname) == 0)
@@ -1634,17 +4026,10 @@ device_state_handler(clixon_handle h,
                 goto done;
             break;
         }
-        if (controller_transaction_nr_devices(h, tid) == 1 &&
-            !ct->ct_pull_transient) {
-            /* See puts from each device in device_recv_config() */
-            if ((ret = commit_after_pull(h, dh, ct, "tmpdev")) < 0)
-                goto done;
-            if (ret == 0)
-                break;
-            xmldb_delete(h, "tmpdev");
-        }
-        /* The device is OK */
-        if (device_state_check_ok(h, dh, ct) < 0)
+        /* Yang-lib is complete, keep it for fast reconnect */
+        if (device_handle_yang_lib_mark(dh) < 0)
+            goto done;
+        if (device_state_sync_done(h, dh, ct) < 0)
             goto done;
         break;
     case CS_PUSH_LOCK:
@@ -1654,6 +4039,7 @@ device_state_handler(clixon_handle h,
         if ((ret = device_recv_ok(h, dh, xmsg, rpcname, conn_state, &cberr)) < 0)
             goto done;
         if (ret == 0){      /* 1. The device has failed: received rpc-error/not <ok>  */
+            device_handle_pipeline_skip(dh);
             if (controller_transaction_failed(h, tid, ct, dh, TR_FAILED_DEV_LEAVE, name, cbuf_get(cberr)) < 0)
                 goto done;
             if (device_state_set(dh, CS_OPEN) < 0)
@@ -1670,11 +4056,21 @@ device_state_handler(clixon_handle h,
             goto done;
         if (ret == 0)
             break;
-        if (device_send_get(h, dh, s, 0, NULL) < 0)
-            goto done;
         device_handle_tid_set(dh, ct->ct_id);
         if (device_state_set(dh, CS_PUSH_CHECK) < 0)
             goto done;
+        /* If pipelined, get-config is already sent */
+        if (ct->ct_push_pipeline)
+            break;
+        /* drift-trust and no config change notified since last sync: skip check */
+        if (device_drift_clean(h, dh)){
+            clixon_debug(CLIXON_DBG_CTRL, "%s: no config drift, skip get-config", name);
+            if (device_state_push_edit(h, dh, ct) < 0)
+                goto done;
+            break;
+        }
+        if (device_state_sync_send(h, dh, 1) < 0)
+            goto done;
         break;
         /* Here starts states of PUSH transaction */
     case CS_PUSH_CHECK:
@@ -1700,38 +4096,10 @@ device_state_handler(clixon_handle h,
                 goto done;
             break;
         }
+        /* Device config is same as SYNCED */
+        device_handle_drift_set(dh, 0);
         /* The device is OK */
-        if ((ret = device_state_check_fail(h, dh, ct, 1)) < 0)
-            goto done;
-        if (ret == 0)
-            break;
-        /* 2.2 The transaction is OK
-           Proceed to next step: get saved edit-msg and send it */
-        if ((cbmsg = device_handle_outmsg_get(dh, 1)) == NULL){
-            if ((cbmsg = device_handle_outmsg_get(dh, 2)) == NULL){
-                device_close_connection(dh, "Device %s no edit-msg in state %s",
-                                        name, device_state_int2str(conn_state));
-                if (controller_transaction_failed(h, tid, ct, dh, TR_FAILED_DEV_LEAVE, name, device_handle_logmsg_get(dh)) < 0)
-                    goto done;
-                break;
-            }
-            if (device_handle_framing_type_get(dh) == NETCONF_SSH_CHUNKED){
-                if (clixon_msg_send11(s, device_handle_name_get(dh), cbmsg) < 0)
-                    goto done;
-            }
-            else if (clixon_msg_send10(s, device_handle_name_get(dh), cbmsg) < 0)
-                goto done;
-            if (device_state_set(dh, CS_PUSH_EDIT2) < 0)
-                goto done;
-            break;
-        }
-        if (device_handle_framing_type_get(dh) == NETCONF_SSH_CHUNKED){
-            if (clixon_msg_send11(s, device_handle_name_get(dh), cbmsg) < 0)
-                goto done;
-        }
-        else if (clixon_msg_send10(s, device_handle_name_get(dh), cbmsg) < 0)
-            goto done;
-        if (device_state_set(dh, CS_PUSH_EDIT) < 0)
+        if (device_state_push_edit(h, dh, ct) < 0)
             goto done;
         break;
     case CS_PUSH_EDIT:
@@ -1744,7 +4112,8 @@ device_state_handler(clixon_handle h,
             if (controller_transaction_failed(h, tid, ct, dh, TR_FAILED_DEV_IGNORE, name, cbuf_get(cberr)) < 0)
                 goto done;
             /* 1.1 The error is "recoverable" (eg validate fail) */
-            /* --> 1.1.1 Trigger DISCARD of the device */
+            /* --> 1.1.1 Trigger DISCARD of the device, after any pipelined requests */
+            device_handle_pipeline_skip(dh);
             if (device_send_discard_changes(h, dh) < 0)
                 goto done;
             if (device_state_set(dh, CS_PUSH_DISCARD) < 0)
@@ -1762,7 +4131,9 @@ device_state_handler(clixon_handle h,
         if (ret == 0)
             break;
         /* 2.2 The transaction is OK
-           Proceed to next step */
+           Proceed to next step, if pipelined it is already sent */
+        if (device_handle_pipeline_nr(dh) > 0)
+            break;
         if ((cbmsg = device_handle_outmsg_get(dh, 2)) == NULL){
             if ((ret = device_send_validate(h, dh)) < 0)
                 goto done;
@@ -1770,11 +4141,7 @@ device_state_handler(clixon_handle h,
                 goto done;
             break;
         }
-        if (device_handle_framing_type_get(dh) == NETCONF_SSH_CHUNKED){
-            if (clixon_msg_send11(s, device_handle_name_get(dh), cbmsg) < 0)
-                goto done;
-        }
-        else if (clixon_msg_send10(s, device_handle_name_get(dh), cbmsg) < 0)
+        if (device_send_msg(h, dh, cbmsg) < 0)
             goto done;
         if (device_state_set(dh, CS_PUSH_EDIT2) < 0)
             goto done;
@@ -1789,7 +4156,8 @@ device_state_handler(clixon_handle h,
             if (controller_transaction_failed(h, tid, ct, dh, TR_FAILED_DEV_IGNORE, name, cbuf_get(cberr)) < 0)
                 goto done;
             /* 1.1 The error is "recoverable" (eg validate fail) */
-            /* --> 1.1.1 Trigger DISCARD of the device */
+            /* --> 1.1.1 Trigger DISCARD of the device, after any pipelined requests */
+            device_handle_pipeline_skip(dh);
             if (device_send_discard_changes(h, dh) < 0)
                 goto done;
             if (device_state_set(dh, CS_PUSH_DISCARD) < 0)
@@ -1807,7 +4175,9 @@ device_state_handler(clixon_handle h,
         if (ret == 0)
             break;
         /* 2.2 The transaction is OK
-           Proceed to next step */
+           Proceed to next step, if pipelined it is already sent */
+        if (device_handle_pipeline_nr(dh) > 0)
+            break;
         if ((ret = device_send_validate(h, dh)) < 0)
             goto done;
         if (device_state_set(dh, CS_PUSH_VALIDATE) < 0)
@@ -1823,7 +4193,8 @@ device_state_handler(clixon_handle h,
             if (controller_transaction_failed(h, tid, ct, dh, TR_FAILED_DEV_IGNORE, name, cbuf_get(cberr)) < 0)
                 goto done;
             /* 1.1 The error is "recoverable" (eg validate fail) */
-            /* --> 1.1.1 Trigger DISCARD of the device */
+            /* --> 1.1.1 Trigger DISCARD of the device, after any pipelined requests */
+            device_handle_pipeline_skip(dh);
             if (device_send_discard_changes(h, dh) < 0)
                 goto done;
             if (device_state_set(dh, CS_PUSH_DISCARD) < 0)
@@ -1847,86 +4218,34 @@ device_state_handler(clixon_handle h,
             goto done;
         if (ret == 0)
             break;
-        if (device_state_set(dh, CS_PUSH_WAIT) < 0)
-            goto done;
-
-        /* 2.2 The transaction is OK */
-        /* 2.2.1 Check if all devices are in WAIT (none are in EDIT/VALIDATE) */
-        if ((ret = controller_transaction_wait(h, tid)) < 0)
-            goto done;
-        if (ret == 1){
-            /* Check if action, skip if dryrun */
-            if (ct->ct_actions_type != AT_NONE && strcmp(ct->ct_sourcedb, "candidate")==0){
-                if ((cberr = cbuf_new()) == NULL){
-                    clixon_err(OE_UNIX, errno, "cbuf_new");
-                    goto done;
-                }
-                /* What to copy to candidate and commit to running? */
-                if (xmldb_candidate_find(h, "candidate", ct->ct_client_id, &de, &candidate) < 0)
-                    goto done;
-                if (candidate == NULL){
-                    if (controller_transaction_failed(h, ct->ct_id, ct, dh, TR_FAILED_DEV_LEAVE, name, "Candidate does not exist (privcand exit?)") < 0)
-                        goto done;
-                    break;
-                }
-                if (xmldb_copy(h, "actions", candidate) < 0)
+        if (ct->ct_push_type == PT_COMMIT_NONATOMIC){
+            /* Commit the controller once, then each device directly when it has validated */
+            if (!ct->ct_local_commit){
+                if ((ret = device_state_local_commit(h, dh, ct)) < 0)
                     goto done;
-                /* Third validate,
-                 * first in rpc_controller_commit,
-                 * second in rpc_transactions_actions_done
-                 * candidate should NOT have changed here
-                 */
-                if (clicon_option_bool(h, "CLICON_XMLDB_PRIVATE_CANDIDATE")){
-                    /* Rebase private candidate with running */
-                    if ((ret = backend_update(h, ct->ct_client_id, de, cberr)) < 0)
-                        goto done;
-                    if (ret == 0){
-                        if (controller_transaction_failed(h, ct->ct_id, ct, dh, TR_FAILED_DEV_IGNORE, name, cbuf_get(cberr)) < 0)
+                if (ret == 0){
+                    if (ct->ct_state == TS_INIT || ct->ct_state == TS_ACTIONS)
+                        controller_transaction_state_set(ct, TS_RESOLVED, TR_FAILED);
+                    if (device_handle_tid_get(dh) != 0 &&
+                        device_handle_conn_state_get(dh) == CS_PUSH_VALIDATE){
+                        if (device_send_discard_changes(h, dh) < 0)
                             goto done;
-                        /* 1.1 The error is "recoverable" (eg validate fail) */
-                        /* --> 1.1.1 Trigger DISCARD of the device */
                         if (device_state_set(dh, CS_PUSH_DISCARD) < 0)
                             goto done;
-                        break;
-                    }
-                }
-                if ((ret = candidate_commit(h, NULL, candidate, 0, 0, cberr)) < 0){
-                    /* Handle that candidate_commit can return < 0 if transaction ongoing */
-                    cprintf(cberr, "Controller commit error");
-                    if (strlen(clixon_err_reason()) > 0)
-                        cprintf(cberr, " %s", clixon_err_reason());
-                    if (controller_transaction_failed(h, ct->ct_id, ct, dh, TR_FAILED_DEV_LEAVE, name, cbuf_get(cberr)) < 0)
-                        goto done;
-                    break;
-                }
-                if (ret == 1){
-                    if (xmldb_post_commit(h, ct->ct_client_id) < 0)
-                        goto done;
-                }
-                if (clicon_option_bool(h, "CLICON_AUTOLOCK")) // XXX maybe also when ret = 0
-                    xmldb_unlock(h, candidate);
-
-                if (ret == 0){
-                    cbuf  *cberr2 = NULL;
-                    if ((cberr2 = cbuf_new()) == NULL){
-                        clixon_err(OE_UNIX, errno, "cbuf_new");
-                        goto done;
                     }
-                    cprintf(cberr2, "Validation: ");
-                    if (netconf_cbuf_err2cb(h, cberr, cberr2) < 0)
-                        goto done;
-                    if (controller_transaction_failed(h, ct->ct_id, ct, dh, TR_FAILED_DEV_IGNORE, "controller", cbuf_get(cberr2)) < 0)
-                        goto done;
-                    if (cberr2)
-                        cbuf_free(cberr2);
-                    if (controller_transaction_wait_trigger(h, tid, 0) < 0)
-                        goto done;
                     break;
                 }
+                ct->ct_local_commit = 1;
             }
-            if (controller_transaction_wait_trigger(h, tid, 1) < 0)
+            if (controller_transaction_device_commit(h, ct, dh) < 0)
                 goto done;
-        } /* All devices are in WAIT state */
+            break;
+        }
+        if (device_state_set(dh, CS_PUSH_WAIT) < 0)
+            goto done;
+        /* 2.2 The transaction is OK */
+        if (device_state_push_commit(h, dh) < 0)
+            goto done;
         break;
     case CS_PUSH_COMMIT:
         if (device_state_check_sanity(dh, tid, ct, name, conn_state, rpcname) == 0)
@@ -1956,7 +4275,13 @@ device_state_handler(clixon_handle h,
         if (device_state_set(dh, CS_PUSH_COMMIT_SYNC) < 0)
             goto done;
 #else
-        if (device_send_lock(h, dh, 0) < 0)
+        /* Device config is changed, refetch change token before unlock */
+        if (conn_state == CS_PUSH_COMMIT &&
+            device_change_token_push(h, dh, ct) < 0)
+            goto done;
+        /* If pipelined, unlock is already sent */
+        if (!ct->ct_push_pipeline &&
+            device_send_lock(h, dh, 0) < 0)
             goto done;
         if (device_state_set(dh, CS_PUSH_UNLOCK) < 0)
             goto done;
@@ -2119,15 +4444,16 @@ device_state_handler(clixon_handle h,
         }
         break;
     }
+ ok:
     retval = 0;
  done:
     clixon_debug(CLIXON_DBG_CTRL|CLIXON_DBG_DETAIL, "retval:%d", retval);
     if (cbxpath)
         cbuf_free(cbxpath);
-    if (digest)
-        free(digest);
     if (cberr)
         cbuf_free(cberr);
+    if (resume)
+        cvec_free(resume);
     return retval;
 }
 
@@ -2164,6 +4490,19 @@ devices_statedata(clixon_handle   h,
     char          *xb;
     char           timestr[28];
     int            ix;
+    uint32_t       handshakes;
+    uint32_t       reuses;
+    uint32_t       ms;
+    int            subscribed;
+    int            drift;
+    uint32_t       changes;
+    int            result;
+    uint32_t       timeouts;
+    uint32_t       ewma;
+    uint32_t       p95;
+    uint32_t       nr;
+    conn_state     st;
+    size_t         len;
 
     if ((cb = cbuf_new()) == NULL){
         clixon_err(OE_UNIX, errno, "cbuf_new");
@@ -2210,6 +4549,15 @@ devices_statedata(clixon_handle   h,
                 goto done;
             cprintf(cb, "<stable-timestamp>%s</stable-timestamp>", timestr);
         }
+        tv.tv_sec = 0;
+        device_handle_sync_check_get(dh, &tv, NULL, &result);
+        if (tv.tv_sec != 0){
+            if (time2str(&tv, timestr, sizeof(timestr)) < 0)
+                goto done;
+            cprintf(cb, "<sync-check-timestamp>%s</sync-check-timestamp>", timestr);
+            cprintf(cb, "<sync-check-state>%s</sync-check-state>",
+                    result == 1 ? "IN-SYNC" : result == 0 ? "OUT-OF-SYNC" : "UNKNOWN");
+        }
         if ((logmsg = device_handle_logmsg_get(dh)) != NULL){
             cprintf(cb, "<logmsg>");
             xml_chardata_cbuf_append(cb, 0, logmsg);
@@ -2219,6 +4567,34 @@ devices_statedata(clixon_handle   h,
             cprintf(cb, "<private-candidate-state>true</private-candidate-state>");
         cprintf(cb, "<netconf-framing-type>%s</netconf-framing-type>",
                 netconf_framing_int2str(device_handle_framing_type_get(dh)));
+        device_handle_handshake_get(dh, &handshakes, &reuses, &ms);
+        cprintf(cb, "<ssh-handshakes>%u</ssh-handshakes>", handshakes);
+        cprintf(cb, "<ssh-reuses>%u</ssh-reuses>", reuses);
+        if (handshakes + reuses > 0)
+            cprintf(cb, "<handshake-time>%u</handshake-time>", ms);
+        device_handle_drift_get(dh, &subscribed, &drift, &changes);
+        if (subscribed)
+            cprintf(cb, "<config-drift>%s</config-drift>", drift?"true":"false");
+        cprintf(cb, "<config-changes>%u</config-changes>", changes);
+        device_handle_timeout_get(dh, NULL, &timeouts);
+        cprintf(cb, "<state-timeouts>%u</state-timeouts>", timeouts);
+        if (device_handle_quarantined(dh))
+            cprintf(cb, "<quarantined>true</quarantined>");
+        for (st = CS_CLOSED; st < CS_NR; st++){
+            device_handle_latency_get(dh, st, &ewma, &p95, &nr);
+            if (nr == 0)
+                continue;
+            cprintf(cb, "<state-latency>");
+            cprintf(cb, "<state>%s</state>", device_state_int2str(st));
+            cprintf(cb, "<samples>%u</samples>", nr);
+            cprintf(cb, "<average>%u</average>", ewma);
+            cprintf(cb, "<p95>%u</p95>", p95);
+            device_state_timeout_get(h, dh, st, &tv);
+            cprintf(cb, "<timeout>%lu</timeout>", (unsigned long)(tv.tv_sec*1000 + tv.tv_usec/1000));
+            cprintf(cb, "</state-latency>");
+        }
+        if ((len = device_handle_outq_len(dh)) > 0)
+            cprintf(cb, "<output-queued>%zu</output-queued>", len);
         cprintf(cb, "</device></devices>");
         if (clixon_xml_parse_string(cbuf_get(cb), YB_NONE, NULL, &xstate, NULL) < 0)
             goto done;
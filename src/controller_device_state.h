@@ -37,6 +37,8 @@
 
   CS_CLOSED
      ^      \ connect
+     |<-- CS_QUEUED (if connect-window full)
+     |       |
      |       v        send get
      |<-- CS_CONNECTING
      |       |
@@ -51,6 +53,9 @@
      |       |
      |       v
   CS_OPEN <-+
+
+  CS_CONNECTING goes directly to CS_DEVICE_SYNC if the device has local YANGs without
+  netconf monitoring, or if its capabilities are unchanged since it was last open
   */
 
 #ifndef _CONTROLLER_DEVICE_STATE_H
@@ -72,6 +77,7 @@ enum conn_state_t {
     CS_OPEN,          /* Connection established and Hello sent to device. */
 
     /* Connect state machine */
+    CS_QUEUED,        /* Waiting for a connect slot, see connect-window */
     CS_CONNECTING,    /* Connect() called, expect to receive hello from device
                          May fail due to (1) connect fails or (2) hello not receivd */
     CS_SCHEMA_LIST,   /* Get ietf-netconf-monitor schema state */
@@ -79,6 +85,7 @@ enum conn_state_t {
     CS_DEVICE_SYNC,   /* Get all config (transient+merge are sub-state parameters) */
 
     /* Push state machine */
+    CS_PUSH_DIFF,     /* Config digests computed by a worker thread, see push-threads */
     CS_PUSH_LOCK,     /* Lock device candidate */
     CS_PUSH_CHECK,    /* sync device transient to check if device is unchanged */
     CS_PUSH_EDIT,     /* First edit-config sent (if any) waiting for reply */
@@ -96,6 +103,9 @@ enum conn_state_t {
 };
 typedef enum conn_state_t conn_state;
 
+/* Number of connection states, for per-state counters */
+#define CS_NR (CS_RPC_GENERIC+1)
+
 /*! How to bind device configuration to YANG
  *
  * @see clixon-controller@2023-01-01.yang yang-config
@@ -120,6 +130,12 @@ extern "C" {
 char        *device_state_int2str(conn_state state);
 conn_state   device_state_str2int(char *str);
 yang_config_t  yang_config_str2int(char *str);
+int          device_schema_fetch_add(clixon_handle h, device_handle dh, char *domain, char *name, char *rev);
+int          device_schema_fetch_wait(clixon_handle h, device_handle dh, char *domain, char *name, char *rev);
+int          device_schema_fetch_done(clixon_handle h, device_handle dh, char *domain, char *name, char *rev, cvec **resume);
+int          device_schema_fetch_free_all(clixon_handle h);
+int          device_shared_yspec_rm(clixon_handle h, device_handle dh);
+int          device_shared_yspec_free_all(clixon_handle h);
 int          device_close_connection(device_handle ch, const char *format, ...) __attribute__ ((format (printf, 2, 3)));
 int          device_input_cb(int s, void *arg);
 int          device_state_mount_point_get(char *devicename, yang_stmt *yspec,
@@ -127,9 +143,19 @@ int          device_state_mount_point_get(char *devicename, yang_stmt *yspec,
 int          device_state_timeout_register(device_handle ch);
 int          device_state_timeout_unregister(device_handle ch);
 int          device_state_set(device_handle dh, conn_state state);
+int          device_state_push_commit(clixon_handle h, device_handle dh);
+int          device_connect_schedule(clixon_handle h, device_handle dh);
+int          device_connect_dispatch_register(clixon_handle h);
 int          device_config_read(clixon_handle h, char *devname, char *config_type, cxobj **xrootp, cbuf **cberr);
 int          device_config_read_cache(clixon_handle h, char *devname, char *config_type, cxobj **xrootp, cbuf **cberr);
 int          device_config_write(clixon_handle h, char *name, char *config_type, cxobj *xdata, cbuf *cbret);
+int          device_config_digest_equal(device_handle dh);
+int          device_drift_clean(clixon_handle h, device_handle dh);
+int          device_state_sync_send(clixon_handle h, device_handle dh, int conditional);
+int          device_sync_check_sweep(clixon_handle h);
+int          device_sync_check_next(clixon_handle h);
+int          device_sync_check_free(clixon_handle h);
+int          device_push_edit_next(clixon_handle h);
 int          device_state_handler(clixon_handle h, device_handle ch, int s, cxobj *xmsg);
 int          devices_statedata(clixon_handle h, cvec *nsc, char *xpath, cxobj *xstate);
 
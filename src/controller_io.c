@@ -0,0 +1,757 @@
+/*
+ *
+  ***** BEGIN LICENSE BLOCK *****
+
+  Copyright (C) 2023 Olof Hagsand
+
+  This file is part of CLIXON.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  Alternatively, the contents of this file may be used under the terms of
+  the GNU General Public License Version 3 or later (the "GPL"),
+  in which case the provisions of the GPL are applicable instead
+  of those above. If you wish to allow use of your version of this file only
+  under the terms of the GPL, and not to allow others to
+  use your version of this file under the terms of Apache License version 2, indicate
+  your decision by deleting the provisions above and replace them with the
+  notice and other provisions required by the GPL. If you do not delete
+  the provisions above, a recipient may use your version of this file under
+  the terms of any one of the Apache License version 2 or the GPL.
+
+  ***** END LICENSE BLOCK *****
+  *
+  * Pool of device input worker threads
+  * The state machine, XML parsing and datastores are single-threaded: clixon error,
+  * log and parser state are global. Workers therefore only read and frame device input.
+  * Each device socket is owned by one worker, least loaded at registration, which polls
+  * its sockets and queues complete messages to the main thread. The main thread is
+  * woken via a pipe registered in the clixon event loop, and handles queued messages
+  * in order within a time budget.
+  * Queued input is bounded: while the bytes queued by a worker exceed CONTROLLER_IO_QUEUE_MAX,
+  * the worker does not poll devices with input already queued, until the main thread has
+  * handled enough of it.
+  * A worker does not call clixon functions. The framing type of a device is copied to its
+  * socket entry by the main thread, and changes when the device hello is handled.
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+/* clicon */
+#include <cligen/cligen.h>
+
+/* Clicon library functions. */
+#include <clixon/clixon.h>
+
+/* Controller includes */
+#include "controller.h"
+#include "controller_lib.h"
+#include "controller_netconf.h"
+#include "controller_device_state.h"
+#include "controller_device_handle.h"
+#include "controller_io.h"
+
+/*! Complete message, or end of input, queued from worker to main thread
+ */
+struct io_msg {
+    struct io_msg    *im_next;
+    struct io_worker *im_worker;      /* Worker that queued the message */
+    struct io_sock   *im_sock;        /* Device socket entry, valid while queued */
+    device_handle     im_dh;          /* Device handle */
+    int               im_socket;      /* Device socket */
+    cbuf             *im_msg;         /* Message without framing, or NULL on end of input */
+    size_t            im_len;         /* Length of message counted as queued input */
+    char              im_reason[128]; /* If im_msg is NULL: "" if closed, otherwise error reason */
+};
+
+/*! Device socket owned by a worker
+ *
+ * Frame fields are only accessed by the worker, is_framing is set by the main thread under
+ * iw_lock, and is_queued is changed by both under ip_lock
+ */
+struct io_sock {
+    struct io_sock *is_next;
+    device_handle   is_dh;          /* Device handle */
+    int             is_socket;      /* Device socket */
+    netconf_framing_type is_framing; /* Framing type of device */
+    struct io_msg  *is_end;         /* End of input, reserved so that it can always be queued */
+    cbuf           *is_frame;       /* Frame being received */
+    int             is_frame_state; /* See netconf_input_msg_scan */
+    size_t          is_frame_size;  /* See netconf_input_msg_scan */
+    int             is_done;        /* End of input queued, socket is not polled */
+    size_t          is_queued;      /* Bytes of messages queued to main thread */
+};
+
+struct io_pool;
+
+/*! Worker thread
+ *
+ * The socket list is changed by the main thread under iw_lock. A removed socket is not
+ * freed until the worker has acknowledged the change, so that the worker can use its
+ * sockets without lock while polling and reading.
+ */
+struct io_worker {
+    struct io_pool  *iw_pool;
+    pthread_t        iw_thread;
+    int              iw_started;   /* Thread is created */
+    pthread_mutex_t  iw_lock;
+    pthread_cond_t   iw_cond;      /* Signalled when worker acknowledges a change */
+    int              iw_wake[2];   /* Pipe to wake worker on change */
+    struct io_sock  *iw_socks;     /* Device sockets of worker */
+    int              iw_nsocks;    /* Number of device sockets */
+    uint64_t         iw_gen;       /* Generation of socket list, incremented on remove */
+    uint64_t         iw_ack;       /* Generation acknowledged by worker */
+    int              iw_stop;      /* Worker should exit */
+    unsigned char   *iw_buf;       /* Read buffer */
+    size_t           iw_queued;    /* Bytes of messages queued to main thread, under ip_lock */
+};
+
+/*! Pool of worker threads, one per clixon handle
+ */
+struct io_pool {
+    int                   ip_nr;      /* Number of workers */
+    struct io_worker     *ip_workers; /* Vector of workers */
+    pthread_mutex_t       ip_lock;    /* Protects message queue */
+    struct io_msg        *ip_head;    /* Message queue to main thread */
+    struct io_msg        *ip_tail;
+    int                   ip_notify[2]; /* Pipe to wake main thread on message */
+    controller_io_msg_cb *ip_fn;      /* Message callback in main thread */
+};
+
+/*! Write a byte to a wakeup pipe, a full pipe is already pending wakeup
+ */
+static void
+io_wakeup(int fd)
+{
+    char c = 0;
+
+    while (write(fd, &c, 1) < 0 && errno == EINTR)
+        ;
+}
+
+/*! Drain a wakeup pipe
+ */
+static void
+io_wakeup_clear(int fd)
+{
+    char buf[64];
+
+    while (read(fd, buf, sizeof(buf)) > 0)
+        ;
+}
+
+/*! Create a non-blocking wakeup pipe
+ */
+static int
+io_wakeup_pipe(int fds[2])
+{
+    int i;
+
+    if (pipe(fds) < 0)
+        return -1;
+    for (i=0; i<2; i++)
+        if (fcntl(fds[i], F_SETFL, O_NONBLOCK) < 0 ||
+            fcntl(fds[i], F_SETFD, FD_CLOEXEC) < 0)
+            return -1;
+    return 0;
+}
+
+/*! Queue message or end of input of device socket to main thread, called by worker
+ *
+ * On end of input, the socket is not polled anymore. If a message cannot be allocated, it
+ * is dropped and end of input is queued with an error reason, so that the device is closed.
+ * @param[in]  iw      Worker
+ * @param[in]  is      Device socket
+ * @param[in]  cbmsg   Message, or NULL on end of input
+ * @param[in]  reason  On end of input, "" if closed by device, otherwise error reason
+ */
+static void
+io_post(struct io_worker *iw,
+        struct io_sock   *is,
+        cbuf             *cbmsg,
+        const char       *reason)
+{
+    struct io_pool *ip = iw->iw_pool;
+    struct io_msg  *im = NULL;
+    int             wake;
+
+    if (cbmsg != NULL && (im = calloc(1, sizeof(*im))) == NULL){
+        cbuf_free(cbmsg);
+        cbmsg = NULL;
+        reason = "Out of memory reading device input";
+    }
+    if (cbmsg == NULL){
+        if ((im = is->is_end) == NULL) /* Already queued */
+            return;
+        is->is_end = NULL;
+        is->is_done = 1;
+    }
+    im->im_worker = iw;
+    im->im_sock = is;
+    im->im_dh = is->is_dh;
+    im->im_socket = is->is_socket;
+    im->im_msg = cbmsg;
+    im->im_len = cbmsg ? cbuf_len(cbmsg) : 0;
+    if (reason)
+        strncpy(im->im_reason, reason, sizeof(im->im_reason)-1);
+    pthread_mutex_lock(&ip->ip_lock);
+    is->is_queued += im->im_len;
+    iw->iw_queued += im->im_len;
+    wake = (ip->ip_head == NULL);
+    if (ip->ip_tail)
+        ip->ip_tail->im_next = im;
+    else
+        ip->ip_head = im;
+    ip->ip_tail = im;
+    pthread_mutex_unlock(&ip->ip_lock);
+    if (wake)
+        io_wakeup(ip->ip_notify[1]);
+}
+
+/*! Remove message from queued input of its worker, called by main thread under ip_lock
+ *
+ * Wakes the worker if its queued input drops below CONTROLLER_IO_QUEUE_MAX, so that it
+ * polls all its devices again.
+ * @param[in]  im      Message removed from queue
+ * @param[in]  is      Device socket entry of message, or NULL if removed
+ */
+static void
+io_unqueue(struct io_msg  *im,
+           struct io_sock *is)
+{
+    struct io_worker *iw = im->im_worker;
+    int               over;
+
+    over = iw->iw_queued >= CONTROLLER_IO_QUEUE_MAX;
+    iw->iw_queued -= im->im_len;
+    if (is)
+        is->is_queued -= im->im_len;
+    if (over && iw->iw_queued < CONTROLLER_IO_QUEUE_MAX)
+        io_wakeup(iw->iw_wake[1]);
+}
+
+/*! Free device socket entry
+ *
+ * @param[in]  is      Device socket
+ */
+static void
+io_sock_free(struct io_sock *is)
+{
+    if (is->is_frame)
+        cbuf_free(is->is_frame);
+    if (is->is_end)
+        free(is->is_end);
+    free(is);
+}
+
+/*! Read and frame input of a device socket, called by worker when socket is readable
+ *
+ * @param[in]  iw      Worker
+ * @param[in]  is      Device socket
+ */
+static void
+io_read(struct io_worker *iw,
+        struct io_sock   *is)
+{
+    unsigned char        *p;
+    size_t                plen;
+    ssize_t               len;
+    int                   eom = 0;
+    char                  reason[128];
+    netconf_framing_type  framing;
+
+    if ((len = read(is->is_socket, iw->iw_buf, CONTROLLER_READ_BUF_MAX)) < 0){
+        if (errno == EINTR || errno == EAGAIN)
+            return;
+        snprintf(reason, sizeof(reason), "read: %s", strerror(errno));
+        io_post(iw, is, NULL, reason);
+        return;
+    }
+    if (len == 0){
+        io_post(iw, is, NULL, "");
+        return;
+    }
+    pthread_mutex_lock(&iw->iw_lock);
+    framing = is->is_framing;
+    pthread_mutex_unlock(&iw->iw_lock);
+    p = iw->iw_buf;
+    plen = len;
+    while (plen > 0){
+        if (netconf_input_msg_scan_r(&p, &plen, is->is_frame,
+                                     framing,
+                                     &is->is_frame_state, &is->is_frame_size, &eom,
+                                     reason, sizeof(reason)) < 0){
+            io_post(iw, is, NULL, reason);
+            return;
+        }
+        if (eom == 0)
+            break;
+        io_post(iw, is, is->is_frame, NULL);
+        is->is_frame = NULL;
+        if (is->is_done)
+            return;
+        if ((is->is_frame = cbuf_new()) == NULL){
+            snprintf(reason, sizeof(reason), "cbuf_new: %s", strerror(errno));
+            io_post(iw, is, NULL, reason);
+            return;
+        }
+    }
+}
+
+/*! Worker thread main loop: poll device sockets of worker and read those readable
+ *
+ * @param[in]  arg   Worker
+ */
+static void *
+io_worker_main(void *arg)
+{
+    struct io_worker *iw = (struct io_worker *)arg;
+    struct io_sock   *is;
+    struct io_sock  **svec = NULL;
+    struct pollfd    *fds = NULL;
+    int               len = 0;
+    int               over;
+    int               n;
+    int               i;
+    void             *p;
+
+    for (;;){
+        pthread_mutex_lock(&iw->iw_lock);
+        if (iw->iw_stop){
+            pthread_mutex_unlock(&iw->iw_lock);
+            break;
+        }
+        /* Previous sockets are not used anymore */
+        iw->iw_ack = iw->iw_gen;
+        pthread_cond_broadcast(&iw->iw_cond);
+        if (iw->iw_nsocks + 1 > len){
+            n = iw->iw_nsocks + 1 + 64;
+            if ((p = realloc(fds, n*sizeof(*fds))) != NULL){
+                fds = p;
+                if ((p = realloc(svec, n*sizeof(*svec))) != NULL){
+                    svec = p;
+                    len = n;
+                }
+            }
+            if (len == 0){ /* Retry later */
+                pthread_mutex_unlock(&iw->iw_lock);
+                usleep(10000);
+                continue;
+            }
+        }
+        fds[0].fd = iw->iw_wake[0];
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        n = 1;
+        pthread_mutex_lock(&iw->iw_pool->ip_lock);
+        over = iw->iw_queued >= CONTROLLER_IO_QUEUE_MAX;
+        for (is = iw->iw_socks; is && n < len; is = is->is_next){
+            if (is->is_done)
+                continue;
+            if (over && is->is_queued > 0) /* Wait until main thread has handled input */
+                continue;
+            svec[n] = is;
+            fds[n].fd = is->is_socket;
+            fds[n].events = POLLIN;
+            fds[n].revents = 0;
+            n++;
+        }
+        pthread_mutex_unlock(&iw->iw_pool->ip_lock);
+        pthread_mutex_unlock(&iw->iw_lock);
+        if (poll(fds, n, -1) < 0)
+            continue;
+        if (fds[0].revents)
+            io_wakeup_clear(iw->iw_wake[0]);
+        for (i=1; i<n; i++)
+            if (fds[i].revents)
+                io_read(iw, svec[i]);
+    }
+    if (fds)
+        free(fds);
+    if (svec)
+        free(svec);
+    return NULL;
+}
+
+/*! Handle queued messages from workers in the main thread, called by event loop
+ *
+ * Messages are handled in order until the queue is empty or a time budget is used,
+ * then other events are served before handling more.
+ * @param[in]  s     Notify pipe
+ * @param[in]  arg   Clixon handle
+ * @retval     0     OK
+ * @retval    -1     Error
+ */
+static int
+io_deliver(int   s,
+           void *arg)
+{
+    int             retval = -1;
+    clixon_handle   h = (clixon_handle)arg;
+    struct io_pool *ip = NULL;
+    struct io_msg  *im;
+    struct timeval  t0;
+    struct timeval  t;
+    int             tbudget;
+    int             ret;
+
+    if (clicon_ptr_get(h, "controller-io-pool", (void**)&ip) < 0 || ip == NULL)
+        goto ok;
+    io_wakeup_clear(s);
+    if ((tbudget = clicon_data_int_get(h, "controller-read-time-budget")) <= 0)
+        tbudget = CONTROLLER_READ_TIME_BUDGET_DEFAULT;
+    gettimeofday(&t0, NULL);
+    for (;;){
+        pthread_mutex_lock(&ip->ip_lock);
+        if ((im = ip->ip_head) != NULL){
+            if ((ip->ip_head = im->im_next) == NULL)
+                ip->ip_tail = NULL;
+            io_unqueue(im, im->im_sock);
+        }
+        pthread_mutex_unlock(&ip->ip_lock);
+        if (im == NULL)
+            break;
+        ret = ip->ip_fn(h, im->im_dh, im->im_socket, im->im_msg, im->im_reason);
+        free(im);
+        if (ret < 0)
+            goto done;
+        gettimeofday(&t, NULL);
+        timersub(&t, &t0, &t);
+        if (t.tv_sec*1000 + t.tv_usec/1000 >= tbudget){
+            pthread_mutex_lock(&ip->ip_lock);
+            if (ip->ip_head != NULL)
+                io_wakeup(ip->ip_notify[1]);
+            pthread_mutex_unlock(&ip->ip_lock);
+            break;
+        }
+    }
+ ok:
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Get worker pool, create and start workers if not exists
+ *
+ * Worker threads block all signals, signals are handled by the main thread
+ * @param[in]  h     Clixon handle
+ * @param[in]  nr    Number of workers if created
+ * @param[in]  fn    Message callback if created
+ * @retval     ip    Worker pool
+ * @retval     NULL  Error
+ */
+static struct io_pool *
+io_pool_get(clixon_handle         h,
+            int                   nr,
+            controller_io_msg_cb *fn)
+{
+    struct io_pool   *ip = NULL;
+    struct io_worker *iw;
+    sigset_t          all;
+    sigset_t          old;
+    int               i;
+    int               ret;
+
+    if (clicon_ptr_get(h, "controller-io-pool", (void**)&ip) == 0 && ip != NULL)
+        return ip;
+    if ((ip = calloc(1, sizeof(*ip))) == NULL){
+        clixon_err(OE_UNIX, errno, "calloc");
+        return NULL;
+    }
+    ip->ip_notify[0] = ip->ip_notify[1] = -1;
+    ip->ip_fn = fn;
+    pthread_mutex_init(&ip->ip_lock, NULL);
+    clicon_ptr_set(h, "controller-io-pool", (void*)ip);
+    if (io_wakeup_pipe(ip->ip_notify) < 0){
+        clixon_err(OE_UNIX, errno, "pipe");
+        goto err;
+    }
+    if (clixon_event_reg_fd(ip->ip_notify[0], io_deliver, h, "controller io workers") < 0)
+        goto err;
+    if ((ip->ip_workers = calloc(nr, sizeof(*ip->ip_workers))) == NULL){
+        clixon_err(OE_UNIX, errno, "calloc");
+        goto err;
+    }
+    ip->ip_nr = nr;
+    for (i=0; i<nr; i++){
+        iw = &ip->ip_workers[i];
+        iw->iw_pool = ip;
+        iw->iw_wake[0] = iw->iw_wake[1] = -1;
+        pthread_mutex_init(&iw->iw_lock, NULL);
+        pthread_cond_init(&iw->iw_cond, NULL);
+    }
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (i=0; i<nr; i++){
+        iw = &ip->ip_workers[i];
+        if (io_wakeup_pipe(iw->iw_wake) < 0){
+            clixon_err(OE_UNIX, errno, "pipe");
+            break;
+        }
+        if ((iw->iw_buf = malloc(CONTROLLER_READ_BUF_MAX)) == NULL){
+            clixon_err(OE_UNIX, errno, "malloc");
+            break;
+        }
+        if ((ret = pthread_create(&iw->iw_thread, NULL, io_worker_main, iw)) != 0){
+            clixon_err(OE_UNIX, ret, "pthread_create");
+            break;
+        }
+        iw->iw_started = 1;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (i < nr)
+        goto err;
+    clixon_debug(CLIXON_DBG_CTRL, "%d io workers started", nr);
+    return ip;
+ err:
+    controller_io_free_all(h);
+    return NULL;
+}
+
+/*! Register device socket with an input worker thread
+ *
+ * The device is assigned to the worker with fewest sockets. Complete messages from the
+ * device are given to fn in the main thread.
+ * If io-threads is 0, the device is not registered and the caller registers the socket
+ * in the event loop.
+ * @param[in]  h     Clixon handle
+ * @param[in]  dh    Device handle
+ * @param[in]  s     Device socket
+ * @param[in]  fn    Message callback
+ * @retval     1     Registered with worker
+ * @retval     0     Not registered, io-threads is 0
+ * @retval    -1     Error
+ * @see io-threads in clixon-controller.yang
+ */
+int
+controller_io_register(clixon_handle         h,
+                       device_handle         dh,
+                       int                   s,
+                       controller_io_msg_cb *fn)
+{
+    int               retval = -1;
+    struct io_pool   *ip;
+    struct io_worker *iw;
+    struct io_sock   *is = NULL;
+    int               nr;
+    int               i;
+
+    if ((nr = clicon_data_int_get(h, "controller-io-threads")) <= 0){
+        retval = 0;
+        goto done;
+    }
+    if ((ip = io_pool_get(h, nr, fn)) == NULL)
+        goto done;
+    iw = &ip->ip_workers[0];
+    for (i=1; i<ip->ip_nr; i++)
+        if (ip->ip_workers[i].iw_nsocks < iw->iw_nsocks)
+            iw = &ip->ip_workers[i];
+    if ((is = calloc(1, sizeof(*is))) == NULL){
+        clixon_err(OE_UNIX, errno, "calloc");
+        goto done;
+    }
+    if ((is->is_frame = cbuf_new()) == NULL){
+        clixon_err(OE_UNIX, errno, "cbuf_new");
+        goto done;
+    }
+    if ((is->is_end = calloc(1, sizeof(*is->is_end))) == NULL){
+        clixon_err(OE_UNIX, errno, "calloc");
+        goto done;
+    }
+    is->is_dh = dh;
+    is->is_socket = s;
+    is->is_framing = device_handle_framing_type_get(dh);
+    pthread_mutex_lock(&iw->iw_lock);
+    is->is_next = iw->iw_socks;
+    iw->iw_socks = is;
+    iw->iw_nsocks++;
+    pthread_mutex_unlock(&iw->iw_lock);
+    is = NULL;
+    io_wakeup(iw->iw_wake[1]);
+    device_handle_flag_set(dh, DH_FLAG_IO_WORKER);
+    retval = 1;
+ done:
+    if (is)
+        io_sock_free(is);
+    return retval;
+}
+
+/*! Set framing type of device registered with an input worker thread
+ *
+ * Called when the framing type of the device changes, ie after its hello
+ * @param[in]  h       Clixon handle
+ * @param[in]  dh      Device handle
+ * @param[in]  framing Framing type
+ * @retval     1       Set
+ * @retval     0       Device is not registered with a worker
+ */
+int
+controller_io_framing_set(clixon_handle        h,
+                          device_handle        dh,
+                          netconf_framing_type framing)
+{
+    struct io_pool   *ip = NULL;
+    struct io_worker *iw;
+    struct io_sock   *is = NULL;
+    int               i;
+
+    if (!device_handle_flag_get(dh, DH_FLAG_IO_WORKER))
+        return 0;
+    if (clicon_ptr_get(h, "controller-io-pool", (void**)&ip) < 0 || ip == NULL)
+        return 0;
+    for (i=0; i<ip->ip_nr && is == NULL; i++){
+        iw = &ip->ip_workers[i];
+        pthread_mutex_lock(&iw->iw_lock);
+        for (is = iw->iw_socks; is; is = is->is_next)
+            if (is->is_dh == dh){
+                is->is_framing = framing;
+                break;
+            }
+        pthread_mutex_unlock(&iw->iw_lock);
+    }
+    return is != NULL;
+}
+
+/*! Unregister device socket from its input worker thread, before the socket is closed
+ *
+ * Waits until the worker does not use the socket. Queued messages of the device not yet
+ * handled are dropped.
+ * @param[in]  h     Clixon handle
+ * @param[in]  dh    Device handle
+ * @retval     1     Unregistered
+ * @retval     0     Device was not registered with a worker
+ */
+int
+controller_io_unregister(clixon_handle h,
+                         device_handle dh)
+{
+    struct io_pool   *ip = NULL;
+    struct io_worker *iw;
+    struct io_sock  **isp;
+    struct io_sock   *is = NULL;
+    struct io_msg   **imp;
+    struct io_msg    *im;
+    int               i;
+
+    if (!device_handle_flag_get(dh, DH_FLAG_IO_WORKER))
+        return 0;
+    device_handle_flag_reset(dh, DH_FLAG_IO_WORKER);
+    if (clicon_ptr_get(h, "controller-io-pool", (void**)&ip) < 0 || ip == NULL)
+        return 0;
+    for (i=0; i<ip->ip_nr && is == NULL; i++){
+        iw = &ip->ip_workers[i];
+        pthread_mutex_lock(&iw->iw_lock);
+        for (isp = &iw->iw_socks; *isp; isp = &(*isp)->is_next)
+            if ((*isp)->is_dh == dh)
+                break;
+        if ((is = *isp) != NULL){
+            *isp = is->is_next;
+            iw->iw_nsocks--;
+            iw->iw_gen++;
+            io_wakeup(iw->iw_wake[1]);
+            while (iw->iw_ack != iw->iw_gen && iw->iw_started && !iw->iw_stop)
+                pthread_cond_wait(&iw->iw_cond, &iw->iw_lock);
+        }
+        pthread_mutex_unlock(&iw->iw_lock);
+    }
+    if (is)
+        io_sock_free(is);
+    pthread_mutex_lock(&ip->ip_lock);
+    ip->ip_tail = NULL;
+    imp = &ip->ip_head;
+    while ((im = *imp) != NULL){
+        if (im->im_dh == dh){
+            *imp = im->im_next;
+            io_unqueue(im, NULL);
+            if (im->im_msg)
+                cbuf_free(im->im_msg);
+            free(im);
+            continue;
+        }
+        ip->ip_tail = im;
+        imp = &im->im_next;
+    }
+    pthread_mutex_unlock(&ip->ip_lock);
+    return 1;
+}
+
+/*! Stop worker threads and free worker pool
+ *
+ * Devices should be closed before
+ * @param[in]  h     Clixon handle
+ * @retval     0     OK
+ */
+int
+controller_io_free_all(clixon_handle h)
+{
+    struct io_pool   *ip = NULL;
+    struct io_worker *iw;
+    struct io_sock   *is;
+    struct io_msg    *im;
+    int               i;
+
+    if (clicon_ptr_get(h, "controller-io-pool", (void**)&ip) < 0 || ip == NULL)
+        return 0;
+    for (i=0; i<ip->ip_nr; i++){
+        iw = &ip->ip_workers[i];
+        if (iw->iw_started){
+            pthread_mutex_lock(&iw->iw_lock);
+            iw->iw_stop = 1;
+            pthread_mutex_unlock(&iw->iw_lock);
+            io_wakeup(iw->iw_wake[1]);
+            pthread_join(iw->iw_thread, NULL);
+        }
+        while ((is = iw->iw_socks) != NULL){
+            iw->iw_socks = is->is_next;
+            io_sock_free(is);
+        }
+        if (iw->iw_buf)
+            free(iw->iw_buf);
+        if (iw->iw_wake[0] != -1)
+            close(iw->iw_wake[0]);
+        if (iw->iw_wake[1] != -1)
+            close(iw->iw_wake[1]);
+        pthread_cond_destroy(&iw->iw_cond);
+        pthread_mutex_destroy(&iw->iw_lock);
+    }
+    while ((im = ip->ip_head) != NULL){
+        ip->ip_head = im->im_next;
+        if (im->im_msg)
+            cbuf_free(im->im_msg);
+        free(im);
+    }
+    if (ip->ip_notify[0] != -1){
+        clixon_event_unreg_fd(ip->ip_notify[0], io_deliver);
+        close(ip->ip_notify[0]);
+    }
+    if (ip->ip_notify[1] != -1)
+        close(ip->ip_notify[1]);
+    pthread_mutex_destroy(&ip->ip_lock);
+    if (ip->ip_workers)
+        free(ip->ip_workers);
+    free(ip);
+    clicon_ptr_set(h, "controller-io-pool", NULL);
+    return 0;
+}
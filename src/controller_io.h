@@ -0,0 +1,74 @@
+/*
+ *
+  ***** BEGIN LICENSE BLOCK *****
+
+  Copyright (C) 2023 Olof Hagsand
+
+  This file is part of CLIXON.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  Alternatively, the contents of this file may be used under the terms of
+  the GNU General Public License Version 3 or later (the "GPL"),
+  in which case the provisions of the GPL are applicable instead
+  of those above. If you wish to allow use of your version of this file only
+  under the terms of the GPL, and not to allow others to
+  use your version of this file under the terms of Apache License version 2, indicate
+  your decision by deleting the provisions above and replace them with the
+  notice and other provisions required by the GPL. If you do not delete
+  the provisions above, a recipient may use your version of this file under
+  the terms of any one of the Apache License version 2 or the GPL.
+
+  ***** END LICENSE BLOCK *****
+  *
+  * Pool of device input worker threads
+  * Each worker owns a shard of device sockets: it reads, frames and queues complete
+  * messages, which are handled one by one in the main thread.
+  */
+
+#ifndef _CONTROLLER_IO_H
+#define _CONTROLLER_IO_H
+
+/*
+ * Types
+ */
+/*! Handle a complete message, or end of input, from a device in the main thread
+ *
+ * @param[in]  h       Clixon handle
+ * @param[in]  dh      Device handle
+ * @param[in]  s       Device socket
+ * @param[in]  cbmsg   Message without framing, freed by callback, or NULL on end of input
+ * @param[in]  reason  If cbmsg is NULL: "" if closed by device, otherwise error reason
+ * @retval     0       OK
+ * @retval    -1       Error
+ */
+typedef int (controller_io_msg_cb)(clixon_handle h, device_handle dh, int s,
+                                   cbuf *cbmsg, const char *reason);
+
+/*
+ * Prototypes
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int controller_io_register(clixon_handle h, device_handle dh, int s, controller_io_msg_cb *fn);
+int controller_io_framing_set(clixon_handle h, device_handle dh, netconf_framing_type framing);
+int controller_io_unregister(clixon_handle h, device_handle dh);
+int controller_io_free_all(clixon_handle h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CONTROLLER_IO_H */
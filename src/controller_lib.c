@@ -91,6 +91,7 @@ static const map_str2int ptmap[] = {
     {"NONE",     PT_NONE},
     {"VALIDATE", PT_VALIDATE},
     {"COMMIT",   PT_COMMIT},
+    {"COMMIT-NONATOMIC", PT_COMMIT_NONATOMIC},
     {NULL,       -1}
 };
 
@@ -106,6 +107,16 @@ static const map_str2int atmap[] = {
     {NULL,     -1}
 };
 
+/*! Mapping between enum pull_commit_type_t and yang pull-commit
+ *
+ * @see clixon-controller.yang
+ */
+static const map_str2int pcmap[] = {
+    {"TRANSACTION", PC_TRANSACTION},
+    {"DEVICE",      PC_DEVICE},
+    {NULL,         -1}
+};
+
 /*! Map controller transaction state from int to string
  *
  * @param[in]  state  Transaction state as int
@@ -216,6 +227,28 @@ actions_type_str2int(char *str)
     return clicon_str2int(atmap, str);
 }
 
+/*! Map pull commit type from int to string
+ *
+ * @param[in]  typ    Pull commit type as int
+ * @retval     str    Pull commit type as string
+ */
+char *
+pull_commit_type_int2str(pull_commit_type t)
+{
+    return (char*)clicon_int2str(pcmap, t);
+}
+
+/*! Map pull commit type from string to int
+ *
+ * @param[in]  str    Pull commit type as string
+ * @retval     type   Pull commit type as int
+ */
+pull_commit_type
+pull_commit_type_str2int(char *str)
+{
+    return clicon_str2int(pcmap, str);
+}
+
 /*! Given a yang-library/module-set, bind it to yang
  *
  * The RFC 8525 yang-library has several different sources with different XML structure,
@@ -524,6 +557,44 @@ controller_mount_yspec_set(clixon_handle h,
     return retval;
 }
 
+/*! Remove the mount of a device from its YANG spec
+ *
+ * As done on connect, but for a device whose mount was kept over reconnect and not restored
+ * @param[in]  h        Clixon handle
+ * @param[in]  devname  Name of device
+ * @retval     0        OK
+ * @retval    -1        Error
+ * @see controller_connect
+ */
+int
+controller_mount_yspec_rm(clixon_handle h,
+                          char         *devname)
+{
+    int    retval = -1;
+    cbuf  *cb = NULL;
+    cxobj *xt = NULL;
+    cxobj *xconfig;
+
+    if ((cb = cbuf_new()) == NULL){
+        clixon_err(OE_UNIX, errno, "cbuf_new");
+        goto done;
+    }
+    cprintf(cb, "devices/device[name='%s']/config", devname);
+    if (xmldb_get0(h, "running", YB_MODULE, NULL, cbuf_get(cb), 1, WITHDEFAULTS_EXPLICIT, &xt, NULL, NULL) < 0)
+        goto done;
+    if ((xconfig = xpath_first(xt, NULL, "%s", cbuf_get(cb))) != NULL){
+        if (yang_schema_yspec_rm(h, xconfig) < 0)
+            goto done;
+    }
+    retval = 0;
+ done:
+    if (cb)
+        cbuf_free(cb);
+    if (xt)
+        xml_free(xt);
+    return retval;
+}
+
 /*! Go through all yspecs and delete if there are no mounts
  *
  * Essentially a garbage collect.
@@ -569,6 +640,1137 @@ yang_mount_cleanup(clixon_handle h)
     return retval;
 }
 
+/* FNV-1a 128-bit constants used by config digests, prime is 2^88 + 0x13b */
+#define CONFIG_DIGEST_OFFSET_HI 0x6c62272e07bb0142ULL
+#define CONFIG_DIGEST_OFFSET_LO 0x62b821756295c58dULL
+#define CONFIG_DIGEST_PRIME_LO  0x13bULL
+
+/*! Initialize a running FNV-1a digest
+ *
+ * @param[out] digest  Digest
+ */
+static void
+config_digest_init(config_digest *digest)
+{
+    digest->cdg_hi = CONFIG_DIGEST_OFFSET_HI;
+    digest->cdg_lo = CONFIG_DIGEST_OFFSET_LO;
+}
+
+/*! Add bytes to a running FNV-1a 128-bit digest
+ *
+ * The 128-bit multiplication with the FNV prime is done in 64-bit words
+ * @param[in,out] digest  Digest
+ * @param[in]     buf     Bytes to add
+ * @param[in]     len     Length of buf
+ */
+static void
+config_digest_add(config_digest *digest,
+                  const void    *buf,
+                  size_t         len)
+{
+    const uint8_t *p = buf;
+    uint64_t       hi = digest->cdg_hi;
+    uint64_t       lo = digest->cdg_lo;
+    uint64_t       p0;
+    uint64_t       p1;
+    uint64_t       lo1;
+    size_t         i;
+
+    for (i=0; i<len; i++){
+        lo ^= p[i];
+        /* (hi,lo) * (2^88 + 0x13b) mod 2^128 */
+        p0 = (lo & 0xffffffffULL) * CONFIG_DIGEST_PRIME_LO;
+        p1 = (lo >> 32) * CONFIG_DIGEST_PRIME_LO;
+        lo1 = p0 + (p1 << 32);
+        hi = hi * CONFIG_DIGEST_PRIME_LO + (p1 >> 32) + (lo1 < p0) + (lo << 24);
+        lo = lo1;
+    }
+    digest->cdg_hi = hi;
+    digest->cdg_lo = lo;
+}
+
+/*! Memo of subtree digests of non-leaf nodes, open addressing on node pointer
+ *
+ * Used in xml_diff_digest so that each subtree digest is computed once
+ */
+struct digest_memo {
+    size_t          dm_size;   /* Number of slots, power of 2 */
+    size_t          dm_len;    /* Number of used slots */
+    cxobj         **dm_key;    /* Node pointers, NULL is free slot */
+    config_digest  *dm_val;    /* Digest of node at same index */
+};
+
+/*! Slot index of node in digest memo
+ */
+static size_t
+digest_memo_slot(struct digest_memo *dm,
+                 cxobj              *x)
+{
+    size_t i;
+
+    i = (size_t)(((uintptr_t)x * 0x9e3779b97f4a7c15ULL) >> 17) & (dm->dm_size - 1);
+    while (dm->dm_key[i] != NULL && dm->dm_key[i] != x)
+        i = (i + 1) & (dm->dm_size - 1);
+    return i;
+}
+
+/*! Insert digest of node in memo, grow if half full
+ *
+ * @param[in]  dm     Digest memo
+ * @param[in]  x      XML node
+ * @param[in]  digest Digest of x
+ * @retval     0      OK
+ * @retval    -1      Error
+ */
+static int
+digest_memo_add(struct digest_memo *dm,
+                cxobj              *x,
+                config_digest      *digest)
+{
+    int            retval = -1;
+    cxobj        **key0;
+    config_digest *val0;
+    size_t         size0;
+    size_t         i;
+    size_t         j;
+
+    if (2*(dm->dm_len + 1) > dm->dm_size){
+        key0 = dm->dm_key;
+        val0 = dm->dm_val;
+        size0 = dm->dm_size;
+        dm->dm_size = size0 ? 2*size0 : 256;
+        if ((dm->dm_key = calloc(dm->dm_size, sizeof(cxobj *))) == NULL){
+            clixon_err(OE_UNIX, errno, "calloc");
+            dm->dm_key = key0;
+            dm->dm_size = size0;
+            goto done;
+        }
+        if ((dm->dm_val = calloc(dm->dm_size, sizeof(config_digest))) == NULL){
+            clixon_err(OE_UNIX, errno, "calloc");
+            free(dm->dm_key);
+            dm->dm_key = key0;
+            dm->dm_val = val0;
+            dm->dm_size = size0;
+            goto done;
+        }
+        for (i=0; i<size0; i++){
+            if (key0[i] == NULL)
+                continue;
+            j = digest_memo_slot(dm, key0[i]);
+            dm->dm_key[j] = key0[i];
+            dm->dm_val[j] = val0[i];
+        }
+        if (key0)
+            free(key0);
+        if (val0)
+            free(val0);
+    }
+    i = digest_memo_slot(dm, x);
+    if (dm->dm_key[i] == NULL){
+        dm->dm_key[i] = x;
+        dm->dm_len++;
+    }
+    dm->dm_val[i] = *digest;
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Get namespace of XML node, from its yang if bound, otherwise from xmlns attributes
+ *
+ * @param[in]  x    XML node
+ * @param[out] ns   Namespace, or NULL if none
+ * @retval     0    OK
+ * @retval    -1    Error
+ */
+static int
+xml_config_digest_ns(cxobj *x,
+                     char **ns)
+{
+    yang_stmt *y;
+
+    *ns = NULL;
+    if ((y = xml_spec(x)) != NULL){
+        *ns = yang_find_mynamespace(y);
+        return 0;
+    }
+    return xml2ns(x, xml_prefix(x), ns);
+}
+
+/*! Compute content digest of XML subtree, use and update memo if given
+ *
+ * @param[in]  x       XML tree
+ * @param[in]  dm      Digest memo, or NULL
+ * @param[out] digest  128-bit content digest
+ * @retval     0       OK
+ * @retval    -1       Error
+ */
+static int
+xml_config_digest1(cxobj              *x,
+                   struct digest_memo *dm,
+                   config_digest      *digest)
+{
+    int            retval = -1;
+    cxobj         *xc;
+    char          *str;
+    config_digest  d;
+    config_digest  dc;
+    size_t         i;
+    int            children = 0;
+
+    if (dm && dm->dm_size){
+        i = digest_memo_slot(dm, x);
+        if (dm->dm_key[i] == x){
+            *digest = dm->dm_val[i];
+            goto ok;
+        }
+    }
+    config_digest_init(&d);
+    if (xml_config_digest_ns(x, &str) < 0)
+        goto done;
+    if (str != NULL)
+        config_digest_add(&d, str, strlen(str)+1);
+    str = xml_name(x);
+    config_digest_add(&d, str, strlen(str)+1);
+    if ((str = xml_body(x)) != NULL)
+        config_digest_add(&d, str, strlen(str)+1);
+    xc = NULL;
+    while ((xc = xml_child_each(x, xc, CX_ELMNT)) != NULL) {
+        if (xml_config_digest1(xc, dm, &dc) < 0)
+            goto done;
+        config_digest_add(&d, &dc, sizeof(dc));
+        children++;
+    }
+    /* Leafs are cheap to recompute, only memo inner nodes */
+    if (dm && children && digest_memo_add(dm, x, &d) < 0)
+        goto done;
+    *digest = d;
+ ok:
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Compute content digest of an XML config subtree (Merkle-style)
+ *
+ * The digest of a node covers its namespace, name, body and, in order, the digests of
+ * its element children. Attributes, such as netconf operations, are not included.
+ * Different digests means different content. It is not a cryptographic hash and device
+ * config can be made to collide, so equal digests must be confirmed with xml_tree_equal,
+ * provided both are sorted, see xml_sort_recurse.
+ * @param[in]  x       XML tree
+ * @param[out] digest  128-bit content digest
+ * @retval     0       OK
+ * @retval    -1       Error
+ * @see xml_tree_equal
+ */
+int
+xml_config_digest(cxobj         *x,
+                  config_digest *digest)
+{
+    if (x == NULL || digest == NULL){
+        clixon_err(OE_UNIX, EINVAL, "x or digest is NULL");
+        return -1;
+    }
+    return xml_config_digest1(x, NULL, digest);
+}
+
+/*! Check if children of a node need the generic xml_diff
+ *
+ * The digest diff matches children with xml_cmp in sorted order. This does not apply to
+ * nodes without yang, such as anydata, or to ordered-by user lists and leaf-lists.
+ * @param[in]  x   XML node
+ * @retval     1   Use xml_diff
+ * @retval     0   Digest diff can be used
+ */
+static int
+xml_diff_digest_generic(cxobj *x)
+{
+    cxobj     *xc;
+    yang_stmt *yc;
+
+    xc = NULL;
+    while ((xc = xml_child_each(x, xc, CX_ELMNT)) != NULL) {
+        if ((yc = xml_spec(xc)) == NULL)
+            return 1;
+        if ((yang_keyword_get(yc) == Y_LIST || yang_keyword_get(yc) == Y_LEAF_LIST) &&
+            yang_find(yc, Y_ORDERED_BY, "user") != NULL)
+            return 1;
+    }
+    return 0;
+}
+
+/*! Append a node vector to another
+ */
+static int
+xml_diff_digest_append(cxobj   **vec,
+                       size_t    len,
+                       cxobj  ***vecp,
+                       size_t   *lenp)
+{
+    size_t i;
+
+    for (i=0; i<len; i++)
+        if (cxvec_append(vec[i], vecp, lenp) < 0)
+            return -1;
+    return 0;
+}
+
+/*! Append a pair of changed nodes to the changed vectors
+ */
+static int
+xml_diff_digest_changed(cxobj   *x0,
+                        cxobj   *x1,
+                        cxobj ***changed_x0,
+                        cxobj ***changed_x1,
+                        size_t  *changedlen)
+{
+    size_t len;
+
+    len = *changedlen;
+    if (cxvec_append(x0, changed_x0, &len) < 0)
+        return -1;
+    len = *changedlen;
+    if (cxvec_append(x1, changed_x1, &len) < 0)
+        return -1;
+    *changedlen = len;
+    return 0;
+}
+
+/*! Digest diff of two matching nodes, descend only into subtrees with different digests
+ *
+ * @see xml_diff_digest
+ */
+static int
+xml_diff_digest1(struct digest_memo *dm,
+                 cxobj              *x0,
+                 cxobj              *x1,
+                 cxobj            ***first,
+                 size_t             *firstlen,
+                 cxobj            ***second,
+                 size_t             *secondlen,
+                 cxobj            ***changed_x0,
+                 cxobj            ***changed_x1,
+                 size_t             *changedlen)
+{
+    int            retval = -1;
+    cxobj         *x0c;
+    cxobj         *x1c;
+    yang_stmt     *yc0;
+    yang_stmt     *yc1;
+    cxobj        **dvec = NULL;
+    size_t         dlen = 0;
+    cxobj        **avec = NULL;
+    size_t         alen = 0;
+    cxobj        **chvec0 = NULL;
+    cxobj        **chvec1 = NULL;
+    size_t         chlen = 0;
+    config_digest  d0;
+    config_digest  d1;
+    char          *b0;
+    char          *b1;
+    int            eq;
+    size_t         i;
+
+    if (xml_config_digest1(x0, dm, &d0) < 0)
+        goto done;
+    if (xml_config_digest1(x1, dm, &d1) < 0)
+        goto done;
+    /* Equal digests are confirmed, see xml_config_digest */
+    if (CONFIG_DIGEST_EQ(d0, d1) && xml_tree_equal(x0, x1) == 0)
+        goto ok;
+    if (xml_diff_digest_generic(x0) || xml_diff_digest_generic(x1)){
+        if (xml_diff(x0, x1, &dvec, &dlen, &avec, &alen, &chvec0, &chvec1, &chlen) < 0)
+            goto done;
+        if (xml_diff_digest_append(dvec, dlen, first, firstlen) < 0)
+            goto done;
+        if (xml_diff_digest_append(avec, alen, second, secondlen) < 0)
+            goto done;
+        for (i=0; i<chlen; i++)
+            if (xml_diff_digest_changed(chvec0[i], chvec1[i], changed_x0, changed_x1, changedlen) < 0)
+                goto done;
+        goto ok;
+    }
+    x0c = xml_child_each(x0, NULL, CX_ELMNT);
+    x1c = xml_child_each(x1, NULL, CX_ELMNT);
+    while (x0c != NULL || x1c != NULL){
+        if (x0c == NULL)
+            eq = 1;
+        else if (x1c == NULL)
+            eq = -1;
+        else
+            eq = xml_cmp(x0c, x1c, 0, 0, NULL);
+        if (eq < 0){ /* Only in x0: deleted */
+            if (cxvec_append(x0c, first, firstlen) < 0)
+                goto done;
+            x0c = xml_child_each(x0, x0c, CX_ELMNT);
+            continue;
+        }
+        if (eq > 0){ /* Only in x1: added */
+            if (cxvec_append(x1c, second, secondlen) < 0)
+                goto done;
+            x1c = xml_child_each(x1, x1c, CX_ELMNT);
+            continue;
+        }
+        yc0 = xml_spec(x0c);
+        yc1 = xml_spec(x1c);
+        if (yc0 != yc1){ /* Eg choice */
+            if (cxvec_append(x0c, first, firstlen) < 0)
+                goto done;
+            if (cxvec_append(x1c, second, secondlen) < 0)
+                goto done;
+        }
+        else if (yang_keyword_get(yc0) == Y_LEAF){
+            b0 = xml_body(x0c);
+            b1 = xml_body(x1c);
+            if ((b0 == NULL) != (b1 == NULL) ||
+                (b0 != NULL && strcmp(b0, b1) != 0)){
+                if (xml_diff_digest_changed(x0c, x1c, changed_x0, changed_x1, changedlen) < 0)
+                    goto done;
+            }
+        }
+        else if (xml_diff_digest1(dm, x0c, x1c,
+                                  first, firstlen,
+                                  second, secondlen,
+                                  changed_x0, changed_x1, changedlen) < 0)
+            goto done;
+        x0c = xml_child_each(x0, x0c, CX_ELMNT);
+        x1c = xml_child_each(x1, x1c, CX_ELMNT);
+    }
+ ok:
+    retval = 0;
+ done:
+    if (dvec)
+        free(dvec);
+    if (avec)
+        free(avec);
+    if (chvec0)
+        free(chvec0);
+    if (chvec1)
+        free(chvec1);
+    return retval;
+}
+
+/*! Compute diff of two XML trees using subtree content digests
+ *
+ * Same output as xml_diff, but subtrees with equal digests are only confirmed equal with
+ * xml_tree_equal instead of diffed. Subtree digests are computed once per call.
+ * Falls back to xml_diff for children without yang or ordered-by user.
+ * @param[in]  x0         First XML tree
+ * @param[in]  x1         Second XML tree
+ * @param[out] first      Pointer to vector of nodes only in x0 (deleted)
+ * @param[out] firstlen   Length of first vector
+ * @param[out] second     Pointer to vector of nodes only in x1 (added)
+ * @param[out] secondlen  Length of second vector
+ * @param[out] changed_x0 Pointer to vector of changed leafs in x0
+ * @param[out] changed_x1 Pointer to vector of changed leafs in x1
+ * @param[out] changedlen Length of changed vectors
+ * @retval     0          OK
+ * @retval    -1          Error
+ * @see xml_diff
+ * @see xml_config_digest
+ */
+int
+xml_diff_digest(cxobj     *x0,
+                cxobj     *x1,
+                cxobj   ***first,
+                size_t    *firstlen,
+                cxobj   ***second,
+                size_t    *secondlen,
+                cxobj   ***changed_x0,
+                cxobj   ***changed_x1,
+                size_t    *changedlen)
+{
+    int                retval = -1;
+    struct digest_memo dm = {0,};
+
+    *firstlen = 0;
+    *secondlen = 0;
+    *changedlen = 0;
+    if (xml_diff_digest1(&dm, x0, x1,
+                         first, firstlen,
+                         second, secondlen,
+                         changed_x0, changed_x1, changedlen) < 0)
+        goto done;
+    retval = 0;
+ done:
+    if (dm.dm_key)
+        free(dm.dm_key);
+    if (dm.dm_val)
+        free(dm.dm_val);
+    return retval;
+}
+
+/*! Subtree of a device config and its content digest
+ *
+ * @see config_digests
+ */
+struct config_subtree {
+    char          *cs_key;     /* Parent key, "/", and namespace, name and keys of subtree */
+    size_t         cs_plen;    /* Length of parent key prefix of cs_key, 0 if depth 1 */
+    int            cs_depth;   /* 1: child of config root, 2: grandchild */
+    int            cs_atomic;  /* Children have no digests of their own */
+    config_digest  cs_digest;  /* Content digest of subtree, see xml_config_digest */
+    cxobj         *cs_x;       /* XML node, if tree kept, see config_digests_new */
+};
+
+/*! Node of flattened device config tree in preorder
+ *
+ * Strings point into the XML tree
+ */
+struct config_flat {
+    const char *cf_ns;
+    const char *cf_name;
+    const char *cf_body;
+    int         cf_depth;    /* Root is 0 */
+    int         cf_subtree;  /* Index in cd_vec, or -1 */
+};
+
+/*! Content digests of a device config root and its subtrees at depth 1 and 2
+ *
+ * Created from an XML tree by config_digests_new. The digests are computed from a
+ * flattened copy of the tree by config_digests_compute, which does not call clixon.
+ * Once computed, the digests are read-only, sorted on key and reference counted.
+ */
+struct config_digests {
+    int                    cd_refs;   /* Reference count */
+    config_digest          cd_root;   /* Digest of root, same as xml_config_digest */
+    int                    cd_atomic; /* Root children have no digests of their own */
+    size_t                 cd_len;    /* Number of subtrees */
+    size_t                 cd_size;   /* Allocated subtrees */
+    struct config_subtree *cd_vec;    /* Subtrees, sorted on key when computed */
+    size_t                 cd_flen;   /* Number of flattened nodes */
+    size_t                 cd_fsize;  /* Allocated flattened nodes */
+    int                    cd_fdepth; /* Max depth of flattened nodes */
+    struct config_flat    *cd_flat;   /* Flattened tree, freed when computed */
+};
+
+/*! Append key of an XML node: namespace, name, and list keys or leaf-list value
+ *
+ * @param[in]  x    XML node
+ * @param[in]  cb   Key buffer
+ * @retval     0    OK
+ * @retval    -1    Error
+ */
+static int
+config_subtree_key(cxobj *x,
+                   cbuf  *cb)
+{
+    yang_stmt *y;
+    cvec      *cvk;
+    cg_var    *cvi;
+    char      *ns;
+    char      *str;
+
+    if (xml_config_digest_ns(x, &ns) < 0)
+        return -1;
+    cprintf(cb, "%s:%s", ns ? ns : "", xml_name(x));
+    if ((y = xml_spec(x)) == NULL)
+        return 0;
+    switch (yang_keyword_get(y)){
+    case Y_LIST:
+        cvk = yang_cvec_get(y);
+        cvi = NULL;
+        while ((cvi = cvec_each(cvk, cvi)) != NULL){
+            str = xml_find_body(x, cv_string_get(cvi));
+            cprintf(cb, "[%s=%s]", cv_string_get(cvi), str ? str : "");
+        }
+        break;
+    case Y_LEAF_LIST:
+        str = xml_body(x);
+        cprintf(cb, "[.=%s]", str ? str : "");
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+/*! Append node to flattened tree
+ */
+static int
+config_digests_flat_add(config_digests *cd,
+                        cxobj          *x,
+                        int             depth,
+                        int             subtree)
+{
+    struct config_flat *cf;
+    char               *ns;
+
+    if (cd->cd_flen == cd->cd_fsize){
+        cd->cd_fsize = cd->cd_fsize ? 2*cd->cd_fsize : 256;
+        if ((cf = realloc(cd->cd_flat, cd->cd_fsize*sizeof(*cf))) == NULL){
+            clixon_err(OE_UNIX, errno, "realloc");
+            return -1;
+        }
+        cd->cd_flat = cf;
+    }
+    if (xml_config_digest_ns(x, &ns) < 0)
+        return -1;
+    cf = &cd->cd_flat[cd->cd_flen++];
+    cf->cf_ns = ns;
+    cf->cf_name = xml_name(x);
+    cf->cf_body = xml_body(x);
+    cf->cf_depth = depth;
+    cf->cf_subtree = subtree;
+    if (depth > cd->cd_fdepth)
+        cd->cd_fdepth = depth;
+    return 0;
+}
+
+/*! Append subtree entry
+ *
+ * @retval     i    Index of entry
+ * @retval    -1    Error
+ */
+static int
+config_digests_subtree_add(config_digests *cd,
+                           cxobj          *x,
+                           const char     *key,
+                           size_t          plen,
+                           int             depth,
+                           int             atomic)
+{
+    struct config_subtree *cs;
+
+    if (cd->cd_len == cd->cd_size){
+        cd->cd_size = cd->cd_size ? 2*cd->cd_size : 64;
+        if ((cs = realloc(cd->cd_vec, cd->cd_size*sizeof(*cs))) == NULL){
+            clixon_err(OE_UNIX, errno, "realloc");
+            return -1;
+        }
+        cd->cd_vec = cs;
+    }
+    cs = &cd->cd_vec[cd->cd_len];
+    memset(cs, 0, sizeof(*cs));
+    if ((cs->cs_key = strdup(key)) == NULL){
+        clixon_err(OE_UNIX, errno, "strdup");
+        return -1;
+    }
+    cs->cs_plen = plen;
+    cs->cs_depth = depth;
+    cs->cs_atomic = atomic;
+    cs->cs_x = x;
+    return cd->cd_len++;
+}
+
+/*! Flatten children of XML node in preorder, and add subtree entries at depth 1 and 2
+ *
+ * @param[in]  cd       Config digests
+ * @param[in]  x        XML node
+ * @param[in]  depth    Depth of x
+ * @param[in]  cb       Key of x, children keys are appended and removed
+ * @param[in]  subtrees If set, children of x are subtrees
+ * @retval     0        OK
+ * @retval    -1        Error
+ */
+static int
+config_digests_walk(config_digests *cd,
+                    cxobj          *x,
+                    int             depth,
+                    cbuf           *cb,
+                    int             subtrees)
+{
+    cxobj  *xc;
+    size_t  plen;
+    int     atomic = 1;
+    int     i = -1;
+
+    xc = NULL;
+    while ((xc = xml_child_each(x, xc, CX_ELMNT)) != NULL) {
+        plen = cbuf_len(cb);
+        if (subtrees){
+            if (depth > 0)
+                cprintf(cb, "/");
+            if (config_subtree_key(xc, cb) < 0)
+                return -1;
+            atomic = depth + 1 >= 2 || xml_diff_digest_generic(xc);
+            if ((i = config_digests_subtree_add(cd, xc, cbuf_get(cb), plen, depth + 1, atomic)) < 0)
+                return -1;
+        }
+        if (config_digests_flat_add(cd, xc, depth + 1, subtrees ? i : -1) < 0)
+            return -1;
+        if (config_digests_walk(cd, xc, depth + 1, cb, subtrees && !atomic) < 0)
+            return -1;
+        if (subtrees)
+            cbuf_trunc(cb, plen);
+    }
+    return 0;
+}
+
+/*! Create config digests of XML tree, flatten tree and find subtrees at depth 1 and 2
+ *
+ * Subtrees are not found below nodes whose children need the generic xml_diff, such as
+ * ordered-by user lists.
+ * Digests are computed by config_digests_compute, until then the tree must not be changed.
+ * @param[in]  x     XML tree, typically device config mount-point
+ * @param[in]  keep  Keep pointers to subtree nodes in x, see config_digests_extract
+ * @param[out] cdp   Config digests, free with config_digests_free
+ * @retval     0     OK
+ * @retval    -1     Error
+ */
+int
+config_digests_new(cxobj           *x,
+                   int              keep,
+                   config_digests **cdp)
+{
+    int             retval = -1;
+    config_digests *cd = NULL;
+    cbuf           *cb = NULL;
+    size_t          i;
+
+    if ((cd = calloc(1, sizeof(*cd))) == NULL){
+        clixon_err(OE_UNIX, errno, "calloc");
+        goto done;
+    }
+    cd->cd_refs = 1;
+    if ((cb = cbuf_new()) == NULL){
+        clixon_err(OE_UNIX, errno, "cbuf_new");
+        goto done;
+    }
+    if (config_digests_flat_add(cd, x, 0, -1) < 0)
+        goto done;
+    cd->cd_atomic = xml_diff_digest_generic(x);
+    if (config_digests_walk(cd, x, 0, cb, !cd->cd_atomic) < 0)
+        goto done;
+    if (!keep)
+        for (i=0; i<cd->cd_len; i++)
+            cd->cd_vec[i].cs_x = NULL;
+    *cdp = cd;
+    cd = NULL;
+    retval = 0;
+ done:
+    if (cb)
+        cbuf_free(cb);
+    if (cd)
+        config_digests_free(cd);
+    return retval;
+}
+
+/*! Compare subtrees on key
+ */
+static int
+config_subtree_cmp(const void *a,
+                   const void *b)
+{
+    return strcmp(((const struct config_subtree *)a)->cs_key,
+                  ((const struct config_subtree *)b)->cs_key);
+}
+
+/*! Compute digests of root and subtrees from flattened tree, and sort subtrees on key
+ *
+ * Does not call clixon and only reads the strings of the tree, may be called by a worker
+ * thread while no other thread changes the tree.
+ * The flattened tree is freed, the tree may be changed or freed after this call.
+ * @param[in]  cd    Config digests
+ * @retval     0     OK
+ * @retval    -1     Error, errno set
+ */
+int
+config_digests_compute(config_digests *cd)
+{
+    int                 retval = -1;
+    struct config_flat *cf;
+    config_digest      *dstack = NULL;
+    int                *sstack = NULL;
+    config_digest       dc;
+    size_t              i;
+    int                 top = -1;
+
+    if (cd->cd_flat == NULL){
+        errno = EINVAL;
+        goto done;
+    }
+    if ((dstack = calloc(cd->cd_fdepth + 1, sizeof(*dstack))) == NULL)
+        goto done;
+    if ((sstack = calloc(cd->cd_fdepth + 1, sizeof(*sstack))) == NULL)
+        goto done;
+    /* Same digest as xml_config_digest1, a node is closed when next node is not below it */
+    for (i=0; i<=cd->cd_flen; i++){
+        cf = i < cd->cd_flen ? &cd->cd_flat[i] : NULL;
+        while (top >= 0 && (cf == NULL || top >= cf->cf_depth)){
+            dc = dstack[top];
+            if (sstack[top] >= 0)
+                cd->cd_vec[sstack[top]].cs_digest = dc;
+            if (top == 0)
+                cd->cd_root = dc;
+            else
+                config_digest_add(&dstack[top-1], &dc, sizeof(dc));
+            top--;
+        }
+        if (cf == NULL)
+            break;
+        top = cf->cf_depth;
+        config_digest_init(&dstack[top]);
+        if (cf->cf_ns)
+            config_digest_add(&dstack[top], cf->cf_ns, strlen(cf->cf_ns)+1);
+        config_digest_add(&dstack[top], cf->cf_name, strlen(cf->cf_name)+1);
+        if (cf->cf_body)
+            config_digest_add(&dstack[top], cf->cf_body, strlen(cf->cf_body)+1);
+        sstack[top] = cf->cf_subtree;
+    }
+    if (cd->cd_len)
+        qsort(cd->cd_vec, cd->cd_len, sizeof(*cd->cd_vec), config_subtree_cmp);
+    free(cd->cd_flat);
+    cd->cd_flat = NULL;
+    cd->cd_flen = cd->cd_fsize = 0;
+    retval = 0;
+ done:
+    if (dstack)
+        free(dstack);
+    if (sstack)
+        free(sstack);
+    return retval;
+}
+
+/*! Get digest of root, same as xml_config_digest, after config_digests_compute
+ */
+config_digest
+config_digests_root(config_digests *cd)
+{
+    return cd->cd_root;
+}
+
+/*! Take a reference to config digests
+ *
+ * @param[in]  cd    Config digests
+ * @retval     cd    Same config digests
+ */
+config_digests *
+config_digests_ref(config_digests *cd)
+{
+    cd->cd_refs++;
+    return cd;
+}
+
+/*! Release reference to config digests, free when last reference is released
+ *
+ * @param[in]  cd    Config digests
+ * @retval     0     OK
+ */
+int
+config_digests_free(config_digests *cd)
+{
+    size_t i;
+
+    if (--cd->cd_refs > 0)
+        return 0;
+    for (i=0; i<cd->cd_len; i++)
+        if (cd->cd_vec[i].cs_key)
+            free(cd->cd_vec[i].cs_key);
+    if (cd->cd_vec)
+        free(cd->cd_vec);
+    if (cd->cd_flat)
+        free(cd->cd_flat);
+    free(cd);
+    return 0;
+}
+
+/*! Find subtree with key of given length in sorted subtrees
+ *
+ * @retval     i    Index of subtree
+ * @retval    -1    Not found
+ */
+static int
+config_digests_find(config_digests *cd,
+                    const char     *key,
+                    size_t          len)
+{
+    size_t lo = 0;
+    size_t hi = cd->cd_len;
+    size_t m;
+    int    cmp;
+
+    while (lo < hi){
+        m = lo + (hi - lo)/2;
+        cmp = strncmp(cd->cd_vec[m].cs_key, key, len);
+        if (cmp == 0 && cd->cd_vec[m].cs_key[len] != '\0')
+            cmp = 1;
+        if (cmp == 0)
+            return m;
+        if (cmp < 0)
+            lo = m + 1;
+        else
+            hi = m;
+    }
+    return -1;
+}
+
+/*! Compare subtree digests of two computed config digests
+ *
+ * Each subtree gets a state in flags0 and flags1:
+ * CONFIG_SUBTREE_EQUAL:   Same digest in both, confirmed by config_digests_extract
+ * CONFIG_SUBTREE_CHANGED: Added, removed or changed, the whole subtree is diffed
+ * CONFIG_SUBTREE_DESCEND: Changed, its depth 2 subtrees are compared instead
+ * 0:                      Below an equal or changed subtree
+ * Does not call clixon, may be called by a worker thread.
+ * @param[in]  cd0     Config digests of first tree, eg synced
+ * @param[in]  cd1     Config digests of second tree, eg current
+ * @param[out] flags0p Subtree states of cd0, free with free()
+ * @param[out] flags1p Subtree states of cd1, free with free()
+ * @retval     1       OK
+ * @retval     0       Subtrees not comparable, root children need the generic xml_diff
+ * @retval    -1       Error, errno set
+ */
+int
+config_digests_diff(config_digests *cd0,
+                    config_digests *cd1,
+                    uint8_t       **flags0p,
+                    uint8_t       **flags1p)
+{
+    int                    retval = -1;
+    uint8_t               *flags0 = NULL;
+    uint8_t               *flags1 = NULL;
+    struct config_subtree *cs;
+    size_t                 j;
+    int                    i;
+    int                    p;
+
+    if (cd0->cd_atomic || cd1->cd_atomic){
+        retval = 0;
+        goto done;
+    }
+    if ((flags0 = calloc(cd0->cd_len + 1, 1)) == NULL)
+        goto done;
+    if ((flags1 = calloc(cd1->cd_len + 1, 1)) == NULL)
+        goto done;
+    for (j=0; j<cd1->cd_len; j++){
+        cs = &cd1->cd_vec[j];
+        if (cs->cs_depth != 1)
+            continue;
+        if ((i = config_digests_find(cd0, cs->cs_key, strlen(cs->cs_key))) < 0)
+            flags1[j] = CONFIG_SUBTREE_CHANGED;
+        else if (CONFIG_DIGEST_EQ(cd0->cd_vec[i].cs_digest, cs->cs_digest))
+            flags0[i] = flags1[j] = CONFIG_SUBTREE_EQUAL;
+        else if (cd0->cd_vec[i].cs_atomic || cs->cs_atomic)
+            flags0[i] = flags1[j] = CONFIG_SUBTREE_CHANGED;
+        else
+            flags0[i] = flags1[j] = CONFIG_SUBTREE_DESCEND;
+    }
+    for (j=0; j<cd1->cd_len; j++){
+        cs = &cd1->cd_vec[j];
+        if (cs->cs_depth != 2)
+            continue;
+        if ((p = config_digests_find(cd1, cs->cs_key, cs->cs_plen)) < 0 ||
+            flags1[p] != CONFIG_SUBTREE_DESCEND)
+            continue;
+        if ((i = config_digests_find(cd0, cs->cs_key, strlen(cs->cs_key))) < 0)
+            flags1[j] = CONFIG_SUBTREE_CHANGED;
+        else if (CONFIG_DIGEST_EQ(cd0->cd_vec[i].cs_digest, cs->cs_digest))
+            flags0[i] = flags1[j] = CONFIG_SUBTREE_EQUAL;
+        else
+            flags0[i] = flags1[j] = CONFIG_SUBTREE_CHANGED;
+    }
+    /* Removed: not in cd1, at depth 1 or below a changed depth 1 subtree */
+    for (j=0; j<cd0->cd_len; j++){
+        cs = &cd0->cd_vec[j];
+        if (flags0[j] != 0)
+            continue;
+        if (cs->cs_depth == 1)
+            flags0[j] = CONFIG_SUBTREE_CHANGED;
+        else if ((p = config_digests_find(cd0, cs->cs_key, cs->cs_plen)) >= 0 &&
+                 flags0[p] == CONFIG_SUBTREE_DESCEND)
+            flags0[j] = CONFIG_SUBTREE_CHANGED;
+    }
+    *flags0p = flags0;
+    flags0 = NULL;
+    *flags1p = flags1;
+    flags1 = NULL;
+    retval = 1;
+ done:
+    if (flags0)
+        free(flags0);
+    if (flags1)
+        free(flags1);
+    return retval;
+}
+
+/*! Copy XML node with its attributes and list keys, but no other children
+ *
+ * @param[in]  x     XML node
+ * @param[in]  xp    Parent of copy, or NULL
+ * @param[out] xcp   Copy
+ * @retval     0     OK
+ * @retval    -1     Error
+ */
+static int
+config_subtree_skeleton(cxobj  *x,
+                        cxobj  *xp,
+                        cxobj **xcp)
+{
+    cxobj     *xn;
+    cxobj     *xc;
+    cxobj     *xa;
+    yang_stmt *y;
+    cg_var    *cvi;
+
+    if ((xn = xml_new(xml_name(x), xp, CX_ELMNT)) == NULL)
+        return -1;
+    if (xml_prefix(x) && xml_prefix_set(xn, xml_prefix(x)) < 0)
+        return -1;
+    y = xml_spec(x);
+    xml_spec_set(xn, y);
+    xa = NULL;
+    while ((xa = xml_child_each(x, xa, CX_ATTR)) != NULL) {
+        if ((xc = xml_dup(xa)) == NULL || xml_addsub(xn, xc) < 0)
+            return -1;
+    }
+    if (y != NULL && yang_keyword_get(y) == Y_LIST){
+        cvi = NULL;
+        while ((cvi = cvec_each(yang_cvec_get(y), cvi)) != NULL){
+            if ((xc = xml_find_type(x, NULL, cv_string_get(cvi), CX_ELMNT)) == NULL)
+                continue;
+            if ((xc = xml_dup(xc)) == NULL || xml_addsub(xn, xc) < 0)
+                return -1;
+        }
+    }
+    *xcp = xn;
+    return 0;
+}
+
+/*! Confirm that a subtree with equal digests has equal content, otherwise mark it changed
+ *
+ * @param[in]  flags0  Subtree states of x0
+ * @param[in]  i       Index of subtree in flags0
+ * @param[in]  xs      Subtree of x0
+ * @param[in]  cd1     Config digests of x1, created with keep
+ * @param[in]  flags1  Subtree states of cd1
+ * @param[in]  key     Key of subtree
+ * @param[in]  len     Length of key
+ * @see xml_config_digest
+ */
+static void
+config_subtree_confirm(uint8_t        *flags0,
+                       int             i,
+                       cxobj          *xs,
+                       config_digests *cd1,
+                       uint8_t        *flags1,
+                       const char     *key,
+                       size_t          len)
+{
+    int j;
+
+    if ((j = config_digests_find(cd1, key, len)) < 0 ||
+        cd1->cd_vec[j].cs_x == NULL ||
+        xml_tree_equal(xs, cd1->cd_vec[j].cs_x) != 0){
+        flags0[i] = CONFIG_SUBTREE_CHANGED;
+        if (j >= 0)
+            flags1[j] = CONFIG_SUBTREE_CHANGED;
+    }
+}
+
+/*! Extract changed subtrees for a diff, using compared config digests
+ *
+ * Copy the changed and removed subtrees of x0 to a new tree, and remove the unchanged
+ * subtrees of x1 in place, keeping list keys. A diff of the two results is the diff of x0 and x1.
+ * Subtrees with equal digests are confirmed equal with xml_tree_equal, or taken as changed.
+ * @param[in]  cd0     Config digests of x0, computed
+ * @param[in]  flags0  Subtree states of cd0, see config_digests_diff
+ * @param[in]  x0      First tree, eg synced, not changed
+ * @param[in]  cd1     Config digests of x1, computed and created with keep
+ * @param[in]  flags1  Subtree states of cd1, see config_digests_diff
+ * @param[out] x0p     Changed subtrees of x0, free with xml_free
+ * @retval     1       OK
+ * @retval     0       x0 does not match cd0
+ * @retval    -1       Error
+ */
+int
+config_digests_extract(config_digests *cd0,
+                       uint8_t        *flags0,
+                       cxobj          *x0,
+                       config_digests *cd1,
+                       uint8_t        *flags1,
+                       cxobj         **x0p)
+{
+    int                    retval = -1;
+    cxobj                 *xc0 = NULL;
+    cxobj                 *xs;
+    cxobj                 *xs1;
+    cxobj                 *xs2;
+    cxobj                 *xn;
+    cbuf                  *cb = NULL;
+    struct config_subtree *cs;
+    yang_stmt             *y;
+    size_t                 plen;
+    size_t                 j;
+    int                    i;
+    int                    p;
+
+    if ((cb = cbuf_new()) == NULL){
+        clixon_err(OE_UNIX, errno, "cbuf_new");
+        goto done;
+    }
+    if (config_subtree_skeleton(x0, NULL, &xc0) < 0)
+        goto done;
+    xs1 = NULL;
+    while ((xs1 = xml_child_each(x0, xs1, CX_ELMNT)) != NULL) {
+        cbuf_reset(cb);
+        if (config_subtree_key(xs1, cb) < 0)
+            goto done;
+        if ((i = config_digests_find(cd0, cbuf_get(cb), cbuf_len(cb))) < 0)
+            goto mismatch;
+        if (flags0[i] == CONFIG_SUBTREE_EQUAL)
+            config_subtree_confirm(flags0, i, xs1, cd1, flags1, cbuf_get(cb), cbuf_len(cb));
+        switch (flags0[i]){
+        case CONFIG_SUBTREE_CHANGED:
+            if ((xn = xml_dup(xs1)) == NULL || xml_addsub(xc0, xn) < 0)
+                goto done;
+            break;
+        case CONFIG_SUBTREE_DESCEND:
+            if (config_subtree_skeleton(xs1, xc0, &xs) < 0)
+                goto done;
+            plen = cbuf_len(cb);
+            xs2 = NULL;
+            while ((xs2 = xml_child_each(xs1, xs2, CX_ELMNT)) != NULL) {
+                cbuf_trunc(cb, plen);
+                cprintf(cb, "/");
+                if (config_subtree_key(xs2, cb) < 0)
+                    goto done;
+                if ((i = config_digests_find(cd0, cbuf_get(cb), cbuf_len(cb))) < 0)
+                    goto mismatch;
+                if (flags0[i] == CONFIG_SUBTREE_EQUAL)
+                    config_subtree_confirm(flags0, i, xs2, cd1, flags1, cbuf_get(cb), cbuf_len(cb));
+                if (flags0[i] != CONFIG_SUBTREE_CHANGED)
+                    continue;
+                if ((xn = xml_dup(xs2)) == NULL || xml_addsub(xs, xn) < 0)
+                    goto done;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    /* Remove unchanged subtrees of x1, depth 2 only below changed depth 1 subtrees */
+    for (j=0; j<cd1->cd_len; j++){
+        cs = &cd1->cd_vec[j];
+        if (cs->cs_x == NULL || flags1[j] != CONFIG_SUBTREE_EQUAL)
+            continue;
+        if (cs->cs_depth == 2){
+            if ((p = config_digests_find(cd1, cs->cs_key, cs->cs_plen)) < 0 ||
+                flags1[p] != CONFIG_SUBTREE_DESCEND)
+                continue;
+            if ((y = xml_spec(cd1->cd_vec[p].cs_x)) != NULL &&
+                yang_key_match(y, xml_name(cs->cs_x), NULL) == 1)
+                continue;
+        }
+        if (xml_purge(cs->cs_x) < 0)
+            goto done;
+        cs->cs_x = NULL;
+    }
+    *x0p = xc0;
+    xc0 = NULL;
+    retval = 1;
+ done:
+    if (cb)
+        cbuf_free(cb);
+    if (xc0)
+        xml_free(xc0);
+    return retval;
+ mismatch:
+    retval = 0;
+    goto done;
+}
+
 /*! Callback for printing version output and exit
  *
  * A plugin can customize a version (or banner) output on stdout.
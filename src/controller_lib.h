@@ -86,6 +86,7 @@ enum push_type_t{
     PT_NONE = 0,     /* Do not push to devices */
     PT_VALIDATE,     /* Push to devices, validate and then discard on devices */
     PT_COMMIT,       /* Push to devices, and commit on devices. */
+    PT_COMMIT_NONATOMIC, /* Push to devices, commit each device when it has validated */
 };
 typedef enum push_type_t push_type;
 
@@ -102,6 +103,38 @@ enum actions_type_t{
 };
 typedef enum actions_type_t actions_type;
 
+/*! How pulled device configs are committed to running
+ *
+ * @see clixon-controller@2026-06-01.yang pull-commit
+ * @see pcmap translation table
+ */
+enum pull_commit_type_t{
+    PC_TRANSACTION = 0, /* Commit all devices in one commit when the last device is pulled */
+    PC_DEVICE,          /* Commit each device config subtree to running as it is pulled */
+};
+typedef enum pull_commit_type_t pull_commit_type;
+
+/*! States of subtrees compared by config_digests_diff
+ */
+#define CONFIG_SUBTREE_EQUAL   1 /* Same content */
+#define CONFIG_SUBTREE_CHANGED 2 /* Added, removed or changed */
+#define CONFIG_SUBTREE_DESCEND 3 /* Changed, compare its subtrees */
+
+/*! 128-bit content digest of a config subtree, see xml_config_digest
+ */
+struct config_digest {
+    uint64_t cdg_hi;
+    uint64_t cdg_lo;
+};
+typedef struct config_digest config_digest;
+
+/*! Equal content digests, taken as equal content */
+#define CONFIG_DIGEST_EQ(d0, d1) ((d0).cdg_hi == (d1).cdg_hi && (d0).cdg_lo == (d1).cdg_lo)
+
+/*! Content digests of a device config and its subtrees, see controller_lib.c
+ */
+typedef struct config_digests config_digests;
+
 /*! Netconf recv/send type
  */
 enum netconf_xmit_type_t{
@@ -126,13 +159,27 @@ char *push_type_int2str(push_type t);
 push_type push_type_str2int(char *str);
 char *actions_type_int2str(actions_type t);
 actions_type actions_type_str2int(char *str);
+char *pull_commit_type_int2str(pull_commit_type t);
+pull_commit_type pull_commit_type_str2int(char *str);
 int controller_yang_library_bind(clixon_handle h, cxobj *yanglib);
 int schema_list2yang_library(clixon_handle h, cxobj *xschemas, char *domain, cxobj **xyanglib);
 int xdev2yang_library(cxobj *xdev, char *domain, cxobj **xyanglib);
 int controller_mount_xpath_get(char *devname, cbuf **cbxpath);
 int controller_mount_yspec_get(clixon_handle h, char *devname, yang_stmt **yspec1);
 int controller_mount_yspec_set(clixon_handle h, char *devname, yang_stmt *yspec1);
+int controller_mount_yspec_rm(clixon_handle h, char *devname);
 int yang_mount_cleanup(clixon_handle h);
+int xml_config_digest(cxobj *x, config_digest *digest);
+int xml_diff_digest(cxobj *x0, cxobj *x1, cxobj ***first, size_t *firstlen, cxobj ***second, size_t *secondlen,
+                    cxobj ***changed_x0, cxobj ***changed_x1, size_t *changedlen);
+int config_digests_new(cxobj *x, int keep, config_digests **cdp);
+int config_digests_compute(config_digests *cd);
+config_digest config_digests_root(config_digests *cd);
+config_digests *config_digests_ref(config_digests *cd);
+int config_digests_free(config_digests *cd);
+int config_digests_diff(config_digests *cd0, config_digests *cd1, uint8_t **flags0p, uint8_t **flags1p);
+int config_digests_extract(config_digests *cd0, uint8_t *flags0, cxobj *x0,
+                           config_digests *cd1, uint8_t *flags1, cxobj **x0p);
 int controller_version(clixon_handle h, FILE *f);
 
 #ifdef __cplusplus
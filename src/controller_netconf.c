@@ -34,6 +34,8 @@
 #include <fcntl.h>
 #include <fnmatch.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/time.h>
 
 /* clicon */
@@ -113,15 +115,64 @@ clixon_client_connect_netconf(clixon_handle  h,
     return retval;
 }
 
+/*! Get path of ssh control socket shared by sessions to same destination
+ *
+ * Placed in the directory of the backend socket CLICON_SOCK. Destination and port are
+ * hashed (FNV-1a) into a fixed-length name, as ssh %C, so that long host names do not
+ * exceed the size of a unix socket path.
+ * @param[in]  h     Clixon  handle
+ * @param[in]  dest  SSH destination
+ * @param[in]  port  SSH port
+ * @param[out] cb    Control path
+ * @retval     1     OK
+ * @retval     0     Directory too long for a unix socket path, do not multiplex
+ * @retval    -1     Error
+ */
+static int
+ssh_control_path(clixon_handle h,
+                 const char   *dest,
+                 const char   *port,
+                 cbuf         *cb)
+{
+    char       *sock;
+    char       *p;
+    const char *s;
+    uint64_t    hash = 0xcbf29ce484222325ULL;
+    int         len;
+
+    if ((sock = clicon_option_str(h, "CLICON_SOCK")) == NULL ||
+        (p = strrchr(sock, '/')) == NULL){
+        clixon_err(OE_CFG, 0, "CLICON_SOCK not set or not absolute path");
+        return -1;
+    }
+    for (s = dest; *s; s++)
+        hash = (hash ^ (uint8_t)*s) * 0x00000100000001b3ULL;
+    hash = (hash ^ ':') * 0x00000100000001b3ULL;
+    for (s = port; *s; s++)
+        hash = (hash ^ (uint8_t)*s) * 0x00000100000001b3ULL;
+    /* "/ssh-" + 16 hex digits, and ssh appends a temporary suffix of up to 17 bytes */
+    len = (int)(p - sock) + 5 + 16 + 17;
+    if (len >= (int)sizeof(((struct sockaddr_un *)NULL)->sun_path))
+        return 0;
+    cprintf(cb, "%.*s/ssh-%016" PRIx64, (int)(p - sock), sock, hash);
+    return 1;
+}
+
 /*! Connect using NETCONF over SSH
  *
+ * If persist is set, sessions to the same destination are multiplexed over one ssh master
+ * connection (ssh ControlMaster), which is kept open persist seconds after the last session
+ * closes. A reconnect within that time does not need a new TCP connection, key exchange and
+ * authentication.
  * @param[in]  h             Clixon  handle
  * @param[in]  dest          SSH destination
  * @param[in]  port          SSH port
  * @param[in]  stricthostkey If set ensure strict hostkey checking. Only for ssh connections
+ * @param[in]  persist       Keep master connection open this many seconds, 0 disables multiplexing
  * @param[out] pid           Sub-process-id
  * @param[out] sock          Stdin/stdout socket
  * @param[out] sockerr       Stderr socket
+ * @param[out] reused        Set to 1 if an existing master connection is used, else 0
  * @retval     0             OK
  * @retval    -1             Error
  */
@@ -130,9 +181,11 @@ clixon_client_connect_ssh(clixon_handle h,
                           const char   *dest,
                           const char   *port,
                           int           stricthostkey,
+                          int           persist,
                           pid_t        *pid,
                           int          *sock,
-                          int          *sockerr)
+                          int          *sockerr,
+                          int          *reused)
 {
     int         retval = -1;
     int         nr;
@@ -141,11 +194,36 @@ clixon_client_connect_ssh(clixon_handle h,
     char       *ssh_bin = SSH_BIN;
     struct stat st = {0,};
     char       *idfile = NULL;
+    cbuf       *cbpath = NULL;
+    cbuf       *cbpersist = NULL;
+    int         ret;
 
     clixon_debug(CLIXON_DBG_MSG | CLIXON_DBG_DETAIL, "%s", dest);
+    *reused = 0;
     nr = 16;  /* NOTE this is hardcoded */
     if ((idfile = clicon_option_str(h, "CONTROLLER_SSH_IDENTITYFILE")) != NULL)
         nr += 2;
+    if (persist > 0){
+        if ((cbpath = cbuf_new()) == NULL ||
+            (cbpersist = cbuf_new()) == NULL){
+            clixon_err(OE_UNIX, errno, "cbuf_new");
+            goto done;
+        }
+        cprintf(cbpath, "ControlPath=");
+        if ((ret = ssh_control_path(h, dest, port, cbpath)) < 0)
+            goto done;
+        if (ret == 0){
+            clixon_debug(CLIXON_DBG_MSG, "%s: control path too long, not multiplexed", dest);
+            persist = 0;
+        }
+    }
+    if (persist > 0){
+        nr += 6;
+        cprintf(cbpersist, "ControlPersist=%d", persist);
+        /* A live master has its control socket in place */
+        if (stat(cbuf_get(cbpath) + strlen("ControlPath="), &st) == 0 && S_ISSOCK(st.st_mode))
+            *reused = 1;
+    }
     if ((argv = calloc(nr, sizeof(char *))) == NULL){
         clixon_err(OE_UNIX, errno, "calloc");
         goto done;
@@ -175,6 +253,14 @@ clixon_client_connect_ssh(clixon_handle h,
     argv[i++] = "PasswordAuthentication=no"; // dont query
     argv[i++] = "-o";
     argv[i++] = "BatchMode=yes"; // user interaction disabled
+    if (persist > 0){
+        argv[i++] = "-o";
+        argv[i++] = "ControlMaster=auto";
+        argv[i++] = "-o";
+        argv[i++] = cbuf_get(cbpath);
+        argv[i++] = "-o";
+        argv[i++] = cbuf_get(cbpersist);
+    }
     argv[i++] = "-s";
     argv[i++] = "netconf";
     argv[i++] = NULL;
@@ -191,5 +277,294 @@ clixon_client_connect_ssh(clixon_handle h,
  done:
     if (argv)
         free(argv);
+    if (cbpath)
+        cbuf_free(cbpath);
+    if (cbpersist)
+        cbuf_free(cbpersist);
     return retval;
 }
+
+/*! End-of-message marker of NETCONF base 1.0 framing, RFC 6242 Sec 4.3 */
+#define NETCONF_EOM "]]>]]>"
+#define NETCONF_EOM_LEN 6
+
+/*! Append data to message, skip NULL chars (eg from terminals)
+ *
+ * @param[in]  cbmsg  Message buffer
+ * @param[in]  p      Data
+ * @param[in]  len    Length of data
+ * @retval     0      OK
+ * @retval    -1      Error, errno set
+ */
+static int
+netconf_input_append(cbuf          *cbmsg,
+                     unsigned char *p,
+                     size_t         len)
+{
+    unsigned char *z;
+    size_t         n;
+
+    while (len > 0){
+        if ((z = memchr(p, 0, len)) == NULL)
+            n = len;
+        else
+            n = z - p;
+        if (n > 0 && cbuf_append_buf(cbmsg, p, n) < 0)
+            return -1;
+        if (z == NULL)
+            break;
+        p += n + 1;
+        len -= n + 1;
+    }
+    return 0;
+}
+
+/*! Length of longest suffix of data that is a proper prefix of end-of-message marker
+ */
+static int
+netconf_eom_suffix(unsigned char *p,
+                   size_t         len)
+{
+    int k;
+
+    for (k = NETCONF_EOM_LEN-1; k > 0; k--)
+        if (len >= (size_t)k && memcmp(p + len - k, NETCONF_EOM, k) == 0)
+            return k;
+    return 0;
+}
+
+/*! Base 1.0 framing: scan for end-of-message marker
+ *
+ * frame_state is the number of marker chars matched at the end of previous data
+ */
+static int
+netconf_input_eom(unsigned char **bufp,
+                  size_t         *lenp,
+                  cbuf           *cbmsg,
+                  int            *frame_state,
+                  int            *eom)
+{
+    /* Prefix function of marker, for matching across data boundaries */
+    static const int pi[NETCONF_EOM_LEN] = {0, 1, 0, 1, 2, 3};
+    unsigned char   *p = *bufp;
+    size_t           len = *lenp;
+    unsigned char   *q;
+    size_t           i = 0;
+    int              k;
+    size_t           n;
+
+    /* Marker started in previous data: match byte by byte until resolved */
+    k = *frame_state;
+    while (k > 0 && i < len){
+        if (p[i] == 0){
+            i++;
+            continue;
+        }
+        while (k > 0 && p[i] != NETCONF_EOM[k])
+            k = pi[k-1];
+        if (p[i] == NETCONF_EOM[k])
+            k++;
+        i++;
+        if (k == NETCONF_EOM_LEN){
+            if (netconf_input_append(cbmsg, p, i) < 0)
+                return -1;
+            cbuf_trunc(cbmsg, cbuf_len(cbmsg) - NETCONF_EOM_LEN);
+            *frame_state = 0;
+            *eom = 1;
+            goto found;
+        }
+    }
+    /* Scan rest of data for marker start */
+    n = i;
+    while (k == 0 && n < len){
+        if ((q = memchr(p + n, NETCONF_EOM[0], len - n)) == NULL)
+            break;
+        if (q + NETCONF_EOM_LEN <= p + len){
+            if (memcmp(q, NETCONF_EOM, NETCONF_EOM_LEN) == 0){
+                if (netconf_input_append(cbmsg, p, q - p) < 0)
+                    return -1;
+                i = q + NETCONF_EOM_LEN - p;
+                *frame_state = 0;
+                *eom = 1;
+                goto found;
+            }
+            n = q - p + 1;
+        }
+        else { /* Possible marker at end of data */
+            k = netconf_eom_suffix(q, p + len - q);
+            break;
+        }
+    }
+    if (netconf_input_append(cbmsg, p, len) < 0)
+        return -1;
+    i = len;
+    *frame_state = k;
+    *eom = 0;
+ found:
+    *bufp += i;
+    *lenp -= i;
+    return 0;
+}
+
+/*! Base 1.1 framing: scan chunk headers and copy chunk data in bulk
+ *
+ * frame_state: 0: expect LF, 1: expect '#', 2: expect chunk-size or '#',
+ *              3: chunk-size, 4: chunk-data, 5: expect LF of end-of-chunks
+ * frame_size:  chunk-size, or remaining chunk-data
+ */
+static int
+netconf_input_chunked(unsigned char **bufp,
+                      size_t         *lenp,
+                      cbuf           *cbmsg,
+                      int            *frame_state,
+                      size_t         *frame_size,
+                      int            *eom,
+                      char           *reason,
+                      size_t          rlen)
+{
+    unsigned char *p = *bufp;
+    size_t         len = *lenp;
+    size_t         i = 0;
+    size_t         n;
+    unsigned char  ch;
+
+    *eom = 0;
+    while (i < len && *eom == 0){
+        if (*frame_state == 4){ /* chunk-data */
+            n = len - i;
+            if (n > *frame_size)
+                n = *frame_size;
+            if (cbuf_append_buf(cbmsg, p + i, n) < 0)
+                return -1;
+            i += n;
+            if ((*frame_size -= n) == 0)
+                *frame_state = 0;
+            continue;
+        }
+        ch = p[i++];
+        switch (*frame_state){
+        case 0:
+            if (ch != '\n')
+                goto err;
+            *frame_state = 1;
+            break;
+        case 1:
+            if (ch != '#')
+                goto err;
+            *frame_state = 2;
+            break;
+        case 2:
+            if (ch == '#')
+                *frame_state = 5;
+            else if (ch >= '1' && ch <= '9'){
+                *frame_size = ch - '0';
+                *frame_state = 3;
+            }
+            else
+                goto err;
+            break;
+        case 3:
+            if (ch >= '0' && ch <= '9'){
+                *frame_size = *frame_size*10 + ch - '0';
+                if (*frame_size > UINT32_MAX)
+                    goto err;
+            }
+            else if (ch == '\n')
+                *frame_state = 4;
+            else
+                goto err;
+            break;
+        case 5:
+            if (ch != '\n')
+                goto err;
+            *frame_state = 0;
+            *eom = 1;
+            break;
+        default:
+            goto err;
+        }
+    }
+    *bufp += i;
+    *lenp -= i;
+    return 0;
+ err:
+    snprintf(reason, rlen, "NETCONF framing error: unexpected char %d in state %d",
+             ch, *frame_state);
+    errno = EPROTO;
+    return -1;
+}
+
+/*! Get netconf message from input data, reentrant version without clixon error handling
+ *
+ * May be called from other threads than the main thread.
+ * @param[in,out] bufp        Input data, incremented as read
+ * @param[in,out] lenp        Data len, decremented as read
+ * @param[in,out] cbmsg       Completed frame (if eom), may contain data on entry
+ * @param[in]     framing     Framing type, base 1.0 (eom) or 1.1 (chunked)
+ * @param[in,out] frame_state Framing state, 0 initially
+ * @param[in,out] frame_size  Chunked framing size
+ * @param[out]    eom         If frame found in cbmsg
+ * @param[out]    reason      Error reason on error
+ * @param[in]     rlen        Length of reason buffer
+ * @retval        0           OK
+ * @retval       -1           Error, errno is EPROTO on framing error
+ * @see netconf_input_msg_scan
+ */
+int
+netconf_input_msg_scan_r(unsigned char      **bufp,
+                         size_t              *lenp,
+                         cbuf                *cbmsg,
+                         netconf_framing_type framing,
+                         int                 *frame_state,
+                         size_t              *frame_size,
+                         int                 *eom,
+                         char                *reason,
+                         size_t               rlen)
+{
+    int ret;
+
+    if (framing == NETCONF_SSH_CHUNKED)
+        ret = netconf_input_chunked(bufp, lenp, cbmsg, frame_state, frame_size, eom, reason, rlen);
+    else
+        ret = netconf_input_eom(bufp, lenp, cbmsg, frame_state, eom);
+    if (ret < 0 && errno != EPROTO)
+        snprintf(reason, rlen, "cbuf_append_buf: %s", strerror(errno));
+    return ret;
+}
+
+/*! Get netconf message from input data, scanning for frame boundaries
+ *
+ * Same as netconf_input_msg2 in clixon, but instead of a state machine for every byte,
+ * frame markers and chunk headers are located with memchr and data is copied in bulk.
+ * The frame state is not compatible with netconf_input_msg2.
+ * @param[in,out] bufp        Input data, incremented as read
+ * @param[in,out] lenp        Data len, decremented as read
+ * @param[in,out] cbmsg       Completed frame (if eom), may contain data on entry
+ * @param[in]     framing     Framing type, base 1.0 (eom) or 1.1 (chunked)
+ * @param[in,out] frame_state Framing state, 0 initially
+ * @param[in,out] frame_size  Chunked framing size
+ * @param[out]    eom         If frame found in cbmsg
+ * @retval        0           OK
+ * @retval       -1          Error
+ */
+int
+netconf_input_msg_scan(unsigned char      **bufp,
+                       size_t              *lenp,
+                       cbuf                *cbmsg,
+                       netconf_framing_type framing,
+                       int                 *frame_state,
+                       size_t              *frame_size,
+                       int                 *eom)
+{
+    char reason[128];
+
+    if (netconf_input_msg_scan_r(bufp, lenp, cbmsg, framing, frame_state, frame_size, eom,
+                                 reason, sizeof(reason)) < 0){
+        if (errno == EPROTO)
+            clixon_err(OE_NETCONF, 0, "%s", reason);
+        else
+            clixon_err(OE_UNIX, errno, "cbuf_append_buf");
+        return -1;
+    }
+    return 0;
+}
@@ -45,7 +45,14 @@ extern "C" {
 
 int clixon_client_connect_netconf(clixon_handle h, pid_t *pid, int *sock);
 int clixon_client_connect_ssh(clixon_handle h, const char *dest, const char *port,
-                              int stricthostkey, pid_t *pid, int *sock, int *sockerr);
+                              int stricthostkey, int persist, pid_t *pid, int *sock, int *sockerr,
+                              int *reused);
+int netconf_input_msg_scan(unsigned char **bufp, size_t *lenp, cbuf *cbmsg,
+                           netconf_framing_type framing, int *frame_state, size_t *frame_size,
+                           int *eom);
+int netconf_input_msg_scan_r(unsigned char **bufp, size_t *lenp, cbuf *cbmsg,
+                             netconf_framing_type framing, int *frame_state, size_t *frame_size,
+                             int *eom, char *reason, size_t rlen);
 
 #ifdef __cplusplus
 }
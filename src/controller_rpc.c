@@ -53,6 +53,8 @@
 #include "controller_device_handle.h"
 #include "controller_device_send.h"
 #include "controller_transaction.h"
+#include "controller_device_recv.h"
+#include "controller_work.h"
 #include "controller_rpc.h"
 
 /* Forward */
@@ -60,6 +62,7 @@ static int traverse_device_group(clixon_handle h, cxobj *xdevs, cxobj **vec1, si
 
 /*! Connect to device via Netconf SSH
  *
+ * The device may be queued if connect-window devices are already connecting
  * @param[in]  h             Clixon handle
  * @param[in]  dh            Device handle, either NULL or in closed state
  * @param[in]  user          Username for ssh login
@@ -79,7 +82,6 @@ connect_netconf_ssh(clixon_handle h,
 {
     int   retval = -1;
     cbuf *cb = NULL;
-    int   s;
 
     if (addr == NULL || dh == NULL){
         clixon_err(OE_PLUGIN, EINVAL, "xn, addr or dh is NULL");
@@ -96,15 +98,10 @@ connect_netconf_ssh(clixon_handle h,
     if (user)
         cprintf(cb, "%s@", user);
     cprintf(cb, "%s", addr);
-    if (device_handle_connect(dh, CLIXON_CLIENT_SSH, cbuf_get(cb), port, stricthostkey) < 0)
+    if (device_handle_conn_params_set(dh, cbuf_get(cb), port, stricthostkey) < 0)
         goto done;
-    if (device_state_set(dh, CS_CONNECTING) < 0)
-        goto done;
-    s = device_handle_socket_get(dh);
-    device_handle_framing_type_set(dh, NETCONF_SSH_EOM); // XXX
-    cbuf_reset(cb); /* reuse cb for event dbg str */
-    cprintf(cb, "Netconf ssh %s", addr);
-    if (clixon_event_reg_fd(s, device_input_cb, dh, cbuf_get(cb)) < 0)
+    /* Connect now or queue if too many devices are connecting */
+    if (device_connect_schedule(h, dh) < 0)
         goto done;
     retval = 0;
  done:
@@ -147,6 +144,8 @@ controller_connect(clixon_handle           h,
     cxobj        *xyanglib = NULL;
     int           ssh_stricthostkey = 1;
     char         *domain = NULL;
+    int           kept = 0;
+    int           ret;
 
     clixon_debug(CLIXON_DBG_CTRL, "");
     if ((name = xml_find_body(xn, "name")) == NULL)
@@ -165,10 +164,15 @@ controller_connect(clixon_handle           h,
             goto ok;
         /* Clear yangs for domain changes, upgrade etc
          * Alt: clear in device_close_connection()
+         * Last good yang-lib is kept and restored if device capabilities are unchanged,
+         * then the mount is left and removed on hello if not restored
          */
-        device_handle_yang_lib_set(dh, NULL);
+        if ((ret = device_handle_yang_lib_keep(dh)) < 0)
+            goto done;
+        kept = ret;
     }
-    if ((xconfig = xml_find(xn, "config")) != NULL){
+    if (!kept &&
+        (xconfig = xml_find(xn, "config")) != NULL){
         if (yang_schema_yspec_rm(h, xconfig) < 0)
             goto done;
     }
@@ -277,6 +281,11 @@ controller_connect(clixon_handle           h,
     }
     if (xb && (str = xml_body(xb)) != NULL && strcmp(str, "false") == 0)
         device_handle_flag_reset(dh, DH_FLAG_YANG_ANNOUNCE_LATEST);
+    if ((xb = xml_find_type(xn, NULL, "change-token", CX_ELMNT)) == NULL &&
+        xdevprofile)
+        xb = xml_find_type(xdevprofile, NULL, "change-token", CX_ELMNT);
+    if (device_handle_change_token_xpath_set(dh, xb ? xml_body(xb) : NULL) < 0)
+        goto done;
     /* Point of no return: assume errors handled in device_input_cb */
     device_handle_tid_set(dh, ct->ct_id);
     if (connect_netconf_ssh(h, dh, user, addr, port, ssh_stricthostkey) < 0) /* match */
@@ -441,35 +450,254 @@ clearvec(clixon_handle h,
     return 0;
 }
 
-/*! Compute diff, construct edit-config and send to device
+/*! Device push job, the config digests are computed by a worker thread
  *
- * 1) get previous device synced xml
- * 2) get current and compute diff with previous
+ * The worker only reads the flattened current device config and the synced digests, and
+ * writes the digests and subtree states. The device handle is looked up by name when the
+ * job is done, the device may be closed or removed meanwhile.
+ * @see push_device_prepare
+ */
+struct push_job {
+    char           *pj_name;      /* Device name */
+    uint64_t        pj_tid;       /* Transaction id */
+    char           *pj_candidate; /* Candidate committed if no device changed, or NULL */
+    cxobj          *pj_x1t;       /* Top of current device config */
+    cxobj          *pj_x1;        /* Current device config */
+    config_digest   pj_d0;        /* Digest of synced device config, if pj_cd1 is set */
+    config_digests *pj_cd0;       /* Subtree digests of synced device config, or NULL */
+    config_digests *pj_cd1;       /* Subtree digests of current device config, or NULL */
+    uint8_t        *pj_flags0;    /* Subtree states of pj_cd0, if compared */
+    uint8_t        *pj_flags1;    /* Subtree states of pj_cd1, if compared */
+    int             pj_ret;       /* Result of worker, -1 on error */
+    int             pj_errno;     /* Error number of worker */
+};
+
+/*! Free device push job
+ */
+static int
+push_job_free(struct push_job *pj)
+{
+    if (pj->pj_name)
+        free(pj->pj_name);
+    if (pj->pj_candidate)
+        free(pj->pj_candidate);
+    if (pj->pj_flags0)
+        free(pj->pj_flags0);
+    if (pj->pj_flags1)
+        free(pj->pj_flags1);
+    if (pj->pj_cd0)
+        config_digests_free(pj->pj_cd0);
+    if (pj->pj_cd1)
+        config_digests_free(pj->pj_cd1);
+    if (pj->pj_x1t)
+        xml_free(pj->pj_x1t);
+    free(pj);
+    return 0;
+}
+
+/*! Get current device config for push, and prepare its config digests
+ *
+ * 1) get current device xml
+ * @param[in]  h         Clixon handle
+ * @param[in]  dh        Device handle
+ * @param[in]  ct        Transaction
+ * @param[in]  db        Device datastore
+ * @param[in]  candidate Candidate committed if no device changed, or NULL
+ * @param[out] pjp       Push job
+ * @param[out] cberr     Error message
+ * @retval     1         OK
+ * @retval     0         Failed, cberr set
+ * @retval    -1         Error
+ */
+static int
+push_device_prepare(clixon_handle           h,
+                    device_handle           dh,
+                    controller_transaction *ct,
+                    const char             *db,
+                    const char             *candidate,
+                    struct push_job       **pjp,
+                    cbuf                  **cberr)
+{
+    int              retval = -1;
+    struct push_job *pj = NULL;
+    cbuf            *cb = NULL;
+    char            *name;
+    cvec            *nsc = NULL;
+    config_digests  *cd0;
+    int              ret;
+
+    name = device_handle_name_get(dh);
+    if ((pj = calloc(1, sizeof(*pj))) == NULL){
+        clixon_err(OE_UNIX, errno, "calloc");
+        goto done;
+    }
+    if ((pj->pj_name = strdup(name)) == NULL ||
+        (candidate && (pj->pj_candidate = strdup(candidate)) == NULL)){
+        clixon_err(OE_UNIX, errno, "strdup");
+        goto done;
+    }
+    pj->pj_tid = ct->ct_id;
+    /* Note x0 and x1 are directly modified in device_create_edit_config_diff, cannot do no-copy
+       1) get current device config */
+    if ((cb = cbuf_new()) == NULL){
+        clixon_err(OE_UNIX, errno, "cbuf_new");
+        goto done;
+    }
+    cprintf(cb, "devices/device[name='%s']/config", name);
+    if (xmldb_get0(h, db, YB_MODULE, nsc, cbuf_get(cb), 1, WITHDEFAULTS_EXPLICIT, &pj->pj_x1t, NULL, NULL) < 0)
+        goto done;
+    if ((pj->pj_x1 = xpath_first(pj->pj_x1t, nsc, "%s", cbuf_get(cb))) == NULL){
+        if ((*cberr = cbuf_new()) == NULL){
+            clixon_err(OE_UNIX, errno, "cbuf_new");
+            goto done;
+        }
+        cprintf(*cberr, "Device not configured");
+        goto failed;
+    }
+    /* Digests are computed from a flattened copy, compared with synced if known */
+    if ((ret = device_handle_config_digest_get(dh, DT_SYNCED, &pj->pj_d0)) < 0)
+        goto done;
+    if (ret == 1){
+        if (config_digests_new(pj->pj_x1, 1, &pj->pj_cd1) < 0)
+            goto done;
+        if ((cd0 = device_handle_synced_digests_get(dh)) != NULL)
+            pj->pj_cd0 = config_digests_ref(cd0);
+    }
+    *pjp = pj;
+    pj = NULL;
+    retval = 1;
+ done:
+    if (cb)
+        cbuf_free(cb);
+    if (pj)
+        push_job_free(pj);
+    return retval;
+ failed:
+    retval = 0;
+    goto done;
+}
+
+/*! Compute config digests of current device config and compare with synced
+ *
+ * Does not call clixon, run by a worker thread
+ * @param[in]  arg    Push job
+ * @see config_digests_compute
+ */
+static void
+push_device_digests(void *arg)
+{
+    struct push_job *pj = (struct push_job *)arg;
+
+    if (pj->pj_cd1 == NULL)
+        return;
+    if (config_digests_compute(pj->pj_cd1) < 0)
+        goto err;
+    /* Unchanged since last sync if same digest, confirmed in push_device_send */
+    if (CONFIG_DIGEST_EQ(config_digests_root(pj->pj_cd1), pj->pj_d0))
+        return;
+    if (pj->pj_cd0 != NULL &&
+        config_digests_diff(pj->pj_cd0, pj->pj_cd1, &pj->pj_flags0, &pj->pj_flags1) < 0)
+        goto err;
+    return;
+ err:
+    pj->pj_ret = -1;
+    pj->pj_errno = errno;
+}
+
+/*! Get changed and removed subtrees of synced device config, using compared subtree digests
+ *
+ * Unchanged subtrees are removed from the current device config. Only the changed subtrees
+ * are copied from the cached SYNCED datastore, instead of all of it.
+ * @param[in]  h       Clixon handle
+ * @param[in]  pj      Push job, with subtree states
+ * @param[out] x0p     Changed subtrees of SYNCED, or NULL if subtrees cannot be used
+ * @retval     0       OK
+ * @retval    -1       Error
+ * @see config_digests_extract
+ */
+static int
+push_device_synced_subtrees(clixon_handle    h,
+                            struct push_job *pj,
+                            cxobj          **x0p)
+{
+    int    retval = -1;
+    cxobj *xs = NULL;
+    cbuf  *cberr = NULL;
+    int    ret;
+
+    /* Cached tree, not copied */
+    if ((ret = device_config_read_cache(h, pj->pj_name, "SYNCED", &xs, &cberr)) < 0)
+        goto done;
+    if (ret == 0)
+        goto ok;
+    if (config_digests_extract(pj->pj_cd0, pj->pj_flags0, xs,
+                               pj->pj_cd1, pj->pj_flags1, x0p) < 0)
+        goto done;
+ ok:
+    retval = 0;
+ done:
+    if (cberr)
+        cbuf_free(cberr);
+    return retval;
+}
+
+/*! Check that current device config is same as synced, when their digests are equal
+ *
+ * Equal digests are confirmed, see xml_config_digest
+ * @param[in]  h       Clixon handle
+ * @param[in]  pj      Push job
+ * @retval     1       Same
+ * @retval     0       Not same, or synced not cached
+ * @retval    -1       Error
+ */
+static int
+push_device_synced_equal(clixon_handle    h,
+                         struct push_job *pj)
+{
+    int    retval = -1;
+    cxobj *xs = NULL;
+    cbuf  *cberr = NULL;
+    int    ret;
+
+    /* Cached tree, not copied */
+    if ((ret = device_config_read_cache(h, pj->pj_name, "SYNCED", &xs, &cberr)) < 0)
+        goto done;
+    /* xml_tree_equal 0: Equal, 1: not equal */
+    retval = ret == 1 && xml_tree_equal(xs, pj->pj_x1) == 0;
+ done:
+    if (cberr)
+        cbuf_free(cberr);
+    return retval;
+}
+
+/*! Compute diff, construct edit-config and send lock to device
+ *
+ * Called by the main thread when the config digests of the device are done
+ * 2) get changed subtrees of previous device synced xml, or all of it
  * 3) construct an edit-config, send it and validate it
  * 4) phase 2 commit
  * @param[in]  h       Clixon handle
- * @param[in]  xe      Request: <rpc><xn></rpc>
  * @param[in]  ct      Transaction
- * @param[in]  db      Device datastore
+ * @param[in]  dh      Device handle
+ * @param[in]  pj      Push job with computed digests
  * @param[out] cberr   Error message
- * @retval     1       OK
- * @retval     0       Failed, cbret set
+ * @retval     2       Edit-config created and lock sent
+ * @retval     1       Device config unchanged
+ * @retval     0       Failed, cberr set
  * @retval    -1       Error
  * @see devices_diff  for top-level all devices
  */
 static int
-push_device_one(clixon_handle           h,
-                device_handle           dh,
-                controller_transaction *ct,
-                const char             *db,
-                cbuf                  **cberr)
+push_device_send(clixon_handle           h,
+                 controller_transaction *ct,
+                 device_handle           dh,
+                 struct push_job        *pj,
+                 cbuf                  **cberr)
 {
     int        retval = -1;
+    char      *name = pj->pj_name;
     cxobj     *x0 = NULL;
-    cxobj     *x1;
-    cxobj     *x1t = NULL;
-    cbuf      *cb = NULL;
-    char      *name;
+    yang_stmt *yspec = NULL;
     cxobj    **dvec = NULL;
     size_t     dlen;
     cxobj    **avec = NULL;
@@ -477,36 +705,36 @@ push_device_one(clixon_handle           h,
     cxobj    **chvec0 = NULL;
     cxobj    **chvec1 = NULL;
     size_t     chlen;
-    yang_stmt *yspec;
     cbuf      *cbmsg1 = NULL;
     cbuf      *cbmsg2 = NULL;
-    cvec      *nsc = NULL;
+    uint64_t   msgid;
     int        ret;
 
-    /* Note x0 and x1 are directly modified in device_create_edit_config_diff, cannot do no-copy
-       1) get previous device synced xml */
-    name = device_handle_name_get(dh);
-    if ((ret = device_config_read(h, name, "SYNCED", &x0, cberr)) < 0)
-        goto done;
-    if (ret == 0)
-        goto failed;
-    /* 2) get current and compute diff with previous */
-    if ((cb = cbuf_new()) == NULL){
-        clixon_err(OE_UNIX, errno, "cbuf_new");
-        goto done;
-    }
-    cprintf(cb, "devices/device[name='%s']/config", name);
-    if (xmldb_get0(h, db, YB_MODULE, nsc, cbuf_get(cb), 1, WITHDEFAULTS_EXPLICIT, &x1t, NULL, NULL) < 0)
-        goto done;
-    if ((x1 = xpath_first(x1t, nsc, "%s", cbuf_get(cb))) == NULL){
+    if (pj->pj_ret < 0){
         if ((*cberr = cbuf_new()) == NULL){
             clixon_err(OE_UNIX, errno, "cbuf_new");
             goto done;
         }
-        cprintf(*cberr, "Device not configured");
+        cprintf(*cberr, "Config digests of device %s: %s", name, strerror(pj->pj_errno));
         goto failed;
     }
-    yspec = NULL;
+    if (pj->pj_cd1 && CONFIG_DIGEST_EQ(config_digests_root(pj->pj_cd1), pj->pj_d0)){
+        if ((ret = push_device_synced_equal(h, pj)) < 0)
+            goto done;
+        if (ret == 1)
+            goto unchanged;
+    }
+    /* 2) get changed subtrees of previous device synced xml */
+    if (pj->pj_flags0 != NULL &&
+        push_device_synced_subtrees(h, pj, &x0) < 0)
+        goto done;
+    /* 2) get all of previous device synced xml, if subtrees cannot be used */
+    if (x0 == NULL){
+        if ((ret = device_config_read(h, name, "SYNCED", &x0, cberr)) < 0)
+            goto done;
+        if (ret == 0)
+            goto failed;
+    }
     if (controller_mount_yspec_get(h, name, &yspec) < 0)
         goto done;
     if (yspec == NULL){
@@ -517,35 +745,44 @@ push_device_one(clixon_handle           h,
         cprintf(*cberr, "No YANGs exists for device %s, is device connected? (set enabled=false)", name);
         goto failed;
     }
-    /* What to push to device? diff between synced and actionsdb */
-    if (xml_diff(x0, x1,
-                 &dvec, &dlen,
-                 &avec, &alen,
-                 &chvec0, &chvec1, &chlen) < 0)
+    /* What to push to device? diff between synced and actionsdb, skip equal subtrees */
+    if (xml_diff_digest(x0, pj->pj_x1,
+                        &dvec, &dlen,
+                        &avec, &alen,
+                        &chvec0, &chvec1, &chlen) < 0)
         goto done;
+    if (dlen == 0 && alen == 0 && chlen == 0)
+        goto unchanged;
     /* 3) construct an edit-config, send it and validate it */
-    if (dlen || alen || chlen){
-        if (device_create_edit_config_diff(h, dh,
-                                           x0, x1, yspec,
-                                           dvec, dlen,
-                                           avec, alen,
-                                           chvec0, chvec1, chlen,
-                                           &cbmsg1, &cbmsg2) < 0)
-            goto done;
-        if (cbmsg1)
-            device_handle_outmsg_set(dh, 1, cbmsg1);
-        if (cbmsg2)
-            device_handle_outmsg_set(dh, 2, cbmsg2);
-        if (device_send_lock(h, dh, 1) < 0)
+    if (device_create_edit_config_diff(h, dh,
+                                       x0, pj->pj_x1, yspec,
+                                       dvec, dlen,
+                                       avec, alen,
+                                       chvec0, chvec1, chlen,
+                                       &cbmsg1, &cbmsg2) < 0)
+        goto done;
+    if (cbmsg1)
+        device_handle_outmsg_set(dh, 1, cbmsg1);
+    if (cbmsg2)
+        device_handle_outmsg_set(dh, 2, cbmsg2);
+    msgid = device_handle_msg_id_get(dh);
+    if (device_send_lock(h, dh, 1) < 0)
+        goto done;
+    if (ct->ct_push_pipeline){
+        /* Send get-config for push check without waiting for lock reply */
+        if (device_handle_pipeline_add(dh, msgid, CS_PUSH_LOCK) < 0)
             goto done;
-        device_handle_tid_set(dh, ct->ct_id);
-        if (device_state_set(dh, CS_PUSH_LOCK) < 0)
+        msgid = device_handle_msg_id_get(dh);
+        if (device_send_get(h, dh, device_handle_socket_get(dh), 0, NULL) < 0)
+            goto done;
+        if (device_handle_pipeline_add(dh, msgid, CS_PUSH_CHECK) < 0)
             goto done;
     }
-    else{
-        device_handle_tid_set(dh, 0);
-    }
-    retval = 1;
+    device_handle_tid_set(dh, ct->ct_id);
+    if (device_state_set(dh, CS_PUSH_LOCK) < 0)
+        goto done;
+    ct->ct_push_started++;
+    retval = 2;
  done:
     if (dvec)
         free(dvec);
@@ -555,18 +792,206 @@ push_device_one(clixon_handle           h,
         free(chvec0);
     if (chvec1)
         free(chvec1);
-    if (cb)
-        cbuf_free(cb);
     if (x0)
         xml_free(x0);
-    if (x1t)
-        xml_free(x1t);
     return retval;
+ unchanged:
+    retval = 1;
+    goto done;
  failed:
     retval = 0;
     goto done;
 }
 
+/*! Close push transaction where no device config has changed
+ *
+ * If there are actions, the candidate is committed to the controller
+ * @param[in]  h         Clixon handle
+ * @param[in]  ct        Transaction
+ * @param[in]  candidate Candidate of actions, or NULL if push without actions
+ * @retval     0         OK
+ * @retval    -1         Error
+ */
+static int
+push_device_nochange(clixon_handle           h,
+                     controller_transaction *ct,
+                     const char             *candidate)
+{
+    int    retval = -1;
+    cbuf  *cberr = NULL;
+    cbuf  *cberr2 = NULL;
+    cxobj *xerr = NULL;
+    int    ret;
+
+    if (candidate == NULL){
+        if ((ct->ct_reason = strdup("No changes to push")) == NULL){
+            clixon_err(OE_UNIX, errno, "strdup");
+            goto done;
+        }
+        if (controller_transaction_done(h, ct, TR_FAILED) < 0)
+            goto done;
+        goto ok;
+    }
+    if (ct->ct_actions_type != AT_NONE && strcmp(ct->ct_sourcedb, "candidate")==0){
+        if ((cberr = cbuf_new()) == NULL){
+            clixon_err(OE_UNIX, errno, "cbuf_new");
+            goto done;
+        }
+        /* What to copy to candidate and commit to running? */
+        if (xmldb_copy(h, "actions", candidate) < 0)
+            goto done;
+        /* XXX: recursive creates transaction */
+        if ((ret = candidate_commit(h, NULL, candidate, 0, 0, cberr)) < 0){
+            /* Handle that candidate_commit can return < 0 if transaction ongoing */
+            cprintf(cberr, "%s", clixon_err_reason()); // XXX encode
+            ret = 0;
+        }
+        if (ret == 1){
+            if (xmldb_post_commit(h, ct->ct_client_id) < 0)
+                goto done;
+        }
+        if (clicon_option_bool(h, "CLICON_AUTOLOCK"))
+            xmldb_unlock(h, candidate);
+        if (ret == 0){ // XXX awkward, cb ->xml->cb
+            if ((cberr2 = cbuf_new()) == NULL){
+                clixon_err(OE_UNIX, errno, "cbuf_new");
+                goto done;
+            }
+            if (clixon_xml_parse_string(cbuf_get(cberr), YB_NONE, NULL, &xerr, NULL) < 0)
+                goto done;
+            if (netconf_err2cb(h, xerr, cberr2) < 0)
+                goto done;
+            if (controller_transaction_failed(h, ct->ct_id, ct, NULL, TR_FAILED_DEV_LEAVE,
+                                              NULL,
+                                              cbuf_get(cberr2)) < 0)
+                goto done;
+            goto ok;
+        }
+    }
+    if ((ct->ct_reason = strdup("No device  configuration changed, no push necessary")) == NULL){
+        clixon_err(OE_UNIX, errno, "strdup");
+        goto done;
+    }
+    if (controller_transaction_done(h, ct, TR_SUCCESS) < 0)
+        goto done;
+ ok:
+    retval = 0;
+ done:
+    if (xerr)
+        xml_free(xerr);
+    if (cberr)
+        cbuf_free(cberr);
+    if (cberr2)
+        cbuf_free(cberr2);
+    return retval;
+}
+
+/*! Device leaves push transaction after its digests are done, continue the transaction
+ *
+ * If it was the last device, close the transaction. If all other devices are in WAIT,
+ * commit them.
+ * @param[in]  h         Clixon handle
+ * @param[in]  ct        Transaction
+ * @param[in]  dh        Device handle, in PUSH-DIFF state
+ * @param[in]  candidate Candidate of actions, or NULL
+ * @retval     0         OK
+ * @retval    -1         Error
+ */
+static int
+push_device_leave(clixon_handle           h,
+                  controller_transaction *ct,
+                  device_handle           dh,
+                  const char             *candidate)
+{
+    int           retval = -1;
+    device_handle dhw = NULL;
+
+    if (device_state_set(dh, CS_OPEN) < 0)
+        goto done;
+    device_handle_tid_set(dh, 0);
+    if (controller_transaction_nr_devices(h, ct->ct_id) == 0){
+        if (ct->ct_state != TS_RESOLVED && ct->ct_push_started == 0){
+            if (push_device_nochange(h, ct, candidate) < 0)
+                goto done;
+            goto ok;
+        }
+        if (ct->ct_state != TS_RESOLVED)
+            controller_transaction_state_set(ct, TS_RESOLVED, ct->ct_nr_failed?TR_FAILED:TR_SUCCESS);
+        if (controller_transaction_done(h, ct, -1) < 0)
+            goto done;
+        goto ok;
+    }
+    if (ct->ct_state == TS_RESOLVED)
+        goto ok;
+    while ((dhw = device_handle_each_tid(ct, dhw)) != NULL)
+        if (device_handle_conn_state_get(dhw) == CS_PUSH_WAIT)
+            break;
+    if (dhw != NULL && device_state_push_commit(h, dhw) < 0)
+        goto done;
+ ok:
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Config digests of device are done, called by the main thread from the event loop
+ *
+ * The device is sent its edit-config and lock, or leaves the transaction if unchanged or
+ * failed. If cancelled, the device is only set to OPEN
+ * @param[in]  h       Clixon handle
+ * @param[in]  arg     Push job
+ * @param[in]  cancel  Job is cancelled and digests may not be computed
+ * @retval     0       OK
+ * @retval    -1       Error
+ * @see push_device_digests  Run by a worker thread
+ */
+static int
+push_device_done(clixon_handle h,
+                 void         *arg,
+                 int           cancel)
+{
+    int                     retval = -1;
+    struct push_job        *pj = (struct push_job *)arg;
+    controller_transaction *ct;
+    device_handle           dh;
+    cbuf                   *cberr = NULL;
+    int                     ret;
+
+    if ((dh = device_handle_find(h, pj->pj_name)) == NULL ||
+        device_handle_conn_state_get(dh) != CS_PUSH_DIFF)
+        goto ok;
+    if (cancel ||
+        device_handle_tid_get(dh) != pj->pj_tid ||
+        (ct = controller_transaction_find(h, pj->pj_tid)) == NULL){
+        /* Cancelled or transaction terminated meanwhile */
+        if (device_state_set(dh, CS_OPEN) < 0)
+            goto done;
+        goto ok;
+    }
+    if (ct->ct_state == TS_RESOLVED) /* Transaction failed meanwhile */
+        ret = 1;
+    else if ((ret = push_device_send(h, ct, dh, pj, &cberr)) < 0)
+        goto done;
+    if (ret == 0){
+        if (device_state_set(dh, CS_OPEN) < 0)
+            goto done;
+        if (controller_transaction_failed(h, pj->pj_tid, ct, dh, TR_FAILED_DEV_LEAVE,
+                                          pj->pj_name, cbuf_get(cberr)) < 0)
+            goto done;
+    }
+    else if (ret == 1){
+        if (push_device_leave(h, ct, dh, pj->pj_candidate) < 0)
+            goto done;
+    }
+ ok:
+    retval = 0;
+ done:
+    if (cberr)
+        cbuf_free(cberr);
+    push_job_free(pj);
+    return retval;
+}
+
 /*! Incoming rpc handler to sync from one or several devices
  *
  * @param[in]  h       Clixon handle
@@ -587,12 +1012,19 @@ pull_device_one(clixon_handle h,
                 const char   *xpath,
                 cbuf         *cbret)
 {
-    int  retval = -1;
-    int  s;
+    int                     retval = -1;
+    int                     s;
+    controller_transaction *ct;
 
     clixon_debug(CLIXON_DBG_CTRL, "");
     s = device_handle_socket_get(dh);
-    if (device_send_get(h, dh, s, state, xpath) < 0)
+    if (state == 0 && xpath == NULL){
+        /* Skip get-config if change token is unchanged, but not for transient pull */
+        ct = controller_transaction_find(h, tid);
+        if (device_state_sync_send(h, dh, ct != NULL && !ct->ct_pull_transient) < 0)
+            goto done;
+    }
+    else if (device_send_get(h, dh, s, state, xpath) < 0)
         goto done;
     if (device_state_set(dh, CS_DEVICE_SYNC) < 0)
         goto done;
@@ -694,6 +1126,7 @@ rpc_config_pull(clixon_handle h,
     char                   *str;
     cbuf                   *cberr = NULL;
     int                     transient = 0;
+    int                     pc;
     int                     ret;
 
     clixon_debug(CLIXON_DBG_CTRL, "");
@@ -720,6 +1153,8 @@ rpc_config_pull(clixon_handle h,
     ct->ct_pull_transient = transient;
     if ((str = xml_find_body(xe, "merge")) != NULL)
         ct->ct_pull_merge = strcmp(str, "true") == 0;
+    if ((pc = clicon_data_int_get(h, "controller-pull-commit")) >= 0)
+        ct->ct_pull_commit = pc;
     if ((ret = xmldb_get_cache(h, "running", &xret, NULL)) < 0)
         goto done;
     if (ret == 0){
@@ -742,10 +1177,13 @@ rpc_config_pull(clixon_handle h,
         if (ret == 0) // XXX: Return value has not been checked before
             goto ok;
     }
-    if (xmldb_db_reset(h, "tmpdev") < 0) /* Requires root access */
-        goto done;
-    if (xmldb_copy(h, "running", "tmpdev") < 0)
-        goto done;
+    /* Initiate tmpdev datastore for device commits, not needed if committed per device */
+    if (ct->ct_pull_commit == PC_TRANSACTION){
+        if (xmldb_db_reset(h, "tmpdev") < 0) /* Requires root access */
+            goto done;
+        if (xmldb_copy(h, "running", "tmpdev") < 0)
+            goto done;
+    }
     cprintf(cbret, "<rpc-reply xmlns=\"%s\">", NETCONF_BASE_NAMESPACE);
     cprintf(cbret, "<tid xmlns=\"%s\">%" PRIu64"</tid>", CONTROLLER_NAMESPACE, ct->ct_id);
     cprintf(cbret, "</rpc-reply>");
@@ -1116,34 +1554,79 @@ strip_service_data_from_device_config(clixon_handle h,
 
 /*! Compute diff of candidate + commit and trigger service-commit notify
  *
- * @param[in]  h       Clixon handle
- * @param[in]  ct      Transaction
- * @param[in]  db      From where to compute diffs and push
- * @param[out] cberr   Error message (if retval = 0)
- * @retval     1       OK
- * @retval     0       Failed
- * @retval    -1       Error
+ * Device configs are read by the main thread. If push-threads is set, the config digests of
+ * each device are computed by a worker thread while the device is in PUSH-DIFF, and the
+ * device is sent its edit-config and lock from the event loop when they are done, see
+ * push_device_done. Otherwise all devices are handled before return.
+ * @param[in]  h         Clixon handle
+ * @param[in]  ct        Transaction
+ * @param[in]  db        From where to compute diffs and push
+ * @param[in]  candidate Candidate committed if no device changed, or NULL if no actions
+ * @param[out] cberr     Error message (if retval = 0)
+ * @retval     1         OK
+ * @retval     0         Failed
+ * @retval    -1         Error
  */
 static int
 controller_commit_push(clixon_handle           h,
                        controller_transaction *ct,
                        const char             *db,
+                       const char             *candidate,
                        cbuf                  **cberr)
 {
-    int           retval = -1;
-    device_handle dh = NULL;
-    int           ret;
+    int              retval = -1;
+    device_handle    dh;
+    device_handle   *vec = NULL;
+    size_t           len = 0;
+    size_t           i;
+    struct push_job *pj = NULL;
+    int              deferred;
+    int              ret;
 
-    while ((dh = device_handle_each(h, dh)) != NULL){
-        if (device_handle_tid_get(dh) != ct->ct_id)
-            continue;
-        if ((ret = push_device_one(h, dh, ct, db, cberr)) < 0)
+    /* Devices are removed from transaction when done, iterate over a copy */
+    dh = NULL;
+    while ((dh = device_handle_each_tid(ct, dh)) != NULL)
+        len++;
+    if (len && (vec = calloc(len, sizeof(*vec))) == NULL){
+        clixon_err(OE_UNIX, errno, "calloc");
+        goto done;
+    }
+    i = 0;
+    dh = NULL;
+    while ((dh = device_handle_each_tid(ct, dh)) != NULL)
+        vec[i++] = dh;
+    deferred = clicon_data_int_get(h, "controller-push-threads") > 0;
+    for (i=0; i<len; i++){
+        dh = vec[i];
+        if ((ret = push_device_prepare(h, dh, ct, db, candidate, &pj, cberr)) < 0)
             goto done;
         if (ret == 0)  /* Failed but cbret set */
             goto failed;
+        if (deferred){
+            /* Done is called from the event loop, after return */
+            if (controller_work_submit(h, push_device_digests, push_device_done, pj) < 0)
+                goto done;
+            pj = NULL;
+            if (device_state_set(dh, CS_PUSH_DIFF) < 0)
+                goto done;
+            continue;
+        }
+        push_device_digests(pj);
+        if ((ret = push_device_send(h, ct, dh, pj, cberr)) < 0)
+            goto done;
+        if (ret == 0)
+            goto failed;
+        if (ret == 1)
+            device_handle_tid_set(dh, 0);
+        push_job_free(pj);
+        pj = NULL;
     }
     retval = 1;
  done:
+    if (pj)
+        push_job_free(pj);
+    if (vec)
+        free(vec);
     return retval;
  failed:
     retval = 0;
@@ -1184,7 +1667,7 @@ commit_push_after_actions(clixon_handle           h,
         /* Compute diff of candidate + commit and trigger service
          * If some device diff is zero, then remove device from transaction
          */
-        if ((ret = controller_commit_push(h, ct, "actions", &cberr)) < 0)
+        if ((ret = controller_commit_push(h, ct, "actions", candidate, &cberr)) < 0)
             goto done;
         if (ret == 0){
             if ((ct->ct_origin = strdup("controller")) == NULL){
@@ -1200,60 +1683,13 @@ commit_push_after_actions(clixon_handle           h,
         }
         /* No device started, close transaction */
         else if (controller_transaction_nr_devices(h, ct->ct_id) == 0){
-            if (ct->ct_actions_type != AT_NONE && strcmp(ct->ct_sourcedb, "candidate")==0){
-                if ((cberr = cbuf_new()) == NULL){
-                    clixon_err(OE_UNIX, errno, "cbuf_new");
-                    goto done;
-                }
-                /* What to copy to candidate and commit to running? */
-                if (xmldb_copy(h, "actions", candidate) < 0)
-                    goto done;
-                /* XXX: recursive creates transaction */
-                if ((ret = candidate_commit(h, NULL, candidate, 0, 0, cberr)) < 0){
-                    /* Handle that candidate_commit can return < 0 if transaction ongoing */
-                    cprintf(cberr, "%s", clixon_err_reason()); // XXX encode
-                    ret = 0;
-                }
-                if (ret == 1){
-                    if (xmldb_post_commit(h, ct->ct_client_id) < 0)
-                        goto done;
-                }
-                if (clicon_option_bool(h, "CLICON_AUTOLOCK"))
-                    xmldb_unlock(h, candidate);
-                if (ret == 0){ // XXX awkward, cb ->xml->cb
-                    cxobj *xerr = NULL;
-                    cbuf *cberr2 = NULL;
-                    if ((cberr2 = cbuf_new()) == NULL){
-                        clixon_err(OE_UNIX, errno, "cbuf_new");
-                        goto done;
-                    }
-                    if (clixon_xml_parse_string(cbuf_get(cberr), YB_NONE, NULL, &xerr, NULL) < 0)
-                        goto done;
-                    if (netconf_err2cb(h, xerr, cberr2) < 0)
-                        goto done;
-                    if (controller_transaction_failed(h, ct->ct_id, ct, NULL, TR_FAILED_DEV_LEAVE,
-                                                      NULL,
-                                                      cbuf_get(cberr2)) < 0)
-                        goto done;
-                    if (xerr)
-                        xml_free(xerr);
-                    if (cberr2)
-                        cbuf_free(cberr2);
-                    goto ok;
-                }
-            }
-            if ((ct->ct_reason = strdup("No device  configuration changed, no push necessary")) == NULL){
-                clixon_err(OE_UNIX, errno, "strdup");
-                goto done;
-            }
-            if (controller_transaction_done(h, ct, TR_SUCCESS) < 0)
+            if (push_device_nochange(h, ct, candidate) < 0)
                 goto done;
         }
         else{
-            /* Some or all started */
+            /* Some or all started, or in PUSH-DIFF, see push_device_done */
         }
     }
- ok:
     retval = 0;
  done:
     if (cberr)
@@ -1553,10 +1989,8 @@ devices_diff(clixon_handle           h,
     }
     /* Check if any device with changes is closed */
     dh = NULL;
-    while ((dh = device_handle_each(h, dh)) != NULL){
+    while ((dh = device_handle_each_tid(ct, dh)) != NULL){
         int touch = 0;
-        if (device_handle_tid_get(dh) != ct->ct_id)
-            continue;
         name = device_handle_name_get(dh);
         if ((xn = xpath_first(td->td_src, nsc, "devices/device[name='%s']", name)) != NULL){
             if (xml_flag(xn, XML_FLAG_CHANGE) != 0)
@@ -1684,6 +2118,7 @@ rpc_controller_commit(clixon_handle h,
     char                   *service_instance = NULL;
     int                     diff = 0;
     char                   *candidate = NULL;
+    cbuf                   *cbq = NULL;
     int                     ret;
 
     clixon_debug(CLIXON_DBG_CTRL, "");
@@ -1748,6 +2183,8 @@ rpc_controller_commit(clixon_handle h,
         goto ok;
     }
     ct->ct_push_type = pusht;
+    if (clicon_data_int_get(h, "controller-push-pipeline") == 1)
+        ct->ct_push_pipeline = 1;
     ct->ct_actions_type = actions;
     ct->ct_sourcedb = sourcedb;
     sourcedb = NULL;
@@ -1776,9 +2213,29 @@ rpc_controller_commit(clixon_handle h,
             continue;
         if (strcmp(body, "true") != 0)
             continue;
+        /* Leave out quarantined device, unless selected by itself */
+        if (cvec_len(devvec) > 1 && device_handle_quarantined(dh)){
+            if (cbq == NULL){
+                if ((cbq = cbuf_new()) == NULL){
+                    clixon_err(OE_UNIX, errno, "cbuf_new");
+                    goto done;
+                }
+                cprintf(cbq, "Quarantined devices not pushed:");
+            }
+            cprintf(cbq, " %s", devname);
+            continue;
+        }
         /* Include device in transaction */
         device_handle_tid_set(dh, ct->ct_id);
     }
+    if (cbq){
+        clixon_log(h, LOG_NOTICE, "%s", cbuf_get(cbq));
+        if (ct->ct_warning == NULL &&
+            (ct->ct_warning = strdup(cbuf_get(cbq))) == NULL){
+            clixon_err(OE_UNIX, errno, "strdup");
+            goto done;
+        }
+    }
     /* If there are no devices selected and push != NONE */
     if (controller_transaction_nr_devices(h, ct->ct_id) == 0 && pusht != PT_NONE){
         if (device_error(h, ct, NULL, 2, cbret) < 0)
@@ -1808,7 +2265,7 @@ rpc_controller_commit(clixon_handle h,
     }
     switch (actions){
     case AT_NONE: /* Bypass actions, directly to push */
-        if ((ret = controller_commit_push(h, ct, "running", &cberr)) < 0)
+        if ((ret = controller_commit_push(h, ct, "running", NULL, &cberr)) < 0)
             goto done;
         if (ret == 0){
             if (netconf_operation_failed(cbret, "application", "%s", cbuf_get(cberr))< 0)
@@ -1859,6 +2316,8 @@ rpc_controller_commit(clixon_handle h,
         cbuf_free(cbtr);
     if (cberr)
         cbuf_free(cberr);
+    if (cbq)
+        cbuf_free(cbq);
     if (devvec)
         cvec_free(devvec);
     return retval;
@@ -2111,6 +2570,7 @@ rpc_connection_change(clixon_handle h,
     cbuf                   *cberr = NULL;
     cbuf                   *cbtr = NULL;
     int                     tmpdev = 0;
+    int                     pc;
     int                     ret;
 
     clixon_debug(CLIXON_DBG_CTRL, "");
@@ -2138,6 +2598,8 @@ rpc_connection_change(clixon_handle h,
             goto done;
         goto ok;
     }
+    if ((pc = clicon_data_int_get(h, "controller-pull-commit")) >= 0)
+        ct->ct_pull_commit = pc;
     if (xmldb_get_cache(h, "running", &xret, NULL) < 0)
         goto done;
     if (devvec_create(h, pattern, xret, nsc, groups, &devvec) < 0)
@@ -2150,8 +2612,8 @@ rpc_connection_change(clixon_handle h,
         if (ret == 0) // XXX: Return value has not been checked before
             goto ok;
     }
-    /* Initiate tmpdev datastore for device commits */
-    if (tmpdev) {
+    /* Initiate tmpdev datastore for device commits, not needed if committed per device */
+    if (tmpdev && ct->ct_pull_commit == PC_TRANSACTION) {
         /* Possibly only copy files / dir */
         if (xmldb_db_reset(h, "tmpdev") < 0) /* Requires root access */
             goto done;
@@ -3072,11 +3534,82 @@ rpc_device_config_template_apply(clixon_handle h,
     return retval;
 }
 
+/*! Generic RPC dispatched by message-id to a busy device, argument of its continuation
+ */
+struct rpc_dispatch {
+    uint64_t rd_tid;   /* Transaction id of rpc transaction */
+    char     rd_name[]; /* Device name */
+};
+
+/*! Continuation of generic RPC dispatched by message-id to a busy device
+ *
+ * The device stays in its own transaction, the reply is stored in the rpc transaction
+ * @param[in]  h     Clixon handle
+ * @param[in]  dh    Device handle, or NULL if removed
+ * @param[in]  xmsg  Reply message, or NULL on timeout or close
+ * @param[in]  arg   struct rpc_dispatch (malloced, freed here)
+ * @retval     0     OK
+ * @retval    -1     Error
+ * @see device_send_rpc_one
+ */
+static int
+device_send_rpc_dispatch_cb(clixon_handle h,
+                            device_handle dh,
+                            cxobj        *xmsg,
+                            void         *arg)
+{
+    int                     retval = -1;
+    struct rpc_dispatch    *rd = (struct rpc_dispatch *)arg;
+    controller_transaction *ct;
+    char                   *name;
+    cbuf                   *cberr = NULL;
+    int                     ret;
+
+    name = rd->rd_name;
+    if ((ct = controller_transaction_find(h, rd->rd_tid)) == NULL)
+        goto ok;
+    ct->ct_nr_requests--;
+    if (xmsg == NULL){
+        if (controller_transaction_failed(h, ct->ct_id, ct, NULL, TR_FAILED_DEV_IGNORE, name, "No reply from device") < 0)
+            goto done;
+    }
+    else {
+        if ((ret = device_recv_generic_rpc(h, dh, ct, xmsg, "rpc-reply",
+                                           device_handle_conn_state_get(dh), &cberr)) < 0)
+            goto done;
+        if (ret == 0){
+            if (controller_transaction_failed(h, ct->ct_id, ct, NULL, TR_FAILED_DEV_IGNORE, name, cbuf_get(cberr)) < 0)
+                goto done;
+        }
+        else if (ret == 1){ /* Closed, caller handles the device transaction */
+            if (controller_transaction_failed(h, ct->ct_id, ct, NULL, TR_FAILED_DEV_IGNORE, name, device_handle_logmsg_get(dh)) < 0)
+                goto done;
+        }
+    }
+    /* If no devices or requests left in transaction, mark as OK and close it */
+    if (controller_transaction_nr_devices(h, ct->ct_id) == 0){
+        if (ct->ct_state != TS_RESOLVED)
+            controller_transaction_state_set(ct, TS_RESOLVED, TR_SUCCESS);
+        if (controller_transaction_done(h, ct, -1) < 0)
+            goto done;
+    }
+ ok:
+    retval = 0;
+ done:
+    if (cberr)
+        cbuf_free(cberr);
+    free(rd);
+    return retval;
+}
+
 /*! Send generic RPC to device within rpc transaction
  *
+ * An open device joins the rpc transaction and its reply is handled by the state machine.
+ * A device busy in another transaction, eg a push, gets the RPC on the same session: the
+ * request is dispatched by message-id and the device stays in its own transaction.
  * @param[in]  h        Clixon handle
  * @param[in]  dh       Device handle
- * @param[in]  tid      Transaction id
+ * @param[in]  ct       RPC transaction
  * @param[in]  xconfig  RPC xml body
  * @param[out] cbret    Return xml tree, eg <rpc-reply>..., <rpc-error.. if retval = 0
  * @retval     1        OK
@@ -3085,25 +3618,81 @@ rpc_device_config_template_apply(clixon_handle h,
  * @see device_send_generic_rpc
  */
 static int
-device_send_rpc_one(clixon_handle h,
-                    device_handle dh,
-                    uint64_t      tid,
-                    cxobj        *xconfig,
-                    cbuf         *cbret)
+device_send_rpc_one(clixon_handle           h,
+                    device_handle           dh,
+                    controller_transaction *ct,
+                    cxobj                  *xconfig,
+                    cbuf                   *cbret)
 {
-    int  retval = -1;
+    int                  retval = -1;
+    uint64_t             msgid;
+    struct rpc_dispatch *rd = NULL;
+    char                *name;
+    int                  d;
 
     clixon_debug(CLIXON_DBG_CTRL, "");
-    if (device_send_generic_rpc(h, dh, xconfig) < 0)
-        goto done;
-    if (device_state_set(dh, CS_RPC_GENERIC) < 0)
-        goto done;
-    device_handle_tid_set(dh, tid);
+    if (device_handle_conn_state_get(dh) == CS_OPEN){
+        if (device_send_generic_rpc(h, dh, xconfig) < 0)
+            goto done;
+        if (device_state_set(dh, CS_RPC_GENERIC) < 0)
+            goto done;
+        device_handle_tid_set(dh, ct->ct_id);
+    }
+    else {
+        name = device_handle_name_get(dh);
+        if ((rd = malloc(sizeof(*rd) + strlen(name) + 1)) == NULL){
+            clixon_err(OE_UNIX, errno, "malloc");
+            goto done;
+        }
+        rd->rd_tid = ct->ct_id;
+        strcpy(rd->rd_name, name);
+        msgid = device_handle_msg_id_get(dh);
+        if (device_send_generic_rpc(h, dh, xconfig) < 0)
+            goto done;
+        if ((d = clicon_data_int_get(h, "controller-device-timeout")) < 0)
+            d = CONTROLLER_DEVICE_TIMEOUT_DEFAULT;
+        if (device_handle_dispatch_add(dh, msgid, device_send_rpc_dispatch_cb, rd, d) < 0)
+            goto done;
+        rd = NULL;
+        ct->ct_nr_requests++;
+    }
     retval = 1;
  done:
+    if (rd)
+        free(rd);
     return retval;
 }
 
+/*! Check if generic RPC can be sent to device
+ *
+ * Either the device is open, or busy in a push or rpc transaction on an established session
+ * @param[in]  dh  Device handle
+ * @retval     1   Yes
+ * @retval     0   No
+ */
+static int
+device_rpc_ready(device_handle dh)
+{
+    switch (device_handle_conn_state_get(dh)){
+    case CS_OPEN:
+    case CS_PUSH_DIFF:
+    case CS_PUSH_LOCK:
+    case CS_PUSH_CHECK:
+    case CS_PUSH_EDIT:
+    case CS_PUSH_EDIT2:
+    case CS_PUSH_VALIDATE:
+    case CS_PUSH_WAIT:
+    case CS_PUSH_COMMIT:
+    case CS_PUSH_COMMIT_SYNC:
+    case CS_PUSH_DISCARD:
+    case CS_PUSH_UNLOCK:
+    case CS_RPC_GENERIC:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
 /*! Apply rpc-template
  *
  * @param[in]  h       Clixon handle
@@ -3231,9 +3820,9 @@ rpc_device_rpc_template_apply(clixon_handle h,
             continue;
         if ((dh = device_handle_find(h, devname)) == NULL)
             continue;
-        if (device_handle_conn_state_get(dh) != CS_OPEN)
+        if (!device_rpc_ready(dh))
             continue;
-        if ((ret = device_send_rpc_one(h, dh, ct->ct_id, xconfig, cbret)) < 0)
+        if ((ret = device_send_rpc_one(h, dh, ct, xconfig, cbret)) < 0)
             goto done;
         if (ret == 0)  /* Failed but cbret set */
             goto ok;
@@ -3379,9 +3968,9 @@ rpc_device_rpc(clixon_handle h,
             continue;
         if ((dh = device_handle_find(h, devname)) == NULL)
             continue;
-        if (device_handle_conn_state_get(dh) != CS_OPEN)
+        if (!device_rpc_ready(dh))
             continue;
-        if ((ret = device_send_rpc_one(h, dh, ct->ct_id, xconfig, cbret)) < 0)
+        if ((ret = device_send_rpc_one(h, dh, ct, xconfig, cbret)) < 0)
             goto done;
         if (ret == 0)  /* Failed but cbret set */
             goto ok;
@@ -3583,6 +4172,89 @@ rpc_get_device_schema(clixon_handle h,
     return retval;
 }
 
+/*! Check if devices are in sync using content digests of SYNCED and TRANSIENT configs
+ *
+ * @param[in]  h       Clixon handle
+ * @param[in]  xe      Request: <rpc><xn></rpc>
+ * @param[out] cbret   Return xml tree, eg <rpc-reply>..., <rpc-error..
+ * @param[in]  arg     Domain specific arg, ec client-entry or FCGX_Request
+ * @param[in]  regarg  User argument given at rpc_callback_register()
+ * @retval     0       OK
+ * @retval    -1       Error
+ * @see device_config_digest_equal
+ */
+static int
+rpc_check_sync(clixon_handle h,
+               cxobj        *xe,
+               cbuf         *cbret,
+               void         *arg,
+               void         *regarg)
+{
+    int            retval = -1;
+    char          *pattern = "*";
+    int            groups = 0;
+    cvec          *devvec = NULL;
+    cg_var        *cv;
+    cvec          *nsc = NULL;
+    cxobj         *xret = NULL;
+    cxobj         *xn;
+    char          *devname;
+    device_handle  dh;
+    char          *state;
+    int            subscribed;
+    int            drift;
+    int            ret;
+
+    if ((xn = xml_find(xe, "device")) != NULL)
+        pattern = xml_body(xn);
+    else if ((xn = xml_find(xe, "device-group")) != NULL){
+        pattern = xml_body(xn);
+        groups++;
+    }
+    if ((ret = xmldb_get_cache(h, "running", &xret, NULL)) < 0)
+        goto done;
+    if (ret == 0){
+        clixon_err(OE_DB, 0, "Error when reading from running_db");
+        goto done;
+    }
+    if (devvec_create(h, pattern, xret, nsc, groups, &devvec) < 0)
+        goto done;
+    cprintf(cbret, "<rpc-reply xmlns=\"%s\">", NETCONF_BASE_NAMESPACE);
+    cprintf(cbret, "<devices xmlns=\"%s\">", CONTROLLER_NAMESPACE);
+    cv = NULL;
+    while ((cv = cvec_each(devvec, cv)) != NULL){
+        xn = cv_void_get(cv);
+        if ((devname = xml_find_body(xn, "name")) == NULL)
+            continue;
+        state = "UNKNOWN";
+        if ((dh = device_handle_find(h, devname)) != NULL){
+            /* Config changes notified since last sync, see drift-tracking */
+            device_handle_drift_get(dh, &subscribed, &drift, NULL);
+            if (subscribed && drift)
+                state = "OUT-OF-SYNC";
+            else if (device_drift_clean(h, dh))
+                state = "IN-SYNC";
+            else if ((ret = device_config_digest_equal(dh)) < 0)
+                goto done;
+            else if (ret == 1)
+                state = "IN-SYNC";
+            else if (ret == 0)
+                state = "OUT-OF-SYNC";
+        }
+        cprintf(cbret, "<device><name>");
+        if (xml_chardata_cbuf_append(cbret, 0, devname) < 0)
+            goto done;
+        cprintf(cbret, "</name><sync-state>%s</sync-state></device>", state);
+    }
+    cprintf(cbret, "</devices>");
+    cprintf(cbret, "</rpc-reply>");
+    retval = 0;
+ done:
+    if (devvec)
+        cvec_free(devvec);
+    return retval;
+}
+
 /*! Register callback for rpc calls
  */
 int
@@ -3656,6 +4328,12 @@ controller_rpc_init(clixon_handle h)
                               "get-device-schema"
                               ) < 0)
         goto done;
+    if (rpc_callback_register(h, rpc_check_sync,
+                              NULL,
+                              CONTROLLER_NAMESPACE,
+                              "check-sync"
+                              ) < 0)
+        goto done;
     retval = 0;
  done:
     return retval;
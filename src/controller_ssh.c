@@ -0,0 +1,897 @@
+/*
+ *
+  ***** BEGIN LICENSE BLOCK *****
+
+  Copyright (C) 2023 Olof Hagsand
+
+  This file is part of CLIXON.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  ***** END LICENSE BLOCK *****
+  *
+  * In-process NETCONF over SSH transport using libssh
+  * Instead of an ssh sub-process per device, the SSH session runs in the backend event loop
+  * and its netconf channel is bridged to a socketpair. The controller reads and writes the
+  * other end of the socketpair as the socket of the ssh sub-process transport.
+  * Errors are written to a pipe read as the stderr socket of the sub-process transport.
+  * No controller dependencies
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+
+/* clicon */
+#include <cligen/cligen.h>
+
+/* Clicon library functions. */
+#include <clixon/clixon.h>
+
+#ifdef HAVE_LIBSSH
+#include <libssh/libssh.h>
+#endif
+
+/* Local includes (no controller dependencies) */
+#include "controller_ssh.h"
+
+#ifdef HAVE_LIBSSH
+
+/*
+ * Constants
+ */
+/* Interval in ms to drive handshake and pending output when not woken up by input */
+#define SSH_TRANSPORT_TICK_MS 10
+
+/* Read buffer size, typically max SSH packet payload */
+#define SSH_TRANSPORT_BUFLEN 32768
+
+/*
+ * Types
+ */
+/*! State of in-process SSH transport */
+enum ssh_transport_state {
+    STS_CONNECT,   /* TCP connect, key exchange and host key check */
+    STS_AUTH,      /* Public key authentication */
+    STS_CHANNEL,   /* Open session channel */
+    STS_SUBSYSTEM, /* Request netconf subsystem */
+    STS_OPEN,      /* Bridge channel and socketpair */
+    STS_CLOSED     /* Closed or failed, wait for disconnect */
+};
+
+/*! Authenticated SSH session kept after its channel is closed, for reuse on reconnect
+ *
+ * Pooled sessions are listed in clicon_ptr "controller-ssh-pool"
+ */
+struct ssh_pooled {
+    qelem_t                  sp_qelem;    /* List header */
+    clixon_handle            sp_h;        /* Clixon handle */
+    char                    *sp_key;      /* Destination and port: <dest>:<port> */
+    ssh_session              sp_session;  /* Authenticated libssh session */
+};
+typedef struct ssh_pooled ssh_pooled;
+
+/*! In-process SSH transport of one device session
+ */
+struct ssh_transport {
+    clixon_handle            st_h;        /* Clixon handle */
+    char                    *st_dest;     /* Destination, for logging */
+    char                    *st_port;     /* SSH port */
+    char                    *st_key;      /* Destination and port, key of session pool */
+    int                      st_pooled;   /* st_session is taken from pool */
+    ssh_session              st_session;  /* libssh session */
+    ssh_channel              st_channel;  /* netconf subsystem channel */
+    enum ssh_transport_state st_state;    /* Transport state */
+    int                      st_stricthostkey; /* Require known host key */
+    int                      st_fd;       /* SSH TCP socket, -1 if not yet known */
+    int                      st_fdreg;    /* st_fd registered in event loop */
+    int                      st_sock;     /* Transport end of socketpair */
+    int                      st_sockreg;  /* st_sock registered in event loop */
+    int                      st_err;      /* Write end of error pipe */
+    int                      st_tick;     /* Tick timer registered */
+    cbuf                    *st_inbuf;    /* Data from device not yet written to st_sock */
+    size_t                   st_inoff;    /* Written offset of st_inbuf */
+    cbuf                    *st_outbuf;   /* Data to device not yet written to channel */
+    size_t                   st_outoff;   /* Written offset of st_outbuf */
+};
+typedef struct ssh_transport ssh_transport;
+
+static int ssh_transport_run(ssh_transport *st);
+static int ssh_transport_session_new(ssh_transport *st);
+static int ssh_transport_close(ssh_transport *st, const char *reason);
+
+/*! Set close-on-exec so that sockets are not inherited by other sub-processes
+ */
+static int
+ssh_transport_cloexec(int fd)
+{
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0){
+        clixon_err(OE_UNIX, errno, "fcntl");
+        return -1;
+    }
+    return 0;
+}
+
+/*! SSH socket has input
+ */
+static int
+ssh_transport_fd_cb(int   s,
+                    void *arg)
+{
+    return ssh_transport_run((ssh_transport *)arg);
+}
+
+/*! Controller has written to device socket
+ */
+static int
+ssh_transport_sock_cb(int   s,
+                      void *arg)
+{
+    ssh_transport *st = (ssh_transport *)arg;
+    char           buf[SSH_TRANSPORT_BUFLEN];
+    ssize_t        n;
+
+    if ((n = read(s, buf, sizeof(buf))) < 0){
+        if (errno == EAGAIN || errno == EINTR)
+            return 0;
+        /* Socketpair broken, close this transport only, not the event loop */
+        return ssh_transport_close(st, strerror(errno));
+    }
+    if (n == 0){ /* Controller closed, wait for disconnect */
+        clixon_event_unreg_fd(st->st_sock, ssh_transport_sock_cb);
+        st->st_sockreg = 0;
+        return 0;
+    }
+    if (cbuf_append_buf(st->st_outbuf, buf, n) < 0){
+        clixon_err(OE_UNIX, errno, "cbuf_append_buf");
+        return -1;
+    }
+    return ssh_transport_run(st);
+}
+
+/*! Periodic tick while handshaking or output is pending
+ */
+static int
+ssh_transport_tick_cb(int   s,
+                      void *arg)
+{
+    ssh_transport *st = (ssh_transport *)arg;
+
+    st->st_tick = 0;
+    return ssh_transport_run(st);
+}
+
+/*! Register or unregister SSH socket in event loop
+ */
+static int
+ssh_transport_fd_reg(ssh_transport *st,
+                     int            on)
+{
+    if (on && !st->st_fdreg && st->st_fd != -1){
+        if (clixon_event_reg_fd(st->st_fd, ssh_transport_fd_cb, st, "ssh transport") < 0)
+            return -1;
+        st->st_fdreg = 1;
+    }
+    else if (!on && st->st_fdreg){
+        clixon_event_unreg_fd(st->st_fd, ssh_transport_fd_cb);
+        st->st_fdreg = 0;
+    }
+    return 0;
+}
+
+/*! Register or unregister transport end of socketpair in event loop
+ */
+static int
+ssh_transport_sock_reg(ssh_transport *st,
+                       int            on)
+{
+    if (on && !st->st_sockreg && st->st_sock != -1){
+        if (clixon_event_reg_fd(st->st_sock, ssh_transport_sock_cb, st, "ssh transport bridge") < 0)
+            return -1;
+        st->st_sockreg = 1;
+    }
+    else if (!on && st->st_sockreg){
+        clixon_event_unreg_fd(st->st_sock, ssh_transport_sock_cb);
+        st->st_sockreg = 0;
+    }
+    return 0;
+}
+
+/*! Close transport, report reason on error pipe and close socketpair so that device reads EOF
+ *
+ * @param[in]  st      SSH transport
+ * @param[in]  reason  Error reason, or NULL if closed by device
+ * @retval     0       OK
+ * @retval    -1       Error
+ */
+static int
+ssh_transport_close(ssh_transport *st,
+                    const char    *reason)
+{
+    clixon_debug(CLIXON_DBG_MSG, "%s: %s", st->st_dest, reason?reason:"closed");
+    if (ssh_transport_fd_reg(st, 0) < 0)
+        return -1;
+    if (ssh_transport_sock_reg(st, 0) < 0)
+        return -1;
+    if (st->st_err != -1){
+        if (reason && write(st->st_err, reason, strlen(reason)) < 0)
+            clixon_debug(CLIXON_DBG_MSG, "write: %s", strerror(errno));
+        close(st->st_err);
+        st->st_err = -1;
+    }
+    if (st->st_sock != -1){
+        close(st->st_sock);
+        st->st_sock = -1;
+    }
+    st->st_state = STS_CLOSED;
+    return 0;
+}
+
+/*! Check host key of device, as ssh StrictHostKeyChecking
+ *
+ * @param[in]  st   SSH transport
+ * @retval     1    OK
+ * @retval     0    Failed, transport closed
+ * @retval    -1    Error
+ */
+static int
+ssh_transport_hostkey(ssh_transport *st)
+{
+    switch (ssh_session_is_known_server(st->st_session)){
+    case SSH_KNOWN_HOSTS_OK:
+        break;
+    case SSH_KNOWN_HOSTS_CHANGED:
+    case SSH_KNOWN_HOSTS_OTHER:
+        if (st->st_stricthostkey)
+            goto failed;
+        break;
+    case SSH_KNOWN_HOSTS_NOT_FOUND:
+    case SSH_KNOWN_HOSTS_UNKNOWN:
+        if (st->st_stricthostkey)
+            goto failed;
+        /* As ssh, add new host key */
+        if (ssh_session_update_known_hosts(st->st_session) != SSH_OK)
+            clixon_debug(CLIXON_DBG_MSG, "%s: %s", st->st_dest, ssh_get_error(st->st_session));
+        break;
+    case SSH_KNOWN_HOSTS_ERROR:
+    default:
+        if (ssh_transport_close(st, ssh_get_error(st->st_session)) < 0)
+            return -1;
+        return 0;
+    }
+    return 1;
+ failed:
+    if (ssh_transport_close(st, "Host key verification failed.") < 0)
+        return -1;
+    return 0;
+}
+
+/*! Write pending device data to socketpair
+ *
+ * @retval  1   All written
+ * @retval  0   Pending, socketpair is full
+ * @retval -1   Socketpair error, errno set
+ */
+static int
+ssh_transport_inbuf_flush(ssh_transport *st)
+{
+    ssize_t n;
+
+    while (st->st_inoff < cbuf_len(st->st_inbuf)){
+        if ((n = write(st->st_sock, cbuf_get(st->st_inbuf) + st->st_inoff,
+                       cbuf_len(st->st_inbuf) - st->st_inoff)) < 0){
+            if (errno == EAGAIN || errno == EINTR)
+                return 0;
+            return -1;
+        }
+        st->st_inoff += n;
+    }
+    cbuf_reset(st->st_inbuf);
+    st->st_inoff = 0;
+    return 1;
+}
+
+/*! Write pending controller data to channel
+ *
+ * @retval  1   All written
+ * @retval  0   Pending, channel window is full
+ * @retval -1   Channel error
+ */
+static int
+ssh_transport_outbuf_flush(ssh_transport *st)
+{
+    int n;
+
+    while (st->st_outoff < cbuf_len(st->st_outbuf)){
+        if ((n = ssh_channel_write(st->st_channel, cbuf_get(st->st_outbuf) + st->st_outoff,
+                                   cbuf_len(st->st_outbuf) - st->st_outoff)) < 0)
+            return -1;
+        if (n == 0)
+            return 0;
+        st->st_outoff += n;
+    }
+    cbuf_reset(st->st_outbuf);
+    st->st_outoff = 0;
+    return 1;
+}
+
+/*! Bridge open channel and socketpair in both directions
+ *
+ * @retval  0   OK (also if transport was closed)
+ * @retval -1   Error
+ */
+static int
+ssh_transport_pump(ssh_transport *st)
+{
+    char buf[SSH_TRANSPORT_BUFLEN];
+    int  n;
+    int  ret;
+
+    /* Device to controller, only read channel when previous data is written */
+    while ((ret = ssh_transport_inbuf_flush(st)) == 1){
+        n = ssh_channel_read_nonblocking(st->st_channel, buf, sizeof(buf), 0);
+        if (n == SSH_ERROR)
+            return ssh_transport_close(st, ssh_get_error(st->st_session));
+        if (n < 0 || (n == 0 && ssh_channel_is_eof(st->st_channel)))
+            return ssh_transport_close(st, NULL);
+        if (n == 0)
+            break;
+        if (cbuf_append_buf(st->st_inbuf, buf, n) < 0){
+            clixon_err(OE_UNIX, errno, "cbuf_append_buf");
+            return -1;
+        }
+    }
+    if (ret < 0)
+        return ssh_transport_close(st, strerror(errno));
+    /* Do not wake up on input until socketpair has room */
+    if (ssh_transport_fd_reg(st, ret == 1) < 0)
+        return -1;
+    /* Controller to device */
+    if ((ret = ssh_transport_outbuf_flush(st)) < 0)
+        return ssh_transport_close(st, ssh_get_error(st->st_session));
+    /* Do not read controller data until channel has room */
+    if (ssh_transport_sock_reg(st, ret == 1) < 0)
+        return -1;
+    return 0;
+}
+
+/*! Drive SSH transport state machine, called on input and ticks
+ *
+ * @param[in]  st   SSH transport
+ * @retval     0    OK
+ * @retval    -1    Error
+ */
+static int
+ssh_transport_run(ssh_transport *st)
+{
+    int            rc;
+    int            ret;
+    struct timeval t;
+    struct timeval t1;
+
+    switch (st->st_state){
+    case STS_CONNECT:
+        rc = ssh_connect(st->st_session);
+        if (st->st_fd == -1 && (st->st_fd = ssh_get_fd(st->st_session)) != -1){
+            if (ssh_transport_cloexec(st->st_fd) < 0)
+                return -1;
+            if (ssh_transport_fd_reg(st, 1) < 0)
+                return -1;
+        }
+        if (rc == SSH_AGAIN)
+            break;
+        if (rc != SSH_OK){
+            if (ssh_transport_close(st, ssh_get_error(st->st_session)) < 0)
+                return -1;
+            break;
+        }
+        if ((ret = ssh_transport_hostkey(st)) < 0)
+            return -1;
+        if (ret == 0)
+            break;
+        st->st_state = STS_AUTH;
+        /* fall through */
+    case STS_AUTH:
+        rc = ssh_userauth_publickey_auto(st->st_session, NULL, NULL);
+        if (rc == SSH_AUTH_AGAIN)
+            break;
+        if (rc != SSH_AUTH_SUCCESS){
+            if (ssh_transport_close(st, "Permission denied (publickey).") < 0)
+                return -1;
+            break;
+        }
+        if ((st->st_channel = ssh_channel_new(st->st_session)) == NULL){
+            if (ssh_transport_close(st, ssh_get_error(st->st_session)) < 0)
+                return -1;
+            break;
+        }
+        st->st_state = STS_CHANNEL;
+        /* fall through */
+    case STS_CHANNEL:
+        rc = ssh_channel_open_session(st->st_channel);
+        if (rc == SSH_AGAIN)
+            break;
+        if (rc != SSH_OK && st->st_pooled){
+            /* Pooled session is stale, start over with connect and authentication */
+            if (ssh_transport_session_new(st) < 0)
+                return -1;
+            return ssh_transport_run(st);
+        }
+        if (rc != SSH_OK){
+            if (ssh_transport_close(st, ssh_get_error(st->st_session)) < 0)
+                return -1;
+            break;
+        }
+        st->st_state = STS_SUBSYSTEM;
+        /* fall through */
+    case STS_SUBSYSTEM:
+        rc = ssh_channel_request_subsystem(st->st_channel, "netconf");
+        if (rc == SSH_AGAIN)
+            break;
+        if (rc != SSH_OK){
+            if (ssh_transport_close(st, ssh_get_error(st->st_session)) < 0)
+                return -1;
+            break;
+        }
+        clixon_debug(CLIXON_DBG_MSG, "%s: netconf subsystem open", st->st_dest);
+        st->st_state = STS_OPEN;
+        /* fall through */
+    case STS_OPEN:
+        if (ssh_transport_pump(st) < 0)
+            return -1;
+        break;
+    case STS_CLOSED:
+        break;
+    }
+    /* Tick while handshaking or if output is pending */
+    if (!st->st_tick &&
+        st->st_state != STS_CLOSED &&
+        (st->st_state != STS_OPEN ||
+         cbuf_len(st->st_inbuf) > 0 ||
+         cbuf_len(st->st_outbuf) > 0 ||
+         (ssh_get_poll_flags(st->st_session) & SSH_WRITE_PENDING))){
+        gettimeofday(&t, NULL);
+        t1.tv_sec = 0;
+        t1.tv_usec = SSH_TRANSPORT_TICK_MS*1000;
+        timeradd(&t, &t1, &t);
+        if (clixon_event_reg_timeout(t, ssh_transport_tick_cb, st, "ssh transport tick") < 0)
+            return -1;
+        st->st_tick = 1;
+    }
+    return 0;
+}
+
+/*! Free pooled session
+ */
+static int
+ssh_pooled_free(ssh_pooled *sp)
+{
+    if (sp->sp_session){
+        ssh_disconnect(sp->sp_session);
+        ssh_free(sp->sp_session);
+    }
+    if (sp->sp_key)
+        free(sp->sp_key);
+    free(sp);
+    return 0;
+}
+
+/*! Pooled session has not been reused within its persist time, disconnect it
+ */
+static int
+ssh_pooled_timeout(int   s,
+                   void *arg)
+{
+    ssh_pooled *sp = (ssh_pooled *)arg;
+    ssh_pooled *pool = NULL;
+
+    clixon_debug(CLIXON_DBG_MSG, "%s: persist timeout", sp->sp_key);
+    clicon_ptr_get(sp->sp_h, "controller-ssh-pool", (void**)&pool);
+    DELQ(sp, pool, ssh_pooled *);
+    clicon_ptr_set(sp->sp_h, "controller-ssh-pool", (void*)pool);
+    return ssh_pooled_free(sp);
+}
+
+/*! Find pooled session to destination
+ */
+static ssh_pooled *
+ssh_pool_find(ssh_pooled *pool,
+              const char *key)
+{
+    ssh_pooled *sp;
+
+    if ((sp = pool) != NULL){
+        do {
+            if (strcmp(sp->sp_key, key) == 0)
+                return sp;
+            sp = NEXTQ(ssh_pooled *, sp);
+        } while (sp && sp != pool);
+    }
+    return NULL;
+}
+
+/*! Take an authenticated session to destination from pool
+ *
+ * @param[in]  h     Clixon handle
+ * @param[in]  key   Destination and port
+ * @retval     sess  Connected session, removed from pool
+ * @retval     NULL  No session found
+ */
+static ssh_session
+ssh_pool_take(clixon_handle h,
+              const char   *key)
+{
+    ssh_pooled *pool = NULL;
+    ssh_pooled *sp;
+    ssh_session session = NULL;
+
+    clicon_ptr_get(h, "controller-ssh-pool", (void**)&pool);
+    while (session == NULL && (sp = ssh_pool_find(pool, key)) != NULL){
+        DELQ(sp, pool, ssh_pooled *);
+        clixon_event_unreg_timeout(ssh_pooled_timeout, sp);
+        /* Device may have closed it while pooled */
+        if (ssh_is_connected(sp->sp_session)){
+            session = sp->sp_session;
+            sp->sp_session = NULL;
+        }
+        ssh_pooled_free(sp);
+    }
+    clicon_ptr_set(h, "controller-ssh-pool", (void*)pool);
+    return session;
+}
+
+/*! Put authenticated session of transport in pool, disconnect after persist seconds
+ *
+ * @param[in]  st       SSH transport, session is moved to pool
+ * @param[in]  persist  Seconds to keep session
+ * @retval     0        OK
+ * @retval    -1        Error
+ */
+static int
+ssh_pool_put(ssh_transport *st,
+             int            persist)
+{
+    int             retval = -1;
+    ssh_pooled     *pool = NULL;
+    ssh_pooled     *sp = NULL;
+    struct timeval  t;
+
+    if ((sp = malloc(sizeof(*sp))) == NULL){
+        clixon_err(OE_UNIX, errno, "malloc");
+        goto done;
+    }
+    memset(sp, 0, sizeof(*sp));
+    sp->sp_h = st->st_h;
+    if ((sp->sp_key = strdup(st->st_key)) == NULL){
+        clixon_err(OE_UNIX, errno, "strdup");
+        goto done;
+    }
+    gettimeofday(&t, NULL);
+    t.tv_sec += persist;
+    if (clixon_event_reg_timeout(t, ssh_pooled_timeout, sp, "ssh transport persist") < 0)
+        goto done;
+    sp->sp_session = st->st_session;
+    st->st_session = NULL;
+    clicon_ptr_get(st->st_h, "controller-ssh-pool", (void**)&pool);
+    ADDQ(sp, pool);
+    clicon_ptr_set(st->st_h, "controller-ssh-pool", (void*)pool);
+    sp = NULL;
+    clixon_debug(CLIXON_DBG_MSG, "%s: persist %ds", st->st_key, persist);
+    retval = 0;
+ done:
+    if (sp)
+        ssh_pooled_free(sp);
+    return retval;
+}
+
+/*! Free SSH transport
+ */
+static int
+ssh_transport_free(ssh_transport *st)
+{
+    if (st->st_tick)
+        clixon_event_unreg_timeout(ssh_transport_tick_cb, st);
+    ssh_transport_fd_reg(st, 0);
+    ssh_transport_sock_reg(st, 0);
+    if (st->st_err != -1)
+        close(st->st_err);
+    if (st->st_sock != -1)
+        close(st->st_sock);
+    if (st->st_channel){
+        if (st->st_state == STS_OPEN)
+            ssh_channel_close(st->st_channel);
+        ssh_channel_free(st->st_channel);
+    }
+    if (st->st_session){
+        ssh_disconnect(st->st_session);
+        ssh_free(st->st_session);
+    }
+    if (st->st_inbuf)
+        cbuf_free(st->st_inbuf);
+    if (st->st_outbuf)
+        cbuf_free(st->st_outbuf);
+    if (st->st_dest)
+        free(st->st_dest);
+    if (st->st_port)
+        free(st->st_port);
+    if (st->st_key)
+        free(st->st_key);
+    free(st);
+    return 0;
+}
+
+/*! Set destination and identity options of new session
+ *
+ * @param[in]  h        Clixon handle
+ * @param[in]  session  libssh session
+ * @param[in]  dest     Destination, [user@]host
+ * @param[in]  port     SSH port
+ * @retval     0        OK
+ * @retval    -1        Error
+ */
+static int
+ssh_transport_options(clixon_handle h,
+                      ssh_session   session,
+                      const char   *dest,
+                      const char   *port)
+{
+    int   retval = -1;
+    char *host;
+    char *user = NULL;
+    char *idfile;
+
+    /* Split [user@]host, dest is copied by libssh */
+    if ((host = strrchr(dest, '@')) != NULL){
+        if ((user = strndup(dest, host - dest)) == NULL){
+            clixon_err(OE_UNIX, errno, "strndup");
+            goto done;
+        }
+        host++;
+    }
+    else
+        host = (char *)dest;
+    if (ssh_options_set(session, SSH_OPTIONS_HOST, host) < 0 ||
+        (user && ssh_options_set(session, SSH_OPTIONS_USER, user) < 0) ||
+        ssh_options_set(session, SSH_OPTIONS_PORT_STR, port) < 0){
+        clixon_err(OE_NETCONF, 0, "ssh_options_set: %s", ssh_get_error(session));
+        goto done;
+    }
+    if ((idfile = clicon_option_str(h, "CONTROLLER_SSH_IDENTITYFILE")) != NULL &&
+        ssh_options_set(session, SSH_OPTIONS_IDENTITY, idfile) < 0){
+        clixon_err(OE_NETCONF, 0, "ssh_options_set: %s", ssh_get_error(session));
+        goto done;
+    }
+    retval = 0;
+ done:
+    if (user)
+        free(user);
+    return retval;
+}
+
+/*! Replace session of transport with a new unconnected session
+ *
+ * Used for a new transport, and if opening a channel on a pooled session fails
+ * @param[in]  st   SSH transport
+ * @retval     0    OK
+ * @retval    -1    Error
+ */
+static int
+ssh_transport_session_new(ssh_transport *st)
+{
+    if (st->st_pooled)
+        clixon_debug(CLIXON_DBG_MSG, "%s: pooled session failed, new handshake", st->st_dest);
+    if (ssh_transport_fd_reg(st, 0) < 0)
+        return -1;
+    if (st->st_channel){
+        ssh_channel_free(st->st_channel);
+        st->st_channel = NULL;
+    }
+    if (st->st_session){
+        ssh_disconnect(st->st_session);
+        ssh_free(st->st_session);
+    }
+    st->st_fd = -1;
+    st->st_pooled = 0;
+    if ((st->st_session = ssh_new()) == NULL){
+        clixon_err(OE_NETCONF, 0, "ssh_new");
+        return -1;
+    }
+    if (ssh_transport_options(st->st_h, st->st_session, st->st_dest, st->st_port) < 0)
+        return -1;
+    ssh_set_blocking(st->st_session, 0);
+    st->st_state = STS_CONNECT;
+    return 0;
+}
+
+/*! Connect using NETCONF over in-process SSH
+ *
+ * Same as clixon_client_connect_ssh but without ssh sub-process.
+ * Returns immediately, connect and authentication continue in the event loop. Failures are
+ * reported as EOF on the socket with the reason readable on the error socket.
+ * If an authenticated session to the destination is kept from an earlier disconnect, only a
+ * new channel is opened on it. If that fails, a new session is connected and authenticated.
+ * @param[in]  h             Clixon handle
+ * @param[in]  dest          Destination, [user@]host
+ * @param[in]  port          SSH port
+ * @param[in]  stricthostkey If set ensure strict hostkey checking
+ * @param[out] transport     Transport handle, free with clixon_client_disconnect_libssh
+ * @param[out] sock          Device socket
+ * @param[out] sockerr       Error socket
+ * @param[out] reused        Set to 1 if a kept session is used, else 0
+ * @retval     0             OK
+ * @retval    -1             Error
+ */
+int
+clixon_client_connect_libssh(clixon_handle h,
+                             const char   *dest,
+                             const char   *port,
+                             int           stricthostkey,
+                             void        **transport,
+                             int          *sock,
+                             int          *sockerr,
+                             int          *reused)
+{
+    int            retval = -1;
+    ssh_transport *st = NULL;
+    int            sv[2] = {-1, -1};
+    int            ep[2] = {-1, -1};
+
+    clixon_debug(CLIXON_DBG_MSG | CLIXON_DBG_DETAIL, "%s", dest);
+    *reused = 0;
+    if ((st = malloc(sizeof(*st))) == NULL){
+        clixon_err(OE_UNIX, errno, "malloc");
+        goto done;
+    }
+    memset(st, 0, sizeof(*st));
+    st->st_h = h;
+    st->st_fd = -1;
+    st->st_sock = -1;
+    st->st_err = -1;
+    st->st_stricthostkey = stricthostkey;
+    if ((st->st_dest = strdup(dest)) == NULL){
+        clixon_err(OE_UNIX, errno, "strdup");
+        goto done;
+    }
+    if ((st->st_port = strdup(port)) == NULL){
+        clixon_err(OE_UNIX, errno, "strdup");
+        goto done;
+    }
+    if ((st->st_key = malloc(strlen(dest) + strlen(port) + 2)) == NULL){
+        clixon_err(OE_UNIX, errno, "malloc");
+        goto done;
+    }
+    sprintf(st->st_key, "%s:%s", dest, port);
+    if ((st->st_inbuf = cbuf_new()) == NULL ||
+        (st->st_outbuf = cbuf_new()) == NULL){
+        clixon_err(OE_UNIX, errno, "cbuf_new");
+        goto done;
+    }
+    if ((st->st_session = ssh_pool_take(h, st->st_key)) != NULL){
+        st->st_pooled = 1;
+        ssh_set_blocking(st->st_session, 0);
+        /* Skip connect and authentication, continue with new channel */
+        if ((st->st_channel = ssh_channel_new(st->st_session)) != NULL){
+            st->st_fd = ssh_get_fd(st->st_session);
+            if (ssh_transport_fd_reg(st, 1) < 0)
+                goto done;
+            st->st_state = STS_CHANNEL;
+            *reused = 1;
+        }
+        else if (ssh_transport_session_new(st) < 0)
+            goto done;
+    }
+    else if (ssh_transport_session_new(st) < 0)
+        goto done;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0){
+        clixon_err(OE_UNIX, errno, "socketpair");
+        goto done;
+    }
+    if (pipe(ep) < 0){
+        clixon_err(OE_UNIX, errno, "pipe");
+        goto done;
+    }
+    if (ssh_transport_cloexec(sv[0]) < 0 || ssh_transport_cloexec(sv[1]) < 0 ||
+        ssh_transport_cloexec(ep[0]) < 0 || ssh_transport_cloexec(ep[1]) < 0)
+        goto done;
+    if (fcntl(sv[1], F_SETFL, O_NONBLOCK) < 0){
+        clixon_err(OE_UNIX, errno, "fcntl");
+        goto done;
+    }
+    st->st_sock = sv[1];
+    st->st_err = ep[1];
+    sv[1] = ep[1] = -1;
+    if (ssh_transport_run(st) < 0)
+        goto done;
+    *transport = st;
+    st = NULL;
+    *sock = sv[0];
+    *sockerr = ep[0];
+    sv[0] = ep[0] = -1;
+    retval = 0;
+ done:
+    if (sv[0] != -1)
+        close(sv[0]);
+    if (sv[1] != -1)
+        close(sv[1]);
+    if (ep[0] != -1)
+        close(ep[0]);
+    if (ep[1] != -1)
+        close(ep[1]);
+    if (st)
+        ssh_transport_free(st);
+    return retval;
+}
+
+/*! Disconnect in-process SSH transport
+ *
+ * The device socket and error socket are closed by the caller
+ * If persist is set and the session is open, only the channel is closed and the authenticated
+ * session is kept for reuse by a later connect to the same destination.
+ * @param[in]  transport  Transport handle from clixon_client_connect_libssh
+ * @param[in]  persist    Keep session this many seconds, 0 disconnects
+ * @retval     0          OK
+ * @retval    -1          Error
+ */
+int
+clixon_client_disconnect_libssh(void *transport,
+                                int   persist)
+{
+    ssh_transport *st = (ssh_transport *)transport;
+
+    if (st == NULL){
+        clixon_err(OE_UNIX, EINVAL, "transport is NULL");
+        return -1;
+    }
+    if (persist > 0 && st->st_state == STS_OPEN && ssh_is_connected(st->st_session)){
+        ssh_channel_close(st->st_channel);
+        ssh_channel_free(st->st_channel);
+        st->st_channel = NULL;
+        if (ssh_transport_fd_reg(st, 0) < 0)
+            return -1;
+        if (ssh_pool_put(st, persist) < 0)
+            return -1;
+    }
+    return ssh_transport_free(st);
+}
+
+/*! Disconnect all kept sessions
+ *
+ * @param[in]  h  Clixon handle
+ * @retval     0  OK
+ */
+int
+clixon_client_libssh_pool_free(clixon_handle h)
+{
+    ssh_pooled *pool = NULL;
+    ssh_pooled *sp;
+
+    clicon_ptr_get(h, "controller-ssh-pool", (void**)&pool);
+    while ((sp = pool) != NULL){
+        DELQ(sp, pool, ssh_pooled *);
+        clixon_event_unreg_timeout(ssh_pooled_timeout, sp);
+        ssh_pooled_free(sp);
+    }
+    clicon_ptr_set(h, "controller-ssh-pool", NULL);
+    return 0;
+}
+
+#endif /* HAVE_LIBSSH */
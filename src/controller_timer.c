@@ -0,0 +1,406 @@
+/*
+ *
+  ***** BEGIN LICENSE BLOCK *****
+
+  Copyright (C) 2023 Olof Hagsand
+
+  This file is part of CLIXON.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  Alternatively, the contents of this file may be used under the terms of
+  the GNU General Public License Version 3 or later (the "GPL"),
+  in which case the provisions of the GPL are applicable instead
+  of those above. If you wish to allow use of your version of this file only
+  under the terms of the GPL, and not to allow others to
+  use your version of this file under the terms of Apache License version 2, indicate
+  your decision by deleting the provisions above and replace them with the
+  notice and other provisions required by the GPL. If you do not delete
+  the provisions above, a recipient may use your version of this file under
+  the terms of any one of the Apache License version 2 or the GPL.
+
+  ***** END LICENSE BLOCK *****
+  *
+  * Timer wheel for per-device timeouts
+  * Timers are hashed by expiry tick into a fixed number of slots, each a doubly linked
+  * list, so that set and cancel are constant time. Timers later than one revolution of
+  * the wheel stay in their slot until their tick comes around.
+  * One clixon event timeout is registered, at the first non-empty slot.
+  * No controller dependencies
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <syslog.h>
+#include <sys/time.h>
+
+/* clicon */
+#include <cligen/cligen.h>
+
+/* Clicon library functions. */
+#include <clixon/clixon.h>
+
+#include "controller_timer.h"
+
+/*! Number of slots of the timer wheel */
+#define TIMER_WHEEL_SLOTS 512
+
+/*! Time of one slot of the timer wheel in ms */
+#define TIMER_WHEEL_TICK  100
+
+/*! Timer wheel, one per clixon handle
+ */
+struct timer_wheel {
+    struct controller_timer *tw_slot[TIMER_WHEEL_SLOTS]; /* Timers by expiry tick modulo slots */
+    struct controller_timer *tw_expired;    /* Expired timers not yet called */
+    uint64_t                 tw_tick;       /* Next tick to expire */
+    uint64_t                 tw_next;       /* Tick of registered event timeout */
+    int                      tw_registered; /* Event timeout is registered */
+    int                      tw_nr;         /* Number of timers in slots or expired */
+};
+
+static int timer_wheel_expire(int s, void *arg);
+
+/*! Map absolute time to wheel tick
+ */
+static uint64_t
+timer_tick(struct timeval *t)
+{
+    return ((uint64_t)t->tv_sec*1000 + t->tv_usec/1000) / TIMER_WHEEL_TICK;
+}
+
+/*! Get timer wheel of handle, create if not exists
+ *
+ * @param[in]  h      Clixon handle
+ * @param[in]  create Create if not exists
+ * @retval     tw     Timer wheel
+ * @retval     NULL   Not found, or error
+ */
+static struct timer_wheel *
+timer_wheel_get(clixon_handle h,
+                int           create)
+{
+    struct timer_wheel *tw = NULL;
+    struct timeval      now;
+
+    if (clicon_ptr_get(h, "controller-timer-wheel", (void**)&tw) < 0 || tw == NULL){
+        if (!create)
+            return NULL;
+        if ((tw = calloc(1, sizeof(*tw))) == NULL){
+            clixon_err(OE_UNIX, errno, "calloc");
+            return NULL;
+        }
+        gettimeofday(&now, NULL);
+        tw->tw_tick = timer_tick(&now);
+        clicon_ptr_set(h, "controller-timer-wheel", (void*)tw);
+    }
+    return tw;
+}
+
+/*! Insert timer first in list
+ */
+static void
+timer_link(struct controller_timer **headp,
+           struct controller_timer  *tm)
+{
+    tm->tm_prev = NULL;
+    if ((tm->tm_next = *headp) != NULL)
+        tm->tm_next->tm_prev = tm;
+    *headp = tm;
+}
+
+/*! Remove timer from list
+ */
+static void
+timer_unlink(struct controller_timer **headp,
+             struct controller_timer  *tm)
+{
+    if (tm->tm_prev)
+        tm->tm_prev->tm_next = tm->tm_next;
+    else
+        *headp = tm->tm_next;
+    if (tm->tm_next)
+        tm->tm_next->tm_prev = tm->tm_prev;
+    tm->tm_next = NULL;
+    tm->tm_prev = NULL;
+}
+
+/*! Register event timeout of wheel at a tick, if earlier than registered
+ *
+ * @param[in]  h      Clixon handle
+ * @param[in]  tw     Timer wheel
+ * @param[in]  tick   Tick to expire
+ * @retval     0      OK
+ * @retval    -1      Error
+ */
+static int
+timer_wheel_register(clixon_handle       h,
+                     struct timer_wheel *tw,
+                     uint64_t            tick)
+{
+    int            retval = -1;
+    struct timeval t;
+    uint64_t       ms;
+
+    if (tw->tw_registered){
+        if (tw->tw_next <= tick)
+            goto ok;
+        (void)clixon_event_unreg_timeout(timer_wheel_expire, h);
+        tw->tw_registered = 0;
+    }
+    /* End of tick, a timer never expires early */
+    ms = (tick + 1)*TIMER_WHEEL_TICK;
+    t.tv_sec = ms/1000;
+    t.tv_usec = (ms%1000)*1000;
+    if (clixon_event_reg_timeout(t, timer_wheel_expire, h, "controller timer wheel") < 0)
+        goto done;
+    tw->tw_next = tick;
+    tw->tw_registered = 1;
+ ok:
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Register event timeout of wheel at first non-empty slot
+ *
+ * @param[in]  h      Clixon handle
+ * @param[in]  tw     Timer wheel
+ * @retval     0      OK
+ * @retval    -1      Error
+ */
+static int
+timer_wheel_schedule(clixon_handle       h,
+                     struct timer_wheel *tw)
+{
+    int retval = -1;
+    int i;
+
+    if (tw->tw_expired != NULL){
+        if (timer_wheel_register(h, tw, tw->tw_tick) < 0)
+            goto done;
+    }
+    else if (tw->tw_nr > 0){
+        for (i=0; i<TIMER_WHEEL_SLOTS; i++)
+            if (tw->tw_slot[(tw->tw_tick + i) % TIMER_WHEEL_SLOTS] != NULL)
+                break;
+        if (i < TIMER_WHEEL_SLOTS &&
+            timer_wheel_register(h, tw, tw->tw_tick + i) < 0)
+            goto done;
+    }
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Event timeout of wheel: call expired timers
+ *
+ * Expired timers are first moved from the slots, since a callback may set or cancel
+ * other timers.
+ * @param[in]  s     Not used
+ * @param[in]  arg   Clixon handle
+ * @retval     0     OK
+ * @retval    -1     Error
+ */
+static int
+timer_wheel_expire(int   s,
+                   void *arg)
+{
+    int                      retval = -1;
+    clixon_handle            h = (clixon_handle)arg;
+    struct timer_wheel      *tw;
+    struct controller_timer *tm;
+    struct controller_timer *tmnext;
+    struct timeval           now;
+    uint64_t                 tick;
+    uint64_t                 n;
+    uint64_t                 i;
+    int                      slot;
+
+    if ((tw = timer_wheel_get(h, 0)) == NULL)
+        goto ok;
+    tw->tw_registered = 0;
+    gettimeofday(&now, NULL);
+    tick = timer_tick(&now);
+    /* Expire ticks that have passed, all slots at most once */
+    if (tick > tw->tw_tick){
+        n = tick - tw->tw_tick;
+        if (n > TIMER_WHEEL_SLOTS)
+            n = TIMER_WHEEL_SLOTS;
+        for (i=0; i<n; i++){
+            slot = (tw->tw_tick + i) % TIMER_WHEEL_SLOTS;
+            tm = tw->tw_slot[slot];
+            while (tm != NULL){
+                tmnext = tm->tm_next;
+                /* Skip timers of a later revolution */
+                if (timer_tick(&tm->tm_expire) < tick){
+                    timer_unlink(&tw->tw_slot[slot], tm);
+                    timer_link(&tw->tw_expired, tm);
+                    tm->tm_state = 2;
+                }
+                tm = tmnext;
+            }
+        }
+        tw->tw_tick = tick;
+    }
+    while ((tm = tw->tw_expired) != NULL){
+        timer_unlink(&tw->tw_expired, tm);
+        tm->tm_state = 0;
+        tw->tw_nr--;
+        if (tm->tm_fn(h, tm->tm_arg) < 0)
+            goto done;
+    }
+ ok:
+    retval = 0;
+ done:
+    if (tw && timer_wheel_schedule(h, tw) < 0)
+        retval = -1;
+    return retval;
+}
+
+/*! Set timer, or reschedule if already set
+ *
+ * @param[in]  h      Clixon handle
+ * @param[in]  tm     Timer, zero-initialized or earlier set
+ * @param[in]  expire Absolute expiry time
+ * @param[in]  fn     Expiry callback
+ * @param[in]  arg    Argument of expiry callback
+ * @retval     0      OK
+ * @retval    -1      Error
+ */
+int
+controller_timer_set(clixon_handle            h,
+                     struct controller_timer *tm,
+                     struct timeval          *expire,
+                     controller_timer_cb     *fn,
+                     void                    *arg)
+{
+    int                 retval = -1;
+    struct timer_wheel *tw;
+    struct timeval      now;
+    uint64_t            tick;
+
+    if ((tw = timer_wheel_get(h, 1)) == NULL)
+        goto done;
+    if (controller_timer_cancel(h, tm) < 0)
+        goto done;
+    /* Idle wheel: start at current tick */
+    if (tw->tw_nr == 0 && !tw->tw_registered){
+        gettimeofday(&now, NULL);
+        tw->tw_tick = timer_tick(&now);
+    }
+    tm->tm_expire = *expire;
+    tm->tm_fn = fn;
+    tm->tm_arg = arg;
+    if ((tick = timer_tick(expire)) < tw->tw_tick)
+        tick = tw->tw_tick;
+    tm->tm_slot = tick % TIMER_WHEEL_SLOTS;
+    tm->tm_state = 1;
+    timer_link(&tw->tw_slot[tm->tm_slot], tm);
+    tw->tw_nr++;
+    if (timer_wheel_register(h, tw, tick) < 0)
+        goto done;
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Cancel timer if set
+ *
+ * The event timeout of the wheel is not changed, an empty slot is skipped when it expires
+ * @param[in]  h      Clixon handle
+ * @param[in]  tm     Timer
+ * @retval     0      OK
+ * @retval    -1      Error
+ */
+int
+controller_timer_cancel(clixon_handle            h,
+                        struct controller_timer *tm)
+{
+    struct timer_wheel *tw;
+
+    if (tm->tm_state == 0)
+        return 0;
+    if ((tw = timer_wheel_get(h, 0)) == NULL){
+        clixon_err(OE_UNIX, EINVAL, "Timer set without timer wheel");
+        return -1;
+    }
+    if (tm->tm_state == 1)
+        timer_unlink(&tw->tw_slot[tm->tm_slot], tm);
+    else
+        timer_unlink(&tw->tw_expired, tm);
+    tm->tm_state = 0;
+    tw->tw_nr--;
+    return 0;
+}
+
+/*! Check if timer is set
+ *
+ * @param[in]  tm     Timer
+ * @retval     1      Set, not yet called
+ * @retval     0      Idle
+ */
+int
+controller_timer_pending(struct controller_timer *tm)
+{
+    return tm->tm_state != 0;
+}
+
+/*! Get number of set timers
+ *
+ * @param[in]  h      Clixon handle
+ * @retval     nr     Number of set timers
+ */
+int
+controller_timer_nr(clixon_handle h)
+{
+    struct timer_wheel *tw;
+
+    if ((tw = timer_wheel_get(h, 0)) == NULL)
+        return 0;
+    return tw->tw_nr;
+}
+
+/*! Free timer wheel, timers still set are made idle
+ *
+ * @param[in]  h      Clixon handle
+ * @retval     0      OK
+ */
+int
+controller_timer_free_all(clixon_handle h)
+{
+    struct timer_wheel      *tw;
+    struct controller_timer *tm;
+    int                      i;
+
+    if ((tw = timer_wheel_get(h, 0)) == NULL)
+        return 0;
+    for (i=0; i<TIMER_WHEEL_SLOTS; i++)
+        while ((tm = tw->tw_slot[i]) != NULL){
+            timer_unlink(&tw->tw_slot[i], tm);
+            tm->tm_state = 0;
+        }
+    while ((tm = tw->tw_expired) != NULL){
+        timer_unlink(&tw->tw_expired, tm);
+        tm->tm_state = 0;
+    }
+    if (tw->tw_registered)
+        (void)clixon_event_unreg_timeout(timer_wheel_expire, h);
+    free(tw);
+    clicon_ptr_set(h, "controller-timer-wheel", NULL);
+    return 0;
+}
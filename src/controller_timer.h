@@ -0,0 +1,88 @@
+/*
+ *
+  ***** BEGIN LICENSE BLOCK *****
+
+  Copyright (C) 2023 Olof Hagsand
+
+  This file is part of CLIXON.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  Alternatively, the contents of this file may be used under the terms of
+  the GNU General Public License Version 3 or later (the "GPL"),
+  in which case the provisions of the GPL are applicable instead
+  of those above. If you wish to allow use of your version of this file only
+  under the terms of the GPL, and not to allow others to
+  use your version of this file under the terms of Apache License version 2, indicate
+  your decision by deleting the provisions above and replace them with the
+  notice and other provisions required by the GPL. If you do not delete
+  the provisions above, a recipient may use your version of this file under
+  the terms of any one of the Apache License version 2 or the GPL.
+
+  ***** END LICENSE BLOCK *****
+  *
+  * Timer wheel for per-device timeouts
+  * Each timer is owned by its user, eg embedded in a device handle, and can be
+  * rescheduled in constant time. Only one clixon event timeout is registered for the
+  * whole wheel.
+  * No controller dependencies
+  */
+
+#ifndef _CONTROLLER_TIMER_H
+#define _CONTROLLER_TIMER_H
+
+/*
+ * Types
+ */
+/*! Timer expiry callback
+ *
+ * @param[in]  h     Clixon handle
+ * @param[in]  arg   Argument given to controller_timer_set
+ * @retval     0     OK
+ * @retval    -1     Error
+ */
+typedef int (controller_timer_cb)(clixon_handle h, void *arg);
+
+/*! Timer, zero-initialized is idle
+ *
+ * Fields are private to controller_timer.c
+ */
+struct controller_timer {
+    struct controller_timer *tm_next;   /* Next timer in same slot */
+    struct controller_timer *tm_prev;   /* Previous timer in same slot */
+    struct timeval           tm_expire; /* Absolute expiry time */
+    int                      tm_state;  /* 0: idle, 1: in wheel slot, 2: expired, not yet called */
+    int                      tm_slot;   /* Slot in wheel if tm_state is 1 */
+    controller_timer_cb     *tm_fn;     /* Expiry callback */
+    void                    *tm_arg;    /* Argument of expiry callback */
+};
+
+/*
+ * Prototypes
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int controller_timer_set(clixon_handle h, struct controller_timer *tm, struct timeval *expire,
+                         controller_timer_cb *fn, void *arg);
+int controller_timer_cancel(clixon_handle h, struct controller_timer *tm);
+int controller_timer_pending(struct controller_timer *tm);
+int controller_timer_nr(clixon_handle h);
+int controller_timer_free_all(clixon_handle h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CONTROLLER_TIMER_H */
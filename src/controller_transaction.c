@@ -566,6 +566,8 @@ controller_transaction_free1(controller_transaction *ct)
         free(ct->ct_sourcedb);
     if (ct->ct_devices)
         cvec_free(ct->ct_devices);
+    if (ct->ct_device_reasons)
+        cvec_free(ct->ct_device_reasons);
     if (ct->ct_devdata)
         xml_free(ct->ct_devdata);
     free(ct);
@@ -579,7 +581,11 @@ controller_transaction_free(clixon_handle           h,
                             controller_transaction *ct)
 {
     controller_transaction *ct_list = NULL;
+    device_handle           dh;
 
+    /* Remaining devices leave transaction */
+    while ((dh = device_handle_each_tid(ct, NULL)) != NULL)
+        device_handle_tid_set(dh, 0);
     if (clicon_ptr_get(h, "controller-transaction-list", (void**)&ct_list) == 0){
         DELQ(ct, ct_list, controller_transaction *);
     }
@@ -595,9 +601,12 @@ controller_transaction_free_all(clixon_handle h)
 {
     controller_transaction *ct_list = NULL;
     controller_transaction *ct;
+    device_handle           dh;
 
     clicon_ptr_get(h, "controller-transaction-list", (void**)&ct_list);
     while ((ct = ct_list) != NULL) {
+        while ((dh = device_handle_each_tid(ct, NULL)) != NULL)
+            device_handle_tid_set(dh, 0);
         DELQ(ct, ct_list, controller_transaction *);
         controller_transaction_free1(ct);
     }
@@ -641,14 +650,9 @@ controller_transaction_done(clixon_handle           h,
                 goto done;
         }
     }
-    /* Unmark all devices */
-    dh = NULL;
-    while ((dh = device_handle_each(h, dh)) != NULL){
-        if (device_handle_tid_get(dh) == ct->ct_id)
-            device_handle_tid_set(dh, 0);
-        device_handle_outmsg_set(dh, 1, NULL);
-        device_handle_outmsg_set(dh, 2, NULL);
-    }
+    /* Unmark all devices, this also frees pending outmsgs */
+    while ((dh = device_handle_each_tid(ct, NULL)) != NULL)
+        device_handle_tid_set(dh, 0);
     /* This should be the only place */
     if (controller_transaction_notify(h, ct) < 0)
         goto done;
@@ -716,23 +720,23 @@ controller_transaction_find_bystate(clixon_handle     h,
 
 /*! Return number of devices in a specific transaction
  *
+ * Also requests dispatched by message-id to devices that are busy in other transactions are
+ * counted, the transaction is not done until they are replied or timed out.
  * @param[in]  h      Clixon handle
  * @param[in]  tid    Transaction id
- * @param[in]  state  In state (or -1 for any)
- * @retval     nr     Number of devices in transaction
+ * @retval     nr     Number of devices and outstanding requests in transaction
+ * @see device_handle_tid_set where members are counted
+ * @see device_handle_dispatch_add where requests are dispatched
  */
 int
 controller_transaction_nr_devices(clixon_handle h,
                                   uint64_t      tid)
 {
-    device_handle dh = NULL;
-    int           nr = 0;
+    controller_transaction *ct;
 
-    while ((dh = device_handle_each(h, dh)) != NULL){
-        if (device_handle_tid_get(dh) == tid)
-            nr++;
-    }
-    return nr;
+    if ((ct = controller_transaction_find(h, tid)) == NULL)
+        return 0;
+    return ct->ct_nr_members + ct->ct_nr_requests;
 }
 
 /*! Add device name to transation struct
@@ -764,6 +768,54 @@ controller_transaction_device_add(controller_transaction *ct,
     return retval;
 }
 
+/*! Set result of one device in transaction, only first result is kept
+ *
+ * @param[in] ct     Transaction
+ * @param[in] name   Device name
+ * @param[in] result Device result: TR_SUCCESS or TR_FAILED
+ * @param[in] reason Reason if failed, or NULL
+ * @retval    0      OK
+ * @retval   -1      Error
+ * @see PT_COMMIT_NONATOMIC where results are set
+ */
+int
+controller_transaction_device_result(controller_transaction *ct,
+                                     const char             *name,
+                                     transaction_result      result,
+                                     const char             *reason)
+{
+    int     retval = -1;
+    cg_var *cv;
+
+    if (controller_transaction_device_add(ct, name) < 0)
+        goto done;
+    if ((cv = cvec_find(ct->ct_devices, name)) == NULL ||
+        cv_string_get(cv) != NULL)
+        goto ok;
+    if (cv_string_set(cv, transaction_result_int2str(result)) == NULL){
+        clixon_err(OE_UNIX, errno, "cv_string_set");
+        goto done;
+    }
+    if (result != TR_FAILED)
+        goto ok;
+    ct->ct_nr_failed++;
+    if (reason){
+        if (ct->ct_device_reasons == NULL &&
+            (ct->ct_device_reasons = cvec_new(0)) == NULL){
+            clixon_err(OE_UNIX, errno, "cvec_new");
+            goto done;
+        }
+        if (cvec_add_string(ct->ct_device_reasons, (char*)name, (char*)reason) < 0){
+            clixon_err(OE_UNIX, errno, "cvec_add_string");
+            goto done;
+        }
+    }
+ ok:
+    retval = 0;
+ done:
+    return retval;
+}
+
 /*! A controller transaction (device) has failed
  *
  * This device failed, ie validation has failed, the device lost connection, etc
@@ -777,6 +829,7 @@ controller_transaction_device_add(controller_transaction *ct,
   * --> 1.3.1 Set transition in error state
   * If >= WAIT state
   * --> 1.3.2 For all other devices in WAIT state trigger DISCARD
+  * In a non-atomic push, only the device fails, 1.3 is made when the last device is done
  * @param[in]  h      Clixon handle
  * @param[in]  func   Inline function name
  * @param[in]  line   Inline file line number
@@ -798,10 +851,11 @@ controller_transaction_failed_fn(clixon_handle           h,
                                  controller_transaction *ct,
                                  device_handle           dh,
                                  tr_failed_devclose      devclose,
-                                 char                   *origin,
-                                 char                   *reason)
+                                 const char             *origin,
+                                 const char             *reason)
 {
     int retval = -1;
+    int nonatomic;
 
     if (ct == NULL){
         device_close_connection(dh, "Device not associated with transaction");
@@ -815,6 +869,24 @@ controller_transaction_failed_fn(clixon_handle           h,
                  devclose,
                  origin?origin:"NULL",
                  reason?reason:"NULL");
+    nonatomic = ct->ct_push_type == PT_COMMIT_NONATOMIC && dh != NULL &&
+        (ct->ct_state == TS_INIT || ct->ct_state == TS_ACTIONS);
+    if (nonatomic){
+        if (controller_transaction_device_result(ct, device_handle_name_get(dh), TR_FAILED, reason) < 0)
+            goto done;
+        if (origin && ct->ct_origin == NULL) {
+            if ((ct->ct_origin = strdup(origin)) == NULL){
+                clixon_err(OE_UNIX, errno, "strdup");
+                goto done;
+            }
+        }
+        if (reason && ct->ct_reason == NULL) {
+            if ((ct->ct_reason = strdup(reason)) == NULL){
+                clixon_err(OE_UNIX, errno, "strdup");
+                goto done;
+            }
+        }
+    }
     if (dh != NULL && devclose != TR_FAILED_DEV_IGNORE){
         if (devclose == TR_FAILED_DEV_CLOSE){
             /* 1.2 The error is not recoverable */
@@ -842,7 +914,9 @@ controller_transaction_failed_fn(clixon_handle           h,
                 goto done;
         }
     }
-    if (ct->ct_state == TS_INIT || ct->ct_state == TS_ACTIONS){
+    if (nonatomic)
+        ;
+    else if (ct->ct_state == TS_INIT || ct->ct_state == TS_ACTIONS){
         /* 1.3 The transition is not in an error state
            1.3.1 Set transition in error state */
         controller_transaction_state_set(ct, TS_RESOLVED, TR_FAILED);
@@ -881,28 +955,24 @@ int
 controller_transaction_wait(clixon_handle h,
                             uint64_t      tid)
 {
-    int           retval = -1;
-    device_handle dh;
-    int           notready = 0;
-    int           wait = 0;
-    int           other = 0;
+    int                     retval = -1;
+    controller_transaction *ct;
+    int                     notready = 0;
+    int                     wait = 0;
+    int                     other = 0;
 
-    dh = NULL;
-    while ((dh = device_handle_each(h, dh)) != NULL){
-        if (device_handle_tid_get(dh) != tid)
-            continue;
-        if (
-            device_handle_conn_state_get(dh) == CS_PUSH_LOCK ||
-            device_handle_conn_state_get(dh) == CS_PUSH_CHECK ||
-            device_handle_conn_state_get(dh) == CS_PUSH_EDIT ||
-            device_handle_conn_state_get(dh) == CS_PUSH_EDIT2 ||
-            device_handle_conn_state_get(dh) == CS_PUSH_VALIDATE)
-            notready++;
-        else if (device_handle_conn_state_get(dh) == CS_PUSH_WAIT)
-            wait++;
-        else
-            other++;
+    if ((ct = controller_transaction_find(h, tid)) == NULL){
+        retval = 0;
+        goto done;
     }
+    notready = ct->ct_nr_state[CS_PUSH_DIFF] +
+        ct->ct_nr_state[CS_PUSH_LOCK] +
+        ct->ct_nr_state[CS_PUSH_CHECK] +
+        ct->ct_nr_state[CS_PUSH_EDIT] +
+        ct->ct_nr_state[CS_PUSH_EDIT2] +
+        ct->ct_nr_state[CS_PUSH_VALIDATE];
+    wait = ct->ct_nr_state[CS_PUSH_WAIT];
+    other = ct->ct_nr_members - notready - wait;
     if ((notready||wait) && other){
         clixon_err(OE_YANG, 0, "Inconsistent states: (notready||wait) && other");
         goto done;
@@ -915,6 +985,44 @@ controller_transaction_wait(clixon_handle h,
     return retval;
 }
 
+/*! Send commit to a device in push, and unlock if pipelined
+ *
+ * @param[in]  h      Clixon handle
+ * @param[in]  ct     Transaction
+ * @param[in]  dh     Device handle, in state WAIT or VALIDATE
+ * @retval     0      OK
+ * @retval    -1      Error
+ */
+int
+controller_transaction_device_commit(clixon_handle           h,
+                                     controller_transaction *ct,
+                                     device_handle           dh)
+{
+    int      retval = -1;
+    uint64_t msgid;
+
+    msgid = device_handle_msg_id_get(dh);
+    if (device_send_commit(h, dh) < 0)
+        goto done;
+#ifndef CONTROLLER_EXTRA_PUSH_SYNC
+    if (ct->ct_push_pipeline){
+        /* Send unlock without waiting for commit reply */
+        if (device_handle_pipeline_add(dh, msgid, CS_PUSH_COMMIT) < 0)
+            goto done;
+        msgid = device_handle_msg_id_get(dh);
+        if (device_send_lock(h, dh, 0) < 0)
+            goto done;
+        if (device_handle_pipeline_add(dh, msgid, CS_PUSH_UNLOCK) < 0)
+            goto done;
+    }
+#endif
+    if (device_state_set(dh, CS_PUSH_COMMIT) < 0)
+        goto done;
+    retval = 0;
+ done:
+    return retval;
+}
+
 /*! For all devices in WAIT state trigger commit or discard
  *
  * @param[in]  h      Clixon handle
@@ -928,18 +1036,19 @@ controller_transaction_wait_trigger(clixon_handle h,
                                     uint64_t      tid,
                                     int           commit)
 {
-    int           retval = -1;
-    device_handle dh = NULL;
+    int                     retval = -1;
+    controller_transaction *ct;
+    device_handle           dh = NULL;
 
-    while ((dh = device_handle_each(h, dh)) != NULL){
-        if (device_handle_tid_get(dh) != tid)
-            continue;
+    if ((ct = controller_transaction_find(h, tid)) == NULL)
+        goto ok;
+    if (ct->ct_nr_state[CS_PUSH_WAIT] == 0)
+        goto ok;
+    while ((dh = device_handle_each_tid(ct, dh)) != NULL){
         if (device_handle_conn_state_get(dh) != CS_PUSH_WAIT)
             continue;
         if (commit){
-            if (device_send_commit(h, dh) < 0)
-                goto done;
-            if (device_state_set(dh, CS_PUSH_COMMIT) < 0)
+            if (controller_transaction_device_commit(h, ct, dh) < 0)
                 goto done;
         }
         else{
@@ -949,6 +1058,7 @@ controller_transaction_wait_trigger(clixon_handle h,
                 goto done;
         }
     }
+ ok:
     retval = 0;
  done:
     return retval;
@@ -975,6 +1085,8 @@ controller_transaction_statedata(clixon_handle h,
     controller_transaction *ct_list = NULL;
     controller_transaction *ct = NULL;
     cg_var                 *cv;
+    cg_var                 *cv1;
+    char                   *str;
 
     clixon_debug(CLIXON_DBG_CTRL|CLIXON_DBG_DETAIL, "");
     if ((cb = cbuf_new()) == NULL){
@@ -1002,8 +1114,18 @@ controller_transaction_statedata(clixon_handle h,
             if (ct->ct_devices){
                 cv = NULL;
                 cprintf(cb, "<devices>");
-                while ((cv = cvec_each(ct->ct_devices, cv)) != NULL)
-                    cprintf(cb, "<device><name>%s</name></device>", cv_name_get(cv));
+                while ((cv = cvec_each(ct->ct_devices, cv)) != NULL){
+                    cprintf(cb, "<device><name>%s</name>", cv_name_get(cv));
+                    if ((str = cv_string_get(cv)) != NULL)
+                        cprintf(cb, "<result>%s</result>", str);
+                    if (ct->ct_device_reasons &&
+                        (cv1 = cvec_find(ct->ct_device_reasons, cv_name_get(cv))) != NULL){
+                        cprintf(cb, "<reason>");
+                        xml_chardata_cbuf_append(cb, 0, cv_string_get(cv1));
+                        cprintf(cb, "</reason>");
+                    }
+                    cprintf(cb, "</device>");
+                }
                 cprintf(cb, "</devices>");
             }
             cprintf(cb, "<state>%s</state>", transaction_state_int2str(ct->ct_state));
@@ -1031,6 +1153,11 @@ controller_transaction_statedata(clixon_handle h,
                     goto done;
                 cprintf(cb, "<timestamp>%s</timestamp>", timestr);
             }
+            /* Progress: devices that have left vs still in transaction */
+            cprintf(cb, "<devices-pending>%d</devices-pending>", ct->ct_nr_members);
+            cprintf(cb, "<devices-queued>%d</devices-queued>", ct->ct_nr_state[CS_QUEUED]);
+            cprintf(cb, "<devices-completed>%d</devices-completed>",
+                    (ct->ct_devices?cvec_len(ct->ct_devices):0) - ct->ct_nr_members);
             cprintf(cb, "</transaction>");
             ct = NEXTQ(controller_transaction *, ct);
         } while (ct && ct != ct_list);
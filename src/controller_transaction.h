@@ -58,7 +58,9 @@ struct controller_transaction_t{
     char              *ct_username;      /* Client username creating the transaction */
     int                ct_pull_transient;/* pull: dont commit locally */
     int                ct_pull_merge;    /* pull: Merge instead of replace */
+    pull_commit_type   ct_pull_commit;   /* pull: Commit per transaction or per device */
     push_type          ct_push_type;     /* push to remote devices: Do not, validate, or commit */
+    int                ct_push_pipeline; /* push: Send requests back-to-back, see push-pipeline */
     actions_type       ct_actions_type;  /* How to trigger service-commit notifications,
                                             and thereby action scripts */
     char              *ct_sourcedb;      /* Source datastore (candidate or running)
@@ -69,7 +71,16 @@ struct controller_transaction_t{
     char              *ct_warning;       /* Warning, first encountered */
     struct timeval     ct_timestamp0;    /* Timestamp when created */
     struct timeval     ct_timestamp;     /* Timestamp when entering current state */
-    cvec              *ct_devices;       /* List of device name partaking in transaction */
+    cvec              *ct_devices;       /* List of device name partaking in transaction,
+                                            value is device result if set, see controller_transaction_device_result */
+    cvec              *ct_device_reasons; /* Reasons of failed devices, by device name */
+    int                ct_nr_failed;     /* Number of devices with result FAILED */
+    int                ct_local_commit;  /* Controller commit done in non-atomic push */
+    int                ct_push_started;  /* Number of devices sent edit-config in push */
+    void              *ct_members;       /* Device handles currently in transaction, see device_handle_tid_set */
+    int                ct_nr_members;    /* Number of devices currently in transaction */
+    int                ct_nr_requests;   /* Number of outstanding requests dispatched by message-id */
+    int                ct_nr_state[CS_NR]; /* Number of member devices in each connection state */
     cxobj             *ct_devdata;       /* Generic device data, eg CS_RPC_GENERIC */
 };
 typedef struct controller_transaction_t controller_transaction;
@@ -110,9 +121,12 @@ controller_transaction *controller_transaction_find(clixon_handle h, const uint6
 controller_transaction *controller_transaction_find_bystate(clixon_handle h, int neg, transaction_state state);
 int   controller_transaction_nr_devices(clixon_handle h, uint64_t tid);
 int   controller_transaction_device_add(controller_transaction *ct, const char *name);
+int   controller_transaction_device_result(controller_transaction *ct, const char *name,
+                                           transaction_result result, const char *reason);
+int   controller_transaction_device_commit(clixon_handle h, controller_transaction *ct, device_handle dh);
 int   controller_transaction_failed_fn(clixon_handle h, const char *func, const int line,
                                        uint64_t tid, controller_transaction *ct, device_handle dh,
-                                       tr_failed_devclose devclose, char *origin, char *reason);
+                                       tr_failed_devclose devclose, const char *origin, const char *reason);
 int   controller_transaction_wait(clixon_handle h, uint64_t tid);
 int   controller_transaction_wait_trigger(clixon_handle h, uint64_t tid, int commit);
 int   controller_transaction_statedata(clixon_handle h, cvec *nsc, char *xpath, cxobj *xstate);
@@ -0,0 +1,360 @@
+/*
+ *
+  ***** BEGIN LICENSE BLOCK *****
+
+  Copyright (C) 2023 Olof Hagsand
+
+  This file is part of CLIXON.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  Alternatively, the contents of this file may be used under the terms of
+  the GNU General Public License Version 3 or later (the "GPL"),
+  in which case the provisions of the GPL are applicable instead
+  of those above. If you wish to allow use of your version of this file only
+  under the terms of the GPL, and not to allow others to
+  use your version of this file under the terms of Apache License version 2, indicate
+  your decision by deleting the provisions above and replace them with the
+  notice and other provisions required by the GPL. If you do not delete
+  the provisions above, a recipient may use your version of this file under
+  the terms of any one of the Apache License version 2 or the GPL.
+
+  ***** END LICENSE BLOCK *****
+  *
+  * Pool of worker threads for CPU-bound jobs
+  * Jobs are queued by the main thread and run by the workers in any order. A finished job is
+  * handed to its done callback in the main thread, from the clixon event loop via a pipe.
+  * A job does not call clixon functions, the done callback may.
+  * The number of workers is push-threads. If 0, a job and its done callback are run directly
+  * when submitted.
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+/* clicon */
+#include <cligen/cligen.h>
+
+/* Clicon library functions. */
+#include <clixon/clixon.h>
+
+/* Controller includes */
+#include "controller.h"
+#include "controller_work.h"
+
+/*! Job, queued or finished
+ */
+struct work_job {
+    struct work_job         *wj_next;
+    controller_work_fn      *wj_fn;
+    controller_work_done_cb *wj_done;
+    void                    *wj_arg;
+};
+
+/*! Worker pool, one per clixon handle
+ */
+struct work_pool {
+    int              wp_nr;          /* Number of worker threads */
+    int              wp_started;     /* Number of started threads */
+    pthread_t       *wp_threads;
+    pthread_mutex_t  wp_lock;
+    pthread_cond_t   wp_todo_cond;   /* Signalled when job is queued or stop */
+    struct work_job *wp_todo;        /* Queued jobs */
+    struct work_job *wp_todo_tail;
+    struct work_job *wp_done;        /* Finished jobs */
+    struct work_job *wp_done_tail;
+    int              wp_outstanding; /* Submitted jobs not yet handed to done callback */
+    int              wp_stop;        /* Workers should exit */
+    int              wp_notify[2];   /* Pipe to wake main thread on finished job */
+};
+
+/*! Append job last in list
+ */
+static void
+work_append(struct work_job **headp,
+            struct work_job **tailp,
+            struct work_job  *wj)
+{
+    wj->wj_next = NULL;
+    if (*tailp)
+        (*tailp)->wj_next = wj;
+    else
+        *headp = wj;
+    *tailp = wj;
+}
+
+/*! Remove first job of list
+ */
+static struct work_job *
+work_pop(struct work_job **headp,
+         struct work_job **tailp)
+{
+    struct work_job *wj;
+
+    if ((wj = *headp) != NULL){
+        if ((*headp = wj->wj_next) == NULL)
+            *tailp = NULL;
+    }
+    return wj;
+}
+
+/*! Worker thread main loop: run queued jobs until stopped
+ *
+ * The main thread is woken when a job is finished and no other finished job is pending
+ * @param[in]  arg   Worker pool
+ */
+static void *
+work_worker_main(void *arg)
+{
+    struct work_pool *wp = (struct work_pool *)arg;
+    struct work_job  *wj;
+    int               wake;
+    char              c = 0;
+
+    pthread_mutex_lock(&wp->wp_lock);
+    for (;;){
+        while (wp->wp_todo == NULL && !wp->wp_stop)
+            pthread_cond_wait(&wp->wp_todo_cond, &wp->wp_lock);
+        if (wp->wp_stop)
+            break;
+        wj = work_pop(&wp->wp_todo, &wp->wp_todo_tail);
+        pthread_mutex_unlock(&wp->wp_lock);
+        wj->wj_fn(wj->wj_arg);
+        pthread_mutex_lock(&wp->wp_lock);
+        wake = (wp->wp_done == NULL);
+        work_append(&wp->wp_done, &wp->wp_done_tail, wj);
+        if (wake)
+            while (write(wp->wp_notify[1], &c, 1) < 0 && errno == EINTR)
+                ;
+    }
+    pthread_mutex_unlock(&wp->wp_lock);
+    return NULL;
+}
+
+/*! Hand finished jobs to their done callbacks in the main thread, called by event loop
+ *
+ * @param[in]  s     Notify pipe
+ * @param[in]  arg   Clixon handle
+ * @retval     0     OK
+ * @retval    -1     Error
+ */
+static int
+work_deliver(int   s,
+             void *arg)
+{
+    int               retval = -1;
+    clixon_handle     h = (clixon_handle)arg;
+    struct work_pool *wp = NULL;
+    struct work_job  *wj;
+    char              buf[64];
+    int               ret;
+
+    if (clicon_ptr_get(h, "controller-work-pool", (void**)&wp) < 0 || wp == NULL)
+        goto ok;
+    while (read(s, buf, sizeof(buf)) > 0)
+        ;
+    for (;;){
+        pthread_mutex_lock(&wp->wp_lock);
+        if ((wj = work_pop(&wp->wp_done, &wp->wp_done_tail)) != NULL)
+            wp->wp_outstanding--;
+        pthread_mutex_unlock(&wp->wp_lock);
+        if (wj == NULL)
+            break;
+        ret = wj->wj_done(h, wj->wj_arg, 0);
+        free(wj);
+        if (ret < 0)
+            goto done;
+    }
+ ok:
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Stop worker threads and free pool
+ *
+ * Jobs not handed to their done callbacks, queued or finished, are cancelled
+ * @param[in]  h     Clixon handle
+ * @param[in]  wp    Worker pool
+ */
+static void
+work_pool_free(clixon_handle     h,
+               struct work_pool *wp)
+{
+    struct work_job *wj;
+    int              i;
+
+    pthread_mutex_lock(&wp->wp_lock);
+    wp->wp_stop = 1;
+    pthread_cond_broadcast(&wp->wp_todo_cond);
+    pthread_mutex_unlock(&wp->wp_lock);
+    for (i=0; i<wp->wp_started; i++)
+        pthread_join(wp->wp_threads[i], NULL);
+    while ((wj = work_pop(&wp->wp_done, &wp->wp_done_tail)) != NULL ||
+           (wj = work_pop(&wp->wp_todo, &wp->wp_todo_tail)) != NULL){
+        wj->wj_done(h, wj->wj_arg, 1);
+        free(wj);
+    }
+    wp->wp_outstanding = 0;
+    if (wp->wp_notify[0] != -1){
+        clixon_event_unreg_fd(wp->wp_notify[0], work_deliver);
+        close(wp->wp_notify[0]);
+    }
+    if (wp->wp_notify[1] != -1)
+        close(wp->wp_notify[1]);
+    pthread_cond_destroy(&wp->wp_todo_cond);
+    pthread_mutex_destroy(&wp->wp_lock);
+    if (wp->wp_threads)
+        free(wp->wp_threads);
+    free(wp);
+}
+
+/*! Get worker pool, create or resize to nr workers if no jobs are outstanding
+ *
+ * Worker threads block all signals, signals are handled by the main thread
+ * @param[in]  h     Clixon handle
+ * @param[in]  nr    Number of workers, > 0
+ * @retval     wp    Worker pool
+ * @retval     NULL  Error
+ */
+static struct work_pool *
+work_pool_get(clixon_handle h,
+              int           nr)
+{
+    struct work_pool *wp = NULL;
+    sigset_t          all;
+    sigset_t          old;
+    int               i;
+    int               ret;
+
+    if (clicon_ptr_get(h, "controller-work-pool", (void**)&wp) == 0 && wp != NULL){
+        if (wp->wp_nr == nr || wp->wp_outstanding > 0)
+            return wp;
+        work_pool_free(h, wp);
+        clicon_ptr_set(h, "controller-work-pool", NULL);
+    }
+    if ((wp = calloc(1, sizeof(*wp))) == NULL){
+        clixon_err(OE_UNIX, errno, "calloc");
+        return NULL;
+    }
+    wp->wp_notify[0] = wp->wp_notify[1] = -1;
+    pthread_mutex_init(&wp->wp_lock, NULL);
+    pthread_cond_init(&wp->wp_todo_cond, NULL);
+    if (pipe(wp->wp_notify) < 0){
+        clixon_err(OE_UNIX, errno, "pipe");
+        goto err;
+    }
+    for (i=0; i<2; i++)
+        if (fcntl(wp->wp_notify[i], F_SETFL, O_NONBLOCK) < 0 ||
+            fcntl(wp->wp_notify[i], F_SETFD, FD_CLOEXEC) < 0){
+            clixon_err(OE_UNIX, errno, "fcntl");
+            goto err;
+        }
+    if (clixon_event_reg_fd(wp->wp_notify[0], work_deliver, h, "controller work threads") < 0)
+        goto err;
+    if ((wp->wp_threads = calloc(nr, sizeof(*wp->wp_threads))) == NULL){
+        clixon_err(OE_UNIX, errno, "calloc");
+        goto err;
+    }
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (wp->wp_nr=0; wp->wp_nr<nr; wp->wp_nr++){
+        if ((ret = pthread_create(&wp->wp_threads[wp->wp_nr], NULL, work_worker_main, wp)) != 0){
+            clixon_err(OE_UNIX, ret, "pthread_create");
+            break;
+        }
+        wp->wp_started++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (wp->wp_nr < nr)
+        goto err;
+    clixon_debug(CLIXON_DBG_CTRL, "%d work threads started", nr);
+    clicon_ptr_set(h, "controller-work-pool", (void*)wp);
+    return wp;
+ err:
+    work_pool_free(h, wp);
+    return NULL;
+}
+
+/*! Submit job to be run by a worker thread
+ *
+ * When the job is finished, done is called with arg by the main thread from the event loop.
+ * If push-threads is 0, the job and done are run directly.
+ * @param[in]  h     Clixon handle
+ * @param[in]  fn    Job function
+ * @param[in]  done  Done callback
+ * @param[in]  arg   Job argument, not accessed by the caller until done is called
+ * @retval     0     OK
+ * @retval    -1     Error, done is not called
+ */
+int
+controller_work_submit(clixon_handle            h,
+                       controller_work_fn      *fn,
+                       controller_work_done_cb *done,
+                       void                    *arg)
+{
+    int               retval = -1;
+    struct work_pool *wp;
+    struct work_job  *wj;
+    int               nr;
+
+    if ((nr = clicon_data_int_get(h, "controller-push-threads")) <= 0){
+        fn(arg);
+        return done(h, arg, 0);
+    }
+    if ((wp = work_pool_get(h, nr)) == NULL)
+        goto done;
+    if ((wj = calloc(1, sizeof(*wj))) == NULL){
+        clixon_err(OE_UNIX, errno, "calloc");
+        goto done;
+    }
+    wj->wj_fn = fn;
+    wj->wj_done = done;
+    wj->wj_arg = arg;
+    pthread_mutex_lock(&wp->wp_lock);
+    work_append(&wp->wp_todo, &wp->wp_todo_tail, wj);
+    wp->wp_outstanding++;
+    pthread_cond_signal(&wp->wp_todo_cond);
+    pthread_mutex_unlock(&wp->wp_lock);
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Stop worker threads and free worker pool
+ *
+ * Outstanding jobs are cancelled, see controller_work_done_cb
+ * @param[in]  h     Clixon handle
+ * @retval     0     OK
+ */
+int
+controller_work_free_all(clixon_handle h)
+{
+    struct work_pool *wp = NULL;
+
+    if (clicon_ptr_get(h, "controller-work-pool", (void**)&wp) < 0 || wp == NULL)
+        return 0;
+    work_pool_free(h, wp);
+    clicon_ptr_set(h, "controller-work-pool", NULL);
+    return 0;
+}
@@ -0,0 +1,77 @@
+/*
+ *
+  ***** BEGIN LICENSE BLOCK *****
+
+  Copyright (C) 2023 Olof Hagsand
+
+  This file is part of CLIXON.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  Alternatively, the contents of this file may be used under the terms of
+  the GNU General Public License Version 3 or later (the "GPL"),
+  in which case the provisions of the GPL are applicable instead
+  of those above. If you wish to allow use of your version of this file only
+  under the terms of the GPL, and not to allow others to
+  use your version of this file under the terms of Apache License version 2, indicate
+  your decision by deleting the provisions above and replace them with the
+  notice and other provisions required by the GPL. If you do not delete
+  the provisions above, a recipient may use your version of this file under
+  the terms of any one of the Apache License version 2 or the GPL.
+
+  ***** END LICENSE BLOCK *****
+  *
+  * Pool of worker threads for CPU-bound jobs on data not shared with other jobs
+  * Jobs are submitted by the main thread, and finished jobs are handed to a done callback in
+  * the main thread. A job must not call clixon functions with global state, such as
+  * datastore, plugin, error, log or xml functions.
+  */
+
+#ifndef _CONTROLLER_WORK_H
+#define _CONTROLLER_WORK_H
+
+/*
+ * Types
+ */
+/*! Job run by a worker thread, result is stored in arg
+ *
+ * @param[in]  arg   Argument given to controller_work_submit
+ */
+typedef void (controller_work_fn)(void *arg);
+
+/*! Done callback of a finished job, called by the main thread
+ *
+ * Also called for jobs left when the worker pool is freed, the job may then not have been run
+ * @param[in]  h      Clixon handle
+ * @param[in]  arg    Argument given to controller_work_submit, owned by the callback
+ * @param[in]  cancel 0: job is finished, 1: job is cancelled, only free arg and state
+ * @retval     0      OK
+ * @retval    -1      Error
+ */
+typedef int (controller_work_done_cb)(clixon_handle h, void *arg, int cancel);
+
+/*
+ * Prototypes
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int controller_work_submit(clixon_handle h, controller_work_fn *fn, controller_work_done_cb *done, void *arg);
+int controller_work_free_all(clixon_handle h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CONTROLLER_WORK_H */
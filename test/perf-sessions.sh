@@ -0,0 +1,103 @@
+#!/usr/bin/env bash
+# Benchmark memory and CPU of idle device sessions for each ssh-transport
+# Open perfnr sessions, round-robin to the device containers, with SUBPROCESS and LIBSSH
+# transports, and report RSS and CPU of the backend and its ssh sub-processes per 1000 sessions
+# Not run by all.sh, run for example as: perfnr=1000 ./perf-sessions.sh
+# LIBSSH requires a controller built with --with-libssh, otherwise SUBPROCESS is measured twice
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+# Number of sessions
+: ${perfnr:=100}
+
+# Idle period in seconds for CPU measurement
+: ${perfidle:=30}
+
+if [[ ! -v CONTAINERS ]]; then
+    err1 "CONTAINERS variable set" "not set"
+fi
+
+ips=($CONTAINERS)
+hz=$(getconf CLK_TCK)
+
+# Print RSS in kB and CPU ticks of backend and its ssh sub-processes
+function perf_sample(){
+    bpid=$(pgrep -o -x clixon_backend)
+    rss=0
+    ticks=0
+    for p in $bpid $(pgrep -P $bpid -x ssh); do
+        r=$(sudo awk '/VmRSS/{print $2}' /proc/$p/status)
+        t=$(sudo awk '{print $14+$15}' /proc/$p/stat)
+        rss=$((rss+r))
+        ticks=$((ticks+t))
+    done
+    echo "$rss $ticks"
+}
+
+for transport in SUBPROCESS LIBSSH; do
+    if $BE; then
+        new "Kill old backend"
+        stop_backend -f $CFG
+
+        new "Start new backend -s init -f $CFG"
+        start_backend -s init -f $CFG
+    fi
+
+    new "Wait backend"
+    wait_backend
+
+    read rss0 ticks0 <<< $(perf_sample)
+
+    new "Configure $perfnr devices with ssh-transport $transport"
+    cmds=$(mktemp)
+    echo "set devices ssh-transport $transport" > $cmds
+    for i in $(seq 1 $perfnr); do
+        ip=${ips[$(( (i-1) % ${#ips[@]} ))]}
+        echo "set devices device perf$i enabled true" >> $cmds
+        echo "set devices device perf$i conn-type NETCONF_SSH" >> $cmds
+        echo "set devices device perf$i user $USER" >> $cmds
+        echo "set devices device perf$i addr $ip" >> $cmds
+    done
+    echo "commit local" >> $cmds
+    $clixon_cli -f $CFG -m configure < $cmds > /dev/null
+    rm -f $cmds
+
+    new "Open $perfnr sessions"
+    t0=$(date +%s%N)
+    expectpart "$($clixon_cli -1 -f $CFG connection open)" 0 "^$"
+    for j in $(seq 1 600); do
+        res=$($clixon_cli -1 -f $CFG show connections | grep -c OPEN)
+        if [ "$res" -ge $perfnr ]; then
+            break
+        fi
+        sleep 1
+    done
+    if [ "$res" -lt $perfnr ]; then
+        err1 "$perfnr devices OPEN" "$res"
+    fi
+    t1=$(date +%s%N)
+
+    read rss1 ticks1 <<< $(perf_sample)
+    sleep $perfidle
+    read rss2 ticks2 <<< $(perf_sample)
+
+    echo "ssh-transport:        $transport"
+    echo "sessions:             $perfnr"
+    echo "connect time:         $(( (t1-t0)/1000000 )) ms"
+    echo "RSS per 1000 sessions: $(( (rss2-rss0)*1000/perfnr )) kB"
+    echo "CPU per 1000 idle sessions: $(( (ticks2-ticks1)*1000*1000/hz/perfnr/perfidle )) ms/s"
+
+    new "Close sessions"
+    expectpart "$($clixon_cli -1 -f $CFG connection close)" 0 "^$"
+
+    if $BE; then
+        new "Kill backend"
+        stop_backend -f $CFG
+    fi
+done
+
+unset perfnr
+unset perfidle
+
+endtest
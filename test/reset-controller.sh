@@ -15,6 +15,8 @@ set -u
 
 : ${EXTRA:=} # Extra top-level device config
 
+: ${DEVICES_EXTRA:=} # Extra config of all devices, eg <ssh-transport>LIBSSH</ssh-transport>
+
 REQ='<interfaces xmlns="http://openconfig.net/yang/interfaces"/>'
 # see reset-devices
 CONFIG='<interfaces xmlns="http://openconfig.net/yang/interfaces">'
@@ -44,6 +46,7 @@ function init_device_config()
     <default-operation>none</default-operation>
     <config>
       <devices xmlns="http://clicon.org/controller">
+        ${DEVICES_EXTRA}
 	<device nc:operation="replace">
 	  <name>$NAME</name>
 	  <enabled>true</enabled>
@@ -0,0 +1,90 @@
+#!/usr/bin/env bash
+# Change-token: a pull with unchanged token skips get-config, a changed token gets it
+# The token is the interfaces of each device
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+set -u
+
+CFG=${SYSCONFDIR}/clixon/controller.xml
+
+# Pull transient from all devices
+function pull_transient()
+{
+    new "Pull transient"
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+  <config-pull xmlns="http://clicon.org/controller">
+    <device>*</device>
+    <transient>true</transient>
+  </config-pull>
+</rpc>]]>]]>
+EOF
+       )
+    match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+    if [ -n "$match" ]; then
+        err1 "netconf rpc-error detected"
+    fi
+}
+
+# Reset devices with initial config
+. ./reset-devices.sh
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+
+    new "Start new backend -s init -f $CFG"
+    start_backend -s init -f $CFG
+fi
+
+new "Wait backend"
+wait_backend
+
+# Reset controller with change token of each device
+EXTRA="<change-token>/interfaces</change-token>"
+. ./reset-controller.sh
+
+new "pull, change token unchanged"
+expectpart "$($clixon_cli -1 -f $CFG pull 2>&1)" 0 "OK"
+
+new "show compare, expect NULL"
+expectpart "$($clixon_cli -1 -f $CFG -m configure show compare)" 0 "^$"
+
+# Change device configs on devices (not controller): remove x, change y and add z
+. ./change-devices.sh
+
+pull_transient
+
+new "Changed token: transient has device change"
+ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+  <get-device-config xmlns="http://clicon.org/controller">
+    <device>${IMG}1</device>
+    <config-type>TRANSIENT</config-type>
+  </get-device-config>
+</rpc>]]>]]>
+EOF
+      )
+match=$(echo "$ret" | grep --null -Eo "<interface><name>z</name>") || true
+if [ -z "$match" ]; then
+    err "<interface><name>z</name>" "$ret"
+fi
+
+new "Changed token: pull replace"
+expectpart "$($clixon_cli -1 -f $CFG pull replace 2>&1)" 0 "OK"
+
+new "Check device config after pull"
+expectpart "$($clixon_cli -1 -f $CFG show configuration xml devices device ${IMG}1 config interfaces)" 0 "<name>z</name>" --not-- "<name>x</name>"
+
+new "show compare, expect NULL"
+expectpart "$($clixon_cli -1 -f $CFG -m configure show compare)" 0 "^$"
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+fi
+
+sudo rm -rf $dir
+endtest
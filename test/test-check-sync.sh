@@ -0,0 +1,100 @@
+#!/usr/bin/env bash
+# Check-sync of devices using config digests
+# In sync after connect and transient pull, out of sync after changes on devices,
+# and in sync again after pull
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+set -u
+
+CFG=${SYSCONFDIR}/clixon/controller.xml
+
+# Check sync state of all devices with rpc check-sync
+# 1: Expected sync-state
+function check_sync()
+{
+    state=$1
+
+    new "check-sync expect $state"
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+  <check-sync xmlns="http://clicon.org/controller">
+    <device>*</device>
+  </check-sync>
+</rpc>]]>]]>
+EOF
+       )
+    match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+    if [ -n "$match" ]; then
+        err1 "netconf rpc-error detected"
+    fi
+    for i in $(seq 1 $nr); do
+        match=$(echo "$ret" | grep --null -Eo "<device><name>$IMG$i</name><sync-state>$state</sync-state></device>") || true
+        if [ -z "$match" ]; then
+            err "$IMG$i $state" "$ret"
+        fi
+    done
+}
+
+# Pull transient from all devices
+function pull_transient()
+{
+    new "Pull transient"
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+  <config-pull xmlns="http://clicon.org/controller">
+    <device>*</device>
+    <transient>true</transient>
+  </config-pull>
+</rpc>]]>]]>
+EOF
+       )
+    match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+    if [ -n "$match" ]; then
+        err1 "netconf rpc-error detected"
+    fi
+}
+
+# Reset devices with initial config
+. ./reset-devices.sh
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+
+    new "Start new backend -s init -f $CFG"
+    start_backend -s init -f $CFG
+fi
+
+new "Wait backend"
+wait_backend
+
+# Reset controller
+. ./reset-controller.sh
+
+pull_transient
+
+check_sync IN-SYNC
+
+# Change device configs on devices (not controller): remove x, change y and add z
+. ./change-devices.sh
+
+pull_transient
+
+check_sync OUT-OF-SYNC
+
+new "pull replace"
+expectpart "$($clixon_cli -1 -f $CFG pull replace 2>&1)" 0 "OK"
+
+pull_transient
+
+check_sync IN-SYNC
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+fi
+
+sudo rm -rf $dir
+endtest
@@ -0,0 +1,207 @@
+#!/usr/bin/env bash
+# Connect window: at most connect-window devices are connecting at the same time
+# 1. Connect all devices with connect-window 1, expect all open
+# 2. Occupy the window with a silent device: a local TCP listener that never sends an SSH
+#    banner, then open the other devices. Expect them QUEUED and counted in devices-queued
+#    of the transaction, and to drain and be open when the silent device times out
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+set -u
+
+CFG=${SYSCONFDIR}/clixon/controller.xml
+
+# Local port of silent device
+: ${PORT:=8311}
+
+# device-timeout of silent device in seconds
+: ${TMO:=5}
+
+# Get connection state of a device
+# 1: device name
+function get_conn_state()
+{
+    name=$1
+
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" xmlns:nc="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="42">
+   <get cl:content="all" xmlns:cl="http://clicon.org/lib">
+      <nc:filter nc:type="xpath" nc:select="co:devices/co:device[co:name='$name']/co:conn-state" xmlns:co="http://clicon.org/controller"/>
+   </get>
+</rpc>]]>]]>
+EOF
+       )
+}
+
+# Check device counters of last transaction
+# 1: devices-pending
+# 2: devices-queued
+# 3: devices-completed
+function check_last_transaction()
+{
+    pending=$1
+    queued=$2
+    completed=$3
+
+    new "Check last transaction pending:$pending queued:$queued completed:$completed"
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" xmlns:nc="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+   <get cl:content="all" xmlns:cl="http://clicon.org/lib">
+      <nc:filter nc:type="xpath" nc:select="co:transactions/co:transaction" xmlns:co="http://clicon.org/controller"/>
+   </get>
+</rpc>]]>]]>
+EOF
+       )
+    expect="<devices-pending>$pending</devices-pending><devices-queued>$queued</devices-queued><devices-completed>$completed</devices-completed>"
+    last=$(echo "$ret" | grep -Eo "<devices-pending>[0-9]+</devices-pending><devices-queued>[0-9]+</devices-queued><devices-completed>[0-9]+</devices-completed>" | tail -1) || true
+    if [ "$last" != "$expect" ]; then
+        err "$expect" "$ret"
+    fi
+}
+
+# Open device(s)
+# 1: device name or pattern
+function open_device()
+{
+    name=$1
+
+    new "Open $name"
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+   <connection-change xmlns="http://clicon.org/controller">
+      <device>$name</device>
+      <operation>OPEN</operation>
+   </connection-change>
+</rpc>]]>]]>
+EOF
+       )
+    match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+    if [ -n "$match" ]; then
+        err "OK" "$ret"
+    fi
+}
+
+# Reset devices with initial config
+. ./reset-devices.sh
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+
+    new "Start new backend -s init -f $CFG"
+    start_backend -s init -f $CFG
+fi
+
+new "Wait backend"
+wait_backend
+
+# 1. Reset controller, devices are connected one at a time
+DEVICES_EXTRA="<connect-window>1</connect-window>" . ./reset-controller.sh
+
+check_last_transaction 0 0 $nr
+
+new "Close connections"
+expectpart "$($clixon_cli -1 -f $CFG connection close)" 0 "^$"
+
+# 2. Occupy the window with a silent device
+new "Start silent device on port $PORT"
+python3 -c "
+import socket, time
+s = socket.socket()
+s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+s.bind(('127.0.0.1', $PORT))
+s.listen(8)
+time.sleep(6*$TMO)
+" &
+SPID=$!
+
+sleep 1
+
+new "Add silent device"
+ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="42">
+  <edit-config>
+    <target><candidate/></target>
+    <config>
+      <devices xmlns="http://clicon.org/controller">
+        <device-timeout>$TMO</device-timeout>
+        <device>
+          <name>silent</name>
+          <enabled>true</enabled>
+          <conn-type>NETCONF_SSH</conn-type>
+          <user>$USER</user>
+          <addr>127.0.0.1</addr>
+          <port>$PORT</port>
+          <config/>
+        </device>
+      </devices>
+    </config>
+  </edit-config>
+</rpc>]]>]]>
+EOF
+   )
+match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+if [ -n "$match" ]; then
+    err1 "netconf rpc-error detected"
+fi
+
+new "Local commit"
+expectpart "$($clixon_cli -1 -f $CFG -m configure commit local)" 0 "^$"
+
+open_device silent
+
+open_device "${IMG}*"
+
+sleep 1
+
+new "Check silent device CONNECTING"
+get_conn_state silent
+match=$(echo "$ret" | grep --null -Eo "<conn-state>CONNECTING</conn-state>") || true
+if [ -z "$match" ]; then
+    err "<conn-state>CONNECTING</conn-state>" "$ret"
+fi
+
+for i in $(seq 1 $nr); do
+    NAME=$IMG$i
+    new "Check $NAME QUEUED"
+    get_conn_state $NAME
+    match=$(echo "$ret" | grep --null -Eo "<conn-state>QUEUED</conn-state>") || true
+    if [ -z "$match" ]; then
+        err "<conn-state>QUEUED</conn-state>" "$ret"
+    fi
+done
+
+check_last_transaction $nr $nr 0
+
+# Silent device times out and frees the window
+sleep $TMO
+
+new "Check queued devices drained and open"
+sleep_open "" ""
+
+new "Check silent device CLOSED"
+get_conn_state silent
+match=$(echo "$ret" | grep --null -Eo "<conn-state>CLOSED</conn-state>") || true
+if [ -z "$match" ]; then
+    err "<conn-state>CLOSED</conn-state>" "$ret"
+fi
+
+check_last_transaction 0 0 $nr
+
+kill $SPID
+wait
+
+new "Restore device-timeout"
+expectpart "$($clixon_cli -1 -f $CFG -m configure set devices device-timeout 60)" 0 "^$"
+
+new "Local commit"
+expectpart "$($clixon_cli -1 -f $CFG -m configure commit local)" 0 "^$"
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+fi
+
+sudo rm -rf $dir
+endtest
@@ -0,0 +1,81 @@
+#!/usr/bin/env bash
+# Concurrent device RPCs to the same device
+# The first RPC puts the device in RPC_GENERIC, the following are sent on the same session
+# and their replies are dispatched by message-id. Check that all transactions succeed and
+# that the device is open afterwards
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+CFG=${SYSCONFDIR}/clixon/controller.xml
+
+dir=/var/tmp/$0
+test -d $dir || mkdir -p $dir
+
+# Reset devices with initial config
+. ./reset-devices.sh
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+
+    new "Start new backend -s init -f $CFG"
+    start_backend -s init -f $CFG
+fi
+
+new "Wait backend"
+wait_backend
+
+# Reset controller
+new "reset controller"
+(. ./reset-controller.sh)
+
+# Number of concurrent RPCs
+nr=4
+
+new "Send $nr device-rpc ping to ${IMG}1 in one session"
+rpcs=""
+for i in $(seq 1 $nr); do
+    rpcs="$rpcs<rpc xmlns=\"urn:ietf:params:xml:ns:netconf:base:1.0\" message-id=\"$i\"><device-rpc xmlns=\"http://clicon.org/controller\"><device>${IMG}1</device><config><ping xmlns=\"http://clicon.org/lib\"/></config></device-rpc></rpc>]]>]]>"
+done
+ret=$(echo "$rpcs" | ${clixon_netconf} -q0 -f $CFG)
+#echo "ret:$ret"
+
+match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+if [ -n "$match" ]; then
+    err "no rpc-error" "$ret"
+fi
+
+tids=$(echo "$ret" | grep -Eo "<tid[^>]*>[0-9]+</tid>" | grep -Eo ">[0-9]+<" | grep -Eo "[0-9]+") || true
+if [ $(echo "$tids" | wc -w) -ne $nr ]; then
+    err "$nr transaction-ids" "$ret"
+fi
+
+sleep $sleep
+
+for tid in $tids; do
+    new "Check transaction $tid succeeded"
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" xmlns:nc="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+   <get cl:content="all" xmlns:cl="http://clicon.org/lib">
+      <nc:filter nc:type="xpath" nc:select="co:transactions/co:transaction[co:tid='$tid']/co:result" xmlns:co="http://clicon.org/controller"/>
+   </get>
+</rpc>]]>]]>
+EOF
+       )
+    match=$(echo "$ret" | grep --null -Eo "<result>SUCCESS</result>") || true
+    if [ -z "$match" ]; then
+        err "<result>SUCCESS</result>" "$ret"
+    fi
+done
+
+new "Check ${IMG}1 open"
+expectpart "$($clixon_cli -1 -f $CFG show connect ${IMG}1)" 0 "OPEN " --not-- CLOSED RPC_GENERIC
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+fi
+
+sudo rm -rf $dir
+endtest
@@ -0,0 +1,178 @@
+#!/usr/bin/env bash
+# Device state timeouts on the controller timer wheel
+# Connect to a silent device: a local TCP listener that never sends an SSH banner, so the
+# device stays in CONNECTING until the state timeout fires.
+# 1. Short device-timeout: device is closed after the timeout
+# 2. device-timeout longer than the wheel span (51.2 s): device is not closed early, ie when
+#    the timer wraps the wheel, but after the timeout
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+set -u
+
+CFG=${SYSCONFDIR}/clixon/controller.xml
+
+# Local port of silent device
+: ${PORT:=8310}
+
+: ${SHORT:=2}   # Short device-timeout in seconds
+: ${LONG:=55}   # device-timeout in seconds longer than wheel span
+
+# Set device-timeout
+# 1: timeout in seconds
+function set_timeout()
+{
+    t=$1
+
+    new "Set device-timeout $t"
+    expectpart "$($clixon_cli -1 -f $CFG -m configure set devices device-timeout $t)" 0 "^$"
+
+    new "Local commit"
+    expectpart "$($clixon_cli -1 -f $CFG -m configure commit local)" 0 "^$"
+}
+
+# Open connection to silent device
+function open_silent()
+{
+    new "Open silent device"
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+   <connection-change xmlns="http://clicon.org/controller">
+      <device>silent</device>
+      <operation>OPEN</operation>
+   </connection-change>
+</rpc>]]>]]>
+EOF
+       )
+    match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+    if [ -n "$match" ]; then
+        err "OK" "$ret"
+    fi
+}
+
+# Check connection state of silent device
+# 1: Expected conn-state
+function check_silent()
+{
+    state=$1
+
+    new "Check silent device $state"
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" xmlns:nc="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+   <get cl:content="all" xmlns:cl="http://clicon.org/lib">
+      <nc:filter nc:type="xpath" nc:select="co:devices/co:device[co:name='silent']" xmlns:co="http://clicon.org/controller"/>
+   </get>
+</rpc>]]>]]>
+EOF
+       )
+    match=$(echo "$ret" | grep --null -Eo "<conn-state>$state</conn-state>") || true
+    if [ -z "$match" ]; then
+        err "<conn-state>$state</conn-state>" "$ret"
+    fi
+    if [ "$state" = CLOSED ]; then
+        match=$(echo "$ret" | grep --null -Eo "<logmsg>Timeout waiting for remote peer</logmsg>") || true
+        if [ -z "$match" ]; then
+            err "<logmsg>Timeout waiting for remote peer</logmsg>" "$ret"
+        fi
+    fi
+}
+
+# Reset devices with initial config
+. ./reset-devices.sh
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+
+    new "Start new backend -s init -f $CFG"
+    start_backend -s init -f $CFG
+fi
+
+new "Wait backend"
+wait_backend
+
+# Reset controller
+. ./reset-controller.sh
+
+new "Start silent device on port $PORT"
+python3 -c "
+import socket, time
+s = socket.socket()
+s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+s.bind(('127.0.0.1', $PORT))
+s.listen(8)
+time.sleep(3*$LONG)
+" &
+SPID=$!
+
+sleep 1
+
+new "Add silent device"
+ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="42">
+  <edit-config>
+    <target><candidate/></target>
+    <config>
+      <devices xmlns="http://clicon.org/controller">
+        <device>
+          <name>silent</name>
+          <enabled>true</enabled>
+          <conn-type>NETCONF_SSH</conn-type>
+          <user>$USER</user>
+          <addr>127.0.0.1</addr>
+          <port>$PORT</port>
+          <config/>
+        </device>
+      </devices>
+    </config>
+  </edit-config>
+</rpc>]]>]]>
+EOF
+   )
+match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+if [ -n "$match" ]; then
+    err1 "netconf rpc-error detected"
+fi
+
+# 1. Short timeout
+set_timeout $SHORT
+
+open_silent
+
+check_silent CONNECTING
+
+sleep $((SHORT+3))
+
+check_silent CLOSED
+
+# 2. Timeout longer than wheel span
+set_timeout $LONG
+
+open_silent
+
+# Not closed when the timer wraps the wheel, at about LONG-51.2 s
+sleep 10
+
+check_silent CONNECTING
+
+sleep $((LONG-10-5))
+
+check_silent CONNECTING
+
+sleep 10
+
+check_silent CLOSED
+
+kill $SPID
+wait
+
+set_timeout 60
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+fi
+
+sudo rm -rf $dir
+endtest
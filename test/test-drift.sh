@@ -0,0 +1,206 @@
+#!/usr/bin/env bash
+# Drift tracking from device netconf-config-change notifications
+# 1. drift-tracking: device config changes by others make devices OUT-OF-SYNC
+# 2. drift-trust: devices without notified changes are IN-SYNC without getting config
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+set -u
+
+CFG=${SYSCONFDIR}/clixon/controller.xml
+
+# Check sync state of all devices with rpc check-sync
+# 1: Expected sync-state
+function check_sync()
+{
+    state=$1
+
+    new "check-sync expect $state"
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+  <check-sync xmlns="http://clicon.org/controller">
+    <device>*</device>
+  </check-sync>
+</rpc>]]>]]>
+EOF
+       )
+    match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+    if [ -n "$match" ]; then
+        err1 "netconf rpc-error detected"
+    fi
+    for i in $(seq 1 $nr); do
+        match=$(echo "$ret" | grep --null -Eo "<device><name>$IMG$i</name><sync-state>$state</sync-state></device>") || true
+        if [ -z "$match" ]; then
+            err "$IMG$i $state" "$ret"
+        fi
+    done
+}
+
+# Check device state leaf of all devices, retry until notifications or sync-checks have arrived
+# 1: Leaf name
+# 2: Expected value
+# 3: Max seconds to wait (default 10)
+function check_state()
+{
+    leaf=$1
+    value=$2
+    jmax=${3:-10}
+
+    for j in $(seq 1 $jmax); do
+        new "Check $leaf is $value"
+        ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" xmlns:nc="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+   <get cl:content="all" xmlns:cl="http://clicon.org/lib">
+      <nc:filter nc:type="xpath" nc:select="co:devices/co:device/co:$leaf" xmlns:co="http://clicon.org/controller"/>
+   </get>
+</rpc>]]>]]>
+EOF
+           )
+        match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+        if [ -n "$match" ]; then
+            err1 "Error: $ret"
+        fi
+        res=$(echo "$ret" | sed "s/<\/$leaf>/<\/$leaf>\n/g" | grep "$IMG" | grep -c "<$leaf>$value</$leaf>") || true
+        if [ "$res" == "$nr" ]; then
+            break
+        fi
+        echo "retry after sleep"
+        sleep 1
+    done
+    if [ $j -eq $jmax ]; then
+        err "$nr devices $leaf $value" "$ret"
+    fi
+}
+
+# Change interface description directly on devices, not via controller
+# Interfaces are the change token, so the token changes
+# 1: description
+function change_description()
+{
+    desc=$1
+
+    i=1
+    for ip in $CONTAINERS; do
+        new "Change description on $IMG$i to $desc"
+        ret=$(ssh $ip ${SSHID} -l ${USER} -o StrictHostKeyChecking=no -o PasswordAuthentication=no -s netconf <<EOF
+<?xml version="1.0" encoding="UTF-8"?>
+<hello xmlns="urn:ietf:params:xml:ns:netconf:base:1.0">
+   <capabilities>
+      <capability>urn:ietf:params:netconf:base:1.0</capability>
+   </capabilities>
+</hello>]]>]]>
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="42">
+  <edit-config>
+    <target><candidate/></target>
+    <config>
+      <interfaces xmlns="http://openconfig.net/yang/interfaces"><interface><name>y</name><config><name>y</name><description>$desc</description></config></interface></interfaces>
+    </config>
+  </edit-config>
+</rpc>]]>]]>
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="42"><commit/></rpc>]]>]]>
+EOF
+           )
+        match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+        if [ -n "$match" ]; then
+            err "OK" "$ret"
+        fi
+        i=$((i+1))
+    done
+}
+
+# Pull transient from all devices
+function pull_transient()
+{
+    new "Pull transient"
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+  <config-pull xmlns="http://clicon.org/controller">
+    <device>*</device>
+    <transient>true</transient>
+  </config-pull>
+</rpc>]]>]]>
+EOF
+       )
+    match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+    if [ -n "$match" ]; then
+        err1 "netconf rpc-error detected"
+    fi
+}
+
+# Reset devices with initial config
+. ./reset-devices.sh
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+
+    new "Start new backend -s init -f $CFG"
+    start_backend -s init -f $CFG
+fi
+
+new "Wait backend"
+wait_backend
+
+# Reset controller with change token of each device
+EXTRA="<change-token>/interfaces</change-token>"
+. ./reset-controller.sh
+
+new "Enable drift-tracking"
+expectpart "$($clixon_cli -1 -f $CFG -m configure set devices drift-tracking true)" 0 "^$"
+
+new "Local commit"
+expectpart "$($clixon_cli -1 -f $CFG -m configure commit local)" 0 "^$"
+
+new "Reconnect to subscribe"
+expectpart "$($clixon_cli -1 -f $CFG connection reconnect)" 0 "^$"
+
+sleep_open "" ""
+
+check_state config-drift false
+
+# 1. drift-tracking
+. ./change-devices.sh
+
+check_state config-drift true
+
+# Notified changes are out of sync also without a transient pull
+check_sync OUT-OF-SYNC
+
+new "pull replace"
+expectpart "$($clixon_cli -1 -f $CFG pull replace 2>&1)" 0 "OK"
+
+check_state config-drift false
+
+pull_transient
+
+check_sync IN-SYNC
+
+# 2. drift-trust
+new "Enable drift-trust"
+expectpart "$($clixon_cli -1 -f $CFG -m configure set devices drift-trust true)" 0 "^$"
+
+new "Local commit"
+expectpart "$($clixon_cli -1 -f $CFG -m configure commit local)" 0 "^$"
+
+change_description drift
+
+check_state config-drift true
+
+check_sync OUT-OF-SYNC
+
+new "pull replace"
+expectpart "$($clixon_cli -1 -f $CFG pull replace 2>&1)" 0 "OK"
+
+check_state config-drift false
+
+# No transient pull after last change: in sync from notifications
+check_sync IN-SYNC
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+fi
+
+sudo rm -rf $dir
+endtest
@@ -0,0 +1,81 @@
+#!/usr/bin/env bash
+# Fast reconnect: reconnect devices with unchanged capabilities
+# Check that schema discovery is skipped on reconnect, ie no new SCHEMA-LIST latency sample,
+# and that the device config is still available via the reattached mount YANG spec
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+set -u
+
+CFG=${SYSCONFDIR}/clixon/controller.xml
+
+dir=/var/tmp/$0
+test -d $dir || mkdir -p $dir
+
+# Reset devices with initial config
+. ./reset-devices.sh
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+
+    new "Start new backend -s init -f $CFG"
+    start_backend -s init -f $CFG
+fi
+
+new "Wait backend"
+wait_backend
+
+# Reset controller
+. ./reset-controller.sh
+
+# Get number of latency samples of a connection state of device 1
+# Args:
+# 1: connection state
+function get_samples()
+{
+    state=$1
+
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" xmlns:nc="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="42">
+   <get>
+      <nc:filter nc:type="xpath" nc:select="co:devices/co:device[co:name='${IMG}1']/co:state-latency[co:state='$state']/co:samples" xmlns:co="http://clicon.org/controller"/>
+   </get>
+</rpc>]]>]]>
+EOF
+       )
+    samples=$(echo "$ret" | grep -Eo "<samples>[0-9]+</samples>" | grep -Eo "[0-9]+") || true
+}
+
+new "Get SCHEMA-LIST samples after connect"
+get_samples SCHEMA-LIST
+if [ -z "$samples" ]; then
+    err "<samples>" "$ret"
+fi
+samples0=$samples
+
+new "Close connections"
+expectpart "$($clixon_cli -1 -f $CFG connection close)" 0 "^$"
+
+new "Open connections"
+expectpart "$($clixon_cli -1 -f $CFG connection open)" 0 "^$"
+
+sleep_open "" ""
+
+new "Check no schema discovery on reconnect"
+get_samples SCHEMA-LIST
+if [ "$samples" != "$samples0" ]; then
+    err "<samples>$samples0</samples>" "$ret"
+fi
+
+new "Check device config after reconnect"
+expectpart "$($clixon_cli -1 -f $CFG show configuration xml devices device ${IMG}1 config system config)" 0 "<hostname>"
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+fi
+
+sudo rm -rf $dir
+endtest
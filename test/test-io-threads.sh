@@ -0,0 +1,127 @@
+#!/usr/bin/env bash
+# Device input read by io-threads workers and queued to the backend main thread
+# With one worker owning all devices, push large device configs and pull them several times,
+# so that the get-config replies of the devices together approach the bound of queued input.
+# Check that all pulls complete, the devices stay open and have the config
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+# Dont run this test with valgrind
+if [ $valgrindtest -ne 0 ]; then
+    echo "...skipped "
+    rm -rf $dir
+    return 0 # skip
+fi
+set -u
+
+CFG=${SYSCONFDIR}/clixon/controller.xml
+
+# Number of interfaces added to each device, each about 200 bytes in get-config reply
+: ${nrbig:=20000}
+
+# Number of pulls
+: ${nrpull:=5}
+
+# Reset devices with initial config
+. ./reset-devices.sh
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+
+    new "Start new backend -s init -f $CFG"
+    start_backend -s init -f $CFG
+fi
+
+new "Wait backend"
+wait_backend
+
+# Reset controller with one io-threads worker
+DEVICES_EXTRA="<io-threads>1</io-threads>" . ./reset-controller.sh
+
+BIG='<interfaces xmlns="http://openconfig.net/yang/interfaces">'
+for j in $(seq 1 $nrbig); do
+    BIG+="<interface><name>big$j</name><config><name>big$j</name><type xmlns:ianaift=\"urn:ietf:params:xml:ns:yang:iana-if-type\">ianaift:ethernetCsmacd</type></config></interface>"
+done
+BIG+='</interfaces>'
+
+for i in $(seq 1 $nr); do
+    NAME=$IMG$i
+    new "Add $nrbig interfaces to $NAME"
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="42">
+  <edit-config>
+    <target><candidate/></target>
+    <config>
+      <devices xmlns="http://clicon.org/controller">
+        <device>
+          <name>$NAME</name>
+          <config>
+            $BIG
+          </config>
+        </device>
+      </devices>
+    </config>
+  </edit-config>
+</rpc>]]>]]>
+EOF
+       )
+    match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+    if [ -n "$match" ]; then
+        err1 "netconf rpc-error detected"
+    fi
+done
+
+new "Commit push"
+expectpart "$($clixon_cli -1 -f $CFG -m configure commit push 2>&1)" 0 "OK" --not-- "Failed"
+
+for k in $(seq 1 $nrpull); do
+    new "Pull transient $k"
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+  <config-pull xmlns="http://clicon.org/controller">
+    <device>*</device>
+    <transient>true</transient>
+  </config-pull>
+</rpc>]]>]]>
+EOF
+          )
+    match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+    if [ -n "$match" ]; then
+        err1 "netconf rpc-error detected"
+    fi
+    sleep $sleep
+
+    for i in $(seq 1 $nr); do
+        NAME=$IMG$i
+        new "Check $NAME has last interface, pull $k"
+        ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+  <get-device-config xmlns="http://clicon.org/controller">
+    <device>$NAME</device>
+    <config-type>TRANSIENT</config-type>
+  </get-device-config>
+</rpc>]]>]]>
+EOF
+              )
+        match=$(echo "$ret" | grep --null -Eo "<interface><name>big$nrbig</name>") || true
+        if [ -z "$match" ]; then
+            err "<interface><name>big$nrbig</name>" "$ret"
+        fi
+    done
+done
+
+for i in $(seq 1 $nr); do
+    NAME=$IMG$i
+    new "Check $NAME open"
+    expectpart "$($clixon_cli -1 -f $CFG show connect $NAME)" 0 "OPEN " --not-- CLOSED
+done
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+fi
+
+sudo rm -rf $dir
+endtest
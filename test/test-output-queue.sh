@@ -0,0 +1,134 @@
+#!/usr/bin/env bash
+# Output queue and backpressure: push edit-configs larger than output-queue-limit
+# With a minimal output-queue-limit, edit-configs to devices are held back until output is
+# drained. Check that the push succeeds, no output is left queued and the devices have the config
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+set -u
+
+CFG=${SYSCONFDIR}/clixon/controller.xml
+
+# Number of interfaces added to each device, each about 200 bytes in edit-config
+: ${nrbig:=1000}
+
+# Reset devices with initial config
+. ./reset-devices.sh
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+
+    new "Start new backend -s init -f $CFG"
+    start_backend -s init -f $CFG
+fi
+
+new "Wait backend"
+wait_backend
+
+# Reset controller
+. ./reset-controller.sh
+
+new "Set minimal output-queue-limit"
+expectpart "$($clixon_cli -1 -f $CFG -m configure set devices output-queue-limit 65536)" 0 "^$"
+
+new "Local commit"
+expectpart "$($clixon_cli -1 -f $CFG -m configure commit local)" 0 "^$"
+
+BIG='<interfaces xmlns="http://openconfig.net/yang/interfaces">'
+for j in $(seq 1 $nrbig); do
+    BIG+="<interface><name>big$j</name><config><name>big$j</name><type xmlns:ianaift=\"urn:ietf:params:xml:ns:yang:iana-if-type\">ianaift:ethernetCsmacd</type></config></interface>"
+done
+BIG+='</interfaces>'
+
+for i in $(seq 1 $nr); do
+    NAME=$IMG$i
+    new "Add $nrbig interfaces to $NAME"
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="42">
+  <edit-config>
+    <target><candidate/></target>
+    <config>
+      <devices xmlns="http://clicon.org/controller">
+        <device>
+          <name>$NAME</name>
+          <config>
+            $BIG
+          </config>
+        </device>
+      </devices>
+    </config>
+  </edit-config>
+</rpc>]]>]]>
+EOF
+       )
+    match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+    if [ -n "$match" ]; then
+        err1 "netconf rpc-error detected"
+    fi
+done
+
+new "Commit push"
+expectpart "$($clixon_cli -1 -f $CFG -m configure commit push 2>&1)" 0 "OK" --not-- "Failed"
+
+new "Check no output queued"
+ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" xmlns:nc="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+   <get>
+      <nc:filter nc:type="xpath" nc:select="co:devices/co:device/co:output-queued" xmlns:co="http://clicon.org/controller"/>
+   </get>
+</rpc>]]>]]>
+EOF
+   )
+match=$(echo "$ret" | grep --null -Eo "<output-queued>") || true
+if [ -n "$match" ]; then
+    err "no output-queued" "$ret"
+fi
+
+for i in $(seq 1 $nr); do
+    NAME=$IMG$i
+    new "Check $NAME open"
+    expectpart "$($clixon_cli -1 -f $CFG show connect $NAME)" 0 "OPEN " --not-- CLOSED
+done
+
+new "Pull transient"
+ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+  <config-pull xmlns="http://clicon.org/controller">
+    <device>*</device>
+    <transient>true</transient>
+  </config-pull>
+</rpc>]]>]]>
+EOF
+      )
+match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+if [ -n "$match" ]; then
+    err1 "netconf rpc-error detected"
+fi
+
+for i in $(seq 1 $nr); do
+    NAME=$IMG$i
+    new "Check $NAME has last interface"
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+  <get-device-config xmlns="http://clicon.org/controller">
+    <device>$NAME</device>
+    <config-type>TRANSIENT</config-type>
+  </get-device-config>
+</rpc>]]>]]>
+EOF
+          )
+    match=$(echo "$ret" | grep --null -Eo "<interface><name>big$nrbig</name>") || true
+    if [ -z "$match" ]; then
+        err "<interface><name>big$nrbig</name>" "$ret"
+    fi
+done
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+fi
+
+sudo rm -rf $dir
+endtest
@@ -0,0 +1,118 @@
+#!/usr/bin/env bash
+# Pull with pull-commit DEVICE: each device config is committed to running as it arrives
+# Change device configs on devices, pull replace and merge, and check running
+# Then pull again with pull-commit TRANSACTION, expect same running
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+set -u
+
+CFG=${SYSCONFDIR}/clixon/controller.xml
+
+# Check device config in running of all devices
+# 1: Pattern expected in each device config
+# 2: Pattern not expected in each device config
+function check_running()
+{
+    expect=$1
+    notexpect=$2
+
+    for i in $(seq 1 $nr); do
+        NAME=$IMG$i
+        new "Check running of $NAME"
+        ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="42">
+  <get-config>
+    <source><running/></source>
+    <filter type='subtree'>
+      <devices xmlns="http://clicon.org/controller">
+        <device>
+          <name>$NAME</name>
+          <config>
+            <interfaces xmlns="http://openconfig.net/yang/interfaces"/>
+          </config>
+        </device>
+      </devices>
+    </filter>
+  </get-config>
+</rpc>]]>]]>
+EOF
+           )
+        match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+        if [ -n "$match" ]; then
+            err1 "netconf rpc-error detected"
+        fi
+        match=$(echo "$ret" | grep --null -Eo "$expect") || true
+        if [ -z "$match" ]; then
+            err "$expect" "$ret"
+        fi
+        match=$(echo "$ret" | grep --null -Eo "$notexpect") || true
+        if [ -n "$match" ]; then
+            err "not $notexpect" "$ret"
+        fi
+    done
+}
+
+# Reset devices with initial config
+. ./reset-devices.sh
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+
+    new "Start new backend -s init -f $CFG"
+    start_backend -s init -f $CFG
+fi
+
+new "Wait backend"
+wait_backend
+
+# Reset controller
+. ./reset-controller.sh
+
+new "Set pull-commit DEVICE"
+expectpart "$($clixon_cli -1 -f $CFG -m configure set devices pull-commit DEVICE)" 0 "^$"
+
+new "Local commit"
+expectpart "$($clixon_cli -1 -f $CFG -m configure commit local)" 0 "^$"
+
+check_running "<interface><name>x</name>" "<interface><name>z</name>"
+
+# Change device configs on devices (not controller): remove x, change y and add z
+. ./change-devices.sh
+
+new "pull replace"
+expectpart "$($clixon_cli -1 -f $CFG pull replace 2>&1)" 0 "OK"
+
+check_running "<interface><name>z</name>" "<interface><name>x</name>"
+
+new "show compare, expect NULL"
+expectpart "$($clixon_cli -1 -f $CFG -m configure show compare)" 0 "^$"
+
+new "pull merge"
+expectpart "$($clixon_cli -1 -f $CFG pull merge 2>&1)" 0 "OK"
+
+check_running "<interface><name>z</name>" "<interface><name>x</name>"
+
+new "Set pull-commit TRANSACTION"
+expectpart "$($clixon_cli -1 -f $CFG -m configure set devices pull-commit TRANSACTION)" 0 "^$"
+
+new "Local commit"
+expectpart "$($clixon_cli -1 -f $CFG -m configure commit local)" 0 "^$"
+
+new "pull replace"
+expectpart "$($clixon_cli -1 -f $CFG pull replace 2>&1)" 0 "OK"
+
+check_running "<interface><name>z</name>" "<interface><name>x</name>"
+
+new "show compare, expect NULL"
+expectpart "$($clixon_cli -1 -f $CFG -m configure show compare)" 0 "^$"
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+fi
+
+sudo rm -rf $dir
+endtest
@@ -0,0 +1,140 @@
+#!/usr/bin/env bash
+# Non-atomic push: each device is committed when it has validated
+# Lock candidate of 1st device directly on the device, edit 1st and 2nd device and push
+# COMMIT-NONATOMIC. Expect 1st device to fail and 2nd device to be committed, with the result
+# of each device in the transaction state
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+# Dont run this test with valgrind
+if [ $valgrindtest -ne 0 ]; then
+    echo "...skipped "
+    rm -rf $dir
+    return 0 # skip
+fi
+set -u
+
+CFG=${SYSCONFDIR}/clixon/controller.xml
+
+# Reset devices with initial config
+. ./reset-devices.sh
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+
+    new "Start new backend -s init -f $CFG"
+    start_backend -s init -f $CFG
+fi
+
+new "Wait backend"
+wait_backend
+
+# Reset controller
+. ./reset-controller.sh
+
+# Start a local blocking session to ${IMG}1
+for ip in $CONTAINERS; do
+    new "asynchronous lock candidate ${IMG}1"
+    sleep 60 |  cat <(echo "<?xml version=\"1.0\" encoding=\"UTF-8\"?><hello xmlns=\"urn:ietf:params:xml:ns:netconf:base:1.0\"><capabilities><capability>urn:ietf:params:netconf:base:1.0</capability></capabilities></hello>]]>]]><rpc xmlns=\"urn:ietf:params:xml:ns:netconf:base:1.0\" message-id=\"42\"><lock><target><candidate/></target></lock></rpc>]]>]]>") -| ssh ${SSHID} -l $USER $ip -o StrictHostKeyChecking=no -o PasswordAuthentication=no -s netconf &
+
+    PIDS=($(jobs -l % | cut -c 6- | awk '{print $1}'))
+    break
+done
+
+sleep 1
+
+new "Configure hostname on ${IMG}1 and ${IMG}2"
+expectpart "$($clixon_cli -1 -f $CFG -m configure set devices device ${IMG}* config system config hostname nonatomic)" 0 "^$"
+
+new "Commit nonatomic, expect ${IMG}1 failed"
+expectpart "$($clixon_cli -1 -f $CFG -m configure commit nonatomic 2>&1)" 0 "lock-denied" "Failed" --not-- "OK"
+
+kill ${PIDS[0]}                   # kill the sleep above to close STDIN on 1st
+wait
+
+sleep_open "" ""
+
+new "Get transaction state"
+ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" xmlns:nc="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+   <get cl:content="all" xmlns:cl="http://clicon.org/lib">
+      <nc:filter nc:type="xpath" nc:select="co:transactions/co:transaction" xmlns:co="http://clicon.org/controller"/>
+   </get>
+</rpc>]]>]]>
+EOF
+   )
+#echo "ret:$ret"
+match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+if [ -n "$match" ]; then
+    err1 "Error: $ret"
+fi
+
+new "Check ${IMG}1 failed"
+match=$(echo "$ret" | grep --null -Eo "<device><name>${IMG}1</name><result>FAILED</result><reason>[^<]*lock[^<]*</reason></device>") || true
+if [ -z "$match" ]; then
+    err "${IMG}1 FAILED" "$ret"
+fi
+
+new "Check ${IMG}2 succeeded"
+match=$(echo "$ret" | grep --null -Eo "<device><name>${IMG}2</name><result>SUCCESS</result></device>") || true
+if [ -z "$match" ]; then
+    err "${IMG}2 SUCCESS" "$ret"
+fi
+
+new "Pull transient"
+ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+  <config-pull xmlns="http://clicon.org/controller">
+    <device>*</device>
+    <transient>true</transient>
+  </config-pull>
+</rpc>]]>]]>
+EOF
+      )
+match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+if [ -n "$match" ]; then
+    err1 "netconf rpc-error detected"
+fi
+
+new "Check ${IMG}2 committed on device"
+ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+  <get-device-config xmlns="http://clicon.org/controller">
+    <device>${IMG}2</device>
+    <config-type>TRANSIENT</config-type>
+  </get-device-config>
+</rpc>]]>]]>
+EOF
+      )
+match=$(echo "$ret" | grep --null -Eo "<hostname>nonatomic</hostname>") || true
+if [ -z "$match" ]; then
+    err "<hostname>nonatomic</hostname>" "$ret"
+fi
+
+new "Check ${IMG}1 not committed on device"
+ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+  <get-device-config xmlns="http://clicon.org/controller">
+    <device>${IMG}1</device>
+    <config-type>TRANSIENT</config-type>
+  </get-device-config>
+</rpc>]]>]]>
+EOF
+      )
+match=$(echo "$ret" | grep --null -Eo "<hostname>nonatomic</hostname>") || true
+if [ -n "$match" ]; then
+    err "no hostname" "$ret"
+fi
+
+new "Push ${IMG}1 nonatomic again, lock released: OK"
+expectpart "$($clixon_cli -1 -f $CFG push ${IMG}1 nonatomic 2>&1)" 0 "OK" --not-- "Failed"
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+fi
+
+sudo rm -rf $dir
+endtest
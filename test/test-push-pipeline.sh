@@ -0,0 +1,112 @@
+#!/usr/bin/env bash
+# Pipelined push: lock and get-config, edit-config(s) and validate are sent back-to-back
+# Lock candidate of 1st device directly on the device, edit 1st and 2nd device and push.
+# Expect lock of 1st device to fail, the reply of the pipelined get-config to be dropped
+# and the 1st device to stay open. The 2nd device is discarded and unlocked.
+# Then release the lock and commit push again, expect OK, ie no device is left locked
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+# Dont run this test with valgrind
+if [ $valgrindtest -ne 0 ]; then
+    echo "...skipped "
+    rm -rf $dir
+    return 0 # skip
+fi
+set -u
+
+CFG=${SYSCONFDIR}/clixon/controller.xml
+
+# Reset devices with initial config
+. ./reset-devices.sh
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+
+    new "Start new backend -s init -f $CFG"
+    start_backend -s init -f $CFG
+fi
+
+new "Wait backend"
+wait_backend
+
+# Reset controller
+. ./reset-controller.sh
+
+new "Enable push-pipeline"
+expectpart "$($clixon_cli -1 -f $CFG -m configure set devices push-pipeline true)" 0 "^$"
+
+new "Local commit"
+expectpart "$($clixon_cli -1 -f $CFG -m configure commit local)" 0 "^$"
+
+# Start a local blocking session to ${IMG}1
+for ip in $CONTAINERS; do
+    new "asynchronous lock candidate ${IMG}1"
+    sleep 60 |  cat <(echo "<?xml version=\"1.0\" encoding=\"UTF-8\"?><hello xmlns=\"urn:ietf:params:xml:ns:netconf:base:1.0\"><capabilities><capability>urn:ietf:params:netconf:base:1.0</capability></capabilities></hello>]]>]]><rpc xmlns=\"urn:ietf:params:xml:ns:netconf:base:1.0\" message-id=\"42\"><lock><target><candidate/></target></lock></rpc>]]>]]>") -| ssh ${SSHID} -l $USER $ip -o StrictHostKeyChecking=no -o PasswordAuthentication=no -s netconf &
+
+    PIDS=($(jobs -l % | cut -c 6- | awk '{print $1}'))
+    break
+done
+
+sleep 1
+
+new "Configure hostname on ${IMG}1 and ${IMG}2"
+expectpart "$($clixon_cli -1 -f $CFG -m configure set devices device ${IMG}* config system config hostname pipeline)" 0 "^$"
+
+new "Commit push, expect ${IMG}1 lock failed"
+expectpart "$($clixon_cli -1 -f $CFG -m configure commit push 2>&1)" 0 "lock-denied" "Failed" --not-- "OK"
+
+kill ${PIDS[0]}                   # kill the sleep above to close STDIN on 1st
+wait
+
+new "Check ${IMG}1 open, get-config reply dropped"
+expectpart "$($clixon_cli -1 -f $CFG show connect ${IMG}1)" 0 "OPEN " --not-- CLOSED "message-id"
+
+new "Pull transient"
+ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+  <config-pull xmlns="http://clicon.org/controller">
+    <device>*</device>
+    <transient>true</transient>
+  </config-pull>
+</rpc>]]>]]>
+EOF
+      )
+match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+if [ -n "$match" ]; then
+    err1 "netconf rpc-error detected"
+fi
+
+new "Check ${IMG}2 discarded"
+ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+  <get-device-config xmlns="http://clicon.org/controller">
+    <device>${IMG}2</device>
+    <config-type>TRANSIENT</config-type>
+  </get-device-config>
+</rpc>]]>]]>
+EOF
+      )
+match=$(echo "$ret" | grep --null -Eo "<hostname>pipeline</hostname>") || true
+if [ -n "$match" ]; then
+    err "no hostname" "$ret"
+fi
+
+new "Commit push again, lock released and devices unlocked: OK"
+expectpart "$($clixon_cli -1 -f $CFG -m configure commit push 2>&1)" 0 "OK" --not-- "Failed"
+
+new "Check ${IMG}2 open"
+expectpart "$($clixon_cli -1 -f $CFG show connect ${IMG}2)" 0 "OPEN " --not-- CLOSED
+
+new "Show compare, expect NULL"
+expectpart "$($clixon_cli -1 -f $CFG -m configure show compare)" 0 "^$"
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+fi
+
+sudo rm -rf $dir
+endtest
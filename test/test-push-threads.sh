@@ -0,0 +1,162 @@
+#!/usr/bin/env bash
+# Push with config digests computed by worker threads, push-threads > 0
+# Push a change of both devices, then of one device, then no change, and check the
+# device configs and transaction results, and that all devices have completed the transactions
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+# Dont run this test with valgrind
+if [ $valgrindtest -ne 0 ]; then
+    echo "...skipped "
+    rm -rf $dir
+    return 0 # skip
+fi
+set -u
+
+CFG=${SYSCONFDIR}/clixon/controller.xml
+
+# Reset devices with initial config
+. ./reset-devices.sh
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+
+    new "Start new backend -s init -f $CFG"
+    start_backend -s init -f $CFG
+fi
+
+new "Wait backend"
+wait_backend
+
+# Reset controller with push worker threads
+DEVICES_EXTRA="<push-threads>2</push-threads>" . ./reset-controller.sh
+
+# Get config of device from controller after a transient pull
+# Args:
+# 1: device name
+function get_transient()
+{
+    name=$1
+
+    new "Pull transient"
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+  <config-pull xmlns="http://clicon.org/controller">
+    <device>*</device>
+    <transient>true</transient>
+  </config-pull>
+</rpc>]]>]]>
+EOF
+          )
+    match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+    if [ -n "$match" ]; then
+        err1 "netconf rpc-error detected"
+    fi
+    sleep $sleep
+    new "Get transient config of $name"
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+  <get-device-config xmlns="http://clicon.org/controller">
+    <device>$name</device>
+    <config-type>TRANSIENT</config-type>
+  </get-device-config>
+</rpc>]]>]]>
+EOF
+          )
+}
+
+# Check device counters of last transaction
+# Args:
+# 1: devices-pending
+# 2: devices-queued
+# 3: devices-completed
+function check_last_transaction()
+{
+    pending=$1
+    queued=$2
+    completed=$3
+
+    new "Check last transaction pending:$pending queued:$queued completed:$completed"
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" xmlns:nc="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+   <get cl:content="all" xmlns:cl="http://clicon.org/lib">
+      <nc:filter nc:type="xpath" nc:select="co:transactions/co:transaction" xmlns:co="http://clicon.org/controller"/>
+   </get>
+</rpc>]]>]]>
+EOF
+       )
+    expect="<devices-pending>$pending</devices-pending><devices-queued>$queued</devices-queued><devices-completed>$completed</devices-completed>"
+    last=$(echo "$ret" | grep -Eo "<devices-pending>[0-9]+</devices-pending><devices-queued>[0-9]+</devices-queued><devices-completed>[0-9]+</devices-completed>" | tail -1) || true
+    if [ "$last" != "$expect" ]; then
+        err "$expect" "$ret"
+    fi
+}
+
+new "Configure hostname on ${IMG}1 and ${IMG}2"
+expectpart "$($clixon_cli -1 -f $CFG -m configure set devices device ${IMG}* config system config hostname threads1)" 0 "^$"
+
+new "Commit push both devices"
+expectpart "$($clixon_cli -1 -f $CFG -m configure commit push 2>&1)" 0 "OK" --not-- "Failed"
+
+check_last_transaction 0 0 $nr
+
+for i in 1 2; do
+    get_transient ${IMG}$i
+    new "Check ${IMG}$i committed on device"
+    match=$(echo "$ret" | grep --null -Eo "<hostname>threads1</hostname>") || true
+    if [ -z "$match" ]; then
+        err "<hostname>threads1</hostname>" "$ret"
+    fi
+done
+
+new "Configure hostname on ${IMG}2 only"
+expectpart "$($clixon_cli -1 -f $CFG -m configure set devices device ${IMG}2 config system config hostname threads2)" 0 "^$"
+
+new "Commit push one device"
+expectpart "$($clixon_cli -1 -f $CFG -m configure commit push 2>&1)" 0 "OK" --not-- "Failed"
+
+check_last_transaction 0 0 $nr
+
+get_transient ${IMG}1
+new "Check ${IMG}1 unchanged on device"
+match=$(echo "$ret" | grep --null -Eo "<hostname>threads1</hostname>") || true
+if [ -z "$match" ]; then
+    err "<hostname>threads1</hostname>" "$ret"
+fi
+
+get_transient ${IMG}2
+new "Check ${IMG}2 committed on device"
+match=$(echo "$ret" | grep --null -Eo "<hostname>threads2</hostname>") || true
+if [ -z "$match" ]; then
+    err "<hostname>threads2</hostname>" "$ret"
+fi
+
+new "Push without changes"
+$clixon_cli -1 -f $CFG push > /dev/null 2>&1 || true
+
+new "Check transaction without changes"
+ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" xmlns:nc="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+   <get cl:content="all" xmlns:cl="http://clicon.org/lib">
+      <nc:filter nc:type="xpath" nc:select="co:transactions/co:transaction/co:reason" xmlns:co="http://clicon.org/controller"/>
+   </get>
+</rpc>]]>]]>
+EOF
+   )
+match=$(echo "$ret" | grep --null -Eo "No changes to push") || true
+if [ -z "$match" ]; then
+    err "No changes to push" "$ret"
+fi
+
+new "Check devices are OPEN after push"
+sleep_open "" ""
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+fi
+
+sudo rm -rf $dir
+endtest
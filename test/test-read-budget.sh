@@ -0,0 +1,178 @@
+#!/usr/bin/env bash
+# Read budgets: input from a device is read in slices of read-budget bytes or read-time-budget
+# milliseconds per wakeup
+# 1. Values outside of range are rejected
+# 2. With minimal budgets, push and pull device configs much larger than the budget and check
+#    that the transactions complete and the devices have the config
+# 3. Same with maximal budgets
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+set -u
+
+CFG=${SYSCONFDIR}/clixon/controller.xml
+
+# Number of interfaces added to each device, each about 200 bytes in get-config reply
+: ${nrbig:=1000}
+
+# Set read budgets
+# 1: read-budget in bytes
+# 2: read-time-budget in milliseconds
+function set_budget()
+{
+    budget=$1
+    tbudget=$2
+
+    new "Set read-budget $budget"
+    expectpart "$($clixon_cli -1 -f $CFG -m configure set devices read-budget $budget)" 0 "^$"
+
+    new "Set read-time-budget $tbudget"
+    expectpart "$($clixon_cli -1 -f $CFG -m configure set devices read-time-budget $tbudget)" 0 "^$"
+
+    new "Local commit"
+    expectpart "$($clixon_cli -1 -f $CFG -m configure commit local)" 0 "^$"
+}
+
+# Push interfaces big1..n to all devices, pull and check last interface
+# 1: number of interfaces
+function push_pull()
+{
+    n=$1
+
+    new "Configure $n interfaces"
+    BIG='<interfaces xmlns="http://openconfig.net/yang/interfaces">'
+    for j in $(seq 1 $n); do
+        BIG+="<interface><name>big$j</name><config><name>big$j</name><type xmlns:ianaift=\"urn:ietf:params:xml:ns:yang:iana-if-type\">ianaift:ethernetCsmacd</type></config></interface>"
+    done
+    BIG+='</interfaces>'
+
+    for i in $(seq 1 $nr); do
+        NAME=$IMG$i
+        new "Add $n interfaces to $NAME"
+        ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="42">
+  <edit-config>
+    <target><candidate/></target>
+    <config>
+      <devices xmlns="http://clicon.org/controller">
+        <device>
+          <name>$NAME</name>
+          <config>
+            $BIG
+          </config>
+        </device>
+      </devices>
+    </config>
+  </edit-config>
+</rpc>]]>]]>
+EOF
+           )
+        match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+        if [ -n "$match" ]; then
+            err1 "netconf rpc-error detected"
+        fi
+    done
+
+    new "Commit push"
+    expectpart "$($clixon_cli -1 -f $CFG -m configure commit push 2>&1)" 0 "OK" --not-- "Failed"
+
+    new "Pull transient"
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+  <config-pull xmlns="http://clicon.org/controller">
+    <device>*</device>
+    <transient>true</transient>
+  </config-pull>
+</rpc>]]>]]>
+EOF
+          )
+    match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+    if [ -n "$match" ]; then
+        err1 "netconf rpc-error detected"
+    fi
+
+    for i in $(seq 1 $nr); do
+        NAME=$IMG$i
+        new "Check $NAME has interface big$n"
+        ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+  <get-device-config xmlns="http://clicon.org/controller">
+    <device>$NAME</device>
+    <config-type>TRANSIENT</config-type>
+  </get-device-config>
+</rpc>]]>]]>
+EOF
+              )
+        match=$(echo "$ret" | grep --null -Eo "<interface><name>big$n</name>") || true
+        if [ -z "$match" ]; then
+            err "<interface><name>big$n</name>" "$ret"
+        fi
+
+        new "Check $NAME open"
+        expectpart "$($clixon_cli -1 -f $CFG show connect $NAME)" 0 "OPEN " --not-- CLOSED
+    done
+}
+
+# Reset devices with initial config
+. ./reset-devices.sh
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+
+    new "Start new backend -s init -f $CFG"
+    start_backend -s init -f $CFG
+fi
+
+new "Wait backend"
+wait_backend
+
+# Reset controller
+. ./reset-controller.sh
+
+# 1. Out of range
+for v in "read-budget 8191" "read-time-budget 0" "read-time-budget 60001"; do
+    set -- $v
+    new "Set $1 $2 out of range"
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="42">
+  <edit-config>
+    <target><candidate/></target>
+    <config>
+      <devices xmlns="http://clicon.org/controller">
+        <$1>$2</$1>
+      </devices>
+    </config>
+  </edit-config>
+</rpc>]]>]]>
+EOF
+       )
+    match=$(echo "$ret" | grep --null -Eo "<rpc-error>.*range") || true
+    if [ -z "$match" ]; then
+        err "<rpc-error> out of range" "$ret"
+    fi
+done
+
+new "Discard"
+expectpart "$($clixon_cli -1 -f $CFG -m configure discard)" 0 "^$"
+
+# 2. Minimal budgets
+set_budget 8192 1
+
+push_pull $nrbig
+
+# 3. Maximal budgets
+set_budget 2147483647 60000
+
+push_pull $((nrbig*2))
+
+set_budget 4194304 50
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+fi
+
+sudo rm -rf $dir
+endtest
@@ -0,0 +1,168 @@
+#!/usr/bin/env bash
+# Schemas shared by devices are fetched once, and handed over if the fetching device is closed
+# Connect devices with the same yang-lib and an empty YANG domain dir, with schema-window 1
+# so that schemas are downloaded one at a time.
+# Close the 1st device while it is downloading schemas and the 2nd device waits for them.
+# Expect the 2nd device to fetch the remaining schemas itself and be open, and all schemas
+# to be downloaded
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+set -u
+
+CFG=${SYSCONFDIR}/clixon/controller.xml
+dir=/var/tmp/$0
+CFD=$dir/conf.d
+mntdir0=$dir/mounts
+mntdir=$mntdir0/default
+test -d $CFD || mkdir -p $CFD
+sudo rm -rf $mntdir0
+mkdir -p $mntdir0
+
+# Specialize controller.xml
+cat<<EOF > $CFD/diff.xml
+<?xml version="1.0" encoding="utf-8"?>
+<clixon-config xmlns="http://clicon.org/config">
+  <CLICON_CONFIGDIR>$CFD</CLICON_CONFIGDIR>
+  <CLICON_YANG_DIR>$dir</CLICON_YANG_DIR>
+  <CLICON_YANG_MAIN_DIR>${DATADIR}/controller/main</CLICON_YANG_MAIN_DIR>
+  <CLICON_YANG_DOMAIN_DIR>$mntdir0</CLICON_YANG_DOMAIN_DIR>
+</clixon-config>
+EOF
+
+cp ../src/autocli.xml $CFD/
+
+# Get connection state of a device
+# 1: device name
+function get_conn_state()
+{
+    name=$1
+
+    ret=$(${clixon_netconf} -q0 -f $CFG -E $CFD <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" xmlns:nc="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="42">
+   <get cl:content="all" xmlns:cl="http://clicon.org/lib">
+      <nc:filter nc:type="xpath" nc:select="co:devices/co:device[co:name='$name']/co:conn-state" xmlns:co="http://clicon.org/controller"/>
+   </get>
+</rpc>]]>]]>
+EOF
+       )
+    state=$(echo "$ret" | grep -Eo "<conn-state>[^<]*</conn-state>" | sed -e 's/<[^>]*>//g') || true
+}
+
+# Change connection of device(s)
+# 1: device name or pattern
+# 2: operation: OPEN or CLOSE
+function connection_change()
+{
+    name=$1
+    op=$2
+
+    new "Connection $op $name"
+    ret=$(${clixon_netconf} -q0 -f $CFG -E $CFD <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+   <connection-change xmlns="http://clicon.org/controller">
+      <device>$name</device>
+      <operation>$op</operation>
+   </connection-change>
+</rpc>]]>]]>
+EOF
+       )
+    match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+    if [ -n "$match" ]; then
+        err "OK" "$ret"
+    fi
+}
+
+# Reset devices with initial config
+. ./reset-devices.sh
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG -E $CFD
+
+    new "Start new backend -s init -f $CFG -E $CFD"
+    start_backend -s init -f $CFG -E $CFD
+fi
+
+new "Wait backend"
+wait_backend
+
+# Reset controller, download schemas one at a time
+DEVICES_EXTRA="<schema-window>1</schema-window>" . ./reset-controller.sh
+
+nfiles=$(ls $mntdir | wc -l)
+
+new "Close connections"
+connection_change "*" CLOSE
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG -E $CFD
+
+    new "Remove downloaded schemas"
+    sudo rm -rf $mntdir
+
+    new "Start new backend -s running -f $CFG -E $CFD"
+    start_backend -s running -f $CFG -E $CFD
+
+    new "Wait backend"
+    wait_backend
+fi
+
+connection_change "${IMG}*" OPEN
+
+new "Wait for ${IMG}1 downloading schemas"
+jmax=100
+for j in $(seq 1 $jmax); do
+    get_conn_state ${IMG}1
+    if [ "$state" = SCHEMA_ONE ]; then
+        break
+    fi
+    sleep 0.1
+done
+if [ $j -eq $jmax ]; then
+    err "SCHEMA_ONE" "$state"
+fi
+
+connection_change ${IMG}1 CLOSE
+
+new "Wait for ${IMG}2 open"
+jmax=20
+for j in $(seq 1 $jmax); do
+    get_conn_state ${IMG}2
+    if [ "$state" = OPEN ]; then
+        break
+    fi
+    sleep 1
+done
+if [ $j -eq $jmax ]; then
+    err "OPEN" "$state"
+fi
+
+new "Check ${IMG}1 closed"
+get_conn_state ${IMG}1
+if [ "$state" != CLOSED ]; then
+    err "CLOSED" "$state"
+fi
+
+new "Check all schemas downloaded"
+n=$(ls $mntdir | wc -l)
+if [ $n -ne $nfiles ]; then
+    err "$nfiles schema files" "$n: $(ls $mntdir)"
+fi
+
+new "Check ${IMG}2 config"
+expectpart "$($clixon_cli -1 -f $CFG -E $CFD show configuration xml devices device ${IMG}2 config interfaces)" 0 "<interface>" "<name>x</name>"
+
+connection_change ${IMG}1 OPEN
+
+sleep_open "$CFD" ""
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG -E $CFD
+fi
+
+sudo rm -rf $dir
+endtest
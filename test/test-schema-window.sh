@@ -0,0 +1,108 @@
+#!/usr/bin/env bash
+# Pipelined get-schema with a small schema-window
+# Connect devices with an empty YANG domain dir so that all device schemas are downloaded,
+# at most schema-window get-schema requests outstanding per device.
+# Check that the devices are open, that all openconfig schemas of the device yang-library
+# have arrived in the domain dir, and that the device config is available
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+set -u
+
+CFG=${SYSCONFDIR}/clixon/controller.xml
+dir=/var/tmp/$0
+CFD=$dir/conf.d
+mntdir0=$dir/mounts
+mntdir=$mntdir0/default
+test -d $CFD || mkdir -p $CFD
+sudo rm -rf $mntdir0
+mkdir -p $mntdir0
+
+# Small window, less than number of schemas of a device
+: ${window:=2}
+
+# Specialize controller.xml
+cat<<EOF > $CFD/diff.xml
+<?xml version="1.0" encoding="utf-8"?>
+<clixon-config xmlns="http://clicon.org/config">
+  <CLICON_CONFIGDIR>$CFD</CLICON_CONFIGDIR>
+  <CLICON_YANG_DIR>$dir</CLICON_YANG_DIR>
+  <CLICON_YANG_MAIN_DIR>${DATADIR}/controller/main</CLICON_YANG_MAIN_DIR>
+  <CLICON_YANG_DOMAIN_DIR>$mntdir0</CLICON_YANG_DOMAIN_DIR>
+</clixon-config>
+EOF
+
+cp ../src/autocli.xml $CFD/
+
+# Reset devices with initial config
+. ./reset-devices.sh
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG -E $CFD
+
+    new "Start new backend -s init -f $CFG -E $CFD"
+    start_backend -s init -f $CFG -E $CFD
+fi
+
+new "Wait backend"
+wait_backend
+
+# Reset controller, connects devices and downloads schemas
+DEVICES_EXTRA="<schema-window>$window</schema-window>" . ./reset-controller.sh
+
+new "Get yang-library of ${IMG}1"
+ret=$(${clixon_netconf} -q0 -f $CFG -E $CFD <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="42">
+  <get>
+    <filter type="subtree">
+      <devices xmlns="http://clicon.org/controller">
+        <device>
+          <name>${IMG}1</name>
+          <config>
+            <yang-library xmlns="urn:ietf:params:xml:ns:yang:ietf-yang-library"/>
+          </config>
+        </device>
+      </devices>
+    </filter>
+  </get>
+</rpc>]]>]]>
+EOF
+   )
+match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+if [ -n "$match" ]; then
+    err1 "netconf rpc-error detected"
+fi
+
+modules=$(echo "$ret" | grep -Eo "<module><name>openconfig-[^<]*</name><revision>[^<]*</revision>" | sed -e 's/<module><name>//' -e 's/<\/name><revision>/@/' -e 's/<\/revision>//' | sort -u)
+nmod=$(echo "$modules" | grep -c "@") || true
+
+new "Check more openconfig schemas than schema-window"
+if [ $nmod -le $window ]; then
+    err "more than $window openconfig modules" "$nmod"
+fi
+
+for m in $modules; do
+    new "Check schema $m downloaded"
+    if [ ! -f $mntdir/$m.yang ]; then
+        err "$mntdir/$m.yang" "$(ls $mntdir)"
+    fi
+done
+
+for i in $(seq 1 $nr); do
+    NAME=$IMG$i
+    new "Check $NAME open"
+    expectpart "$($clixon_cli -1 -f $CFG -E $CFD show connect $NAME)" 0 "OPEN " --not-- CLOSED
+
+    new "Check $NAME config"
+    expectpart "$($clixon_cli -1 -f $CFG -E $CFD show configuration xml devices device $NAME config interfaces)" 0 "<interface>" "<name>x</name>"
+done
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG -E $CFD
+fi
+
+sudo rm -rf $dir
+endtest
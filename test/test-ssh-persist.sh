@@ -0,0 +1,131 @@
+#!/usr/bin/env bash
+# SSH connection reuse with ssh-persist
+# 1. Connect devices with ssh-persist, expect a full SSH handshake and a control socket
+# 2. Reconnect, expect the kept SSH connection to be reused: ssh-reuses is incremented,
+#    ssh-handshakes is not
+# 3. Kill the kept SSH connections so that their control sockets are stale, reconnect and
+#    expect ssh to fall back to a new connection and the devices to be open
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+set -u
+
+CFG=${SYSCONFDIR}/clixon/controller.xml
+
+# Control sockets are in the directory of the backend socket
+sockdir=$(dirname $(sed -n 's/.*<CLICON_SOCK>\(.*\)<\/CLICON_SOCK>.*/\1/p' $CFG))
+
+# Get SSH connect counters of device 1
+function get_ssh_counters()
+{
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" xmlns:nc="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="42">
+   <get>
+      <nc:filter nc:type="xpath" nc:select="co:devices/co:device[co:name='${IMG}1']" xmlns:co="http://clicon.org/controller"/>
+   </get>
+</rpc>]]>]]>
+EOF
+       )
+    match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+    if [ -n "$match" ]; then
+        err1 "Error: $ret"
+    fi
+    handshakes=$(echo "$ret" | grep -Eo "<ssh-handshakes>[0-9]+</ssh-handshakes>" | grep -Eo "[0-9]+") || true
+    reuses=$(echo "$ret" | grep -Eo "<ssh-reuses>[0-9]+</ssh-reuses>" | grep -Eo "[0-9]+") || true
+    htime=$(echo "$ret" | grep -Eo "<handshake-time>[0-9]+</handshake-time>" | grep -Eo "[0-9]+") || true
+}
+
+# Close and open all devices
+function reconnect()
+{
+    new "Close connections"
+    expectpart "$($clixon_cli -1 -f $CFG connection close)" 0 "^$"
+
+    new "Open connections"
+    expectpart "$($clixon_cli -1 -f $CFG connection open)" 0 "^$"
+
+    sleep_open "" ""
+}
+
+# Reset devices with initial config
+. ./reset-devices.sh
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+
+    new "Start new backend -s init -f $CFG"
+    start_backend -s init -f $CFG
+fi
+
+new "Wait backend"
+wait_backend
+
+# Kept SSH connections of earlier runs
+sudo pkill -f "ControlPath=$sockdir/ssh-" || true
+
+# 1. Connect with ssh-persist
+DEVICES_EXTRA="<ssh-persist>60</ssh-persist>" . ./reset-controller.sh
+
+new "Check full SSH handshake"
+get_ssh_counters
+if [ "$handshakes" != 1 -o "$reuses" != 0 ]; then
+    err "<ssh-handshakes>1</ssh-handshakes><ssh-reuses>0</ssh-reuses>" "$ret"
+fi
+
+new "Check control sockets"
+n=$(sudo find $sockdir -maxdepth 1 -name "ssh-*" -type s | wc -l)
+if [ $n -lt 1 ]; then
+    err "control socket in $sockdir" "$(ls $sockdir)"
+fi
+
+# 2. Reconnect reuses SSH connection
+reconnect
+
+new "Check SSH connection reused"
+get_ssh_counters
+if [ "$handshakes" != 1 -o "$reuses" != 1 ]; then
+    err "<ssh-handshakes>1</ssh-handshakes><ssh-reuses>1</ssh-reuses>" "$ret"
+fi
+
+new "Check handshake-time"
+if [ -z "$htime" ]; then
+    err "<handshake-time>" "$ret"
+fi
+
+# 3. Stale control sockets
+new "Close connections"
+expectpart "$($clixon_cli -1 -f $CFG connection close)" 0 "^$"
+
+new "Kill kept SSH connections, control sockets are left stale"
+sudo pkill -9 -f "ControlPath=$sockdir/ssh-" || true
+
+sleep 1
+
+new "Check stale control sockets"
+n=$(sudo find $sockdir -maxdepth 1 -name "ssh-*" -type s | wc -l)
+if [ $n -lt 1 ]; then
+    err "control socket in $sockdir" "$(ls $sockdir)"
+fi
+
+new "Open connections"
+expectpart "$($clixon_cli -1 -f $CFG connection open)" 0 "^$"
+
+sleep_open "" ""
+
+new "Check device config after fallback"
+expectpart "$($clixon_cli -1 -f $CFG show configuration xml devices device ${IMG}1 config interfaces)" 0 "<interface>" "<name>x</name>"
+
+new "Reconnect after fallback"
+reconnect
+
+sudo pkill -f "ControlPath=$sockdir/ssh-" || true
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+fi
+
+sudo rm -rf $dir
+endtest
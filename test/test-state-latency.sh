@@ -0,0 +1,115 @@
+#!/usr/bin/env bash
+# Device state latency and quarantine state data
+# Push with adaptive-timeout, quarantine and a minimal output-queue-limit so that edit-configs
+# may be held back. Check that each push adds one PUSH-CHECK latency sample, also when held
+# back, and that no device has timed out or is quarantined
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+set -u
+
+CFG=${SYSCONFDIR}/clixon/controller.xml
+
+# Get state data of device 1
+# Args:
+# 1: xpath below device
+function get_state()
+{
+    xpath=$1
+
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" xmlns:nc="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="42">
+   <get>
+      <nc:filter nc:type="xpath" nc:select="co:devices/co:device[co:name='${IMG}1']/$xpath" xmlns:co="http://clicon.org/controller"/>
+   </get>
+</rpc>]]>]]>
+EOF
+       )
+    match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+    if [ -n "$match" ]; then
+        err1 "Error: $ret"
+    fi
+}
+
+# Check number of latency samples of a connection state of device 1
+# Args:
+# 1: connection state
+# 2: expected number of samples
+function check_samples()
+{
+    state=$1
+    expect=$2
+
+    new "Check $state latency samples is $expect"
+    get_state "co:state-latency[co:state='$state']"
+    samples=$(echo "$ret" | grep -Eo "<samples>[0-9]+</samples>" | grep -Eo "[0-9]+") || true
+    if [ "$samples" != "$expect" ]; then
+        err "<samples>$expect</samples>" "$ret"
+    fi
+    average=$(echo "$ret" | grep -Eo "<average>[0-9]+</average>" | grep -Eo "[0-9]+") || true
+    if [ -z "$average" ]; then
+        err "<average>" "$ret"
+    fi
+}
+
+# Reset devices with initial config
+. ./reset-devices.sh
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+
+    new "Start new backend -s init -f $CFG"
+    start_backend -s init -f $CFG
+fi
+
+new "Wait backend"
+wait_backend
+
+# Reset controller
+. ./reset-controller.sh
+
+new "Enable adaptive-timeout"
+expectpart "$($clixon_cli -1 -f $CFG -m configure set devices adaptive-timeout true)" 0 "^$"
+
+new "Set quarantine-threshold"
+expectpart "$($clixon_cli -1 -f $CFG -m configure set devices quarantine-threshold 2)" 0 "^$"
+
+new "Set minimal output-queue-limit"
+expectpart "$($clixon_cli -1 -f $CFG -m configure set devices output-queue-limit 65536)" 0 "^$"
+
+new "Local commit"
+expectpart "$($clixon_cli -1 -f $CFG -m configure commit local)" 0 "^$"
+
+for i in $(seq 1 2); do
+    new "Configure hostname latency$i"
+    expectpart "$($clixon_cli -1 -f $CFG -m configure set devices device ${IMG}* config system config hostname latency$i)" 0 "^$"
+
+    new "Commit push $i"
+    expectpart "$($clixon_cli -1 -f $CFG -m configure commit push 2>&1)" 0 "OK" --not-- "Failed"
+
+    check_samples PUSH-CHECK $i
+done
+
+new "Check no state timeouts"
+get_state "co:state-timeouts"
+match=$(echo "$ret" | grep --null -Eo "<state-timeouts>0</state-timeouts>") || true
+if [ -z "$match" ]; then
+    err "<state-timeouts>0</state-timeouts>" "$ret"
+fi
+
+new "Check not quarantined"
+get_state "co:quarantined"
+match=$(echo "$ret" | grep --null -Eo "<quarantined>true</quarantined>") || true
+if [ -n "$match" ]; then
+    err "not quarantined" "$ret"
+fi
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+fi
+
+sudo rm -rf $dir
+endtest
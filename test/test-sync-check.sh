@@ -0,0 +1,126 @@
+#!/usr/bin/env bash
+# Background sync-check of devices, see sync-check-state
+# Checks are started by the controller periodic timer once a minute
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+set -u
+
+CFG=${SYSCONFDIR}/clixon/controller.xml
+
+# Check device state leaf of all devices, retry until notifications or sync-checks have arrived
+# 1: Leaf name
+# 2: Expected value
+# 3: Max seconds to wait (default 10)
+function check_state()
+{
+    leaf=$1
+    value=$2
+    jmax=${3:-10}
+
+    for j in $(seq 1 $jmax); do
+        new "Check $leaf is $value"
+        ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" xmlns:nc="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+   <get cl:content="all" xmlns:cl="http://clicon.org/lib">
+      <nc:filter nc:type="xpath" nc:select="co:devices/co:device/co:$leaf" xmlns:co="http://clicon.org/controller"/>
+   </get>
+</rpc>]]>]]>
+EOF
+           )
+        match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+        if [ -n "$match" ]; then
+            err1 "Error: $ret"
+        fi
+        res=$(echo "$ret" | sed "s/<\/$leaf>/<\/$leaf>\n/g" | grep "$IMG" | grep -c "<$leaf>$value</$leaf>") || true
+        if [ "$res" == "$nr" ]; then
+            break
+        fi
+        echo "retry after sleep"
+        sleep 1
+    done
+    if [ $j -eq $jmax ]; then
+        err "$nr devices $leaf $value" "$ret"
+    fi
+}
+
+# Change interface description directly on devices, not via controller
+# Interfaces are the change token, so the token changes
+# 1: description
+function change_description()
+{
+    desc=$1
+
+    i=1
+    for ip in $CONTAINERS; do
+        new "Change description on $IMG$i to $desc"
+        ret=$(ssh $ip ${SSHID} -l ${USER} -o StrictHostKeyChecking=no -o PasswordAuthentication=no -s netconf <<EOF
+<?xml version="1.0" encoding="UTF-8"?>
+<hello xmlns="urn:ietf:params:xml:ns:netconf:base:1.0">
+   <capabilities>
+      <capability>urn:ietf:params:netconf:base:1.0</capability>
+   </capabilities>
+</hello>]]>]]>
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="42">
+  <edit-config>
+    <target><candidate/></target>
+    <config>
+      <interfaces xmlns="http://openconfig.net/yang/interfaces"><interface><name>y</name><config><name>y</name><description>$desc</description></config></interface></interfaces>
+    </config>
+  </edit-config>
+</rpc>]]>]]>
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="42"><commit/></rpc>]]>]]>
+EOF
+           )
+        match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+        if [ -n "$match" ]; then
+            err "OK" "$ret"
+        fi
+        i=$((i+1))
+    done
+}
+
+# Reset devices with initial config
+. ./reset-devices.sh
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+
+    new "Start new backend -s init -f $CFG"
+    start_backend -s init -f $CFG
+fi
+
+new "Wait backend"
+wait_backend
+
+# Reset controller with change token of each device
+EXTRA="<change-token>/interfaces</change-token>"
+. ./reset-controller.sh
+
+new "Enable sync-check"
+expectpart "$($clixon_cli -1 -f $CFG -m configure set devices sync-check-interval 1)" 0 "^$"
+
+new "Local commit"
+expectpart "$($clixon_cli -1 -f $CFG -m configure commit local)" 0 "^$"
+
+check_state sync-check-state IN-SYNC 130
+
+change_description sync-check
+
+check_state sync-check-state OUT-OF-SYNC 130
+
+new "Disable sync-check"
+expectpart "$($clixon_cli -1 -f $CFG -m configure set devices sync-check-interval 0)" 0 "^$"
+
+new "Local commit"
+expectpart "$($clixon_cli -1 -f $CFG -m configure commit local)" 0 "^$"
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+fi
+
+sudo rm -rf $dir
+endtest
@@ -0,0 +1,129 @@
+#!/usr/bin/env bash
+# Devices with the same yang-lib share mount YANG spec
+# Connect two devices with the same yang-lib, remove the 1st device and check that the
+# 2nd device still has its mount YANG spec: yang-library, config and push
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+set -u
+
+CFG=${SYSCONFDIR}/clixon/controller.xml
+
+# Check yang-library of device
+# 1: device name
+function check_yang_lib()
+{
+    name=$1
+
+    new "Check yang-library of $name"
+    ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="42">
+  <get>
+    <filter type="subtree">
+      <devices xmlns="http://clicon.org/controller">
+        <device>
+          <name>$name</name>
+          <config>
+            <yang-library xmlns="urn:ietf:params:xml:ns:yang:ietf-yang-library"/>
+          </config>
+        </device>
+      </devices>
+    </filter>
+  </get>
+</rpc>]]>]]>
+EOF
+       )
+    match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+    if [ -n "$match" ]; then
+        err1 "netconf rpc-error detected"
+    fi
+    match=$(echo "$ret" | grep --null -Eo "<module><name>openconfig-interfaces</name>") || true
+    if [ -z "$match" ]; then
+        err "<module><name>openconfig-interfaces</name>" "$ret"
+    fi
+}
+
+# Reset devices with initial config
+. ./reset-devices.sh
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+
+    new "Start new backend -s init -f $CFG"
+    start_backend -s init -f $CFG
+fi
+
+new "Wait backend"
+wait_backend
+
+# Reset controller
+. ./reset-controller.sh
+
+check_yang_lib ${IMG}1
+check_yang_lib ${IMG}2
+
+new "Close ${IMG}1"
+ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="43">
+   <connection-change xmlns="http://clicon.org/controller">
+      <device>${IMG}1</device>
+      <operation>CLOSE</operation>
+   </connection-change>
+</rpc>]]>]]>
+EOF
+   )
+match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+if [ -n "$match" ]; then
+    err "OK" "$ret"
+fi
+
+new "Remove ${IMG}1"
+ret=$(${clixon_netconf} -q0 -f $CFG <<EOF
+<rpc xmlns="urn:ietf:params:xml:ns:netconf:base:1.0" xmlns:nc="urn:ietf:params:xml:ns:netconf:base:1.0" message-id="42">
+  <edit-config>
+    <target><candidate/></target>
+    <config>
+      <devices xmlns="http://clicon.org/controller">
+        <device nc:operation="remove">
+          <name>${IMG}1</name>
+        </device>
+      </devices>
+    </config>
+  </edit-config>
+</rpc>]]>]]>
+EOF
+   )
+match=$(echo "$ret" | grep --null -Eo "<rpc-error>") || true
+if [ -n "$match" ]; then
+    err1 "netconf rpc-error detected"
+fi
+
+new "Local commit"
+expectpart "$($clixon_cli -1 -f $CFG -m configure commit local)" 0 "^$"
+
+new "Check ${IMG}1 removed"
+expectpart "$($clixon_cli -1 -f $CFG show connections)" 0 "${IMG}2" --not-- "${IMG}1"
+
+check_yang_lib ${IMG}2
+
+new "Check ${IMG}2 config"
+expectpart "$($clixon_cli -1 -f $CFG show configuration xml devices device ${IMG}2 config interfaces)" 0 "<interface>" "<name>x</name>"
+
+new "Configure hostname on ${IMG}2"
+expectpart "$($clixon_cli -1 -f $CFG -m configure set devices device ${IMG}2 config system config hostname shared)" 0 "^$"
+
+new "Commit push ${IMG}2"
+expectpart "$($clixon_cli -1 -f $CFG -m configure commit push 2>&1)" 0 "OK" --not-- "Failed"
+
+new "Check ${IMG}2 open"
+expectpart "$($clixon_cli -1 -f $CFG show connect ${IMG}2)" 0 "OPEN " --not-- CLOSED
+
+if $BE; then
+    new "Kill old backend"
+    stop_backend -f $CFG
+fi
+
+sudo rm -rf $dir
+endtest
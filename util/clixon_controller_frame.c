@@ -0,0 +1,259 @@
+/*
+ *
+  ***** BEGIN LICENSE BLOCK *****
+
+  Copyright (C) 2023 Olof Hagsand
+
+  This file is part of CLIXON.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  ***** END LICENSE BLOCK *****
+
+  Microbenchmark of NETCONF frame scanning of device input
+  Compares clixon netconf_input_msg2 with controller netconf_input_msg_scan on a
+  generated multi-megabyte reply, in base 1.0 (eom) or base 1.1 (chunked) framing
+  */
+
+#ifdef HAVE_CONFIG_H
+#include "clixon_config.h" /* generated by config & autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <syslog.h>
+#include <sys/time.h>
+
+/* cligen */
+#include <cligen/cligen.h>
+
+/* clixon */
+#include "clixon/clixon.h"
+
+#include "controller_netconf.h"
+
+/* Command line options to be passed to getopt(3) */
+#define FRAME_OPTS "hD:s:c:b:n:C"
+
+static int
+usage(char *argv0)
+{
+    fprintf(stderr, "usage:%s [options]\n"
+            "where options are\n"
+            "\t-h \t\tHelp\n"
+            "\t-D <level> \tDebug\n"
+            "\t-s <MB> \tSize of generated reply in MB (default 16)\n"
+            "\t-C \t\tChunked framing (base 1.1), default end-of-message (base 1.0)\n"
+            "\t-c <bytes> \tChunk size for chunked framing (default 65536)\n"
+            "\t-b <bytes> \tRead size, ie data passed to framer per call (default 65536)\n"
+            "\t-n <nr> \tNumber of iterations (default 5)\n",
+            argv0
+            );
+    exit(0);
+}
+
+typedef int (framer_fn)(unsigned char **bufp, size_t *lenp, cbuf *cbmsg,
+                        netconf_framing_type framing, int *frame_state, size_t *frame_size,
+                        int *eom);
+
+/*! Generate framed reply of approximately size bytes
+ */
+static int
+frame_generate(cbuf  *cb,
+               size_t size,
+               int    chunked,
+               size_t chunk)
+{
+    int    retval = -1;
+    cbuf  *cbmsg = NULL;
+    size_t i;
+    size_t n;
+
+    if ((cbmsg = cbuf_new()) == NULL){
+        clixon_err(OE_UNIX, errno, "cbuf_new");
+        goto done;
+    }
+    cprintf(cbmsg, "<rpc-reply xmlns=\"urn:ietf:params:xml:ns:netconf:base:1.0\" message-id=\"42\"><data>");
+    for (i=0; cbuf_len(cbmsg) < size; i++)
+        cprintf(cbmsg, "<interface><name>eth%zu</name><description>Interface [%zu] ]]</description>"
+                "<enabled>true</enabled><mtu>1500</mtu></interface>", i, i);
+    cprintf(cbmsg, "</data></rpc-reply>");
+    if (chunked){
+        for (i=0; i<cbuf_len(cbmsg); i+=n){
+            n = cbuf_len(cbmsg) - i;
+            if (n > chunk)
+                n = chunk;
+            cprintf(cb, "\n#%zu\n", n);
+            cbuf_append_buf(cb, cbuf_get(cbmsg) + i, n);
+        }
+        cprintf(cb, "\n##\n");
+    }
+    else
+        cprintf(cb, "%s]]>]]>", cbuf_get(cbmsg));
+    retval = 0;
+ done:
+    if (cbmsg)
+        cbuf_free(cbmsg);
+    return retval;
+}
+
+/*! Run framer over input in pieces of readsize, return time in us and message
+ */
+static int
+frame_run(framer_fn *fn,
+          cbuf      *cbin,
+          int        chunked,
+          size_t     readsize,
+          cbuf      *cbmsg,
+          uint64_t  *usp)
+{
+    int            retval = -1;
+    unsigned char *buf = (unsigned char *)cbuf_get(cbin);
+    size_t         len = cbuf_len(cbin);
+    unsigned char *p;
+    size_t         plen;
+    size_t         i;
+    int            frame_state = 0;
+    size_t         frame_size = 0;
+    int            eom = 0;
+    int            nr = 0;
+    struct timeval t0;
+    struct timeval t1;
+
+    cbuf_reset(cbmsg);
+    gettimeofday(&t0, NULL);
+    for (i=0; i<len; i+=readsize){
+        p = buf + i;
+        plen = (len - i < readsize) ? len - i : readsize;
+        while (plen > 0){
+            if (fn(&p, &plen, cbmsg,
+                   chunked?NETCONF_SSH_CHUNKED:NETCONF_SSH_EOM,
+                   &frame_state, &frame_size, &eom) < 0)
+                goto done;
+            if (eom == 0)
+                break;
+            nr++;
+        }
+    }
+    gettimeofday(&t1, NULL);
+    timersub(&t1, &t0, &t1);
+    *usp = t1.tv_sec*1000000 + t1.tv_usec;
+    if (nr != 1){
+        clixon_err(OE_NETCONF, 0, "Expected one message, got %d", nr);
+        goto done;
+    }
+    retval = 0;
+ done:
+    return retval;
+}
+
+int
+main(int    argc,
+     char **argv)
+{
+    int           retval = -1;
+    char         *argv0 = argv[0];
+    clixon_handle h;
+    int           c;
+    int           dbg = 0;
+    size_t        size = 16;
+    size_t        chunk = 65536;
+    size_t        readsize = 65536;
+    int           chunked = 0;
+    int           nr = 5;
+    int           i;
+    cbuf         *cbin = NULL;
+    cbuf         *cb0 = NULL;
+    cbuf         *cb1 = NULL;
+    uint64_t      us;
+    uint64_t      us0 = 0;
+    uint64_t      us1 = 0;
+
+    if ((h = clixon_handle_init()) == NULL)
+        goto done;
+    clixon_log_init(h, "frame", LOG_DEBUG, CLIXON_LOG_STDERR);
+    optind = 1;
+    opterr = 0;
+    while ((c = getopt(argc, argv, FRAME_OPTS)) != -1)
+        switch (c) {
+        case 'h':
+            usage(argv0);
+            break;
+        case 'D':
+            if (sscanf(optarg, "%d", &dbg) != 1)
+                usage(argv0);
+            break;
+        case 's':
+            if (sscanf(optarg, "%zu", &size) != 1 || size == 0)
+                usage(argv0);
+            break;
+        case 'C':
+            chunked++;
+            break;
+        case 'c':
+            if (sscanf(optarg, "%zu", &chunk) != 1 || chunk == 0)
+                usage(argv0);
+            break;
+        case 'b':
+            if (sscanf(optarg, "%zu", &readsize) != 1 || readsize == 0)
+                usage(argv0);
+            break;
+        case 'n':
+            if (sscanf(optarg, "%d", &nr) != 1 || nr <= 0)
+                usage(argv0);
+            break;
+        default:
+            usage(argv0);
+            break;
+        }
+    clixon_debug_init(h, dbg);
+    if ((cbin = cbuf_new()) == NULL ||
+        (cb0 = cbuf_new()) == NULL ||
+        (cb1 = cbuf_new()) == NULL){
+        clixon_err(OE_UNIX, errno, "cbuf_new");
+        goto done;
+    }
+    if (frame_generate(cbin, size*1024*1024, chunked, chunk) < 0)
+        goto done;
+    for (i=0; i<nr; i++){
+        if (frame_run(netconf_input_msg2, cbin, chunked, readsize, cb0, &us) < 0)
+            goto done;
+        us0 += us;
+        if (frame_run(netconf_input_msg_scan, cbin, chunked, readsize, cb1, &us) < 0)
+            goto done;
+        us1 += us;
+    }
+    if (strcmp(cbuf_get(cb0), cbuf_get(cb1)) != 0){
+        clixon_err(OE_NETCONF, 0, "Framed messages differ");
+        goto done;
+    }
+    fprintf(stdout, "framing: %s, input: %zu bytes, read size: %zu, iterations: %d\n",
+            chunked?"chunked":"eom", cbuf_len(cbin), readsize, nr);
+    fprintf(stdout, "netconf_input_msg2:     %8.1f MB/s\n",
+            us0 ? (double)cbuf_len(cbin)*nr/us0 : 0.0);
+    fprintf(stdout, "netconf_input_msg_scan: %8.1f MB/s\n",
+            us1 ? (double)cbuf_len(cbin)*nr/us1 : 0.0);
+    retval = 0;
+ done:
+    if (cbin)
+        cbuf_free(cbin);
+    if (cb0)
+        cbuf_free(cb0);
+    if (cb1)
+        cbuf_free(cb1);
+    return retval;
+}